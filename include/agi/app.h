@@ -3,25 +3,56 @@
  */
 #pragma once
 #include "defines.h"
+#include "event_loop.h"
+#include "font_reconcile.h"
 #include "tcp_client.h"
+#include "worker_pool.h"
 
 // A packet listener for command packets
 typedef struct AppDescriptor {
-    const char hostname[32];
-    const u16 port;
+    char hostname[32];
+    u16 port;
     PacketHandler command_handler;
     PacketHandler auth_handler;
     PacketHandler font_install_handler;  // New handler for font installation
+    PacketHandler font_batch_handler;    // Many installs/uninstalls in one v2 packet
+    u32 worker_count;                    // Background threads for downloads/installs, 0 = default (1)
+    u32 job_queue_capacity;              // Jobs allowed to wait for a worker, 0 = default
+    u32 max_downloads_per_host;          // Parallel font transfers to one server, 0 = default
+    const char *font_cache_directory;    // NULL = per-user default
+    const char *font_server_url;         // Base URL fonts are downloaded from, NULL = default
+    u64 font_cache_bytes;                // 0 = default
+    const char *metrics_file;            // Text dump of the metrics, rewritten every minute; NULL = none
+    const char *trace_directory;         // Chrome trace dumps of slow or requested traces; NULL = none
+    u32 trace_slow_ms;                   // Requests at least this slow are dumped, 0 = default
+    // Many apps can share one process, as the fleet simulator's virtual agents do
+    EventLoop *loop;                       // Shared loop, NULL = the app creates its own
+    b8 simulated;                          // No download engine, font cache or workers; handlers answer installs themselves
+    const char *username;                  // Sent at authentication instead of the OS user, NULL = detect
+    const char *hwid;                      // Sent instead of this machine's hardware ID hash, NULL = detect
+    DisconnectHandler disconnect_handler;  // NULL = stop the loop
+    void *userdata;                        // For the handlers, through app->descriptor
 } AppDescriptor;
 
 typedef struct App {
     TcpClient *client;
+    EventLoop *loop;
+    WorkerPool *workers;
+    FontReconciler *reconciler;  // NULL without a font inventory
+    u32 metrics_timer;           // 0 without a metrics file
+    b8 owns_loop;
     AppDescriptor *descriptor;
 } App;
 
 // Function prototypes
 App *app_create(AppDescriptor *descriptor);
+// Connects and sends the auth request
 agi_result_t app_connect(App *app);
+// Hands the connection to the loop without running it, for a shared loop
+agi_result_t app_attach(App *app);
+// Attaches, then runs the event loop until the connection drops or app_stop() is called
+agi_result_t app_run(App *app);
+void app_stop(App *app);
 void app_destroy(App *app);
 
 // AppDescriptor macro
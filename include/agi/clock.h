@@ -0,0 +1,9 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+
+// Monotonic clock, unaffected by wall-clock adjustments
+u64 agi_clock_now_ns(void);
+u64 agi_clock_now_ms(void);
@@ -37,6 +37,8 @@ typedef enum {
     AGI_ERROR_NETWORK,
     AGI_ERROR_PROTOCOL,
     AGI_ERROR_IO,
+    AGI_ERROR_BUSY,
+    AGI_ERROR_INTEGRITY,
     // Add more error codes as needed
 } agi_result_t;
 
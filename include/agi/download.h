@@ -4,5 +4,86 @@
 
 #pragma once
 #include "defines.h"
+#include "sha256.h"
 
-agi_result_t download_file(const char* url, const char* output_path);
\ No newline at end of file
+// Download engine: one background thread drives every transfer through a
+// single curl multi handle, so connections to the font server stay open and
+// are reused between files, and many files can be in flight at once.
+typedef struct DownloadEngine DownloadEngine;
+
+typedef struct {
+    u32 max_connections_per_host;  // parallel transfers to one host, 0 = default
+    u32 max_connections;           // parallel transfers overall, 0 = default
+    u32 timeout_seconds;           // per attempt, 0 = default
+    u32 max_attempts;              // 0 = default
+    u64 segment_threshold;         // files above this may be split into ranges, 0 = default
+} DownloadEngineConfig;
+
+#define AGI_DOWNLOAD_DEFAULT_CONNECTIONS_PER_HOST 4
+#define AGI_DOWNLOAD_DEFAULT_CONNECTIONS 16
+#define AGI_DOWNLOAD_DEFAULT_TIMEOUT 30
+#define AGI_DOWNLOAD_DEFAULT_ATTEMPTS 3
+#define AGI_DOWNLOAD_DEFAULT_SEGMENT_THRESHOLD (8ull * 1024 * 1024)
+#define AGI_DOWNLOAD_MAX_SEGMENTS 8
+
+// Optional per-transfer settings; a NULL DownloadOptions means all defaults
+typedef struct {
+    // 64 hex chars. The body is hashed as it is written, with no second pass over
+    // the file; a mismatch fails the attempt with AGI_ERROR_INTEGRITY.
+    const char* expected_sha256;
+    // Keep an interrupted transfer's bytes and continue them with a Range request,
+    // both on retry and after a restart: progress is checkpointed to
+    // <output_path>.resume. Only for output paths no other transfer uses at once.
+    b8 resumable;
+    // Fetch files larger than the engine's segment_threshold over up to this many
+    // parallel byte ranges (capped by the per-host connection limit), into a
+    // preallocated file. Servers without range support get one plain stream.
+    // A split transfer no longer writes a resume record. 0 or 1 = one stream.
+    u32 segments;
+} DownloadOptions;
+
+// Fresh whole-file requests offer every content coding curl can decode (gzip,
+// deflate, br, zstd as built); bodies are decoded as they stream in, so the file
+// and its digest are always of the identity bytes. Encoded responses are never
+// split, and resumed or ranged requests ask for the identity encoding.
+
+// Per-transfer completion, delivered on the engine thread
+typedef struct {
+    const char* url;
+    const char* output_path;
+    agi_result_t result;
+    long http_status;
+    u64 bytes;
+    u64 wire_bytes;  // body bytes received before decoding, over all attempts
+    u64 elapsed_ms;
+    u32 attempts;
+    u8 sha256[AGI_SHA256_DIGEST_SIZE];  // of the bytes written, valid on success
+} DownloadReport;
+
+typedef void (*DownloadCallback)(const DownloadReport* report, void* userdata);
+
+// NULL config uses the defaults
+DownloadEngine* download_engine_create(const DownloadEngineConfig* config);
+// Aborts unfinished transfers; their callbacks run with AGI_ERROR_NETWORK
+void download_engine_destroy(DownloadEngine* engine);
+// Thread-safe. url and output_path are copied. The callback always runs exactly
+// once when this returns AGI_SUCCESS, and never otherwise.
+agi_result_t download_engine_submit(DownloadEngine* engine, const char* url, const char* output_path,
+                                    const DownloadOptions* options, DownloadCallback callback, void* userdata);
+
+// Blocking wait for several transfers from any thread: start a group, add each
+// submit to it, then wait. Each slot receives that transfer's result.
+typedef struct DownloadGroup DownloadGroup;
+DownloadGroup* download_group_create(DownloadEngine* engine);
+void download_group_destroy(DownloadGroup* group);
+agi_result_t download_group_add(DownloadGroup* group, const char* url, const char* output_path,
+                                const DownloadOptions* options, agi_result_t* result);
+void download_group_wait(DownloadGroup* group);
+
+// Process-wide engine used by download_file(); set up once before any download
+agi_result_t download_init(const DownloadEngineConfig* config);
+void download_shutdown(void);
+DownloadEngine* download_default_engine(void);
+
+// Blocking single download through the default engine; options may be NULL
+agi_result_t download_file(const char* url, const char* output_path, const DownloadOptions* options);
@@ -0,0 +1,72 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+
+typedef struct EventLoop EventLoop;
+
+// Readiness flags reported to and requested from a backend
+#define AGI_EVENT_READ (1u << 0)
+#define AGI_EVENT_WRITE (1u << 1)
+#define AGI_EVENT_ERROR (1u << 2)
+
+typedef void (*EventCallback)(EventLoop *loop, int fd, u32 events, void *userdata);
+typedef void (*TimerCallback)(EventLoop *loop, u32 timer_id, void *userdata);
+typedef void (*TaskCallback)(EventLoop *loop, void *userdata);
+
+// A unit of work handed back to the loop thread from any other thread.
+// Owned by the caller and embedded in its own job structs, so posting never allocates.
+typedef struct EventLoopTask {
+    struct EventLoopTask *next;
+    TaskCallback callback;
+    void *userdata;
+} EventLoopTask;
+
+// A single readiness event produced by a backend; tag is whatever was passed to add()
+typedef struct {
+    void *tag;
+    u32 events;
+} BackendEvent;
+
+// Pluggable readiness backend (epoll on Linux, poll/WSAPoll everywhere else)
+typedef struct {
+    const char *name;
+    void *(*create)(void);
+    void (*destroy)(void *state);
+    agi_result_t (*add)(void *state, int fd, u32 events, void *tag);
+    agi_result_t (*modify)(void *state, int fd, u32 events, void *tag);
+    agi_result_t (*remove)(void *state, int fd);
+    // Blocks for at most timeout_ms (-1 = forever); returns the number of events or -1 on error
+    int (*wait)(void *state, BackendEvent *events, int max_events, int timeout_ms);
+} EventLoopBackend;
+
+const EventLoopBackend *event_loop_default_backend(void);
+#if defined(AGI_PLATFORM_LINUX)
+extern const EventLoopBackend agi_event_backend_epoll;
+#endif
+extern const EventLoopBackend agi_event_backend_poll;
+
+EventLoop *event_loop_create(void);
+EventLoop *event_loop_create_with_backend(const EventLoopBackend *backend);
+void event_loop_destroy(EventLoop *loop);
+
+agi_result_t event_loop_add_fd(EventLoop *loop, int fd, u32 events, EventCallback callback, void *userdata);
+agi_result_t event_loop_modify_fd(EventLoop *loop, int fd, u32 events);
+agi_result_t event_loop_remove_fd(EventLoop *loop, int fd);
+
+// Timers fire on the loop thread; a zero interval_ms makes the timer one-shot
+u32 event_loop_add_timer(EventLoop *loop, u64 delay_ms, u64 interval_ms, TimerCallback callback, void *userdata);
+void event_loop_cancel_timer(EventLoop *loop, u32 timer_id);
+
+// Thread-safe: queues the task and wakes the loop
+void event_loop_post(EventLoop *loop, EventLoopTask *task);
+// Thread-safe: unlinks a task that was posted but hasn't started running yet.
+// Returns false if it isn't queued (never posted, or already picked up).
+b8 event_loop_cancel_task(EventLoop *loop, EventLoopTask *task);
+
+// Runs until event_loop_stop() is called (from any thread)
+agi_result_t event_loop_run(EventLoop *loop);
+// Runs a single iteration, waiting at most timeout_ms for events
+agi_result_t event_loop_run_once(EventLoop *loop, int timeout_ms);
+void event_loop_stop(EventLoop *loop);
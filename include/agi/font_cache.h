@@ -0,0 +1,42 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+
+// Content-addressed store for downloaded font files, keyed by the sanitized
+// 64-character font hash. Layout under the cache directory:
+//   objects/<hash>  one file per font
+//   tmp/            in-progress downloads, renamed into objects/ when done;
+//                   <hash>.part files with a .resume record survive a restart
+//   index.bin       sizes and recency of every object, read in one go at startup
+// Total size is bounded; the least recently used objects are evicted first.
+// All functions are thread-safe.
+typedef struct FontCache FontCache;
+
+#define AGI_FONT_HASH_LENGTH 64
+#define AGI_FONT_CACHE_DEFAULT_BYTES (256ull * 1024 * 1024)
+
+FontCache *font_cache_open(const char *directory, u64 max_bytes);
+// Persists the index and frees the cache
+void font_cache_close(FontCache *cache);
+
+// On a hit copies the object's path and marks it most recently used
+b8 font_cache_lookup(FontCache *cache, const char *hash, char *path, size_t path_size);
+// A file name under tmp/ to download hash into. The first caller for a hash gets
+// tmp/<hash>.part, which it may resume into, and resumable is set; callers racing
+// it get a unique name. Hand the path back through commit or release.
+agi_result_t font_cache_temp_path(FontCache *cache, const char *hash, char *path, size_t path_size, b8 *resumable);
+// Gives up a temp path after a failed download, leaving any partial file in place
+void font_cache_release(FontCache *cache, const char *hash, const char *temp_path);
+// Moves a finished download into objects/, evicting old entries to stay within
+// budget, and returns the object's path
+agi_result_t font_cache_commit(FontCache *cache, const char *hash, const char *temp_path, char *path, size_t path_size);
+agi_result_t font_cache_flush(FontCache *cache);
+
+u64 font_cache_size(FontCache *cache);
+u32 font_cache_count(FontCache *cache);
+
+// Per-user cache location: %LOCALAPPDATA%\agi\fonts, ~/Library/Caches/agi/fonts
+// or $XDG_CACHE_HOME/agi/fonts (~/.cache/agi/fonts)
+agi_result_t font_cache_default_directory(char *directory, size_t size);
@@ -0,0 +1,48 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+#include "font_cache.h"
+
+// Every font file this agent has put in the font directory, findable by font
+// hash and by file name without touching the disk. The index file holds
+// fixed-size records behind a small header; at startup it is memory-mapped
+// and taken over as is, and the records are only checked against the disk when
+// the directory changed while the agent wasn't running. While running, a
+// watcher (inotify, ReadDirectoryChangesW) drops fonts that are deleted or
+// replaced behind our back. Files the agent didn't install are not tracked.
+// All functions are thread-safe.
+typedef struct FontInventory FontInventory;
+
+#define AGI_FONT_FAMILY_SIZE 33
+#define AGI_FONT_FILE_NAME_SIZE 128
+
+typedef struct {
+    char hash[AGI_FONT_HASH_LENGTH + 1];
+    char family[AGI_FONT_FAMILY_SIZE];
+    char style[AGI_FONT_FAMILY_SIZE];
+    char file_name[AGI_FONT_FILE_NAME_SIZE];  // within the font directory
+    u64 size;
+    u64 mtime_ns;
+} FontInventoryEntry;
+
+// index_path may be NULL to keep the inventory in memory only
+FontInventory *font_inventory_open(const char *index_path, const char *font_directory);
+// Stops watching, persists the index and frees the inventory
+void font_inventory_close(FontInventory *inventory);
+
+// After installing font_directory/file_name; its size and mtime are read now
+agi_result_t font_inventory_record(FontInventory *inventory, const char *hash, const char *family, const char *style,
+                                   const char *file_name);
+// After removing font_directory/file_name
+void font_inventory_forget(FontInventory *inventory, const char *file_name);
+
+b8 font_inventory_find(FontInventory *inventory, const char *hash, FontInventoryEntry *entry);
+b8 font_inventory_find_file(FontInventory *inventory, const char *file_name, FontInventoryEntry *entry);
+
+u32 font_inventory_count(FontInventory *inventory);
+// Calls visit for every entry, with the inventory locked
+typedef void (*FontInventoryVisitor)(const FontInventoryEntry *entry, void *userdata);
+void font_inventory_visit(FontInventory *inventory, FontInventoryVisitor visit, void *userdata);
+agi_result_t font_inventory_flush(FontInventory *inventory);
@@ -0,0 +1,18 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+#include "protocol.h"
+#include "tcp_client.h"
+#include "worker_pool.h"
+
+// Font install/uninstall commands run on the worker pool so downloads never
+// stall the network loop. The request is copied out of the packet, and the
+// response is sent from the loop thread once the job finishes. If the pool is
+// full the command is answered right away with AGI_ERROR_BUSY. A command for a
+// font another job is already working on waits for that job instead of
+// downloading it again; identical commands share its result.
+agi_result_t font_jobs_submit_install(WorkerPool *pool, TcpClient *client, const FontInstallRequest *request);
+// Consumes the batch's entries
+agi_result_t font_jobs_submit_batch(WorkerPool *pool, TcpClient *client, FontBatchRequest *batch);
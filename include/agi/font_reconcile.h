@@ -0,0 +1,30 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+#include "font_inventory.h"
+#include "protocol.h"
+#include "tcp_client.h"
+
+// Brings the server up to date with what's installed without listing it. The
+// agent sends one digest of its whole installed set; if the server's copy of
+// the set differs it asks for the buckets (hash prefixes) that disagree, and
+// keeps drilling into mismatching children until the buckets are small enough
+// to list. A machine that's in sync costs one packet, one that's off by a few
+// fonts costs a few round trips of a few KB, however many fonts it has.
+//
+// Queries are answered from a sorted snapshot taken when the digest is sent, so
+// installs finishing mid-exchange don't make the answers inconsistent. Loop thread only.
+typedef struct FontReconciler FontReconciler;
+
+// Buckets with at most this many hashes are listed instead of split
+#define AGI_RECONCILE_LEAF_SIZE 32
+
+FontReconciler *font_reconciler_create(FontInventory *inventory);
+void font_reconciler_destroy(FontReconciler *reconciler);
+
+// Snapshots the inventory and sends its digest under a new session
+agi_result_t font_reconciler_send_digest(FontReconciler *reconciler, TcpClient *client);
+// Answers a query; one for a stale session gets a fresh digest instead
+agi_result_t font_reconciler_answer(FontReconciler *reconciler, TcpClient *client, ReconcileQuery *query);
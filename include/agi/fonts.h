@@ -4,7 +4,74 @@
 #pragma once
 
 #include "defines.h"
+#include "font_cache.h"
+#include "font_inventory.h"
+
+#define AGI_FONT_PATH_SIZE 1024
+// Parallel ranges for font files above the download engine's segment threshold
+#define AGI_FONT_DOWNLOAD_SEGMENTS 4
+
+// Opens the download cache used by install_font(). A NULL directory picks the
+// per-user default; without a cache, fonts are downloaded to the temp dir every time.
+// The inventory of installed fonts is kept in the same directory.
+agi_result_t fonts_init(const char *cache_directory, u64 cache_bytes);
+void fonts_shutdown(void);
+// What this agent has installed; NULL before fonts_init() or without a font directory
+FontInventory *fonts_inventory(void);
+// Where fonts are downloaded from: the hash and extension are appended to base_url.
+// NULL restores the default. Set it before any install starts.
+agi_result_t fonts_set_server_url(const char *base_url);
 
 agi_result_t install_font(const char *font_hash, const char *font_name, const char *font_style, const char *font_extension);
 
-agi_result_t uninstall_font(const char *font_name, const char *font_style, const char *font_extension);
\ No newline at end of file
+agi_result_t uninstall_font(const char *font_name, const char *font_style, const char *font_extension);
+// Removes every installed file the inventory has for font_hash
+agi_result_t uninstall_font_by_hash(const char *font_hash);
+
+// Server-sent names end up in file names: a name or style must not be empty, start
+// with a dot, contain "..", a path separator or a control character
+b8 font_valid_name(const char *name);
+// A dot followed by letters and digits only, e.g. ".ttf"
+b8 font_valid_extension(const char *extension);
+
+// Keeps the first 64 alphanumeric characters of a hash, zero-padded; this is the cache key
+void font_sanitize_hash(const char *hash, char sanitized[AGI_FONT_HASH_LENGTH + 1]);
+
+// install_font() in steps, so callers can run many downloads at once. When
+// the font is cached, path is the cached file; otherwise download url to path
+// and hand it to font_store_download(), which moves it into the cache. Without
+// a cache, path is a staging file next to the installed fonts.
+typedef struct {
+    char hash[AGI_FONT_HASH_LENGTH + 1];
+    char path[AGI_FONT_PATH_SIZE];
+    b8 cached;
+    b8 verify;     // hash is a SHA-256 hex digest the download must match
+    b8 resumable;  // path is the only download of hash, so keep its partial bytes
+    b8 staged;     // path is a staging file in the font directory, moved into place by the install
+    b8 installed;  // already installed under this name, nothing to download or install
+} FontSource;
+
+agi_result_t font_resolve_source(const char *font_hash, const char *font_name, const char *font_style, const char *font_extension,
+                                 FontSource *source, char *url, size_t url_size);
+agi_result_t font_store_download(FontSource *source);
+// Call instead of font_store_download() when the download failed
+void font_abandon_download(FontSource *source);
+// Installs a resolved source. WOFF and WOFF2 packages are unpacked first and
+// installed as .ttf or .otf, whatever font_extension says.
+agi_result_t font_install_source(const FontSource *source, const char *font_name, const char *font_style, const char *font_extension);
+// True for the web package extensions (.woff, .woff2) font_install_source() unpacks
+b8 font_is_package_extension(const char *font_extension);
+// Platform backend: where fonts are installed, created if missing
+agi_result_t font_install_directory(char *directory, size_t size);
+// Platform backend: a hidden file in the font directory, i.e. on the same volume as
+// the installed fonts, where a file for font_hash can be written and then moved into place
+agi_result_t font_staging_path(const char *font_hash, const char *font_extension, char *path, size_t size);
+// Platform backend: installs the file at font_path as font_name_font_style + font_extension.
+// With move, font_path is a staging file and is renamed into place; otherwise it is
+// hard-linked or copied to a staging file first. The font never appears half-written.
+agi_result_t install_font_file(const char *font_path, const char *font_name, const char *font_style, const char *font_extension,
+                               b8 move);
+// Platform backend: removes file_name from the font directory
+agi_result_t uninstall_font_file(const char *file_name);
+// Platform backend: finishes deferred work, e.g. a pending font cache refresh
+void font_backend_shutdown(void);
@@ -11,10 +11,51 @@ typedef enum {
     AGI_LOG_LEVEL_ERROR
 } agi_log_level_t;
 
+// Calls below this level are compiled out, arguments included: 0 debug, 1 info,
+// 2 warning, 3 error. Release builds leave out debug logging unless told otherwise.
+#ifndef AGI_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define AGI_LOG_MIN_LEVEL 1
+#else
+#define AGI_LOG_MIN_LEVEL 0
+#endif
+#endif
+
+typedef struct {
+    const char *file_path;  // NULL = stderr
+    u64 max_file_bytes;     // the file is rotated past this, 0 = default
+    u32 max_files;          // rotated files kept besides the current one, 0 = default
+} LogConfig;
+
+// Until agi_log_start(), and after agi_log_shutdown(), messages are written
+// synchronously to stderr. In between, callers only format the message into a
+// slot of a lock-free ring; a background thread adds the timestamp and prefix
+// and writes them out in batches. When the ring is full, messages are dropped
+// and counted rather than blocking the caller.
+agi_result_t agi_log_start(const LogConfig *config);
+// Writes out everything still queued and stops the writer thread
+void agi_log_shutdown(void);
+u64 agi_log_dropped(void);
+
 void agi_log_set_level(agi_log_level_t level);
 void agi_log_message(agi_log_level_t level, const char *file, int line, const char *format, ...);
 
+// Keeps an elided call type-checked without evaluating anything
+#define AGI_LOG_ELIDED(format, ...) (0 ? agi_log_message(AGI_LOG_LEVEL_DEBUG, __FILE__, __LINE__, format, ##__VA_ARGS__) : (void)0)
+
+#if AGI_LOG_MIN_LEVEL <= 0
 #define agi_log_debug(format, ...) agi_log_message(AGI_LOG_LEVEL_DEBUG, __FILE__, __LINE__, format, ##__VA_ARGS__)
+#else
+#define agi_log_debug(format, ...) AGI_LOG_ELIDED(format, ##__VA_ARGS__)
+#endif
+#if AGI_LOG_MIN_LEVEL <= 1
 #define agi_log_info(format, ...) agi_log_message(AGI_LOG_LEVEL_INFO, __FILE__, __LINE__, format, ##__VA_ARGS__)
+#else
+#define agi_log_info(format, ...) AGI_LOG_ELIDED(format, ##__VA_ARGS__)
+#endif
+#if AGI_LOG_MIN_LEVEL <= 2
 #define agi_log_warning(format, ...) agi_log_message(AGI_LOG_LEVEL_WARNING, __FILE__, __LINE__, format, ##__VA_ARGS__)
+#else
+#define agi_log_warning(format, ...) AGI_LOG_ELIDED(format, ##__VA_ARGS__)
+#endif
 #define agi_log_error(format, ...) agi_log_message(AGI_LOG_LEVEL_ERROR, __FILE__, __LINE__, format, ##__VA_ARGS__)
@@ -0,0 +1,22 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+
+// Counting allocator used by the networking core so heap traffic per packet
+// can be observed (and asserted to be zero at steady state).
+typedef struct {
+    u64 allocations;    // malloc/calloc calls, plus reallocs of NULL
+    u64 reallocations;
+    u64 frees;
+    u64 bytes_in_use;
+    u64 peak_bytes_in_use;
+} AgiMemoryStats;
+
+void *agi_malloc(size_t size);
+void *agi_calloc(size_t count, size_t size);
+void *agi_realloc(void *pointer, size_t size);
+void agi_free(void *pointer);
+
+void agi_memory_get_stats(AgiMemoryStats *stats);
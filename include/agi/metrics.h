@@ -0,0 +1,80 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+
+// Process-wide counters and latency histograms, cheap enough to leave on.
+// Every thread updates its own shard with plain relaxed stores, no shared
+// cache lines and no read-modify-write; readers sum the shards. Shards are
+// kept after their thread exits, so counts never go backwards.
+typedef enum {
+    AGI_COUNTER_TCP_PACKETS_RECEIVED,
+    AGI_COUNTER_TCP_PACKETS_SENT,
+    AGI_COUNTER_TCP_BYTES_RECEIVED,
+    AGI_COUNTER_TCP_BYTES_SENT,
+    AGI_COUNTER_TCP_UNKNOWN_PACKETS,
+    AGI_COUNTER_TCP_SEND_CALLS,     // send syscalls, however many packets each carried
+    AGI_COUNTER_TCP_RECV_CALLS,
+    AGI_COUNTER_DOWNLOADS_SUCCEEDED,
+    AGI_COUNTER_DOWNLOADS_FAILED,
+    AGI_COUNTER_DOWNLOAD_RETRIES,
+    AGI_COUNTER_DOWNLOAD_RESTARTS,  // resume refused, started over from zero
+    AGI_COUNTER_DOWNLOAD_BYTES,
+    AGI_COUNTER_DOWNLOAD_WIRE_BYTES,
+    AGI_COUNTER_FONT_INSTALLS,
+    AGI_COUNTER_FONT_INSTALL_FAILURES,
+    AGI_COUNTER_FONT_UNINSTALLS,
+    AGI_COUNTER_FONT_UNINSTALL_FAILURES,
+    AGI_COUNTER_COUNT
+} agi_counter_t;
+
+// Values are microseconds
+typedef enum {
+    AGI_HISTOGRAM_TCP_HANDLER,          // one packet handler call
+    AGI_HISTOGRAM_DOWNLOAD,             // submit to finish, all attempts
+    AGI_HISTOGRAM_FONT_BACKEND_INSTALL, // install_font_file()
+    AGI_HISTOGRAM_FONT_BACKEND_UNINSTALL,
+    AGI_HISTOGRAM_FONT_CACHE_REFRESH,   // fc-cache on Linux, WM_FONTCHANGE broadcast on Windows
+    AGI_HISTOGRAM_COUNT
+} agi_histogram_t;
+
+// Log-linear buckets: values below 8 get their own bucket, above that every
+// power of two is split into 8, so a bucket is within 12.5% of its values.
+// Everything from 2^40 up shares the last bucket.
+#define AGI_HISTOGRAM_SUB_BUCKET_BITS 3
+#define AGI_HISTOGRAM_MAX_BITS 40
+#define AGI_HISTOGRAM_BUCKETS ((AGI_HISTOGRAM_MAX_BITS - AGI_HISTOGRAM_SUB_BUCKET_BITS + 1) << AGI_HISTOGRAM_SUB_BUCKET_BITS)
+
+typedef struct {
+    u64 count;
+    u64 sum;
+    u64 max;
+    u64 buckets[AGI_HISTOGRAM_BUCKETS];
+} MetricsHistogram;
+
+typedef struct {
+    u64 uptime_ms;
+    u64 counters[AGI_COUNTER_COUNT];
+    MetricsHistogram histograms[AGI_HISTOGRAM_COUNT];
+} MetricsSnapshot;
+
+void metrics_add(agi_counter_t counter, u64 value);
+void metrics_record(agi_histogram_t histogram, u64 value);
+// Records the microseconds since started_ns (an agi_clock_now_ns() reading)
+void metrics_record_since(agi_histogram_t histogram, u64 started_ns);
+
+// Sums every thread's shard; not an atomic cut across metrics
+void metrics_snapshot(MetricsSnapshot *snapshot);
+const char *metrics_counter_name(agi_counter_t counter);
+const char *metrics_histogram_name(agi_histogram_t histogram);
+u32 metrics_bucket_index(u64 value);
+// Smallest value that lands in bucket
+u64 metrics_bucket_lower_bound(u32 bucket);
+// Upper bound of the bucket holding the q-th quantile (0..1), capped at the maximum seen
+u64 metrics_histogram_quantile(const MetricsHistogram *histogram, f64 q);
+
+// One metric per line: "name value", or "name count=.. sum=.. p50=.. p90=.. p99=.. max=.."
+size_t metrics_format_text(const MetricsSnapshot *snapshot, char *buffer, size_t size);
+// Replaces path with a fresh text dump
+agi_result_t metrics_write_text_file(const char *path);
@@ -0,0 +1,23 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+#include "tcp_client.h"
+
+// Packet type -> handler table. Dense type ranges are direct-indexed, sparse
+// ones use multiplicative hashing with linear probing at <= 50% load, so a
+// lookup is one multiply and (almost always) a single 16-byte entry read.
+typedef struct {
+    PacketHandlerInfo *entries;
+    u32 capacity;  // power of two
+    u32 multiplier;
+    u32 shift;
+    u32 count;
+} PacketDispatchTable;
+
+void packet_dispatch_init(PacketDispatchTable *table);
+void packet_dispatch_free(PacketDispatchTable *table);
+// Rejects duplicate types with AGI_ERROR_INVALID_ARGUMENT
+agi_result_t packet_dispatch_insert(PacketDispatchTable *table, PacketHandlerInfo info);
+const PacketHandlerInfo *packet_dispatch_find(const PacketDispatchTable *table, u16 packet_type);
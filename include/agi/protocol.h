@@ -0,0 +1,132 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+#include "metrics.h"
+#include "tcp_client.h"
+#include "wire.h"
+
+typedef enum {
+    AGI_PACKET_AUTH_REQUEST = 0,
+    AGI_PACKET_AUTH_RESPONSE = 1,
+    AGI_PACKET_FONT_INSTALL_REQUEST = 2,
+    AGI_PACKET_FONT_INSTALL_RESPONSE = 3,
+    AGI_PACKET_FONT_INSTALL_REQUEST_LEGACY = 4,
+    AGI_PACKET_PROTOCOL_SELECT = 5,
+    AGI_PACKET_FONT_BATCH_REQUEST = 6,   // v2 only
+    AGI_PACKET_FONT_BATCH_RESPONSE = 7,  // v2 only
+    AGI_PACKET_RECONCILE_DIGEST = 8,     // v2 only
+    AGI_PACKET_RECONCILE_QUERY = 9,      // v2 only
+    AGI_PACKET_RECONCILE_BUCKETS = 10,   // v2 only
+    AGI_PACKET_STATS_REQUEST = 11,       // v2 only
+    AGI_PACKET_STATS_RESPONSE = 12,      // v2 only
+    AGI_PACKET_TRACE_DUMP_REQUEST = 13,  // v2 only
+    AGI_PACKET_TRACE_DUMP_RESPONSE = 14, // v2 only
+} agi_packet_type_t;
+
+// Upper bound on entries in one batch; keeps a worst-case response well under a frame
+#define AGI_MAX_BATCH_ENTRIES 4096
+
+// Upper bound on prefixes in one reconcile query
+#define AGI_MAX_RECONCILE_PREFIXES 256
+
+#pragma pack(push, 1)
+// Sent by a v2-capable server (in v1 framing) in reply to an AuthRequestPacket
+// whose version is >= 2; both sides switch framing right after it
+typedef struct {
+    u32 version;
+} ProtocolSelectPacket;
+#pragma pack(pop)
+
+// Decoded views over either wire version; strings point into the packet
+typedef struct {
+    b8 success;
+    WireString message;
+} AuthResponse;
+
+typedef struct {
+    WireString font_hash;
+    WireString font_name;
+    WireString font_style;
+    WireString font_extension;
+    b8 install;
+} FontInstallRequest;
+
+// Batch request: varint job_id, varint count, then count entries of
+// u8 install, hash, name, style, extension. Entries are decoded one at a time.
+typedef struct {
+    u64 job_id;
+    u32 count;
+    WireReader entries;
+} FontBatchRequest;
+
+// Batch response: varint job_id, varint count, ceil(count / 8) bytes of
+// per-entry success bits (LSB first), varint failure count, then
+// (varint index, varint agi_result_t) for each failed entry only.
+typedef struct {
+    u32 index;
+    agi_result_t error;
+} FontBatchFailure;
+
+// Reconciliation (see font_reconcile.h). Installed font hashes, as
+// font_sanitize_hash() leaves them, are ordered bytewise; a bucket is every hash
+// starting with a prefix, and its digest is the SHA-256 of its hashes
+// concatenated in that order.
+//
+// Digest (agent -> server): varint session, varint count, 32-byte digest of the
+// whole set. Sent whenever v2 is selected.
+//
+// Query (server -> agent): varint session, varint count, then count prefix
+// strings. A session the agent doesn't have (e.g. 0) asks for a fresh digest.
+typedef struct {
+    u64 session;
+    u32 count;
+    WireReader prefixes;
+} ReconcileQuery;
+
+// Buckets (agent -> server): varint session, varint count, then per queried
+// prefix: prefix string, u8 kind, and either
+//   AGI_RECONCILE_CHILDREN: varint n, n x (u8 next character, varint count, 32-byte digest)
+//     for the non-empty buckets one character longer, or
+//   AGI_RECONCILE_LEAF: varint n, n x AGI_FONT_HASH_LENGTH-byte hashes, when the bucket is small.
+// The server answers with a font batch: installs for what's missing, and
+// uninstalls carrying only the hash for what shouldn't be there.
+typedef enum {
+    AGI_RECONCILE_CHILDREN = 0,
+    AGI_RECONCILE_LEAF = 1,
+} agi_reconcile_bucket_kind_t;
+
+// Stats request (server -> agent): varint request_id.
+// Stats response: varint request_id, varint uptime_ms, varint counter count, then
+// (name, varint value) per counter; varint sub-bucket bits (see metrics.h),
+// varint histogram count, then per histogram: name, varint count, varint sum,
+// varint max, varint non-empty buckets, (varint bucket index, varint count) each.
+// Metrics are named so the portal can add new ones without a protocol change.
+
+// Trace dump request (server -> agent): varint request_id, varint trace_id (0 = every
+// buffered span). The agent writes Chrome trace JSON to its trace directory (see trace.h).
+// Trace dump response: varint request_id, varint agi_result_t, varint span count, path string.
+
+agi_result_t protocol_decode_auth_response(const TcpClient *client, const void *packet_data, size_t packet_size, AuthResponse *response);
+agi_result_t protocol_decode_font_install_request(const TcpClient *client, const void *packet_data, size_t packet_size, FontInstallRequest *request);
+
+agi_result_t protocol_decode_font_batch_request(const TcpClient *client, const void *packet_data, size_t packet_size, FontBatchRequest *request);
+// Returns false once all entries are consumed or on malformed input (request->entries.failed)
+b8 protocol_next_font_batch_entry(FontBatchRequest *request, FontInstallRequest *entry);
+
+agi_result_t protocol_decode_reconcile_query(const TcpClient *client, const void *packet_data, size_t packet_size, ReconcileQuery *query);
+agi_result_t protocol_decode_stats_request(const TcpClient *client, const void *packet_data, size_t packet_size, u64 *request_id);
+agi_result_t protocol_decode_trace_dump_request(const TcpClient *client, const void *packet_data, size_t packet_size, u64 *request_id,
+                                                u64 *trace_id);
+// Returns false once all prefixes are consumed or on malformed input (query->prefixes.failed)
+b8 protocol_next_reconcile_prefix(ReconcileQuery *query, WireString *prefix);
+
+agi_result_t protocol_send_font_install_response(TcpClient *client, b8 success, const char *message);
+// bitmap holds ceil(count / 8) bytes; failures lists only the entries whose bit is clear
+agi_result_t protocol_send_font_batch_response(TcpClient *client, u64 job_id, u32 count, const u8 *bitmap,
+                                               const FontBatchFailure *failures, u32 failure_count);
+agi_result_t protocol_send_reconcile_digest(TcpClient *client, u64 session, u32 count, const u8 digest[32]);
+agi_result_t protocol_send_stats_response(TcpClient *client, u64 request_id, const MetricsSnapshot *snapshot);
+agi_result_t protocol_send_trace_dump_response(TcpClient *client, u64 request_id, agi_result_t result, u32 span_count,
+                                               const char *path);
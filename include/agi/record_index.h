@@ -0,0 +1,44 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+
+// Building blocks of the on-disk record indexes (font cache, font inventory):
+// a growable record array, hash slots to find records by key, and the file
+// write that swaps a new index in whole.
+
+// Dirty indexes are persisted at most this often (and on close)
+#define AGI_RECORD_INDEX_FLUSH_INTERVAL_MS 5000
+
+// Open-addressed key -> record index + 1 (0 = empty), at most half full
+typedef struct {
+    u32 *slots;
+    u32 capacity;  // a power of two, 0 = nothing allocated
+} RecordSlots;
+
+// FNV-1a over at most length bytes, stopping early at a NUL
+u32 record_key(const char *key, size_t length);
+
+// Empties the table and sizes it for count records. On failure it is left
+// empty and finds nothing until a reset succeeds.
+agi_result_t record_slots_reset(RecordSlots *table, u32 count);
+// Whether count records fit without a reset
+b8 record_slots_room(const RecordSlots *table, u32 count);
+void record_slots_insert(RecordSlots *table, u32 key, u32 index);
+// True when the record at index is the one wanted
+typedef b8 (*RecordMatch)(const void *records, u32 index, const void *wanted);
+// Index of the record with this key that matches wanted, or UINT32_MAX
+u32 record_slots_find(const RecordSlots *table, u32 key, RecordMatch match, const void *records, const void *wanted);
+void record_slots_free(RecordSlots *table);
+
+// Grows *records to hold at least count records of record_size bytes. Doubles,
+// and fails rather than let the capacity wrap.
+agi_result_t record_array_reserve(void **records, u32 *capacity, u32 count, size_t record_size);
+
+// Replaces to with from in one step
+b8 record_file_replace(const char *from, const char *to);
+// Writes header and then count records to temp_path and moves it over path, so
+// readers only ever see a complete index
+agi_result_t record_file_write(const char *path, const char *temp_path, const void *header, size_t header_size,
+                               const void *records, size_t record_size, u32 count);
@@ -0,0 +1,37 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+
+// Byte queue that keeps its readable region contiguous so whole frames can be
+// handed out as a single pointer. Space freed at the front is reclaimed by
+// sliding the (at most one partial frame) remainder down when the tail runs out.
+typedef struct {
+    u8 *data;
+    size_t capacity;  // allocated bytes, including the origin offset
+    size_t origin;    // where an empty buffer starts filling
+    size_t head;      // first readable byte
+    size_t tail;      // one past the last readable byte
+} RingBuffer;
+
+// A capacity of 0 allocates nothing until the first append
+agi_result_t ring_buffer_init(RingBuffer *buffer, size_t capacity);
+void ring_buffer_free(RingBuffer *buffer);
+// Grows the usable storage to at least capacity bytes; never shrinks
+agi_result_t ring_buffer_reserve(RingBuffer *buffer, size_t capacity);
+// Gives storage beyond capacity back to the heap; only an empty buffer is shrunk
+void ring_buffer_shrink(RingBuffer *buffer, size_t capacity);
+size_t ring_buffer_capacity(const RingBuffer *buffer);
+// Moves the fill origin of an empty buffer, e.g. so a frame header ends on an aligned boundary
+agi_result_t ring_buffer_set_origin(RingBuffer *buffer, size_t origin);
+
+size_t ring_buffer_size(const RingBuffer *buffer);
+const u8 *ring_buffer_read_ptr(const RingBuffer *buffer);
+void ring_buffer_consume(RingBuffer *buffer, size_t count);
+
+// Returns contiguous writable space, compacting if that frees more room
+u8 *ring_buffer_write_ptr(RingBuffer *buffer, size_t *available);
+void ring_buffer_commit(RingBuffer *buffer, size_t count);
+// Copies count bytes in, growing the storage if they don't fit
+agi_result_t ring_buffer_append(RingBuffer *buffer, const void *data, size_t count);
@@ -0,0 +1,29 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+
+// Incremental SHA-256. Uses the x86 SHA extensions when the CPU has them,
+// otherwise a portable implementation; the choice is made once at runtime.
+
+#define AGI_SHA256_DIGEST_SIZE 32
+#define AGI_SHA256_BLOCK_SIZE 64
+
+typedef struct {
+    u32 state[8];
+    u64 length;  // bytes hashed so far
+    u8 buffer[AGI_SHA256_BLOCK_SIZE];
+    size_t buffered;
+} Sha256;
+
+void sha256_init(Sha256 *sha);
+void sha256_update(Sha256 *sha, const void *data, size_t size);
+void sha256_final(Sha256 *sha, u8 digest[AGI_SHA256_DIGEST_SIZE]);
+
+// Parses exactly 64 hex characters, either case
+b8 sha256_parse_hex(const char *hex, u8 digest[AGI_SHA256_DIGEST_SIZE]);
+void sha256_to_hex(const u8 digest[AGI_SHA256_DIGEST_SIZE], char hex[2 * AGI_SHA256_DIGEST_SIZE + 1]);
+
+// "sha-ni" or "portable"
+const char *sha256_implementation(void);
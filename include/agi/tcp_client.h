@@ -1,23 +1,76 @@
 #pragma once
 #include "defines.h"
+#include "event_loop.h"
+
+#define AGI_PACKET_ALIGNMENT 8
+
+// Wire protocol versions. v1 frames are a raw u16 type followed by a fixed-size
+// packed struct; v2 frames are varint length + varint type + a byte-encoded payload
+// (see wire.h). Connections start on v1 and switch once the server selects v2.
+#define AGI_PROTOCOL_V1 1
+#define AGI_PROTOCOL_V2 2
+#define AGI_PROTOCOL_VERSION_MAX AGI_PROTOCOL_V2
+#define AGI_MAX_FRAME_SIZE (16 * 1024 * 1024)
 
 typedef struct TcpClient TcpClient;
-typedef void (*PacketHandler)(TcpClient *client, void *packet_data);
+// packet_data is a read-only view into the client's receive buffer, valid only
+// until the handler returns. v1 payloads are aligned to AGI_PACKET_ALIGNMENT; v2
+// payloads are byte-encoded and unaligned. Copy anything that must outlive the
+// callback, and don't register handlers from inside one. Under v2 the registered
+// packet_size is ignored and packet_size is the actual payload length.
+typedef void (*PacketHandler)(TcpClient *client, const void *packet_data, size_t packet_size);
+typedef void (*DisconnectHandler)(TcpClient *client, agi_result_t reason);
+typedef void (*DrainHandler)(TcpClient *client);
 
 typedef struct {
-    uint16_t type;
-    size_t size;
-    PacketHandler handler;
+    PacketHandler handler;  // NULL registers a known size whose packets are skipped
+    u32 size;
+    u16 type;
+    b8 registered;
 } PacketHandlerInfo;
 
+// What to do with a packet type that has no registered handler. Only v2 frames
+// carry a length to skip by; under v1 an unknown type is always a protocol error.
+typedef enum {
+    AGI_UNKNOWN_PACKET_SKIP,       // log and drop it, keep the connection (v2 only)
+    AGI_UNKNOWN_PACKET_DISCONNECT  // treat it as a protocol error
+} agi_unknown_packet_policy_t;
+
 TcpClient *tcp_client_create(const char *host, u16 port);
 void tcp_client_destroy(TcpClient *client);
 agi_result_t tcp_client_connect(TcpClient *client);
 agi_result_t tcp_client_disconnect(TcpClient *client);
 agi_result_t tcp_client_send_packet(TcpClient *client, uint16_t packet_type, const void *packet_data, size_t data_size);
 agi_result_t tcp_client_register_packet_handler(TcpClient *client, uint16_t packet_type, size_t packet_size, PacketHandler handler);
+void tcp_client_set_unknown_packet_policy(TcpClient *client, agi_unknown_packet_policy_t policy);
+// Takes effect from the next frame in both directions
+void tcp_client_set_protocol_version(TcpClient *client, u32 version);
+u32 tcp_client_protocol_version(const TcpClient *client);
 agi_result_t tcp_client_process_packets(TcpClient *client);
 
+// Hands the socket to an event loop: switches it to non-blocking mode and
+// dispatches packets as soon as bytes arrive. The disconnect handler fires on EOF or error.
+agi_result_t tcp_client_attach(TcpClient *client, EventLoop *loop);
+
+// Outbound queue. tcp_client_send_packet() never blocks on a non-blocking socket:
+// whatever the kernel doesn't take is queued and written when the socket becomes
+// writable. While corked (always the case inside packet handlers) sends are only
+// queued, so a burst of responses leaves in a single write on uncork.
+void tcp_client_cork(TcpClient *client);
+agi_result_t tcp_client_uncork(TcpClient *client);
+agi_result_t tcp_client_flush(TcpClient *client);
+size_t tcp_client_pending_bytes(const TcpClient *client);
+// Producers should hold back while congested (pending >= high-water mark); the
+// drain handler fires once the queue falls back under half the mark
+void tcp_client_set_high_water_mark(TcpClient *client, size_t bytes);
+b8 tcp_client_is_congested(const TcpClient *client);
+void tcp_client_set_drain_handler(TcpClient *client, DrainHandler handler);
+
+void tcp_client_detach(TcpClient *client);
+void tcp_client_set_disconnect_handler(TcpClient *client, DisconnectHandler handler);
+void tcp_client_set_userdata(TcpClient *client, void *userdata);
+void *tcp_client_get_userdata(TcpClient *client);
+
 #pragma pack(push, 1)
 typedef struct {
     u32 version;
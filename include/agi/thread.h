@@ -0,0 +1,46 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+
+#if defined(AGI_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <windows.h>
+typedef CRITICAL_SECTION agi_mutex_t;
+typedef CONDITION_VARIABLE agi_cond_t;
+typedef HANDLE agi_thread_t;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t agi_mutex_t;
+typedef pthread_cond_t agi_cond_t;
+typedef pthread_t agi_thread_t;
+#endif
+
+// Per-thread storage for statics
+#if defined(_MSC_VER)
+#define AGI_THREAD_LOCAL __declspec(thread)
+#else
+#define AGI_THREAD_LOCAL _Thread_local
+#endif
+
+typedef void (*agi_thread_fn)(void *arg);
+
+void agi_mutex_init(agi_mutex_t *mutex);
+void agi_mutex_destroy(agi_mutex_t *mutex);
+void agi_mutex_lock(agi_mutex_t *mutex);
+void agi_mutex_unlock(agi_mutex_t *mutex);
+
+void agi_cond_init(agi_cond_t *cond);
+void agi_cond_destroy(agi_cond_t *cond);
+// Atomically releases mutex and sleeps; may wake spuriously, so wait in a loop
+void agi_cond_wait(agi_cond_t *cond, agi_mutex_t *mutex);
+// As agi_cond_wait(), but gives up after timeout_ms; false on timeout
+b8 agi_cond_timed_wait(agi_cond_t *cond, agi_mutex_t *mutex, u64 timeout_ms);
+void agi_cond_signal(agi_cond_t *cond);
+void agi_cond_broadcast(agi_cond_t *cond);
+
+// stack_size of 0 keeps the platform default
+agi_result_t agi_thread_create(agi_thread_t *thread, agi_thread_fn fn, void *arg, size_t stack_size);
+void agi_thread_join(agi_thread_t thread);
@@ -0,0 +1,51 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+
+// Span tracing, for following one request through the pipeline. Spans go into
+// a fixed ring in memory, the oldest overwritten first, and can be written out
+// as Chrome trace JSON (chrome://tracing, ui.perfetto.dev). Recording is a few
+// relaxed stores, so it is always on.
+//
+// A request gets an id from trace_new_id(); code that runs for it on another
+// thread makes it current there with trace_set_current(), so the layers below
+// record with trace_span() without the id being passed down. Spans recorded with
+// no current trace (id 0) are background work, such as font cache refreshes.
+#define AGI_TRACE_CAPACITY 8192
+#define AGI_TRACE_MAX_THREADS 64
+#define AGI_TRACE_DEFAULT_SLOW_MS 2000
+
+typedef struct {
+    const char *directory;  // where dumps are written; NULL = no slow-request dumps
+    u32 slow_ms;            // requests taking at least this long are dumped, 0 = default
+} TraceConfig;
+
+// Call before tracing starts; the directory is copied. NULL turns dumps off.
+// With dumps on, starts the thread that writes slow-request dumps.
+void trace_configure(const TraceConfig *config);
+// Writes a pending slow-request dump and stops the dump thread
+void trace_shutdown(void);
+
+// Never 0
+u64 trace_new_id(void);
+void trace_set_current(u64 trace_id);
+u64 trace_current(void);
+// Names the calling thread in dumps; name must be a literal
+void trace_name_thread(const char *name);
+
+// Span names are not copied: they must be literals
+void trace_record(u64 trace_id, const char *name, u64 started_ns, u64 ended_ns);
+// A span of the current trace from started_ns (an agi_clock_now_ns() reading) until now
+void trace_span(const char *name, u64 started_ns);
+// Records a request's root span. If it took the slow threshold or longer, its spans
+// are written to <directory>/trace-<id>.json, at most one request per second. The
+// file is written by the dump thread, so this returns without waiting for it.
+void trace_finish_request(u64 trace_id, const char *name, u64 started_ns);
+
+// Writes the buffered spans of trace_id, or all of them for 0, to path
+agi_result_t trace_write_chrome_json(const char *path, u64 trace_id, u32 *span_count);
+// Writes trace_id's spans, or all of them for 0, to a file in the configured directory
+// and returns its name in path
+agi_result_t trace_dump(u64 trace_id, char *path, size_t path_size, u32 *span_count);
@@ -0,0 +1,53 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+
+// Compact field encoding used by protocol v2. Integers are little-endian
+// LEB128 varints, strings are a varint length followed by the raw bytes.
+// Readers decode in place: strings come back as views into the frame.
+
+#define WIRE_MAX_VARINT_SIZE 10
+
+typedef struct {
+    const char *data;  // not NUL-terminated
+    u32 length;
+} WireString;
+
+typedef struct {
+    const u8 *data;
+    size_t size;
+    size_t position;
+    b8 failed;  // sticky: set on truncation or malformed input
+} WireReader;
+
+typedef struct {
+    u8 *data;
+    size_t capacity;
+    size_t length;
+    b8 failed;  // sticky: set when the buffer is too small
+} WireWriter;
+
+// Decodes a varint at the start of data: 1 = ok, 0 = need more bytes, -1 = malformed
+int wire_peek_varint(const u8 *data, size_t size, u64 *value, size_t *consumed);
+size_t wire_varint_size(u64 value);
+size_t wire_encode_varint(u8 *destination, u64 value);
+
+WireReader wire_reader(const void *data, size_t size);
+u64 wire_read_varint(WireReader *reader);
+u8 wire_read_u8(WireReader *reader);
+WireString wire_read_string(WireReader *reader);
+const u8 *wire_read_bytes(WireReader *reader, size_t count);
+size_t wire_reader_remaining(const WireReader *reader);
+
+WireWriter wire_writer(void *buffer, size_t capacity);
+void wire_write_varint(WireWriter *writer, u64 value);
+void wire_write_u8(WireWriter *writer, u8 value);
+void wire_write_bytes(WireWriter *writer, const void *data, size_t count);
+void wire_write_string(WireWriter *writer, const char *data, size_t length);
+void wire_write_cstring(WireWriter *writer, const char *string);
+
+// Copies a view into a NUL-terminated buffer, truncating if needed
+void wire_string_copy(WireString string, char *destination, size_t destination_size);
+b8 wire_string_equals(WireString string, const char *other);
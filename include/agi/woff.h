@@ -0,0 +1,24 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+
+// Unpacking of web font packages into the plain TrueType/OpenType (sfnt) files
+// the OS font APIs take. WOFF tables are zlib streams; WOFF2 is one Brotli
+// stream whose glyf/loca and hmtx tables may additionally be transformed, and
+// those are rebuilt here. Font collections are not supported.
+
+typedef enum {
+    AGI_FONT_FORMAT_SFNT,
+    AGI_FONT_FORMAT_WOFF,
+    AGI_FONT_FORMAT_WOFF2,
+} agi_font_format_t;
+
+// Sniffs the signature of the file at path; anything unrecognized is SFNT
+agi_font_format_t woff_detect_format(const char *path);
+
+// Writes the sfnt inside the package at input_path to output_path. cff is set
+// when the font has CFF outlines, i.e. belongs in a .otf rather than a .ttf.
+// Malformed packages fail with AGI_ERROR_INVALID_ARGUMENT.
+agi_result_t woff_unpack_file(const char *input_path, const char *output_path, b8 *cff);
@@ -0,0 +1,40 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "defines.h"
+#include "event_loop.h"
+
+// Small fixed set of threads that run blocking work (downloads, installs) off
+// the network loop. Jobs are intrusive: the caller embeds a WorkerJob in its
+// own struct and keeps it alive until complete() runs.
+typedef struct WorkerPool WorkerPool;
+typedef struct WorkerJob WorkerJob;
+
+// run() executes on a worker thread; complete() executes on the loop thread
+// afterwards and owns the job from then on. complete() also runs, with
+// cancelled set and run() skipped, for jobs still queued at destroy time.
+typedef void (*WorkerJobFn)(WorkerJob *job);
+
+struct WorkerJob {
+    WorkerJob *next;
+    WorkerJobFn run;
+    WorkerJobFn complete;
+    void *userdata;
+    b8 cancelled;
+};
+
+#define AGI_DEFAULT_WORKER_COUNT 1
+#define AGI_DEFAULT_JOB_QUEUE_CAPACITY 32
+#define AGI_WORKER_STACK_SIZE (256 * 1024)
+
+// Zero worker_count / queue_capacity pick the defaults above
+WorkerPool *worker_pool_create(EventLoop *loop, u32 worker_count, u32 queue_capacity);
+// Call from the loop thread, but not from inside a complete() callback. Waits for
+// running jobs, cancels queued ones and runs every outstanding complete().
+void worker_pool_destroy(WorkerPool *pool);
+
+// Loop thread only. Returns AGI_ERROR_BUSY when queue_capacity jobs are already waiting.
+agi_result_t worker_pool_submit(WorkerPool *pool, WorkerJob *job);
+// Jobs queued or running whose complete() hasn't run yet
+u32 worker_pool_pending(const WorkerPool *pool);
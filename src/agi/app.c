@@ -5,7 +5,14 @@
 #include <string.h>
 
 #include "agi/defines.h"
+#include "agi/download.h"
+#include "agi/font_reconcile.h"
+#include "agi/fonts.h"
+#include "agi/memory.h"
+#include "agi/metrics.h"
+#include "agi/protocol.h"
 #include "agi/tcp_client.h"
+#include "agi/trace.h"
 
 #if defined(AGI_PLATFORM_APPLE)
 #include <CoreFoundation/CoreFoundation.h>
@@ -14,10 +21,14 @@
 #elif defined(AGI_PLATFORM_WINDOWS)
 #include <intrin.h>
 #include <windows.h>
+#elif defined(AGI_PLATFORM_LINUX)
+#include <pwd.h>
+#include <unistd.h>
 #endif
 
 #define HASH_SIZE 64
 #define HWID_SIZE 32
+#define METRICS_DUMP_INTERVAL_MS 60000
 
 // Function prototypes
 static void get_current_username(char* username, size_t max_length);
@@ -60,33 +71,166 @@ static void get_motherboard_id(unsigned char* hwid, size_t hwid_size) {
         RegQueryValueExA(hKey, "SystemManufacturer", NULL, &type, hwid, &dataSize);
         RegCloseKey(hKey);
     }
+#elif defined(AGI_PLATFORM_LINUX)
+    // The DMI board serial is root-only; the machine ID is readable by everyone and
+    // stable across reboots, with the DMI product UUID as a fallback for root
+    static const char* sources[] = {"/etc/machine-id", "/var/lib/dbus/machine-id", "/sys/class/dmi/id/product_uuid"};
+    for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]) && !hwid[0]; i++) {
+        FILE* file = fopen(sources[i], "r");
+        if (!file) continue;
+        if (fgets((char*)hwid, (int)hwid_size, file)) {
+            hwid[strcspn((char*)hwid, "\r\n")] = '\0';
+        }
+        fclose(file);
+    }
 #endif
     // Ensure the string is null-terminated
     hwid[hwid_size - 1] = '\0';
 }
 
+// The server picked a protocol version; everything after this packet uses it
+static void handle_protocol_select(TcpClient* client, const void* packet_data, size_t packet_size) {
+    if (packet_size < sizeof(ProtocolSelectPacket)) {
+        agi_log_error("Protocol select packet too short: %zu bytes", packet_size);
+        return;
+    }
+    const ProtocolSelectPacket* packet = (const ProtocolSelectPacket*)packet_data;
+    if (packet->version < AGI_PROTOCOL_V1 || packet->version > AGI_PROTOCOL_VERSION_MAX) {
+        agi_log_error("Server selected unsupported protocol version %u", packet->version);
+        return;
+    }
+    agi_log_info("Using protocol version %u", packet->version);
+    tcp_client_set_protocol_version(client, packet->version);
+
+    // Let the server diff our installed set against what it wants, instead of replaying every install
+    App* app = tcp_client_get_userdata(client);
+    if (packet->version >= AGI_PROTOCOL_V2 && app->reconciler) {
+        font_reconciler_send_digest(app->reconciler, client);
+    }
+}
+
+static void handle_reconcile_query(TcpClient* client, const void* packet_data, size_t packet_size) {
+    App* app = tcp_client_get_userdata(client);
+    ReconcileQuery query;
+    if (!app->reconciler || protocol_decode_reconcile_query(client, packet_data, packet_size, &query) != AGI_SUCCESS) {
+        agi_log_error("Malformed or unsupported reconcile query");
+        return;
+    }
+    font_reconciler_answer(app->reconciler, client, &query);
+}
+
+static void handle_stats_request(TcpClient* client, const void* packet_data, size_t packet_size) {
+    u64 request_id;
+    if (protocol_decode_stats_request(client, packet_data, packet_size, &request_id) != AGI_SUCCESS) {
+        agi_log_error("Malformed stats request");
+        return;
+    }
+    // Too big for the loop thread's stack
+    MetricsSnapshot* snapshot = agi_malloc(sizeof(MetricsSnapshot));
+    if (!snapshot) return;
+    metrics_snapshot(snapshot);
+    protocol_send_stats_response(client, request_id, snapshot);
+    agi_free(snapshot);
+}
+
+static void handle_trace_dump_request(TcpClient* client, const void* packet_data, size_t packet_size) {
+    u64 request_id;
+    u64 trace_id;
+    if (protocol_decode_trace_dump_request(client, packet_data, packet_size, &request_id, &trace_id) != AGI_SUCCESS) {
+        agi_log_error("Malformed trace dump request");
+        return;
+    }
+    char path[1024] = "";
+    u32 span_count = 0;
+    agi_result_t result = trace_dump(trace_id, path, sizeof(path), &span_count);
+    if (result == AGI_SUCCESS) {
+        agi_log_info("Wrote %u spans to %s", span_count, path);
+    } else {
+        agi_log_warning("Trace dump failed: %d", result);
+    }
+    protocol_send_trace_dump_response(client, request_id, result, span_count, path);
+}
+
+static void dump_metrics(EventLoop* loop, u32 timer_id, void* userdata) {
+    App* app = userdata;
+    if (metrics_write_text_file(app->descriptor->metrics_file) != AGI_SUCCESS) {
+        agi_log_warning("Failed to write metrics to %s", app->descriptor->metrics_file);
+    }
+}
+
 // Wrapper function to handle authentication
 agi_result_t handle_authentication(TcpClient* client) {
     char username[32];
     unsigned char hwid[HWID_SIZE];
     char hwid_hash[HASH_SIZE + 1];  // 8 hex chars + null terminator
 
-    get_current_username(username, sizeof(username));
-    get_motherboard_id(hwid, HWID_SIZE);
-    compute_hwid_hash(hwid, strlen((char*)hwid), hwid_hash, sizeof(hwid_hash));
+    // Simulated agents bring their own identity
+    const App* app = tcp_client_get_userdata(client);
+    if (app->descriptor->username) {
+        snprintf(username, sizeof(username), "%s", app->descriptor->username);
+    } else {
+        get_current_username(username, sizeof(username));
+    }
+    if (app->descriptor->hwid) {
+        snprintf(hwid_hash, sizeof(hwid_hash), "%s", app->descriptor->hwid);
+    } else {
+        get_motherboard_id(hwid, HWID_SIZE);
+        compute_hwid_hash(hwid, strlen((char*)hwid), hwid_hash, sizeof(hwid_hash));
+    }
 
+    // Advertise the highest protocol we speak; a v2 server answers with a ProtocolSelectPacket
     AuthRequestPacket auth_packet = {
-        .version = 0x01
+        .version = AGI_PROTOCOL_VERSION_MAX
     };
     strncpy(auth_packet.username, username, sizeof(auth_packet.username) - 1);
     strncpy(auth_packet.hwid, hwid_hash, sizeof(auth_packet.hwid) - 1);
 
-    return tcp_client_send_packet(client, 0, &auth_packet, sizeof(auth_packet));
+    return tcp_client_send_packet(client, AGI_PACKET_AUTH_REQUEST, &auth_packet, sizeof(auth_packet));
+}
+
+static agi_result_t start_font_services(App* app) {
+    const AppDescriptor* descriptor = app->descriptor;
+    DownloadEngineConfig download_config = {
+        .max_connections_per_host = descriptor->max_downloads_per_host
+    };
+    agi_result_t result = download_init(&download_config);
+    if (result != AGI_SUCCESS) {
+        agi_log_error("Failed to start download engine");
+        return result;
+    }
+
+    if (fonts_set_server_url(descriptor->font_server_url) != AGI_SUCCESS) {
+        agi_log_warning("Font server URL too long, using the default");
+    }
+    // Installs still work without a cache, they just always download
+    if (fonts_init(descriptor->font_cache_directory, descriptor->font_cache_bytes) != AGI_SUCCESS) {
+        agi_log_warning("Font cache unavailable");
+    }
+    // Without an inventory we can't tell the server what's installed, so it falls back to replaying installs
+    app->reconciler = fonts_inventory() ? font_reconciler_create(fonts_inventory()) : NULL;
+
+    app->workers = worker_pool_create(app->loop, descriptor->worker_count, descriptor->job_queue_capacity);
+    if (app->workers == NULL) {
+        agi_log_error("Failed to start worker pool");
+        font_reconciler_destroy(app->reconciler);
+        fonts_shutdown();
+        download_shutdown();
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+    return AGI_SUCCESS;
+}
+
+static void stop_font_services(App* app) {
+    // Let in-flight jobs finish first; their completions still reference the client
+    worker_pool_destroy(app->workers);
+    font_reconciler_destroy(app->reconciler);
+    fonts_shutdown();
+    download_shutdown();
 }
 
 // Get the current user's username
 static void get_current_username(char* username, size_t max_length) {
-#if defined(AGI_PLATFORM_APPLE)
+#if defined(AGI_PLATFORM_APPLE) || defined(AGI_PLATFORM_LINUX)
     struct passwd* pwd = getpwuid(getuid());
     if (pwd != NULL) {
         strncpy(username, pwd->pw_name, max_length - 1);
@@ -100,19 +244,6 @@ static void get_current_username(char* username, size_t max_length) {
         strncpy(username, "unknown", max_length - 1);
     }
 #endif
-}
-
-// Get a unique hardware ID
-static void get_hardware_id(unsigned char* hwid, size_t hwid_size) {
-#if defined(AGI_PLATFORM_APPLE)
-    uuid_t uuid;
-    uuid_generate(uuid);
-    memcpy(hwid, uuid, MIN(sizeof(uuid), hwid_size));
-#elif defined(AGI_PLATFORM_WINDOWS)
-        int cpu_info[4] = {0};
-        __cpuid(cpu_info, 0);
-        memcpy(hwid, cpu_info, MIN(sizeof(cpu_info), hwid_size));
-#endif
 }
 
  App* app_create(AppDescriptor* descriptor) {
@@ -120,20 +251,62 @@ static void get_hardware_id(unsigned char* hwid, size_t hwid_size) {
     if (app == NULL) {
         return NULL;
     }
+    app->descriptor = descriptor;
+    app->workers = NULL;
+    app->reconciler = NULL;
+
+    // Before any thread that records spans is started
+    if (!descriptor->simulated) {
+        trace_configure(&(TraceConfig){.directory = descriptor->trace_directory, .slow_ms = descriptor->trace_slow_ms});
+    }
+
+    app->owns_loop = descriptor->loop == NULL;
+    app->loop = app->owns_loop ? event_loop_create() : descriptor->loop;
+    if (app->loop == NULL) {
+        agi_log_error("Failed to create event loop");
+        if (!descriptor->simulated) trace_shutdown();
+        free(app);
+        return NULL;
+    }
+
+    // The download engine and font state are per process; simulated agents stub them out
+    if (!descriptor->simulated && start_font_services(app) != AGI_SUCCESS) {
+        trace_shutdown();
+        if (app->owns_loop) event_loop_destroy(app->loop);
+        free(app);
+        return NULL;
+    }
 
     app->client = tcp_client_create(descriptor->hostname, descriptor->port);
     TcpClient* client = app->client;
     if (client == NULL) {
         agi_log_error("Failed to create TCP client");
+        if (!descriptor->simulated) {
+            stop_font_services(app);
+            trace_shutdown();
+        }
+        if (app->owns_loop) event_loop_destroy(app->loop);
         free(app);
         return NULL;
     }
+    tcp_client_set_userdata(client, app);
 
-    tcp_client_register_packet_handler(client, 1, sizeof(AuthResponsePacket), descriptor->auth_handler);
+    tcp_client_register_packet_handler(client, AGI_PACKET_AUTH_RESPONSE, sizeof(AuthResponsePacket), descriptor->auth_handler);
     // Register the font installation packet handler
-    tcp_client_register_packet_handler(client, 2, sizeof(FontInstallRequestPacket), descriptor->font_install_handler);
+    tcp_client_register_packet_handler(client, AGI_PACKET_FONT_INSTALL_REQUEST, sizeof(FontInstallRequestPacket), descriptor->font_install_handler);
+    if (descriptor->font_batch_handler) {
+        // Batches are variable-length, so the registered size only matters to v1 (which never sends them)
+        tcp_client_register_packet_handler(client, AGI_PACKET_FONT_BATCH_REQUEST, 0, descriptor->font_batch_handler);
+    }
+    tcp_client_register_packet_handler(client, AGI_PACKET_PROTOCOL_SELECT, sizeof(ProtocolSelectPacket), handle_protocol_select);
+    tcp_client_register_packet_handler(client, AGI_PACKET_RECONCILE_QUERY, 0, handle_reconcile_query);
+    tcp_client_register_packet_handler(client, AGI_PACKET_STATS_REQUEST, 0, handle_stats_request);
+    tcp_client_register_packet_handler(client, AGI_PACKET_TRACE_DUMP_REQUEST, 0, handle_trace_dump_request);
 
-    app->descriptor = descriptor;
+    app->metrics_timer = 0;
+    if (descriptor->metrics_file) {
+        app->metrics_timer = event_loop_add_timer(app->loop, METRICS_DUMP_INTERVAL_MS, METRICS_DUMP_INTERVAL_MS, dump_metrics, app);
+    }
     return app;
 }
 
@@ -148,8 +321,54 @@ static void get_hardware_id(unsigned char* hwid, size_t hwid_size) {
     return handle_authentication(app->client);
 }
 
+static void on_disconnect(TcpClient* client, agi_result_t reason) {
+    App* app = tcp_client_get_userdata(client);
+    if (app->descriptor->disconnect_handler) {
+        app->descriptor->disconnect_handler(client, reason);
+        return;
+    }
+    agi_log_error("Connection to server lost: %d", reason);
+    event_loop_stop(app->loop);
+}
+
+ agi_result_t app_attach(App* app) {
+    tcp_client_set_disconnect_handler(app->client, on_disconnect);
+    agi_result_t result = tcp_client_attach(app->client, app->loop);
+    if (result != AGI_SUCCESS) {
+        agi_log_error("Failed to attach client to event loop");
+    }
+    return result;
+}
+
+ agi_result_t app_run(App* app) {
+    trace_name_thread("loop");
+    agi_result_t result = app_attach(app);
+    if (result != AGI_SUCCESS) {
+        return result;
+    }
+
+    return event_loop_run(app->loop);
+}
+
+ void app_stop(App* app) {
+    event_loop_stop(app->loop);
+}
+
  void app_destroy(App* app) {
+    if (!app->descriptor->simulated) {
+        stop_font_services(app);
+        // No request finishes after the workers are gone
+        trace_shutdown();
+    }
+    if (app->metrics_timer) {
+        // One last dump so short runs leave a record too
+        event_loop_cancel_timer(app->loop, app->metrics_timer);
+        dump_metrics(app->loop, app->metrics_timer, app);
+    }
     tcp_client_disconnect(app->client);
     tcp_client_destroy(app->client);
+    if (app->owns_loop) {
+        event_loop_destroy(app->loop);
+    }
     free(app);
 }
\ No newline at end of file
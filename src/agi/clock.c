@@ -0,0 +1,34 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/clock.h"
+
+#if defined(AGI_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+u64 agi_clock_now_ns(void) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    static LARGE_INTEGER frequency = {0};
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    // Split to avoid overflowing u64 on long uptimes
+    u64 seconds = counter.QuadPart / frequency.QuadPart;
+    u64 remainder = counter.QuadPart % frequency.QuadPart;
+    return seconds * 1000000000ULL + remainder * 1000000000ULL / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+#endif
+}
+
+u64 agi_clock_now_ms(void) {
+    return agi_clock_now_ns() / 1000000ULL;
+}
@@ -5,177 +5,1173 @@
 #include "agi/download.h"
 
 #include <agi/log.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ws2tcpip.h>
+
+#include <curl/curl.h>
 
 #if defined(_WIN32)
-#include <windns.h>
-#pragma comment(lib, "Dnsapi.lib")
-#include <windows.h>
-#include <winhttp.h>
-#pragma comment(lib, "winhttp.lib")
+#include <io.h>
 #else
-#include <curl/curl.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
-#define MAX_DOWNLOAD_ATTEMPTS 3
-#define DOWNLOAD_TIMEOUT 30L
-#define CHUNK_SIZE 16384
+#include "agi/clock.h"
+#include "agi/memory.h"
+#include "agi/metrics.h"
+#include "agi/trace.h"
+#include "agi/thread.h"
 
+#define RETRY_BASE_DELAY_MS 1000
+#define RETRY_MAX_DELAY_MS 30000
+#define IDLE_POLL_MS 1000
+// How much may arrive between sidecar updates; at most this is refetched after a crash
+#define RESUME_CHECKPOINT_BYTES (4 * 1024 * 1024)
+#define RESUME_MAGIC "AGIR"
+#define RESUME_VERSION 1
+#define VALIDATOR_SIZE 256
+#define HASH_CHUNK_SIZE (64 * 1024)
+
+// One byte range of a segmented transfer. The first range rides on the
+// transfer's own stream until that stream ends, then gets its own like the rest.
 typedef struct {
+    CURL* easy;
     FILE* fp;
-    size_t size;
-} WriteData;
+    u64 offset;  // next byte to write
+    u64 end;     // one past the last byte
+    struct curl_slist* headers;
+    b8 checked;   // response code looked at
+    b8 mismatch;  // answered with something other than the range
+} Segment;
+
+typedef struct Transfer {
+    struct Transfer* next;
+    struct Transfer* prev;  // only meaningful on the active list
+    CURL* easy;
+    FILE* fp;
+    u64 size;
+    u64 wire_bytes;  // as received, i.e. before content decoding, all handles and attempts
+    Sha256 sha;  // of the first size bytes on disk
+    b8 verify;
+    b8 resumable;
+    b8 validator_is_etag;
+    b8 encoded;  // the current response has a Content-Encoding
+    u64 resume_offset;       // bytes on disk when this attempt started
+    u64 checkpoint_size;     // size recorded in the sidecar
+    char validator[VALIDATOR_SIZE];  // strong ETag or Last-Modified for If-Range
+    struct curl_slist* headers;
+
+    // Segmented mode: once the first response shows a large file and range
+    // support, the file is cut into segment_count ranges. This stream keeps the
+    // first one and stops at segment_end; the others get a stream each.
+    u32 max_segments;
+    u32 segment_count;
+    u32 segments_running;
+    u64 segment_threshold;
+    u64 range_total;   // from Content-Range of the current response
+    u64 segment_end;   // 0 = unbounded
+    b8 split_pending;  // segments planned, handles not added yet
+    b8 segment_error;
+    b8 segment_restart;  // the server stopped honoring ranges
+    Segment* segments;
+
+    u8 expected_sha256[AGI_SHA256_DIGEST_SIZE];
+    u8 sha256[AGI_SHA256_DIGEST_SIZE];
+    char* url;
+    char* output_path;
+    DownloadCallback callback;
+    void* userdata;
+    u32 attempts;
+    u64 started_ms;
+    u64 retry_at_ms;
+    u64 trace_id;  // the submitting thread's current trace
+} Transfer;
+
+typedef struct {
+    Transfer* head;
+    Transfer* tail;
+} TransferQueue;
+
+struct DownloadEngine {
+    DownloadEngineConfig config;
+    CURLM* multi;
+    agi_thread_t thread;
+
+    // Guarded by lock: handed over from submitting threads
+    agi_mutex_t lock;
+    TransferQueue incoming;
+    b8 stopping;
+
+    // Engine thread only
+    TransferQueue pending;   // waiting for a connection slot
+    TransferQueue retrying;  // failed attempts waiting out their delay, ordered by retry_at_ms
+    Transfer* active;        // added to the multi handle
+    u32 active_count;        // easy handles in the multi handle
+    u64 random_state;        // jitter for retry backoff
+    CURL** idle_handles;     // easy handles kept for reuse, at most max_connections
+    u32 idle_count;
+};
+
+struct DownloadGroup {
+    DownloadEngine* engine;
+    agi_mutex_t lock;
+    agi_cond_t done;
+    u32 outstanding;
+};
+
+static DownloadEngine* default_engine = NULL;
+
+static void queue_push(TransferQueue* queue, Transfer* transfer) {
+    transfer->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = transfer;
+    } else {
+        queue->head = transfer;
+    }
+    queue->tail = transfer;
+}
+
+static Transfer* queue_pop(TransferQueue* queue) {
+    Transfer* transfer = queue->head;
+    if (transfer) {
+        queue->head = transfer->next;
+        if (!queue->head) queue->tail = NULL;
+        transfer->next = NULL;
+    }
+    return transfer;
+}
+
+// --- resume sidecar ---
+// <output>.resume records how many bytes of <output> are good, the hash state
+// over them and the validator they came with, so a retry or a restarted agent
+// continues with a Range request instead of starting over.
+
+typedef struct {
+    char magic[4];
+    u32 version;
+    u64 offset;
+    Sha256 sha;
+    char validator[VALIDATOR_SIZE];
+    u32 url_length;  // followed by the URL
+} ResumeRecord;
+
+// False when the path doesn't fit; the transfer then just isn't resumable
+static b8 sidecar_path(const Transfer* transfer, const char* suffix, char* path, size_t size) {
+    int length = snprintf(path, size, "%s.resume%s", transfer->output_path, suffix);
+    return length >= 0 && (size_t)length < size;
+}
+
+static b8 truncate_file(FILE* fp, u64 size) {
+    fflush(fp);
+#if defined(_WIN32)
+    return _chsize_s(_fileno(fp), (__int64)size) == 0;
+#else
+    return ftruncate(fileno(fp), (off_t)size) == 0;
+#endif
+}
+
+static void save_resume_record(Transfer* transfer) {
+    if (!transfer->resumable || transfer->size == 0) return;
+    // The record must never claim bytes that aren't on disk yet
+    if (transfer->fp) fflush(transfer->fp);
 
+    ResumeRecord record = {.version = RESUME_VERSION, .offset = transfer->size, .sha = transfer->sha};
+    memcpy(record.magic, RESUME_MAGIC, 4);
+    memcpy(record.validator, transfer->validator, sizeof(record.validator));
+    record.url_length = (u32)strlen(transfer->url);
+
+    char path[1024];
+    char temp_path[1024];
+    if (!sidecar_path(transfer, "", path, sizeof(path))) return;
+    if (!sidecar_path(transfer, ".tmp", temp_path, sizeof(temp_path))) return;
+    FILE* file = fopen(temp_path, "wb");
+    if (!file) return;
+    b8 written = fwrite(&record, sizeof(record), 1, file) == 1 &&
+                 fwrite(transfer->url, 1, record.url_length, file) == record.url_length;
+    written = (fclose(file) == 0) && written;
+    remove(path);
+    if (!written || rename(temp_path, path) != 0) {
+        remove(temp_path);
+        return;
+    }
+    transfer->checkpoint_size = transfer->size;
+}
+
+static void discard_resume_record(Transfer* transfer) {
+    char path[1024];
+    if (sidecar_path(transfer, "", path, sizeof(path))) remove(path);
+}
+
+// Picks up a partial file left by an earlier run, if its record matches this URL
+static void load_resume_record(Transfer* transfer) {
+    char path[1024];
+    if (!sidecar_path(transfer, "", path, sizeof(path))) return;
+    FILE* file = fopen(path, "rb");
+    if (!file) return;
+
+    ResumeRecord record;
+    b8 valid = fread(&record, sizeof(record), 1, file) == 1 && memcmp(record.magic, RESUME_MAGIC, 4) == 0 &&
+               record.version == RESUME_VERSION && record.url_length == strlen(transfer->url) &&
+               record.sha.length == record.offset;
+    if (valid) {
+        char url[1024];
+        valid = record.url_length < sizeof(url) && fread(url, 1, record.url_length, file) == record.url_length &&
+                memcmp(url, transfer->url, record.url_length) == 0;
+    }
+    fclose(file);
+    if (!valid) {
+        discard_resume_record(transfer);
+        return;
+    }
+
+    record.validator[VALIDATOR_SIZE - 1] = '\0';
+    transfer->size = record.offset;
+    transfer->checkpoint_size = record.offset;
+    transfer->sha = record.sha;
+    memcpy(transfer->validator, record.validator, sizeof(transfer->validator));
+    agi_log_info("Resuming %s from %llu bytes", transfer->output_path, (unsigned long long)record.offset);
+}
+
+static b8 header_is(const char* line, size_t length, const char* name) {
+    size_t name_length = strlen(name);
+    if (length <= name_length) return false;
+    for (size_t i = 0; i < name_length; i++) {
+        if (tolower((unsigned char)line[i]) != tolower((unsigned char)name[i])) return false;
+    }
+    return true;
+}
+
+// At the end of the first response's headers: a 206 for a large file means the
+// rest of it can be fetched in parallel. This stream keeps the first slice.
+static void plan_segments(Transfer* transfer) {
+    if (transfer->max_segments < 2 || transfer->segment_count > 0 || transfer->resume_offset > 0) return;
+    // Content-Range of an encoded body counts encoded bytes, which can't be decoded piecewise
+    if (transfer->range_total <= transfer->segment_threshold || transfer->encoded) return;
+    long http_code = 0;
+    curl_easy_getinfo(transfer->easy, CURLINFO_RESPONSE_CODE, &http_code);
+    if (http_code != 206) return;
+
+    u64 total = transfer->range_total;
+    u32 count = transfer->max_segments;
+    transfer->segment_end = total / count;
+    for (u32 i = 0; i < count; i++) {
+        Segment* segment = &transfer->segments[i];
+        memset(segment, 0, sizeof(*segment));
+        segment->offset = total * i / count;
+        segment->end = total * (i + 1) / count;
+    }
+    transfer->segment_count = count;
+    transfer->split_pending = true;
+    agi_log_debug("Fetching %s in %u ranges of %llu bytes", transfer->url, count, (unsigned long long)(total / count));
+}
+
+// Captures the validator If-Range needs; weak ETags can't be used for ranges
+static size_t header_callback(char* buffer, size_t size, size_t nitems, void* userp) {
+    Transfer* transfer = (Transfer*)userp;
+    size_t length = size * nitems;
+
+    if (length > 5 && memcmp(buffer, "HTTP/", 5) == 0) {
+        // A new response: forget what an earlier one (e.g. a redirect) said
+        transfer->validator_is_etag = false;
+        transfer->encoded = false;
+        transfer->range_total = 0;
+        return length;
+    }
+    if (buffer[0] == '\r' || buffer[0] == '\n') {
+        plan_segments(transfer);
+        return length;
+    }
+    if (header_is(buffer, length, "Content-Range:")) {
+        // bytes 0-1023/4096
+        char value[128];
+        size_t value_length = MIN(length, sizeof(value) - 1);
+        memcpy(value, buffer, value_length);
+        value[value_length] = '\0';
+        const char* total = strrchr(value, '/');
+        if (total && total[1] != '*') transfer->range_total = strtoull(total + 1, NULL, 10);
+        return length;
+    }
+    if (header_is(buffer, length, "Content-Encoding:")) {
+        const char* coding = buffer + 17;
+        while (coding < buffer + length && (*coding == ' ' || *coding == '\t')) coding++;
+        transfer->encoded = !header_is(coding, (size_t)(buffer + length - coding), "identity");
+        return length;
+    }
+
+    const char* value = NULL;
+    b8 is_etag = false;
+    if (header_is(buffer, length, "ETag:")) {
+        value = buffer + 5;
+        is_etag = true;
+    } else if (header_is(buffer, length, "Last-Modified:")) {
+        value = buffer + 14;
+    }
+    if (!value || (!is_etag && transfer->validator_is_etag)) return length;
+
+    const char* end = buffer + length;
+    while (value < end && (*value == ' ' || *value == '\t')) value++;
+    while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ')) end--;
+    size_t value_length = (size_t)(end - value);
+    if (value_length == 0 || value_length >= VALIDATOR_SIZE || (is_etag && value[0] == 'W')) return length;
+
+    memcpy(transfer->validator, value, value_length);
+    transfer->validator[value_length] = '\0';
+    transfer->validator_is_etag = is_etag;
+    return length;
+}
+
+// Hashes the bytes on their way to disk, so verification needs no re-read
 static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
-    size_t realsize = size * nmemb;
-    WriteData* wd = (WriteData*)userp;
-    size_t written = fwrite(contents, size, nmemb, wd->fp);
-    wd->size += written;
+    Transfer* transfer = (Transfer*)userp;
+    size_t length = size * nmemb;
+    if (transfer->segment_end) {
+        // Stop at the end of the first range; curl aborts on the short write
+        length = (size_t)MIN((u64)length, transfer->segment_end - transfer->size);
+    }
+    size_t written = fwrite(contents, 1, length, transfer->fp);
+    sha256_update(&transfer->sha, contents, written);
+    transfer->size += written;
+
+    if (transfer->resumable && transfer->size - transfer->checkpoint_size >= RESUME_CHECKPOINT_BYTES) {
+        save_resume_record(transfer);
+    }
     return written;
 }
 
-#if defined(_WIN32)
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-#include <wininet.h>
-#include <stdio.h>
+static void finish_transfer(Transfer* transfer, agi_result_t result, long http_status) {
+    DownloadReport report = {
+        .url = transfer->url,
+        .output_path = transfer->output_path,
+        .result = result,
+        .http_status = http_status,
+        .bytes = transfer->size,
+        .wire_bytes = transfer->wire_bytes,
+        .elapsed_ms = agi_clock_now_ms() - transfer->started_ms,
+        .attempts = transfer->attempts
+    };
+    memcpy(report.sha256, transfer->sha256, sizeof(report.sha256));
+    metrics_add(result == AGI_SUCCESS ? AGI_COUNTER_DOWNLOADS_SUCCEEDED : AGI_COUNTER_DOWNLOADS_FAILED, 1);
+    metrics_add(AGI_COUNTER_DOWNLOAD_WIRE_BYTES, transfer->wire_bytes);
+    metrics_record(AGI_HISTOGRAM_DOWNLOAD, report.elapsed_ms * 1000);
+    if (result == AGI_SUCCESS) {
+        metrics_add(AGI_COUNTER_DOWNLOAD_BYTES, transfer->size);
+        discard_resume_record(transfer);
+    } else if (transfer->resumable && result != AGI_ERROR_INTEGRITY && transfer->size > 0) {
+        // Keep the partial file for the next attempt, even across restarts
+        save_resume_record(transfer);
+    } else {
+        remove(transfer->output_path);  // Clean up partial download
+        discard_resume_record(transfer);
+    }
+    transfer->callback(&report, transfer->userdata);
+    agi_free(transfer);
+}
 
-#pragma comment(lib, "wininet.lib")
+static CURL* acquire_handle(DownloadEngine* engine) {
+    if (engine->idle_count > 0) {
+        CURL* easy = engine->idle_handles[--engine->idle_count];
+        curl_easy_reset(easy);
+        engine->active_count++;
+        return easy;
+    }
+    CURL* easy = curl_easy_init();
+    if (easy) engine->active_count++;
+    return easy;
+}
 
+// Splits a finished handle's time into curl's phases. They are offsets from the
+// handle's start, which is recovered from the total; a reused connection has
+// no DNS or connect phase, so those come out empty and are left out.
+static void trace_handle(const Transfer* transfer, CURL* easy, const char* name) {
+    static const CURLINFO phases[] = {CURLINFO_NAMELOOKUP_TIME_T, CURLINFO_CONNECT_TIME_T, CURLINFO_APPCONNECT_TIME_T,
+                                      CURLINFO_STARTTRANSFER_TIME_T};
+    static const char* phase_names[] = {"dns", "connect", "tls", "first_byte"};
+    curl_off_t total = 0;
+    if (curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &total) != CURLE_OK) return;
+    u64 ended_ns = agi_clock_now_ns();
+    u64 started_ns = ended_ns - (u64)total * 1000;
+    trace_record(transfer->trace_id, name, started_ns, ended_ns);
 
-static agi_result_t download_file_windows(const char* url, const char* output_path) {
-    HINTERNET hInternet, hConnect;
-    HANDLE hFile;
-    DWORD bytesRead, bytesWritten;
-    char buffer[4096];
-    BOOL result = FALSE;
+    u64 phase_start = started_ns;
+    for (size_t i = 0; i < sizeof(phases) / sizeof(phases[0]); i++) {
+        curl_off_t offset = 0;
+        if (curl_easy_getinfo(easy, phases[i], &offset) != CURLE_OK || offset <= 0) continue;
+        u64 phase_end = started_ns + (u64)offset * 1000;
+        if (phase_end > phase_start) trace_record(transfer->trace_id, phase_names[i], phase_start, phase_end);
+        if (phase_end > phase_start) phase_start = phase_end;
+    }
+    if (ended_ns > phase_start) trace_record(transfer->trace_id, "transfer", phase_start, ended_ns);
+}
 
-    // Initialize WinINet
-    hInternet = InternetOpen("DownloadAgent", INTERNET_OPEN_TYPE_DIRECT, NULL, NULL, 0);
-    if (!hInternet) {
-        agi_log_error("Error initializing WinINet: %lu\n", GetLastError());
-        return AGI_ERROR_NETWORK;
+static void release_handle(DownloadEngine* engine, Transfer* transfer, CURL* easy) {
+    trace_handle(transfer, easy, easy == transfer->easy ? "http_attempt" : "http_range");
+    curl_off_t received = 0;
+    if (curl_easy_getinfo(easy, CURLINFO_SIZE_DOWNLOAD_T, &received) == CURLE_OK && received > 0) {
+        transfer->wire_bytes += (u64)received;
+    }
+    engine->active_count--;
+    if (engine->idle_count < engine->config.max_connections) {
+        engine->idle_handles[engine->idle_count++] = easy;
+    } else {
+        curl_easy_cleanup(easy);
     }
+}
 
-    // Open the URL
-    hConnect = InternetOpenUrl(hInternet, url, NULL, 0, INTERNET_FLAG_RELOAD, 0);
-    if (!hConnect) {
-        agi_log_error("Error opening URL: %lu\n", GetLastError());
-        InternetCloseHandle(hInternet);
-        return AGI_ERROR_NETWORK;
+static void active_unlink(DownloadEngine* engine, Transfer* transfer) {
+    if (transfer->prev) {
+        transfer->prev->next = transfer->next;
+    } else {
+        engine->active = transfer->next;
     }
+    if (transfer->next) transfer->next->prev = transfer->prev;
+    transfer->next = NULL;
+    transfer->prev = NULL;
+}
 
-    // Create the output file
-    hFile = CreateFileA(output_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) {
-        agi_log_error("Error creating output file: %lu\n", GetLastError());
-        InternetCloseHandle(hConnect);
-        InternetCloseHandle(hInternet);
-        return AGI_ERROR_IO;
+static void active_link(DownloadEngine* engine, Transfer* transfer) {
+    transfer->prev = NULL;
+    transfer->next = engine->active;
+    if (engine->active) engine->active->prev = transfer;
+    engine->active = transfer;
+}
+
+static void configure_handle(DownloadEngine* engine, CURL* easy, Transfer* transfer) {
+    curl_easy_setopt(easy, CURLOPT_URL, transfer->url);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, transfer);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT, (long)engine->config.timeout_seconds);
+    curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+}
+
+static struct curl_slist* if_range_header(const Transfer* transfer) {
+    if (!transfer->validator[0]) return NULL;
+    char header[VALIDATOR_SIZE + 16];
+    snprintf(header, sizeof(header), "If-Range: %s", transfer->validator);
+    return curl_slist_append(NULL, header);
+}
+
+static void start_segments(DownloadEngine* engine, Transfer* transfer);
+
+// Without a validator or an expected digest nothing would catch a file that
+// changed on the server between attempts, so such transfers start over
+static b8 can_resume(const Transfer* transfer) {
+    return transfer->size > 0 && (transfer->validator[0] || transfer->verify);
+}
+
+static void start_attempt(DownloadEngine* engine, Transfer* transfer) {
+    if (transfer->attempts == 0 && transfer->resumable) {
+        load_resume_record(transfer);
+    }
+    transfer->attempts++;
+    if (transfer->segment_count > 0) {
+        start_segments(engine, transfer);
+        return;
     }
 
-    // Download and write the file
-    do {
-        if (!InternetReadFile(hConnect, buffer, sizeof(buffer), &bytesRead)) {
-            agi_log_error("Error reading from URL: %lu\n", GetLastError());
-            break;
+    if (!can_resume(transfer)) {
+        transfer->size = 0;
+        transfer->checkpoint_size = 0;
+        sha256_init(&transfer->sha);
+    }
+    transfer->resume_offset = transfer->size;
+
+    if (transfer->resume_offset > 0) {
+        // Drop anything past the last good byte, e.g. written after the last checkpoint
+        transfer->fp = fopen(transfer->output_path, "r+b");
+        if (transfer->fp && (!truncate_file(transfer->fp, transfer->resume_offset) ||
+                             fseek(transfer->fp, 0, SEEK_END) != 0 ||
+                             (u64)ftell(transfer->fp) != transfer->resume_offset)) {
+            fclose(transfer->fp);
+            transfer->fp = NULL;
         }
+        if (!transfer->fp) {
+            // Partial file is gone or shorter than recorded: start over
+            transfer->size = 0;
+            transfer->resume_offset = 0;
+            transfer->checkpoint_size = 0;
+            sha256_init(&transfer->sha);
+        }
+    }
+    if (!transfer->fp) {
+        transfer->fp = fopen(transfer->output_path, "wb");
+    }
+    if (!transfer->fp) {
+        agi_log_error("Failed to open file for writing: %s", transfer->output_path);
+        finish_transfer(transfer, AGI_ERROR_IO, 0);
+        return;
+    }
 
-        if (bytesRead == 0) {
-            result = TRUE;  // Download complete
-            break;
+    CURL* easy = acquire_handle(engine);
+    if (!easy) {
+        fclose(transfer->fp);
+        finish_transfer(transfer, AGI_ERROR_OUT_OF_MEMORY, 0);
+        return;
+    }
+    transfer->easy = easy;
+
+    configure_handle(engine, easy, transfer);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, transfer);
+    curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(easy, CURLOPT_HEADERDATA, transfer);
+    if (transfer->resume_offset > 0) {
+        curl_easy_setopt(easy, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)transfer->resume_offset);
+        transfer->headers = if_range_header(transfer);
+        if (transfer->headers) curl_easy_setopt(easy, CURLOPT_HTTPHEADER, transfer->headers);
+        agi_log_info("Resuming %s at byte %llu", transfer->url, (unsigned long long)transfer->resume_offset);
+    } else {
+        // Compression only for whole bodies: the bytes on disk are always the decoded
+        // ones, so a later resume asks for the rest of the identity encoding
+        curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, "");
+        // An open-ended range costs nothing and tells us whether the server could split
+        if (transfer->max_segments > 1) curl_easy_setopt(easy, CURLOPT_RANGE, "0-");
+    }
+
+    active_link(engine, transfer);
+    curl_multi_add_handle(engine->multi, easy);
+}
+
+static u64 next_random(DownloadEngine* engine) {
+    // xorshift64*: only used to spread retries out
+    u64 x = engine->random_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    engine->random_state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Exponential backoff with jitter: somewhere in [delay / 2, delay], where delay
+// doubles per attempt up to a cap, so agents that failed together don't retry together
+static u64 retry_delay_ms(DownloadEngine* engine, u32 attempts) {
+    u64 delay = RETRY_MAX_DELAY_MS;
+    if (attempts <= 16) delay = MIN((u64)RETRY_BASE_DELAY_MS << (attempts - 1), (u64)RETRY_MAX_DELAY_MS);
+    return delay / 2 + next_random(engine) % (delay / 2 + 1);
+}
+
+// Keeps the retry list sorted by due time so only its head needs checking
+static void schedule_retry(DownloadEngine* engine, Transfer* transfer, u64 delay_ms) {
+    transfer->retry_at_ms = agi_clock_now_ms() + delay_ms;
+    Transfer** link = &engine->retrying.head;
+    while (*link && (*link)->retry_at_ms <= transfer->retry_at_ms) {
+        link = &(*link)->next;
+    }
+    transfer->next = *link;
+    *link = transfer;
+    if (!transfer->next) engine->retrying.tail = transfer;
+}
+
+// --- segmented transfers ---
+// Every range writes through its own FILE* at its own offset into a file
+// preallocated to the full size. Ranges keep their progress across attempts, but
+// not across restarts; the digest is checked with one read of the finished file.
+
+static size_t segment_write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    Segment* segment = (Segment*)userp;
+    if (!segment->checked) {
+        segment->checked = true;
+        long http_code = 0;
+        curl_easy_getinfo(segment->easy, CURLINFO_RESPONSE_CODE, &http_code);
+        if (http_code != 206) {
+            segment->mismatch = true;
+            return 0;
         }
+    }
+    size_t length = (size_t)MIN((u64)(size * nmemb), segment->end - segment->offset);
+    size_t written = fwrite(contents, 1, length, segment->fp);
+    segment->offset += written;
+    return written;
+}
 
-        if (!WriteFile(hFile, buffer, bytesRead, &bytesWritten, NULL) || bytesWritten != bytesRead) {
-            agi_log_error("Error writing to file: %lu\n", GetLastError());
-            break;
+static void preallocate_file(FILE* fp, u64 size) {
+    fflush(fp);
+#if defined(__linux__)
+    int error = posix_fallocate(fileno(fp), 0, (off_t)size);
+    if (error != 0) agi_log_warning("Failed to preallocate %llu bytes: %s", (unsigned long long)size, strerror(error));
+#else
+    // Sets the size up front; the filesystem allocates as the ranges arrive
+    truncate_file(fp, size);
+#endif
+}
+
+static b8 seek_file(FILE* fp, u64 offset) {
+#if defined(_WIN32)
+    return _fseeki64(fp, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static b8 start_range(DownloadEngine* engine, Transfer* transfer, Segment* segment) {
+    char range[64];
+    segment->checked = false;
+    segment->mismatch = false;
+    segment->fp = fopen(transfer->output_path, "r+b");
+    if (!segment->fp || !seek_file(segment->fp, segment->offset)) {
+        agi_log_error("Failed to open %s at %llu", transfer->output_path, (unsigned long long)segment->offset);
+        if (segment->fp) fclose(segment->fp);
+        segment->fp = NULL;
+        return false;
+    }
+    segment->easy = acquire_handle(engine);
+    if (!segment->easy) {
+        fclose(segment->fp);
+        segment->fp = NULL;
+        return false;
+    }
+
+    snprintf(range, sizeof(range), "%llu-%llu", (unsigned long long)segment->offset,
+             (unsigned long long)(segment->end - 1));
+    configure_handle(engine, segment->easy, transfer);
+    curl_easy_setopt(segment->easy, CURLOPT_WRITEFUNCTION, segment_write_callback);
+    curl_easy_setopt(segment->easy, CURLOPT_WRITEDATA, segment);
+    curl_easy_setopt(segment->easy, CURLOPT_RANGE, range);
+    // A changed file answers with 200 instead of mixing versions
+    segment->headers = if_range_header(transfer);
+    if (segment->headers) curl_easy_setopt(segment->easy, CURLOPT_HTTPHEADER, segment->headers);
+    transfer->segments_running++;
+    curl_multi_add_handle(engine->multi, segment->easy);
+    return true;
+}
+
+static void stop_range(DownloadEngine* engine, Transfer* transfer, Segment* segment) {
+    curl_multi_remove_handle(engine->multi, segment->easy);
+    release_handle(engine, transfer, segment->easy);
+    segment->easy = NULL;
+    curl_slist_free_all(segment->headers);
+    segment->headers = NULL;
+    fclose(segment->fp);
+    segment->fp = NULL;
+    transfer->segments_running--;
+}
+
+static void stop_primary(DownloadEngine* engine, Transfer* transfer) {
+    // Unsplit transfers have no segment array at all
+    if (transfer->segments) transfer->segments[0].offset = transfer->size;
+    curl_multi_remove_handle(engine->multi, transfer->easy);
+    release_handle(engine, transfer, transfer->easy);
+    transfer->easy = NULL;
+    curl_slist_free_all(transfer->headers);
+    transfer->headers = NULL;
+    fclose(transfer->fp);
+    transfer->fp = NULL;
+}
+
+static void stop_all_ranges(DownloadEngine* engine, Transfer* transfer) {
+    if (transfer->easy) stop_primary(engine, transfer);
+    for (u32 i = 0; i < transfer->segment_count; i++) {
+        if (transfer->segments[i].easy) stop_range(engine, transfer, &transfer->segments[i]);
+    }
+}
+
+static void finish_segments(Transfer* transfer) {
+    u64 total = transfer->segments[transfer->segment_count - 1].end;
+    u64 started_ns = agi_clock_now_ns();
+    agi_result_t result = AGI_ERROR_IO;
+    u8* buffer = agi_malloc(HASH_CHUNK_SIZE);
+    FILE* fp = buffer ? fopen(transfer->output_path, "rb") : NULL;
+    if (fp) {
+        Sha256 sha;
+        sha256_init(&sha);
+        size_t read;
+        while ((read = fread(buffer, 1, HASH_CHUNK_SIZE, fp)) > 0) {
+            sha256_update(&sha, buffer, read);
         }
-    } while (TRUE);
+        sha256_final(&sha, transfer->sha256);
+        if (!ferror(fp) && sha.length == total) result = AGI_SUCCESS;
+        fclose(fp);
+    }
+    agi_free(buffer);
+    transfer->size = total;
+    // Ranges arrive out of order, so unlike a single stream the file is hashed after the fact
+    trace_record(transfer->trace_id, "verify", started_ns, agi_clock_now_ns());
+
+    if (result != AGI_SUCCESS) {
+        agi_log_error("Failed to read back %s", transfer->output_path);
+    } else if (transfer->verify && memcmp(transfer->sha256, transfer->expected_sha256, AGI_SHA256_DIGEST_SIZE) != 0) {
+        char actual[2 * AGI_SHA256_DIGEST_SIZE + 1];
+        sha256_to_hex(transfer->sha256, actual);
+        agi_log_error("Digest mismatch for %s: got %s", transfer->url, actual);
+        result = AGI_ERROR_INTEGRITY;
+    } else {
+        agi_log_info("File downloaded successfully: %s (Size: %llu bytes in %u ranges)", transfer->output_path,
+                     (unsigned long long)transfer->size, transfer->segment_count);
+    }
+    finish_transfer(transfer, result, 206);
+}
 
-    // Clean up
-    CloseHandle(hFile);
-    InternetCloseHandle(hConnect);
-    InternetCloseHandle(hInternet);
+// Runs once the last range of an attempt has stopped
+static void settle_segments(DownloadEngine* engine, Transfer* transfer) {
+    if (transfer->easy || transfer->segments_running > 0) return;
+    active_unlink(engine, transfer);
 
-    if (result) {
-        agi_log_debug("File downloaded successfully: %s\n", output_path);
-        return AGI_SUCCESS;
+    if (transfer->segment_restart) {
+        // Ranges are no longer honored or the file changed: fetch it whole,
+        // without spending an attempt, as if segmenting had never started
+        agi_log_info("Ranges rejected for %s, restarting as one stream", transfer->url);
+        transfer->segment_count = 0;
+        transfer->max_segments = 0;
+        transfer->segment_end = 0;
+        transfer->segment_restart = false;
+        transfer->size = 0;
+        transfer->validator[0] = '\0';
+        transfer->attempts--;
+        metrics_add(AGI_COUNTER_DOWNLOAD_RESTARTS, 1);
+        schedule_retry(engine, transfer, 0);
+    } else if (!transfer->segment_error) {
+        finish_segments(transfer);
+    } else if (transfer->attempts < engine->config.max_attempts) {
+        agi_log_info("Retrying download (attempt %u of %u)...", transfer->attempts + 1, engine->config.max_attempts);
+        metrics_add(AGI_COUNTER_DOWNLOAD_RETRIES, 1);
+        schedule_retry(engine, transfer, retry_delay_ms(engine, transfer->attempts));
     } else {
-        DeleteFileA(output_path);  // Clean up partial download
-        agi_log_error("Failed to download file\n");
-        return AGI_ERROR_NETWORK;
+        agi_log_error("Failed to download file after %u attempts", transfer->attempts);
+        finish_transfer(transfer, AGI_ERROR_NETWORK, 0);
     }
 }
-#else
-static agi_result_t download_file_curl(const char* url, const char* output_path) {
-    CURL* curl;
-    CURLcode res;
-    WriteData wd = {NULL, 0};
-    int attempt = 0;
+
+static void fail_segments(DownloadEngine* engine, Transfer* transfer) {
+    transfer->segment_error = true;
+    stop_all_ranges(engine, transfer);
+    settle_segments(engine, transfer);
+}
+
+// Adds the planned ranges once the first response allowed a split
+static void launch_segments(DownloadEngine* engine, Transfer* transfer) {
+    transfer->split_pending = false;
+    // Progress is spread over several ranges now, which a resume record can't express
+    if (transfer->resumable) {
+        discard_resume_record(transfer);
+        transfer->resumable = false;
+    }
+    preallocate_file(transfer->fp, transfer->segments[transfer->segment_count - 1].end);
+    for (u32 i = 1; i < transfer->segment_count; i++) {
+        if (!start_range(engine, transfer, &transfer->segments[i])) {
+            fail_segments(engine, transfer);
+            return;
+        }
+    }
+}
+
+// A retry of a split transfer: every unfinished range continues where it stopped
+static void start_segments(DownloadEngine* engine, Transfer* transfer) {
+    transfer->segment_error = false;
+    active_link(engine, transfer);
+    for (u32 i = 0; i < transfer->segment_count; i++) {
+        Segment* segment = &transfer->segments[i];
+        if (segment->offset < segment->end && !start_range(engine, transfer, segment)) {
+            fail_segments(engine, transfer);
+            return;
+        }
+    }
+    settle_segments(engine, transfer);
+}
+
+static void on_segment_done(DownloadEngine* engine, Transfer* transfer, CURL* easy, CURLcode code) {
+    b8 complete;
+    if (easy == transfer->easy) {
+        stop_primary(engine, transfer);
+        complete = transfer->size == transfer->segment_end;
+    } else {
+        Segment* segment = NULL;
+        for (u32 i = 0; i < transfer->segment_count && !segment; i++) {
+            if (transfer->segments[i].easy == easy) segment = &transfer->segments[i];
+        }
+        if (segment->mismatch) transfer->segment_restart = true;
+        stop_range(engine, transfer, segment);
+        complete = segment->offset == segment->end;
+    }
+
+    // A range that is complete stopped on purpose, which curl reports as a write error
+    if (complete && (code == CURLE_OK || code == CURLE_WRITE_ERROR)) {
+        settle_segments(engine, transfer);
+        return;
+    }
+    if (!transfer->segment_error && !transfer->segment_restart) {
+        agi_log_error("Range of %s failed on attempt %u: %s", transfer->url, transfer->attempts, curl_easy_strerror(code));
+    }
+    fail_segments(engine, transfer);
+}
+
+static void on_transfer_done(DownloadEngine* engine, CURL* easy, CURLcode code) {
+    Transfer* transfer = NULL;
+    curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char**)&transfer);
+    if (transfer->segment_count > 0) {
+        on_segment_done(engine, transfer, easy, code);
+        return;
+    }
+
+    long http_code = 0;
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &http_code);
+    curl_multi_remove_handle(engine->multi, easy);
+    release_handle(engine, transfer, easy);
+    transfer->easy = NULL;
+    curl_slist_free_all(transfer->headers);
+    transfer->headers = NULL;
+    active_unlink(engine, transfer);
+    fclose(transfer->fp);
+    transfer->fp = NULL;
+
     agi_result_t result = AGI_ERROR_NETWORK;
+    if (transfer->resume_offset > 0 && (code == CURLE_RANGE_ERROR || http_code == 416)) {
+        // No range support, a changed file (If-Range answered with the whole body)
+        // or an offset past its end: what we have is useless, but the server is
+        // fine, so start over right away without spending an attempt
+        agi_log_info("Cannot resume %s, restarting from zero", transfer->url);
+        transfer->size = 0;
+        transfer->validator[0] = '\0';
+        transfer->attempts--;
+        metrics_add(AGI_COUNTER_DOWNLOAD_RESTARTS, 1);
+        discard_resume_record(transfer);
+        schedule_retry(engine, transfer, 0);
+        return;
+    }
+    if (code == CURLE_OK) {
+        // Finalize a copy: the running hash must stay resumable until the digest checks out
+        Sha256 sha = transfer->sha;
+        sha256_final(&sha, transfer->sha256);
+        if ((http_code != 200 && http_code != 206) || transfer->size == 0) {
+            agi_log_error("HTTP error: %ld", http_code);
+        } else if (transfer->verify && memcmp(transfer->sha256, transfer->expected_sha256, AGI_SHA256_DIGEST_SIZE) != 0) {
+            char actual[2 * AGI_SHA256_DIGEST_SIZE + 1];
+            sha256_to_hex(transfer->sha256, actual);
+            agi_log_error("Digest mismatch for %s: got %s", transfer->url, actual);
+            result = AGI_ERROR_INTEGRITY;
+            transfer->size = 0;
+        } else {
+            agi_log_info("File downloaded successfully: %s (Size: %llu bytes, %llu received)", transfer->output_path,
+                         (unsigned long long)transfer->size, (unsigned long long)transfer->wire_bytes);
+            finish_transfer(transfer, AGI_SUCCESS, http_code);
+            return;
+        }
+    } else {
+        agi_log_error("Curl error on attempt %u: %s", transfer->attempts, curl_easy_strerror(code));
+    }
 
-    curl = curl_easy_init();
-    if (!curl) {
-        agi_log_error("Failed to initialize curl");
-        return AGI_ERROR_NETWORK;
+    // Truncation already surfaces as a curl error; a complete body with the wrong
+    // digest means the server has the wrong bytes, so don't fetch them again
+    if (result != AGI_ERROR_INTEGRITY && transfer->attempts < engine->config.max_attempts) {
+        agi_log_info("Retrying download (attempt %u of %u)...", transfer->attempts + 1, engine->config.max_attempts);
+        metrics_add(AGI_COUNTER_DOWNLOAD_RETRIES, 1);
+        // Persist progress so a restart during the backoff still resumes
+        save_resume_record(transfer);
+        schedule_retry(engine, transfer, retry_delay_ms(engine, transfer->attempts));
+        return;
     }
 
-    while (attempt < MAX_DOWNLOAD_ATTEMPTS) {
-        wd.fp = fopen(output_path, "wb");
-        if (!wd.fp) {
-            agi_log_error("Failed to open file for writing: %s", output_path);
-            curl_easy_cleanup(curl);
-            return AGI_ERROR_IO;
+    agi_log_error("Failed to download file after %u attempts", transfer->attempts);
+    finish_transfer(transfer, result, http_code);
+}
+
+// Fills free connection slots: due retries first, then new transfers in submit order
+static void start_queued(DownloadEngine* engine) {
+    u64 now = agi_clock_now_ms();
+    while (engine->active_count < engine->config.max_connections) {
+        Transfer* transfer;
+        if (engine->retrying.head && engine->retrying.head->retry_at_ms <= now) {
+            transfer = queue_pop(&engine->retrying);
+        } else if (engine->pending.head) {
+            transfer = queue_pop(&engine->pending);
+        } else {
+            break;
+        }
+        start_attempt(engine, transfer);
+    }
+}
+
+static int poll_timeout(const DownloadEngine* engine) {
+    if (!engine->retrying.head) return IDLE_POLL_MS;
+    u64 now = agi_clock_now_ms();
+    u64 due = engine->retrying.head->retry_at_ms;
+    if (due <= now) return 0;
+    return (int)MIN(due - now, (u64)IDLE_POLL_MS);
+}
+
+static void abort_all(DownloadEngine* engine) {
+    while (engine->active) {
+        Transfer* transfer = engine->active;
+        stop_all_ranges(engine, transfer);
+        active_unlink(engine, transfer);
+        finish_transfer(transfer, AGI_ERROR_NETWORK, 0);
+    }
+
+    TransferQueue* queues[] = {&engine->incoming, &engine->pending, &engine->retrying};
+    for (size_t i = 0; i < sizeof(queues) / sizeof(queues[0]); i++) {
+        Transfer* transfer;
+        while ((transfer = queue_pop(queues[i]))) {
+            finish_transfer(transfer, AGI_ERROR_NETWORK, 0);
+        }
+    }
+}
+
+static void engine_main(void* arg) {
+    DownloadEngine* engine = arg;
+    trace_name_thread("download");
+
+    for (;;) {
+        agi_mutex_lock(&engine->lock);
+        b8 stopping = engine->stopping;
+        Transfer* incoming = engine->incoming.head;
+        engine->incoming.head = NULL;
+        engine->incoming.tail = NULL;
+        agi_mutex_unlock(&engine->lock);
+
+        while (incoming) {
+            Transfer* next = incoming->next;
+            queue_push(&engine->pending, incoming);
+            incoming = next;
         }
+        if (stopping) break;
+
+        start_queued(engine);
 
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &wd);
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, DOWNLOAD_TIMEOUT);
-        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
-
-        res = curl_easy_perform(curl);
-        fclose(wd.fp);
-
-        if (res == CURLE_OK) {
-            long http_code = 0;
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-            if (http_code == 200 && wd.size > 0) {
-                agi_log_info("File downloaded successfully: %s (Size: %zu bytes)", output_path, wd.size);
-                result = AGI_SUCCESS;
-                break;
-            } else {
-                agi_log_error("HTTP error: %ld", http_code);
+        int running = 0;
+        curl_multi_perform(engine->multi, &running);
+
+        // Handles can't be added from inside curl's callbacks, so splits happen here
+        for (Transfer* transfer = engine->active; transfer;) {
+            Transfer* next = transfer->next;
+            if (transfer->split_pending) launch_segments(engine, transfer);
+            transfer = next;
+        }
+
+        CURLMsg* message;
+        int remaining;
+        while ((message = curl_multi_info_read(engine->multi, &remaining))) {
+            if (message->msg == CURLMSG_DONE) {
+                on_transfer_done(engine, message->easy_handle, message->data.result);
             }
-        } else {
-            agi_log_error("Curl error on attempt %d: %s", attempt + 1, curl_easy_strerror(res));
         }
 
-        attempt++;
-        if (attempt < MAX_DOWNLOAD_ATTEMPTS) {
-            agi_log_info("Retrying download (attempt %d of %d)...", attempt + 1, MAX_DOWNLOAD_ATTEMPTS);
-            Sleep(1000 * attempt);  // Exponential backoff
+        // Finished transfers free slots immediately; don't wait for the next poll
+        if (engine->active_count < engine->config.max_connections &&
+            (engine->pending.head || (engine->retrying.head && poll_timeout(engine) == 0))) {
+            continue;
         }
+        curl_multi_poll(engine->multi, NULL, 0, poll_timeout(engine), NULL);
     }
 
-    curl_easy_cleanup(curl);
+    abort_all(engine);
+}
 
-    if (result != AGI_SUCCESS) {
-        remove(output_path);  // Clean up partial download
-        agi_log_error("Failed to download file after %d attempts", MAX_DOWNLOAD_ATTEMPTS);
+DownloadEngine* download_engine_create(const DownloadEngineConfig* config) {
+    DownloadEngine* engine = agi_calloc(1, sizeof(DownloadEngine));
+    if (!engine) return NULL;
+
+    if (config) engine->config = *config;
+    if (!engine->config.max_connections_per_host) {
+        engine->config.max_connections_per_host = AGI_DOWNLOAD_DEFAULT_CONNECTIONS_PER_HOST;
     }
+    if (!engine->config.max_connections) engine->config.max_connections = AGI_DOWNLOAD_DEFAULT_CONNECTIONS;
+    if (!engine->config.timeout_seconds) engine->config.timeout_seconds = AGI_DOWNLOAD_DEFAULT_TIMEOUT;
+    if (!engine->config.max_attempts) engine->config.max_attempts = AGI_DOWNLOAD_DEFAULT_ATTEMPTS;
+    if (!engine->config.segment_threshold) engine->config.segment_threshold = AGI_DOWNLOAD_DEFAULT_SEGMENT_THRESHOLD;
 
-    return result;
+    engine->random_state = agi_clock_now_ns() | 1;
+    engine->idle_handles = agi_calloc(engine->config.max_connections, sizeof(CURL*));
+    engine->multi = curl_multi_init();
+    if (!engine->idle_handles || !engine->multi) {
+        agi_log_error("Failed to initialize curl");
+        if (engine->multi) curl_multi_cleanup(engine->multi);
+        agi_free(engine->idle_handles);
+        agi_free(engine);
+        return NULL;
+    }
+
+    // The multi handle owns the connection cache shared by every transfer
+    curl_multi_setopt(engine->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)engine->config.max_connections_per_host);
+    curl_multi_setopt(engine->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)engine->config.max_connections);
+    curl_multi_setopt(engine->multi, CURLMOPT_MAXCONNECTS, (long)engine->config.max_connections);
+    curl_multi_setopt(engine->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    agi_mutex_init(&engine->lock);
+    if (agi_thread_create(&engine->thread, engine_main, engine, 0) != AGI_SUCCESS) {
+        agi_log_error("Failed to start download thread");
+        agi_mutex_destroy(&engine->lock);
+        curl_multi_cleanup(engine->multi);
+        agi_free(engine->idle_handles);
+        agi_free(engine);
+        return NULL;
+    }
+    return engine;
 }
-#endif
 
-agi_result_t download_file(const char* url, const char* output_path) {
-#if defined(_WIN32)
-    return download_file_windows(url, output_path);
-#else
-    return download_file_curl(url, output_path);
-#endif
-}
\ No newline at end of file
+void download_engine_destroy(DownloadEngine* engine) {
+    if (!engine) return;
+
+    agi_mutex_lock(&engine->lock);
+    engine->stopping = true;
+    agi_mutex_unlock(&engine->lock);
+    curl_multi_wakeup(engine->multi);
+    agi_thread_join(engine->thread);
+
+    while (engine->idle_count > 0) {
+        curl_easy_cleanup(engine->idle_handles[--engine->idle_count]);
+    }
+    curl_multi_cleanup(engine->multi);
+    agi_mutex_destroy(&engine->lock);
+    agi_free(engine->idle_handles);
+    agi_free(engine);
+}
+
+agi_result_t download_engine_submit(DownloadEngine* engine, const char* url, const char* output_path,
+                                    const DownloadOptions* options, DownloadCallback callback, void* userdata) {
+    if (!engine || !url || !output_path || !callback) return AGI_ERROR_INVALID_ARGUMENT;
+
+    u8 expected_sha256[AGI_SHA256_DIGEST_SIZE];
+    b8 verify = options && options->expected_sha256;
+    if (verify && !sha256_parse_hex(options->expected_sha256, expected_sha256)) {
+        agi_log_error("Invalid expected digest for %s", url);
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    // More ranges than connections to the host would only queue inside curl
+    u32 max_segments = options ? MIN(options->segments, AGI_DOWNLOAD_MAX_SEGMENTS) : 0;
+    max_segments = MIN(max_segments, engine->config.max_connections_per_host);
+    if (max_segments < 2) max_segments = 0;
+
+    // One allocation holds the transfer, its ranges and both strings
+    size_t segments_size = max_segments * sizeof(Segment);
+    size_t url_size = strlen(url) + 1;
+    size_t path_size = strlen(output_path) + 1;
+    Transfer* transfer = agi_calloc(1, sizeof(Transfer) + segments_size + url_size + path_size);
+    if (!transfer) return AGI_ERROR_OUT_OF_MEMORY;
+
+    transfer->segments = max_segments ? (Segment*)(transfer + 1) : NULL;
+    transfer->max_segments = max_segments;
+    transfer->segment_threshold = engine->config.segment_threshold;
+    transfer->url = (char*)(transfer + 1) + segments_size;
+    transfer->output_path = transfer->url + url_size;
+    memcpy(transfer->url, url, url_size);
+    memcpy(transfer->output_path, output_path, path_size);
+    transfer->verify = verify;
+    transfer->resumable = options && options->resumable;
+    if (verify) memcpy(transfer->expected_sha256, expected_sha256, sizeof(expected_sha256));
+    transfer->callback = callback;
+    transfer->userdata = userdata;
+    transfer->started_ms = agi_clock_now_ms();
+    transfer->trace_id = trace_current();
+
+    agi_mutex_lock(&engine->lock);
+    if (engine->stopping) {
+        agi_mutex_unlock(&engine->lock);
+        agi_free(transfer);
+        return AGI_ERROR_BUSY;
+    }
+    queue_push(&engine->incoming, transfer);
+    agi_mutex_unlock(&engine->lock);
+
+    curl_multi_wakeup(engine->multi);
+    return AGI_SUCCESS;
+}
+
+// --- blocking groups ---
+
+typedef struct {
+    DownloadGroup* group;
+    agi_result_t* result;
+} GroupSlot;
+
+static void on_group_transfer_done(const DownloadReport* report, void* userdata) {
+    GroupSlot slot = *(GroupSlot*)userdata;
+    agi_free(userdata);
+
+    agi_mutex_lock(&slot.group->lock);
+    if (slot.result) *slot.result = report->result;
+    if (--slot.group->outstanding == 0) {
+        agi_cond_broadcast(&slot.group->done);
+    }
+    agi_mutex_unlock(&slot.group->lock);
+}
+
+DownloadGroup* download_group_create(DownloadEngine* engine) {
+    if (!engine) return NULL;
+    DownloadGroup* group = agi_calloc(1, sizeof(DownloadGroup));
+    if (!group) return NULL;
+    group->engine = engine;
+    agi_mutex_init(&group->lock);
+    agi_cond_init(&group->done);
+    return group;
+}
+
+void download_group_destroy(DownloadGroup* group) {
+    if (!group) return;
+    download_group_wait(group);
+    agi_cond_destroy(&group->done);
+    agi_mutex_destroy(&group->lock);
+    agi_free(group);
+}
+
+agi_result_t download_group_add(DownloadGroup* group, const char* url, const char* output_path,
+                                const DownloadOptions* options, agi_result_t* result) {
+    GroupSlot* slot = agi_malloc(sizeof(GroupSlot));
+    if (!slot) return AGI_ERROR_OUT_OF_MEMORY;
+    slot->group = group;
+    slot->result = result;
+
+    agi_mutex_lock(&group->lock);
+    group->outstanding++;
+    agi_mutex_unlock(&group->lock);
+
+    agi_result_t submitted = download_engine_submit(group->engine, url, output_path, options, on_group_transfer_done, slot);
+    if (submitted != AGI_SUCCESS) {
+        agi_free(slot);
+        agi_mutex_lock(&group->lock);
+        group->outstanding--;
+        agi_mutex_unlock(&group->lock);
+    }
+    return submitted;
+}
+
+void download_group_wait(DownloadGroup* group) {
+    agi_mutex_lock(&group->lock);
+    while (group->outstanding > 0) {
+        agi_cond_wait(&group->done, &group->lock);
+    }
+    agi_mutex_unlock(&group->lock);
+}
+
+// --- process-wide engine ---
+
+agi_result_t download_init(const DownloadEngineConfig* config) {
+    if (default_engine) return AGI_SUCCESS;
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
+        agi_log_error("Failed to initialize curl");
+        return AGI_ERROR_NETWORK;
+    }
+    default_engine = download_engine_create(config);
+    if (!default_engine) {
+        curl_global_cleanup();
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+    return AGI_SUCCESS;
+}
+
+void download_shutdown(void) {
+    if (!default_engine) return;
+    download_engine_destroy(default_engine);
+    default_engine = NULL;
+    curl_global_cleanup();
+}
+
+DownloadEngine* download_default_engine(void) {
+    return default_engine;
+}
+
+agi_result_t download_file(const char* url, const char* output_path, const DownloadOptions* options) {
+    if (!default_engine) {
+        agi_log_error("download_file() called before download_init()");
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    agi_result_t result = AGI_ERROR_NETWORK;
+    DownloadGroup* group = download_group_create(default_engine);
+    if (!group) return AGI_ERROR_OUT_OF_MEMORY;
+    agi_result_t submitted = download_group_add(group, url, output_path, options, &result);
+    download_group_destroy(group);
+    return submitted == AGI_SUCCESS ? result : submitted;
+}
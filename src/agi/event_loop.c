@@ -0,0 +1,546 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/event_loop.h"
+
+#include <string.h>
+
+#include "agi/clock.h"
+#include "agi/log.h"
+#include "agi/memory.h"
+#include "agi/thread.h"
+
+#if defined(AGI_PLATFORM_WINDOWS)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define close closesocket
+#elif defined(AGI_PLATFORM_LINUX)
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define MAX_EVENTS_PER_WAIT 64
+
+typedef struct Watcher {
+    int fd;
+    u32 events;
+    EventCallback callback;
+    void *userdata;
+    b8 removed;
+    struct Watcher *next_removed;
+} Watcher;
+
+typedef struct {
+    u64 deadline_ms;
+    u64 interval_ms;
+    u32 id;
+    TimerCallback callback;
+    void *userdata;
+} Timer;
+
+struct EventLoop {
+    const EventLoopBackend *backend;
+    void *backend_state;
+
+    // fd -> watcher, open addressing with linear probing
+    Watcher **watchers;
+    size_t watcher_capacity;
+    size_t watcher_count;
+    Watcher *removed_watchers;
+
+    // Binary min-heap ordered by deadline
+    Timer *timers;
+    size_t timer_count;
+    size_t timer_capacity;
+    u32 next_timer_id;
+
+    agi_mutex_t task_lock;
+    EventLoopTask *task_head;
+    EventLoopTask *task_tail;
+
+    int wakeup_read_fd;
+    int wakeup_write_fd;
+    volatile b8 stopping;
+};
+
+const EventLoopBackend *event_loop_default_backend(void) {
+#if defined(AGI_PLATFORM_LINUX)
+    return &agi_event_backend_epoll;
+#else
+    return &agi_event_backend_poll;
+#endif
+}
+
+// --- fd -> watcher map ---
+
+static size_t watcher_slot(const EventLoop *loop, int fd) {
+    return ((u32)fd * 0x9E3779B1u) & (loop->watcher_capacity - 1);
+}
+
+static Watcher *watcher_find(const EventLoop *loop, int fd) {
+    if (loop->watcher_capacity == 0) return NULL;
+    size_t slot = watcher_slot(loop, fd);
+    while (loop->watchers[slot]) {
+        if (loop->watchers[slot]->fd == fd) {
+            return loop->watchers[slot];
+        }
+        slot = (slot + 1) & (loop->watcher_capacity - 1);
+    }
+    return NULL;
+}
+
+static void watcher_insert_slot(EventLoop *loop, Watcher *watcher) {
+    size_t slot = watcher_slot(loop, watcher->fd);
+    while (loop->watchers[slot]) {
+        slot = (slot + 1) & (loop->watcher_capacity - 1);
+    }
+    loop->watchers[slot] = watcher;
+}
+
+static agi_result_t watcher_insert(EventLoop *loop, Watcher *watcher) {
+    if ((loop->watcher_count + 1) * 2 > loop->watcher_capacity) {
+        size_t old_capacity = loop->watcher_capacity;
+        Watcher **old = loop->watchers;
+        size_t capacity = old_capacity ? old_capacity * 2 : 16;
+        Watcher **grown = agi_calloc(capacity, sizeof(Watcher *));
+        if (!grown) return AGI_ERROR_OUT_OF_MEMORY;
+
+        loop->watchers = grown;
+        loop->watcher_capacity = capacity;
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old[i]) watcher_insert_slot(loop, old[i]);
+        }
+        agi_free(old);
+    }
+    watcher_insert_slot(loop, watcher);
+    loop->watcher_count++;
+    return AGI_SUCCESS;
+}
+
+static void watcher_erase(EventLoop *loop, int fd) {
+    size_t mask = loop->watcher_capacity - 1;
+    size_t slot = watcher_slot(loop, fd);
+    while (loop->watchers[slot] && loop->watchers[slot]->fd != fd) {
+        slot = (slot + 1) & mask;
+    }
+    if (!loop->watchers[slot]) return;
+
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    size_t hole = slot;
+    size_t next = (hole + 1) & mask;
+    while (loop->watchers[next]) {
+        size_t home = watcher_slot(loop, loop->watchers[next]->fd);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            loop->watchers[hole] = loop->watchers[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    loop->watchers[hole] = NULL;
+    loop->watcher_count--;
+}
+
+// --- timer heap ---
+
+static void timer_swap(Timer *a, Timer *b) {
+    Timer tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void timer_sift_up(EventLoop *loop, size_t index) {
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (loop->timers[parent].deadline_ms <= loop->timers[index].deadline_ms) break;
+        timer_swap(&loop->timers[parent], &loop->timers[index]);
+        index = parent;
+    }
+}
+
+static void timer_sift_down(EventLoop *loop, size_t index) {
+    for (;;) {
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+        size_t smallest = index;
+        if (left < loop->timer_count && loop->timers[left].deadline_ms < loop->timers[smallest].deadline_ms) smallest = left;
+        if (right < loop->timer_count && loop->timers[right].deadline_ms < loop->timers[smallest].deadline_ms) smallest = right;
+        if (smallest == index) break;
+        timer_swap(&loop->timers[smallest], &loop->timers[index]);
+        index = smallest;
+    }
+}
+
+static agi_result_t timer_push(EventLoop *loop, Timer timer) {
+    if (loop->timer_count == loop->timer_capacity) {
+        size_t capacity = loop->timer_capacity ? loop->timer_capacity * 2 : 8;
+        Timer *grown = agi_realloc(loop->timers, capacity * sizeof(Timer));
+        if (!grown) return AGI_ERROR_OUT_OF_MEMORY;
+        loop->timers = grown;
+        loop->timer_capacity = capacity;
+    }
+    loop->timers[loop->timer_count] = timer;
+    timer_sift_up(loop, loop->timer_count);
+    loop->timer_count++;
+    return AGI_SUCCESS;
+}
+
+static void timer_remove_at(EventLoop *loop, size_t index) {
+    loop->timer_count--;
+    if (index == loop->timer_count) return;
+    loop->timers[index] = loop->timers[loop->timer_count];
+    timer_sift_down(loop, index);
+    timer_sift_up(loop, index);
+}
+
+// --- wakeup channel ---
+
+static agi_result_t wakeup_open(EventLoop *loop) {
+#if defined(AGI_PLATFORM_LINUX)
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1) return AGI_ERROR_IO;
+    loop->wakeup_read_fd = fd;
+    loop->wakeup_write_fd = fd;
+#elif defined(AGI_PLATFORM_WINDOWS)
+    // A UDP socket connected to itself; WSAPoll can only wait on sockets
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s == INVALID_SOCKET) return AGI_ERROR_NETWORK;
+    struct sockaddr_in addr = {0};
+    int addr_len = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    u_long nonblocking = 1;
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        getsockname(s, (struct sockaddr *)&addr, &addr_len) != 0 ||
+        connect(s, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        ioctlsocket(s, FIONBIO, &nonblocking) != 0) {
+        closesocket(s);
+        return AGI_ERROR_NETWORK;
+    }
+    loop->wakeup_read_fd = (int)s;
+    loop->wakeup_write_fd = (int)s;
+#else
+    int fds[2];
+    if (pipe(fds) == -1) return AGI_ERROR_IO;
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    loop->wakeup_read_fd = fds[0];
+    loop->wakeup_write_fd = fds[1];
+#endif
+    return AGI_SUCCESS;
+}
+
+static void wakeup_close(EventLoop *loop) {
+    if (loop->wakeup_read_fd != -1) {
+        close(loop->wakeup_read_fd);
+    }
+    if (loop->wakeup_write_fd != -1 && loop->wakeup_write_fd != loop->wakeup_read_fd) {
+        close(loop->wakeup_write_fd);
+    }
+}
+
+static void wakeup_signal(EventLoop *loop) {
+#if defined(AGI_PLATFORM_LINUX)
+    u64 one = 1;
+    ssize_t written = write(loop->wakeup_write_fd, &one, sizeof(one));
+    (void)written;
+#elif defined(AGI_PLATFORM_WINDOWS)
+    char one = 1;
+    send((SOCKET)loop->wakeup_write_fd, &one, 1, 0);
+#else
+    char one = 1;
+    ssize_t written = write(loop->wakeup_write_fd, &one, 1);
+    (void)written;
+#endif
+}
+
+static void wakeup_drain(EventLoop *loop) {
+#if defined(AGI_PLATFORM_LINUX)
+    u64 value;
+    ssize_t received = read(loop->wakeup_read_fd, &value, sizeof(value));
+    (void)received;
+#elif defined(AGI_PLATFORM_WINDOWS)
+    char buffer[64];
+    while (recv((SOCKET)loop->wakeup_read_fd, buffer, sizeof(buffer), 0) > 0) {
+    }
+#else
+    char buffer[64];
+    while (read(loop->wakeup_read_fd, buffer, sizeof(buffer)) > 0) {
+    }
+#endif
+}
+
+static void run_posted_tasks(EventLoop *loop) {
+    agi_mutex_lock(&loop->task_lock);
+    EventLoopTask *task = loop->task_head;
+    loop->task_head = NULL;
+    loop->task_tail = NULL;
+    agi_mutex_unlock(&loop->task_lock);
+
+    while (task) {
+        // Read next first: the callback is free to release the task
+        EventLoopTask *next = task->next;
+        task->next = NULL;
+        task->callback(loop, task->userdata);
+        task = next;
+    }
+}
+
+static void on_wakeup(EventLoop *loop, int fd, u32 events, void *userdata) {
+    wakeup_drain(loop);
+    run_posted_tasks(loop);
+}
+
+// --- public API ---
+
+EventLoop *event_loop_create(void) {
+    return event_loop_create_with_backend(event_loop_default_backend());
+}
+
+EventLoop *event_loop_create_with_backend(const EventLoopBackend *backend) {
+    EventLoop *loop = agi_calloc(1, sizeof(EventLoop));
+    if (!loop) {
+        return NULL;
+    }
+
+    loop->backend = backend;
+    loop->wakeup_read_fd = -1;
+    loop->wakeup_write_fd = -1;
+    loop->next_timer_id = 1;
+    agi_mutex_init(&loop->task_lock);
+
+    loop->backend_state = backend->create();
+    if (!loop->backend_state) {
+        agi_log_error("Failed to create %s event backend", backend->name);
+        agi_mutex_destroy(&loop->task_lock);
+        agi_free(loop);
+        return NULL;
+    }
+
+    if (wakeup_open(loop) != AGI_SUCCESS ||
+        event_loop_add_fd(loop, loop->wakeup_read_fd, AGI_EVENT_READ, on_wakeup, NULL) != AGI_SUCCESS) {
+        agi_log_error("Failed to create event loop wakeup channel");
+        event_loop_destroy(loop);
+        return NULL;
+    }
+
+    return loop;
+}
+
+static void free_removed_watchers(EventLoop *loop) {
+    while (loop->removed_watchers) {
+        Watcher *next = loop->removed_watchers->next_removed;
+        agi_free(loop->removed_watchers);
+        loop->removed_watchers = next;
+    }
+}
+
+void event_loop_destroy(EventLoop *loop) {
+    if (!loop) return;
+
+    for (size_t i = 0; i < loop->watcher_capacity; i++) {
+        if (loop->watchers[i]) {
+            loop->backend->remove(loop->backend_state, loop->watchers[i]->fd);
+            agi_free(loop->watchers[i]);
+        }
+    }
+    agi_free(loop->watchers);
+    free_removed_watchers(loop);
+    agi_free(loop->timers);
+
+    wakeup_close(loop);
+    loop->backend->destroy(loop->backend_state);
+    agi_mutex_destroy(&loop->task_lock);
+    agi_free(loop);
+}
+
+agi_result_t event_loop_add_fd(EventLoop *loop, int fd, u32 events, EventCallback callback, void *userdata) {
+    if (!callback || watcher_find(loop, fd)) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    Watcher *watcher = agi_calloc(1, sizeof(Watcher));
+    if (!watcher) {
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+    watcher->fd = fd;
+    watcher->events = events;
+    watcher->callback = callback;
+    watcher->userdata = userdata;
+
+    agi_result_t result = watcher_insert(loop, watcher);
+    if (result != AGI_SUCCESS) {
+        agi_free(watcher);
+        return result;
+    }
+
+    result = loop->backend->add(loop->backend_state, fd, events, watcher);
+    if (result != AGI_SUCCESS) {
+        watcher_erase(loop, fd);
+        agi_free(watcher);
+    }
+    return result;
+}
+
+agi_result_t event_loop_modify_fd(EventLoop *loop, int fd, u32 events) {
+    Watcher *watcher = watcher_find(loop, fd);
+    if (!watcher) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+    if (watcher->events == events) {
+        return AGI_SUCCESS;
+    }
+
+    agi_result_t result = loop->backend->modify(loop->backend_state, fd, events, watcher);
+    if (result == AGI_SUCCESS) {
+        watcher->events = events;
+    }
+    return result;
+}
+
+agi_result_t event_loop_remove_fd(EventLoop *loop, int fd) {
+    Watcher *watcher = watcher_find(loop, fd);
+    if (!watcher) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    loop->backend->remove(loop->backend_state, fd);
+    watcher_erase(loop, fd);
+
+    // Events for this watcher may still be pending in the current batch; free it afterwards
+    watcher->removed = true;
+    watcher->next_removed = loop->removed_watchers;
+    loop->removed_watchers = watcher;
+    return AGI_SUCCESS;
+}
+
+u32 event_loop_add_timer(EventLoop *loop, u64 delay_ms, u64 interval_ms, TimerCallback callback, void *userdata) {
+    Timer timer = {
+        .deadline_ms = agi_clock_now_ms() + delay_ms,
+        .interval_ms = interval_ms,
+        .id = loop->next_timer_id++,
+        .callback = callback,
+        .userdata = userdata
+    };
+    if (loop->next_timer_id == 0) {
+        loop->next_timer_id = 1;
+    }
+
+    if (timer_push(loop, timer) != AGI_SUCCESS) {
+        return 0;
+    }
+    return timer.id;
+}
+
+void event_loop_cancel_timer(EventLoop *loop, u32 timer_id) {
+    for (size_t i = 0; i < loop->timer_count; i++) {
+        if (loop->timers[i].id == timer_id) {
+            timer_remove_at(loop, i);
+            return;
+        }
+    }
+}
+
+void event_loop_post(EventLoop *loop, EventLoopTask *task) {
+    task->next = NULL;
+
+    agi_mutex_lock(&loop->task_lock);
+    b8 was_empty = loop->task_head == NULL;
+    if (loop->task_tail) {
+        loop->task_tail->next = task;
+    } else {
+        loop->task_head = task;
+    }
+    loop->task_tail = task;
+    agi_mutex_unlock(&loop->task_lock);
+
+    // One pending wakeup is enough to drain the whole queue
+    if (was_empty) {
+        wakeup_signal(loop);
+    }
+}
+
+b8 event_loop_cancel_task(EventLoop *loop, EventLoopTask *task) {
+    b8 found = false;
+
+    agi_mutex_lock(&loop->task_lock);
+    EventLoopTask *previous = NULL;
+    for (EventLoopTask *current = loop->task_head; current; previous = current, current = current->next) {
+        if (current != task) continue;
+        if (previous) {
+            previous->next = current->next;
+        } else {
+            loop->task_head = current->next;
+        }
+        if (loop->task_tail == current) {
+            loop->task_tail = previous;
+        }
+        current->next = NULL;
+        found = true;
+        break;
+    }
+    agi_mutex_unlock(&loop->task_lock);
+    return found;
+}
+
+static void run_due_timers(EventLoop *loop) {
+    u64 now = agi_clock_now_ms();
+    while (loop->timer_count > 0 && loop->timers[0].deadline_ms <= now) {
+        Timer timer = loop->timers[0];
+        if (timer.interval_ms > 0) {
+            loop->timers[0].deadline_ms = now + timer.interval_ms;
+            timer_sift_down(loop, 0);
+        } else {
+            timer_remove_at(loop, 0);
+        }
+        timer.callback(loop, timer.id, timer.userdata);
+    }
+}
+
+agi_result_t event_loop_run_once(EventLoop *loop, int timeout_ms) {
+    if (loop->timer_count > 0) {
+        u64 now = agi_clock_now_ms();
+        u64 deadline = loop->timers[0].deadline_ms;
+        int until_timer = deadline > now ? (int)MIN(deadline - now, 0x7FFFFFFF) : 0;
+        if (timeout_ms < 0 || until_timer < timeout_ms) {
+            timeout_ms = until_timer;
+        }
+    }
+
+    BackendEvent events[MAX_EVENTS_PER_WAIT];
+    int count = loop->backend->wait(loop->backend_state, events, MAX_EVENTS_PER_WAIT, timeout_ms);
+    if (count < 0) {
+        agi_log_error("Event backend %s failed while waiting", loop->backend->name);
+        return AGI_ERROR_IO;
+    }
+
+    for (int i = 0; i < count; i++) {
+        Watcher *watcher = events[i].tag;
+        if (watcher->removed) continue;
+        watcher->callback(loop, watcher->fd, events[i].events, watcher->userdata);
+    }
+    free_removed_watchers(loop);
+
+    run_due_timers(loop);
+    return AGI_SUCCESS;
+}
+
+agi_result_t event_loop_run(EventLoop *loop) {
+    loop->stopping = false;
+    while (!loop->stopping) {
+        agi_result_t result = event_loop_run_once(loop, -1);
+        if (result != AGI_SUCCESS) {
+            return result;
+        }
+    }
+    return AGI_SUCCESS;
+}
+
+void event_loop_stop(EventLoop *loop) {
+    loop->stopping = true;
+    wakeup_signal(loop);
+}
@@ -0,0 +1,103 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/event_loop.h"
+
+#if defined(AGI_PLATFORM_LINUX)
+#include <errno.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "agi/memory.h"
+
+#define EPOLL_BATCH 64
+
+typedef struct {
+    int epoll_fd;
+} EpollState;
+
+static u32 to_epoll_events(u32 events) {
+    u32 result = 0;
+    if (events & AGI_EVENT_READ) result |= EPOLLIN | EPOLLRDHUP;
+    if (events & AGI_EVENT_WRITE) result |= EPOLLOUT;
+    return result;
+}
+
+static void *epoll_backend_create(void) {
+    EpollState *state = agi_malloc(sizeof(EpollState));
+    if (!state) return NULL;
+
+    state->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (state->epoll_fd == -1) {
+        agi_free(state);
+        return NULL;
+    }
+    return state;
+}
+
+static void epoll_backend_destroy(void *state) {
+    EpollState *epoll_state = state;
+    close(epoll_state->epoll_fd);
+    agi_free(epoll_state);
+}
+
+static agi_result_t epoll_backend_control(void *state, int op, int fd, u32 events, void *tag) {
+    EpollState *epoll_state = state;
+    struct epoll_event event = {
+        .events = to_epoll_events(events),
+        .data.ptr = tag
+    };
+    if (epoll_ctl(epoll_state->epoll_fd, op, fd, &event) == -1) {
+        return AGI_ERROR_IO;
+    }
+    return AGI_SUCCESS;
+}
+
+static agi_result_t epoll_backend_add(void *state, int fd, u32 events, void *tag) {
+    return epoll_backend_control(state, EPOLL_CTL_ADD, fd, events, tag);
+}
+
+static agi_result_t epoll_backend_modify(void *state, int fd, u32 events, void *tag) {
+    return epoll_backend_control(state, EPOLL_CTL_MOD, fd, events, tag);
+}
+
+static agi_result_t epoll_backend_remove(void *state, int fd) {
+    EpollState *epoll_state = state;
+    struct epoll_event unused = {0};
+    if (epoll_ctl(epoll_state->epoll_fd, EPOLL_CTL_DEL, fd, &unused) == -1) {
+        return AGI_ERROR_IO;
+    }
+    return AGI_SUCCESS;
+}
+
+static int epoll_backend_wait(void *state, BackendEvent *events, int max_events, int timeout_ms) {
+    EpollState *epoll_state = state;
+    struct epoll_event ready[EPOLL_BATCH];
+    if (max_events > EPOLL_BATCH) max_events = EPOLL_BATCH;
+
+    int count;
+    do {
+        count = epoll_wait(epoll_state->epoll_fd, ready, max_events, timeout_ms);
+    } while (count == -1 && errno == EINTR);
+
+    for (int i = 0; i < count; i++) {
+        u32 flags = 0;
+        if (ready[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) flags |= AGI_EVENT_READ;
+        if (ready[i].events & EPOLLOUT) flags |= AGI_EVENT_WRITE;
+        if (ready[i].events & EPOLLERR) flags |= AGI_EVENT_ERROR;
+        events[i].tag = ready[i].data.ptr;
+        events[i].events = flags;
+    }
+    return count;
+}
+
+const EventLoopBackend agi_event_backend_epoll = {
+    .name = "epoll",
+    .create = epoll_backend_create,
+    .destroy = epoll_backend_destroy,
+    .add = epoll_backend_add,
+    .modify = epoll_backend_modify,
+    .remove = epoll_backend_remove,
+    .wait = epoll_backend_wait
+};
+#endif
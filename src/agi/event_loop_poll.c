@@ -0,0 +1,130 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/event_loop.h"
+
+#include "agi/memory.h"
+
+#if defined(AGI_PLATFORM_WINDOWS)
+#include <winsock2.h>
+#define poll WSAPoll
+typedef ULONG nfds_t;
+#else
+#include <errno.h>
+#include <poll.h>
+#endif
+
+// Portable fallback backend: poll() on POSIX, WSAPoll() on Windows
+typedef struct {
+    struct pollfd *fds;
+    void **tags;
+    size_t count;
+    size_t capacity;
+} PollState;
+
+static short to_poll_events(u32 events) {
+    short result = 0;
+    if (events & AGI_EVENT_READ) result |= POLLIN;
+    if (events & AGI_EVENT_WRITE) result |= POLLOUT;
+    return result;
+}
+
+static void *poll_backend_create(void) {
+    return agi_calloc(1, sizeof(PollState));
+}
+
+static void poll_backend_destroy(void *state) {
+    PollState *poll_state = state;
+    agi_free(poll_state->fds);
+    agi_free(poll_state->tags);
+    agi_free(poll_state);
+}
+
+static size_t poll_backend_index(PollState *state, int fd) {
+    for (size_t i = 0; i < state->count; i++) {
+        if ((int)state->fds[i].fd == fd) return i;
+    }
+    return state->count;
+}
+
+static agi_result_t poll_backend_add(void *state, int fd, u32 events, void *tag) {
+    PollState *poll_state = state;
+    if (poll_state->count == poll_state->capacity) {
+        size_t capacity = poll_state->capacity ? poll_state->capacity * 2 : 8;
+        struct pollfd *fds = agi_realloc(poll_state->fds, capacity * sizeof(struct pollfd));
+        if (!fds) return AGI_ERROR_OUT_OF_MEMORY;
+        poll_state->fds = fds;
+        void **tags = agi_realloc(poll_state->tags, capacity * sizeof(void *));
+        if (!tags) return AGI_ERROR_OUT_OF_MEMORY;
+        poll_state->tags = tags;
+        poll_state->capacity = capacity;
+    }
+
+    poll_state->fds[poll_state->count].fd = fd;
+    poll_state->fds[poll_state->count].events = to_poll_events(events);
+    poll_state->fds[poll_state->count].revents = 0;
+    poll_state->tags[poll_state->count] = tag;
+    poll_state->count++;
+    return AGI_SUCCESS;
+}
+
+static agi_result_t poll_backend_modify(void *state, int fd, u32 events, void *tag) {
+    PollState *poll_state = state;
+    size_t index = poll_backend_index(poll_state, fd);
+    if (index == poll_state->count) return AGI_ERROR_INVALID_ARGUMENT;
+
+    poll_state->fds[index].events = to_poll_events(events);
+    poll_state->tags[index] = tag;
+    return AGI_SUCCESS;
+}
+
+static agi_result_t poll_backend_remove(void *state, int fd) {
+    PollState *poll_state = state;
+    size_t index = poll_backend_index(poll_state, fd);
+    if (index == poll_state->count) return AGI_ERROR_INVALID_ARGUMENT;
+
+    poll_state->count--;
+    poll_state->fds[index] = poll_state->fds[poll_state->count];
+    poll_state->tags[index] = poll_state->tags[poll_state->count];
+    return AGI_SUCCESS;
+}
+
+static int poll_backend_wait(void *state, BackendEvent *events, int max_events, int timeout_ms) {
+    PollState *poll_state = state;
+
+    int ready;
+#if defined(AGI_PLATFORM_WINDOWS)
+    ready = poll(poll_state->fds, (nfds_t)poll_state->count, timeout_ms);
+#else
+    do {
+        ready = poll(poll_state->fds, (nfds_t)poll_state->count, timeout_ms);
+    } while (ready == -1 && errno == EINTR);
+#endif
+    if (ready < 0) return -1;
+
+    int count = 0;
+    for (size_t i = 0; i < poll_state->count && count < max_events && ready > 0; i++) {
+        short revents = poll_state->fds[i].revents;
+        if (!revents) continue;
+        ready--;
+
+        u32 flags = 0;
+        if (revents & (POLLIN | POLLHUP)) flags |= AGI_EVENT_READ;
+        if (revents & POLLOUT) flags |= AGI_EVENT_WRITE;
+        if (revents & (POLLERR | POLLNVAL)) flags |= AGI_EVENT_ERROR;
+        events[count].tag = poll_state->tags[i];
+        events[count].events = flags;
+        count++;
+    }
+    return count;
+}
+
+const EventLoopBackend agi_event_backend_poll = {
+    .name = "poll",
+    .create = poll_backend_create,
+    .destroy = poll_backend_destroy,
+    .add = poll_backend_add,
+    .modify = poll_backend_modify,
+    .remove = poll_backend_remove,
+    .wait = poll_backend_wait
+};
@@ -0,0 +1,507 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/font_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agi/clock.h"
+#include "agi/log.h"
+#include "agi/memory.h"
+#include "agi/record_index.h"
+#include "agi/thread.h"
+
+#if defined(AGI_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define PATH_SEPARATOR '\\'
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PATH_SEPARATOR '/'
+#endif
+
+#define CACHE_PATH_SIZE 1024
+#define INDEX_MAGIC "AGFC"
+#define INDEX_VERSION 1
+
+typedef struct {
+    char magic[4];
+    u32 version;
+    u32 count;
+    u32 reserved;
+} IndexHeader;
+
+// Same layout in memory and in index.bin
+typedef struct {
+    char hash[AGI_FONT_HASH_LENGTH];  // not NUL-terminated
+    u64 size;
+    u64 last_used;
+} CacheEntry;
+
+struct FontCache {
+    agi_mutex_t lock;
+    char directory[CACHE_PATH_SIZE];
+    u64 max_bytes;
+    u64 total_bytes;
+
+    CacheEntry *entries;
+    u32 count;
+    u32 capacity;
+    RecordSlots slots;  // by hash
+
+    u64 use_clock;
+    u32 next_temp_id;
+    // Hashes whose tmp/<hash>.part is being downloaded right now
+    char (*claims)[AGI_FONT_HASH_LENGTH];
+    u32 claim_count;
+    u32 claim_capacity;
+    b8 dirty;
+    u64 last_flush_ms;
+};
+
+// --- filesystem helpers ---
+
+static b8 file_size(const char *path, u64 *size) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) return false;
+    *size = ((u64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+#else
+    struct stat info;
+    if (stat(path, &info) != 0) return false;
+    *size = (u64)info.st_size;
+#endif
+    return true;
+}
+
+static b8 make_directory(const char *path) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+static b8 make_directories(const char *path) {
+    char partial[CACHE_PATH_SIZE];
+    size_t length = strlen(path);
+    if (length >= sizeof(partial)) return false;
+    memcpy(partial, path, length + 1);
+
+    for (size_t i = 1; i < length; i++) {
+        if (partial[i] != '/' && partial[i] != '\\') continue;
+        // Skip drive roots like "C:\"
+        if (partial[i - 1] == ':') continue;
+        partial[i] = '\0';
+        make_directory(partial);
+        partial[i] = path[i];
+    }
+    return make_directory(partial);
+}
+
+static b8 has_suffix(const char *name, const char *suffix) {
+    size_t length = strlen(name);
+    size_t suffix_length = strlen(suffix);
+    return length >= suffix_length && strcmp(name + length - suffix_length, suffix) == 0;
+}
+
+// A partial download and its resume record are only worth keeping as a pair
+static b8 resumable_leftover(const char *directory, const char *name) {
+    char path[CACHE_PATH_SIZE];
+    u64 size;
+    if (has_suffix(name, ".part")) {
+        snprintf(path, sizeof(path), "%s%c%s.resume", directory, PATH_SEPARATOR, name);
+        return file_size(path, &size);
+    }
+    if (has_suffix(name, ".part.resume")) {
+        snprintf(path, sizeof(path), "%s%c%.*s", directory, PATH_SEPARATOR, (int)(strlen(name) - strlen(".resume")), name);
+        return file_size(path, &size);
+    }
+    return false;
+}
+
+// Leftovers from downloads interrupted by a crash or shutdown, except the ones
+// the download engine can resume
+static void clear_directory(const char *directory) {
+    char path[CACHE_PATH_SIZE];
+#if defined(AGI_PLATFORM_WINDOWS)
+    WIN32_FIND_DATAA data;
+    snprintf(path, sizeof(path), "%s\\*", directory);
+    HANDLE find = FindFirstFileA(path, &data);
+    if (find == INVALID_HANDLE_VALUE) return;
+    do {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        if (resumable_leftover(directory, data.cFileName)) continue;
+        snprintf(path, sizeof(path), "%s\\%s", directory, data.cFileName);
+        DeleteFileA(path);
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR *dir = opendir(directory);
+    if (!dir) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') continue;
+        if (resumable_leftover(directory, entry->d_name)) continue;
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        remove(path);
+    }
+    closedir(dir);
+#endif
+}
+
+// --- index ---
+
+// The AGI_FONT_HASH_LENGTH characters of a key, as stored in an entry
+static b8 valid_hash_chars(const char *hash) {
+    for (size_t i = 0; i < AGI_FONT_HASH_LENGTH; i++) {
+        char c = hash[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) return false;
+    }
+    return true;
+}
+
+static b8 valid_hash(const char *hash) {
+    return valid_hash_chars(hash) && hash[AGI_FONT_HASH_LENGTH] == '\0';
+}
+
+static b8 entry_matches(const void *entries, u32 index, const void *hash) {
+    return memcmp(((const CacheEntry *)entries)[index].hash, hash, AGI_FONT_HASH_LENGTH) == 0;
+}
+
+static u32 find_entry(const FontCache *cache, const char *hash) {
+    return record_slots_find(&cache->slots, record_key(hash, AGI_FONT_HASH_LENGTH), entry_matches, cache->entries,
+                             hash);
+}
+
+static agi_result_t rebuild_slots(FontCache *cache) {
+    agi_result_t result = record_slots_reset(&cache->slots, cache->count);
+    if (result != AGI_SUCCESS) return result;
+    for (u32 i = 0; i < cache->count; i++) {
+        record_slots_insert(&cache->slots, record_key(cache->entries[i].hash, AGI_FONT_HASH_LENGTH), i);
+    }
+    return AGI_SUCCESS;
+}
+
+static agi_result_t reserve_entries(FontCache *cache, u32 count) {
+    return record_array_reserve((void **)&cache->entries, &cache->capacity, count, sizeof(CacheEntry));
+}
+
+static void object_path(const FontCache *cache, const char *hash, char *path, size_t path_size) {
+    snprintf(path, path_size, "%s%cobjects%c%.*s", cache->directory, PATH_SEPARATOR, PATH_SEPARATOR,
+             AGI_FONT_HASH_LENGTH, hash);
+}
+
+static void remove_entry(FontCache *cache, u32 index) {
+    cache->total_bytes -= cache->entries[index].size;
+    cache->entries[index] = cache->entries[--cache->count];
+    cache->dirty = true;
+}
+
+static void load_index(FontCache *cache) {
+    char path[CACHE_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s%cindex.bin", cache->directory, PATH_SEPARATOR);
+    u64 size;
+    FILE *file = file_size(path, &size) ? fopen(path, "rb") : NULL;
+    if (!file) return;
+
+    // The count is only believed as far as the file backs it
+    IndexHeader header;
+    if (fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, INDEX_MAGIC, 4) == 0 &&
+        header.version == INDEX_VERSION && size >= sizeof(header) + (u64)header.count * sizeof(CacheEntry) &&
+        reserve_entries(cache, header.count) == AGI_SUCCESS &&
+        fread(cache->entries, sizeof(CacheEntry), header.count, file) == header.count) {
+        cache->count = header.count;
+    } else {
+        agi_log_warning("Ignoring unreadable font cache index %s", path);
+        cache->count = 0;
+    }
+    fclose(file);
+
+    // Entry hashes become object paths that eviction removes
+    for (u32 i = 0; i < cache->count; i++) {
+        if (!valid_hash_chars(cache->entries[i].hash)) {
+            agi_log_warning("Ignoring corrupt font cache index %s", path);
+            cache->count = 0;
+        }
+    }
+
+    for (u32 i = 0; i < cache->count; i++) {
+        cache->total_bytes += cache->entries[i].size;
+        if (cache->entries[i].last_used > cache->use_clock) cache->use_clock = cache->entries[i].last_used;
+    }
+}
+
+static agi_result_t write_index(FontCache *cache) {
+    char path[CACHE_PATH_SIZE];
+    char temp_path[CACHE_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s%cindex.bin", cache->directory, PATH_SEPARATOR);
+    snprintf(temp_path, sizeof(temp_path), "%s%cindex.tmp", cache->directory, PATH_SEPARATOR);
+
+    IndexHeader header = {.version = INDEX_VERSION, .count = cache->count};
+    memcpy(header.magic, INDEX_MAGIC, 4);
+    agi_result_t result =
+        record_file_write(path, temp_path, &header, sizeof(header), cache->entries, sizeof(CacheEntry), cache->count);
+    if (result != AGI_SUCCESS) return result;
+    cache->dirty = false;
+    cache->last_flush_ms = agi_clock_now_ms();
+    return AGI_SUCCESS;
+}
+
+// Drops least recently used objects until the cache fits; keep is never evicted
+static void evict(FontCache *cache, u32 keep) {
+    b8 removed = false;
+    while (cache->total_bytes > cache->max_bytes && cache->count > 1) {
+        u32 victim = UINT32_MAX;
+        for (u32 i = 0; i < cache->count; i++) {
+            if (i == keep) continue;
+            if (victim == UINT32_MAX || cache->entries[i].last_used < cache->entries[victim].last_used) victim = i;
+        }
+
+        char path[CACHE_PATH_SIZE];
+        object_path(cache, cache->entries[victim].hash, path, sizeof(path));
+        agi_log_debug("Evicting %s from font cache", path);
+        remove(path);
+        remove_entry(cache, victim);
+        // The last entry moved into the victim's place
+        if (keep == cache->count) keep = victim;
+        removed = true;
+    }
+    if (removed) rebuild_slots(cache);
+}
+
+// --- public API ---
+
+FontCache *font_cache_open(const char *directory, u64 max_bytes) {
+    FontCache *cache = agi_calloc(1, sizeof(FontCache));
+    if (!cache) return NULL;
+
+    if (strlen(directory) + AGI_FONT_HASH_LENGTH + 32 > sizeof(cache->directory)) {
+        agi_log_error("Font cache path too long: %s", directory);
+        agi_free(cache);
+        return NULL;
+    }
+    snprintf(cache->directory, sizeof(cache->directory), "%s", directory);
+    cache->max_bytes = max_bytes ? max_bytes : AGI_FONT_CACHE_DEFAULT_BYTES;
+
+    char path[CACHE_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s%cobjects", directory, PATH_SEPARATOR);
+    b8 created = make_directories(path);
+    snprintf(path, sizeof(path), "%s%ctmp", directory, PATH_SEPARATOR);
+    created = make_directories(path) && created;
+    if (!created) {
+        agi_log_error("Failed to create font cache directory %s", directory);
+        agi_free(cache);
+        return NULL;
+    }
+    clear_directory(path);
+
+    load_index(cache);
+    if (rebuild_slots(cache) != AGI_SUCCESS) {
+        agi_free(cache->entries);
+        agi_free(cache);
+        return NULL;
+    }
+    evict(cache, UINT32_MAX);
+
+    agi_mutex_init(&cache->lock);
+    cache->last_flush_ms = agi_clock_now_ms();
+    agi_log_debug("Font cache %s: %u fonts, %llu bytes", directory, cache->count,
+                  (unsigned long long)cache->total_bytes);
+    return cache;
+}
+
+void font_cache_close(FontCache *cache) {
+    if (!cache) return;
+    if (cache->dirty && write_index(cache) != AGI_SUCCESS) {
+        agi_log_error("Failed to write font cache index");
+    }
+    agi_mutex_destroy(&cache->lock);
+    agi_free(cache->claims);
+    record_slots_free(&cache->slots);
+    agi_free(cache->entries);
+    agi_free(cache);
+}
+
+b8 font_cache_lookup(FontCache *cache, const char *hash, char *path, size_t path_size) {
+    if (!valid_hash(hash)) return false;
+
+    agi_mutex_lock(&cache->lock);
+    u32 index = find_entry(cache, hash);
+    b8 found = false;
+    if (index != UINT32_MAX) {
+        object_path(cache, hash, path, path_size);
+        u64 size;
+        if (file_size(path, &size) && size == cache->entries[index].size) {
+            cache->entries[index].last_used = ++cache->use_clock;
+            cache->dirty = true;
+            found = true;
+        } else {
+            // Deleted or replaced behind our back: forget it
+            remove_entry(cache, index);
+            rebuild_slots(cache);
+        }
+    }
+    agi_mutex_unlock(&cache->lock);
+    return found;
+}
+
+static u32 find_claim(const FontCache *cache, const char *hash) {
+    for (u32 i = 0; i < cache->claim_count; i++) {
+        if (memcmp(cache->claims[i], hash, AGI_FONT_HASH_LENGTH) == 0) return i;
+    }
+    return UINT32_MAX;
+}
+
+static b8 add_claim(FontCache *cache, const char *hash) {
+    if (cache->claim_count == cache->claim_capacity) {
+        u32 capacity = cache->claim_capacity ? cache->claim_capacity * 2 : 8;
+        void *claims = agi_realloc(cache->claims, (size_t)capacity * sizeof(*cache->claims));
+        if (!claims) return false;
+        cache->claims = claims;
+        cache->claim_capacity = capacity;
+    }
+    memcpy(cache->claims[cache->claim_count++], hash, AGI_FONT_HASH_LENGTH);
+    return true;
+}
+
+static void remove_claim(FontCache *cache, u32 index) {
+    memcpy(cache->claims[index], cache->claims[--cache->claim_count], AGI_FONT_HASH_LENGTH);
+}
+
+static void drop_claim(FontCache *cache, const char *hash, const char *temp_path) {
+    u32 index = find_claim(cache, hash);
+    if (index == UINT32_MAX || !has_suffix(temp_path, ".part")) return;
+    // Only the claimant's path is tmp/<hash>.part; other downloads of the hash carry an id
+    const char *name = temp_path + strlen(temp_path) - AGI_FONT_HASH_LENGTH - strlen(".part");
+    if (name < temp_path || memcmp(name, hash, AGI_FONT_HASH_LENGTH) != 0) return;
+    if (name > temp_path && name[-1] != '/' && name[-1] != '\\') return;
+    remove_claim(cache, index);
+}
+
+agi_result_t font_cache_temp_path(FontCache *cache, const char *hash, char *path, size_t path_size, b8 *resumable) {
+    if (!valid_hash(hash)) return AGI_ERROR_INVALID_ARGUMENT;
+
+    agi_mutex_lock(&cache->lock);
+    *resumable = find_claim(cache, hash) == UINT32_MAX && add_claim(cache, hash);
+    u32 id = *resumable ? 0 : ++cache->next_temp_id;
+    agi_mutex_unlock(&cache->lock);
+
+    int length;
+    if (*resumable) {
+        length = snprintf(path, path_size, "%s%ctmp%c%.*s.part", cache->directory, PATH_SEPARATOR, PATH_SEPARATOR,
+                          AGI_FONT_HASH_LENGTH, hash);
+    } else {
+        length = snprintf(path, path_size, "%s%ctmp%c%.*s.%u.part", cache->directory, PATH_SEPARATOR,
+                          PATH_SEPARATOR, AGI_FONT_HASH_LENGTH, hash, id);
+    }
+    if (length > 0 && (size_t)length < path_size) return AGI_SUCCESS;
+    if (*resumable) {
+        agi_mutex_lock(&cache->lock);
+        remove_claim(cache, find_claim(cache, hash));
+        agi_mutex_unlock(&cache->lock);
+    }
+    return AGI_ERROR_INVALID_ARGUMENT;
+}
+
+void font_cache_release(FontCache *cache, const char *hash, const char *temp_path) {
+    if (!valid_hash(hash)) return;
+    agi_mutex_lock(&cache->lock);
+    drop_claim(cache, hash, temp_path);
+    agi_mutex_unlock(&cache->lock);
+}
+
+agi_result_t font_cache_commit(FontCache *cache, const char *hash, const char *temp_path, char *path, size_t path_size) {
+    if (!valid_hash(hash)) return AGI_ERROR_INVALID_ARGUMENT;
+
+    u64 size;
+    if (!file_size(temp_path, &size)) {
+        font_cache_release(cache, hash, temp_path);
+        return AGI_ERROR_IO;
+    }
+
+    agi_mutex_lock(&cache->lock);
+    agi_result_t result = AGI_SUCCESS;
+    drop_claim(cache, hash, temp_path);
+    object_path(cache, hash, path, path_size);
+    if (!record_file_replace(temp_path, path)) {
+        agi_log_error("Failed to move %s into font cache", temp_path);
+        remove(temp_path);
+        result = AGI_ERROR_IO;
+        goto done;
+    }
+
+    u32 index = find_entry(cache, hash);
+    if (index != UINT32_MAX) {
+        cache->total_bytes -= cache->entries[index].size;
+    } else {
+        result = reserve_entries(cache, cache->count + 1);
+        if (result != AGI_SUCCESS) goto done;
+        index = cache->count++;
+        memcpy(cache->entries[index].hash, hash, AGI_FONT_HASH_LENGTH);
+        result = rebuild_slots(cache);
+        if (result != AGI_SUCCESS) goto done;
+    }
+    cache->entries[index].size = size;
+    cache->entries[index].last_used = ++cache->use_clock;
+    cache->total_bytes += size;
+    cache->dirty = true;
+
+    evict(cache, index);
+    if (agi_clock_now_ms() - cache->last_flush_ms >= AGI_RECORD_INDEX_FLUSH_INTERVAL_MS) {
+        write_index(cache);
+    }
+
+done:
+    agi_mutex_unlock(&cache->lock);
+    return result;
+}
+
+agi_result_t font_cache_flush(FontCache *cache) {
+    agi_mutex_lock(&cache->lock);
+    agi_result_t result = cache->dirty ? write_index(cache) : AGI_SUCCESS;
+    agi_mutex_unlock(&cache->lock);
+    return result;
+}
+
+u64 font_cache_size(FontCache *cache) {
+    agi_mutex_lock(&cache->lock);
+    u64 size = cache->total_bytes;
+    agi_mutex_unlock(&cache->lock);
+    return size;
+}
+
+u32 font_cache_count(FontCache *cache) {
+    agi_mutex_lock(&cache->lock);
+    u32 count = cache->count;
+    agi_mutex_unlock(&cache->lock);
+    return count;
+}
+
+agi_result_t font_cache_default_directory(char *directory, size_t size) {
+    const char *base;
+    const char *suffix;
+#if defined(AGI_PLATFORM_WINDOWS)
+    base = getenv("LOCALAPPDATA");
+    suffix = "\\agi\\fonts";
+#elif defined(AGI_PLATFORM_APPLE)
+    base = getenv("HOME");
+    suffix = "/Library/Caches/agi/fonts";
+#else
+    base = getenv("XDG_CACHE_HOME");
+    suffix = "/agi/fonts";
+    if (!base || !*base) {
+        base = getenv("HOME");
+        suffix = "/.cache/agi/fonts";
+    }
+#endif
+    if (!base || !*base) return AGI_ERROR_IO;
+
+    int length = snprintf(directory, size, "%s%s", base, suffix);
+    return length > 0 && (size_t)length < size ? AGI_SUCCESS : AGI_ERROR_INVALID_ARGUMENT;
+}
@@ -0,0 +1,586 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/font_inventory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agi/clock.h"
+#include "agi/log.h"
+#include "agi/memory.h"
+#include "agi/record_index.h"
+#include "agi/thread.h"
+
+#if defined(AGI_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define PATH_SEPARATOR '\\'
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(AGI_PLATFORM_LINUX)
+#include <sys/inotify.h>
+#endif
+#define PATH_SEPARATOR '/'
+#endif
+
+#define INVENTORY_PATH_SIZE 1024
+#define INDEX_MAGIC "AGFI"
+#define INDEX_VERSION 1
+#define WATCH_BUFFER_SIZE (16 * 1024)
+
+typedef struct {
+    char magic[4];
+    u32 version;
+    u32 count;
+    u32 record_size;
+    u64 directory_mtime_ns;  // font directory as of the last write
+} IndexHeader;
+
+// Written to the index file as is
+typedef struct {
+    char hash[AGI_FONT_HASH_LENGTH];             // not NUL-terminated
+    char family[AGI_FONT_FAMILY_SIZE - 1];       // NUL-padded
+    char style[AGI_FONT_FAMILY_SIZE - 1];        // NUL-padded
+    char file_name[AGI_FONT_FILE_NAME_SIZE];     // NUL-terminated
+    u64 size;
+    u64 mtime_ns;
+} InventoryRecord;
+
+struct FontInventory {
+    agi_mutex_t lock;
+    char index_path[INVENTORY_PATH_SIZE];  // empty = memory only
+    char directory[INVENTORY_PATH_SIZE];
+
+    InventoryRecord *records;
+    u32 count;
+    u32 capacity;
+    RecordSlots hash_slots;
+    RecordSlots file_slots;
+    b8 dirty;
+    u64 last_flush_ms;
+
+    // Directory watcher
+    agi_thread_t watcher;
+    b8 watching;
+    volatile b8 stopping;
+#if defined(AGI_PLATFORM_WINDOWS)
+    HANDLE directory_handle;
+#else
+    int watch_fd;
+    int wake_pipe[2];
+#endif
+};
+
+// --- filesystem helpers ---
+
+static b8 file_stat(const char *path, u64 *size, u64 *mtime_ns) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) return false;
+    *size = ((u64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    // FILETIME counts 100 ns intervals
+    *mtime_ns = (((u64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime) * 100;
+#else
+    struct stat info;
+    if (stat(path, &info) != 0) return false;
+    *size = (u64)info.st_size;
+#if defined(AGI_PLATFORM_APPLE)
+    *mtime_ns = (u64)info.st_mtimespec.tv_sec * 1000000000ull + (u64)info.st_mtimespec.tv_nsec;
+#else
+    *mtime_ns = (u64)info.st_mtim.tv_sec * 1000000000ull + (u64)info.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+static u64 directory_mtime(const FontInventory *inventory) {
+    u64 size = 0;
+    u64 mtime_ns = 0;
+    file_stat(inventory->directory, &size, &mtime_ns);
+    return mtime_ns;
+}
+
+// --- records ---
+
+static void copy_field(char *field, size_t field_size, const char *value) {
+    memset(field, 0, field_size);
+    size_t length = strlen(value);
+    memcpy(field, value, MIN(length, field_size));
+}
+
+static void to_entry(const InventoryRecord *record, FontInventoryEntry *entry) {
+    memcpy(entry->hash, record->hash, AGI_FONT_HASH_LENGTH);
+    entry->hash[AGI_FONT_HASH_LENGTH] = '\0';
+    snprintf(entry->family, sizeof(entry->family), "%.*s", (int)sizeof(record->family), record->family);
+    snprintf(entry->style, sizeof(entry->style), "%.*s", (int)sizeof(record->style), record->style);
+    snprintf(entry->file_name, sizeof(entry->file_name), "%s", record->file_name);
+    entry->size = record->size;
+    entry->mtime_ns = record->mtime_ns;
+}
+
+static u32 hash_key(const char *hash) {
+    return record_key(hash, AGI_FONT_HASH_LENGTH);
+}
+
+static u32 file_key(const char *file_name) {
+    return record_key(file_name, AGI_FONT_FILE_NAME_SIZE);
+}
+
+static b8 hash_matches(const void *records, u32 index, const void *hash) {
+    return memcmp(((const InventoryRecord *)records)[index].hash, hash, AGI_FONT_HASH_LENGTH) == 0;
+}
+
+static b8 file_matches(const void *records, u32 index, const void *file_name) {
+    return strcmp(((const InventoryRecord *)records)[index].file_name, file_name) == 0;
+}
+
+static u32 find_hash(const FontInventory *inventory, const char *hash) {
+    return record_slots_find(&inventory->hash_slots, hash_key(hash), hash_matches, inventory->records, hash);
+}
+
+static u32 find_file(const FontInventory *inventory, const char *file_name) {
+    return record_slots_find(&inventory->file_slots, file_key(file_name), file_matches, inventory->records,
+                             file_name);
+}
+
+static void insert_slots(FontInventory *inventory, u32 index) {
+    record_slots_insert(&inventory->hash_slots, hash_key(inventory->records[index].hash), index);
+    record_slots_insert(&inventory->file_slots, file_key(inventory->records[index].file_name), index);
+}
+
+static agi_result_t rebuild_slots(FontInventory *inventory) {
+    if (record_slots_reset(&inventory->hash_slots, inventory->count) != AGI_SUCCESS ||
+        record_slots_reset(&inventory->file_slots, inventory->count) != AGI_SUCCESS) {
+        record_slots_free(&inventory->hash_slots);
+        record_slots_free(&inventory->file_slots);
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+    for (u32 i = 0; i < inventory->count; i++) {
+        insert_slots(inventory, i);
+    }
+    return AGI_SUCCESS;
+}
+
+static agi_result_t reserve_records(FontInventory *inventory, u32 count) {
+    return record_array_reserve((void **)&inventory->records, &inventory->capacity, count, sizeof(InventoryRecord));
+}
+
+// Slots must be rebuilt afterwards
+static void remove_record(FontInventory *inventory, u32 index) {
+    inventory->records[index] = inventory->records[--inventory->count];
+    inventory->dirty = true;
+}
+
+static void record_path(const FontInventory *inventory, const InventoryRecord *record, char *path, size_t path_size) {
+    snprintf(path, path_size, "%s%c%s", inventory->directory, PATH_SEPARATOR, record->file_name);
+}
+
+// A tracked font is still ours only while its file is exactly what we installed
+static b8 record_current(const FontInventory *inventory, const InventoryRecord *record) {
+    char path[INVENTORY_PATH_SIZE];
+    u64 size;
+    u64 mtime_ns;
+    record_path(inventory, record, path, sizeof(path));
+    return file_stat(path, &size, &mtime_ns) && size == record->size && mtime_ns == record->mtime_ns;
+}
+
+static void verify_all(FontInventory *inventory) {
+    u32 dropped = 0;
+    for (u32 i = 0; i < inventory->count;) {
+        if (record_current(inventory, &inventory->records[i])) {
+            i++;
+            continue;
+        }
+        remove_record(inventory, i);
+        dropped++;
+    }
+    if (dropped > 0) {
+        rebuild_slots(inventory);
+        agi_log_info("%u installed fonts were removed or replaced outside the agent", dropped);
+    }
+}
+
+// --- index file ---
+
+// The file is mapped rather than read: the records need no parsing, so loading
+// is one copy out of the page cache
+static void load_index(FontInventory *inventory) {
+    const u8 *data = NULL;
+    u64 size = 0;
+#if defined(AGI_PLATFORM_WINDOWS)
+    HANDLE file = CreateFileA(inventory->index_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE) return;
+    LARGE_INTEGER file_size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        size = (u64)file_size.QuadPart;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    int fd = open(inventory->index_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        size = (u64)info.st_size;
+        void *mapped = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) data = mapped;
+    }
+#endif
+
+    IndexHeader header;
+    b8 valid = data && size >= sizeof(header);
+    if (valid) {
+        memcpy(&header, data, sizeof(header));
+        valid = memcmp(header.magic, INDEX_MAGIC, 4) == 0 && header.version == INDEX_VERSION &&
+                header.record_size == sizeof(InventoryRecord) &&
+                size >= sizeof(header) + (u64)header.count * sizeof(InventoryRecord) &&
+                reserve_records(inventory, header.count) == AGI_SUCCESS;
+    }
+    if (valid) {
+        memcpy(inventory->records, data + sizeof(header), (size_t)header.count * sizeof(InventoryRecord));
+        inventory->count = header.count;
+        for (u32 i = 0; i < inventory->count; i++) {
+            inventory->records[i].file_name[AGI_FONT_FILE_NAME_SIZE - 1] = '\0';
+        }
+    } else if (size > 0) {
+        agi_log_warning("Ignoring unreadable font inventory %s", inventory->index_path);
+    }
+
+#if defined(AGI_PLATFORM_WINDOWS)
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    if (data) munmap((void *)data, (size_t)size);
+    close(fd);
+#endif
+
+    // Nothing was added, removed or renamed while we were away: trust the records
+    if (valid && header.directory_mtime_ns != directory_mtime(inventory)) {
+        verify_all(inventory);
+    }
+}
+
+static agi_result_t write_index(FontInventory *inventory) {
+    inventory->last_flush_ms = agi_clock_now_ms();
+    if (!inventory->index_path[0]) {
+        inventory->dirty = false;
+        return AGI_SUCCESS;
+    }
+
+    char temp_path[INVENTORY_PATH_SIZE + 8];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", inventory->index_path);
+    IndexHeader header = {
+        .version = INDEX_VERSION,
+        .count = inventory->count,
+        .record_size = sizeof(InventoryRecord),
+        .directory_mtime_ns = directory_mtime(inventory)
+    };
+    memcpy(header.magic, INDEX_MAGIC, 4);
+    agi_result_t result = record_file_write(inventory->index_path, temp_path, &header, sizeof(header),
+                                            inventory->records, sizeof(InventoryRecord), inventory->count);
+    if (result != AGI_SUCCESS) return result;
+    inventory->dirty = false;
+    return AGI_SUCCESS;
+}
+
+static void maybe_flush(FontInventory *inventory) {
+    if (inventory->dirty && agi_clock_now_ms() - inventory->last_flush_ms >= AGI_RECORD_INDEX_FLUSH_INTERVAL_MS) {
+        write_index(inventory);
+    }
+}
+
+// --- watcher ---
+
+// Something happened to file_name in the font directory
+static void on_file_changed(FontInventory *inventory, const char *file_name) {
+    // Staging files and the like
+    if (file_name[0] == '.') return;
+
+    agi_mutex_lock(&inventory->lock);
+    u32 index = find_file(inventory, file_name);
+    if (index != UINT32_MAX && !record_current(inventory, &inventory->records[index])) {
+        agi_log_info("Installed font %s was removed or replaced outside the agent", file_name);
+        remove_record(inventory, index);
+        rebuild_slots(inventory);
+        maybe_flush(inventory);
+    }
+    agi_mutex_unlock(&inventory->lock);
+}
+
+static void on_events_lost(FontInventory *inventory) {
+    agi_log_warning("Font directory events overflowed, rechecking every installed font");
+    agi_mutex_lock(&inventory->lock);
+    verify_all(inventory);
+    agi_mutex_unlock(&inventory->lock);
+}
+
+#if defined(AGI_PLATFORM_WINDOWS)
+static void watcher_main(void *arg) {
+    FontInventory *inventory = arg;
+    DWORD *buffer = agi_malloc(WATCH_BUFFER_SIZE);  // entries must be DWORD-aligned
+    if (!buffer) return;
+
+    while (!inventory->stopping) {
+        DWORD length = 0;
+        // Blocks until something changes; shutdown cancels it with CancelSynchronousIo
+        if (!ReadDirectoryChangesW(inventory->directory_handle, buffer, WATCH_BUFFER_SIZE, FALSE,
+                                   FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
+                                   &length, NULL, NULL)) {
+            break;
+        }
+        if (length == 0) {
+            on_events_lost(inventory);
+            continue;
+        }
+
+        const u8 *cursor = (const u8 *)buffer;
+        for (;;) {
+            const FILE_NOTIFY_INFORMATION *info = (const FILE_NOTIFY_INFORMATION *)cursor;
+            char file_name[AGI_FONT_FILE_NAME_SIZE];
+            int converted = WideCharToMultiByte(CP_UTF8, 0, info->FileName, (int)(info->FileNameLength / sizeof(WCHAR)),
+                                                file_name, sizeof(file_name) - 1, NULL, NULL);
+            if (converted > 0) {
+                file_name[converted] = '\0';
+                on_file_changed(inventory, file_name);
+            }
+            if (info->NextEntryOffset == 0) break;
+            cursor += info->NextEntryOffset;
+        }
+    }
+    agi_free(buffer);
+}
+
+static b8 watch_start(FontInventory *inventory) {
+    inventory->directory_handle = CreateFileA(inventory->directory, FILE_LIST_DIRECTORY,
+                                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                              OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (inventory->directory_handle == INVALID_HANDLE_VALUE) return false;
+    if (agi_thread_create(&inventory->watcher, watcher_main, inventory, 0) != AGI_SUCCESS) {
+        CloseHandle(inventory->directory_handle);
+        return false;
+    }
+    return true;
+}
+
+static void watch_stop(FontInventory *inventory) {
+    inventory->stopping = true;
+    // The cancel only lands once the thread is inside the call, so keep at it
+    while (WaitForSingleObject(inventory->watcher, 10) == WAIT_TIMEOUT) {
+        CancelSynchronousIo(inventory->watcher);
+    }
+    agi_thread_join(inventory->watcher);
+    CloseHandle(inventory->directory_handle);
+}
+#elif defined(AGI_PLATFORM_LINUX)
+static void watcher_main(void *arg) {
+    FontInventory *inventory = arg;
+    union {
+        struct inotify_event event;
+        char bytes[WATCH_BUFFER_SIZE];
+    } buffer;
+    struct pollfd fds[2] = {{.fd = inventory->watch_fd, .events = POLLIN}, {.fd = inventory->wake_pipe[0], .events = POLLIN}};
+
+    while (!inventory->stopping) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+
+        ssize_t length = read(inventory->watch_fd, buffer.bytes, sizeof(buffer.bytes));
+        if (length <= 0) continue;
+        for (ssize_t offset = 0; offset < length;) {
+            const struct inotify_event *event = (const struct inotify_event *)(buffer.bytes + offset);
+            if (event->mask & IN_Q_OVERFLOW) {
+                on_events_lost(inventory);
+            } else if (event->len > 0) {
+                on_file_changed(inventory, event->name);
+            }
+            offset += (ssize_t)(sizeof(struct inotify_event) + event->len);
+        }
+    }
+}
+
+static b8 watch_start(FontInventory *inventory) {
+    inventory->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inventory->watch_fd < 0) return false;
+    u32 mask = IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB;
+    if (inotify_add_watch(inventory->watch_fd, inventory->directory, mask) < 0 || pipe(inventory->wake_pipe) != 0) {
+        close(inventory->watch_fd);
+        return false;
+    }
+    if (agi_thread_create(&inventory->watcher, watcher_main, inventory, 0) != AGI_SUCCESS) {
+        close(inventory->wake_pipe[0]);
+        close(inventory->wake_pipe[1]);
+        close(inventory->watch_fd);
+        return false;
+    }
+    return true;
+}
+
+static void watch_stop(FontInventory *inventory) {
+    inventory->stopping = true;
+    char wake = 1;
+    while (write(inventory->wake_pipe[1], &wake, 1) < 0 && errno == EINTR) {
+    }
+    agi_thread_join(inventory->watcher);
+    close(inventory->wake_pipe[0]);
+    close(inventory->wake_pipe[1]);
+    close(inventory->watch_fd);
+}
+#else
+// No watcher here; changes made outside the agent are caught at the next startup
+static b8 watch_start(FontInventory *inventory) {
+    (void)inventory;
+    return false;
+}
+
+static void watch_stop(FontInventory *inventory) {
+    (void)inventory;
+}
+#endif
+
+// --- public API ---
+
+FontInventory *font_inventory_open(const char *index_path, const char *font_directory) {
+    FontInventory *inventory = agi_calloc(1, sizeof(FontInventory));
+    if (!inventory) return NULL;
+
+    if (strlen(font_directory) + AGI_FONT_FILE_NAME_SIZE + 2 > sizeof(inventory->directory) ||
+        (index_path && strlen(index_path) >= sizeof(inventory->index_path))) {
+        agi_log_error("Font inventory path too long");
+        agi_free(inventory);
+        return NULL;
+    }
+    snprintf(inventory->directory, sizeof(inventory->directory), "%s", font_directory);
+    if (index_path) snprintf(inventory->index_path, sizeof(inventory->index_path), "%s", index_path);
+
+    u64 started_ns = agi_clock_now_ns();
+    if (inventory->index_path[0]) load_index(inventory);
+    if (rebuild_slots(inventory) != AGI_SUCCESS) {
+        agi_free(inventory->records);
+        agi_free(inventory);
+        return NULL;
+    }
+
+    agi_mutex_init(&inventory->lock);
+    inventory->last_flush_ms = agi_clock_now_ms();
+    inventory->watching = watch_start(inventory);
+    if (!inventory->watching) {
+        agi_log_warning("Not watching %s, outside changes show up after a restart", font_directory);
+    }
+    agi_log_debug("Font inventory: %u fonts in %s, loaded in %llu us", inventory->count, font_directory,
+                  (unsigned long long)((agi_clock_now_ns() - started_ns) / 1000));
+    return inventory;
+}
+
+void font_inventory_close(FontInventory *inventory) {
+    if (!inventory) return;
+    if (inventory->watching) watch_stop(inventory);
+    if (inventory->dirty && write_index(inventory) != AGI_SUCCESS) {
+        agi_log_error("Failed to write font inventory");
+    }
+    agi_mutex_destroy(&inventory->lock);
+    record_slots_free(&inventory->hash_slots);
+    record_slots_free(&inventory->file_slots);
+    agi_free(inventory->records);
+    agi_free(inventory);
+}
+
+agi_result_t font_inventory_record(FontInventory *inventory, const char *hash, const char *family, const char *style,
+                                   const char *file_name) {
+    if (strlen(hash) != AGI_FONT_HASH_LENGTH || strlen(file_name) >= AGI_FONT_FILE_NAME_SIZE) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    InventoryRecord record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.hash, hash, AGI_FONT_HASH_LENGTH);
+    copy_field(record.family, sizeof(record.family), family);
+    copy_field(record.style, sizeof(record.style), style);
+    copy_field(record.file_name, sizeof(record.file_name), file_name);
+    char path[INVENTORY_PATH_SIZE];
+    record_path(inventory, &record, path, sizeof(path));
+    if (!file_stat(path, &record.size, &record.mtime_ns)) return AGI_ERROR_IO;
+
+    agi_mutex_lock(&inventory->lock);
+    agi_result_t result = AGI_SUCCESS;
+    u32 index = find_file(inventory, file_name);
+    if (index != UINT32_MAX) {
+        // Reinstalled under the same name, possibly a different font
+        inventory->records[index] = record;
+        result = rebuild_slots(inventory);
+    } else if ((result = reserve_records(inventory, inventory->count + 1)) == AGI_SUCCESS) {
+        inventory->records[inventory->count++] = record;
+        if (!record_slots_room(&inventory->file_slots, inventory->count)) {
+            result = rebuild_slots(inventory);
+        } else {
+            insert_slots(inventory, inventory->count - 1);
+        }
+    }
+    inventory->dirty = true;
+    maybe_flush(inventory);
+    agi_mutex_unlock(&inventory->lock);
+    return result;
+}
+
+void font_inventory_forget(FontInventory *inventory, const char *file_name) {
+    agi_mutex_lock(&inventory->lock);
+    u32 index = find_file(inventory, file_name);
+    if (index != UINT32_MAX) {
+        remove_record(inventory, index);
+        rebuild_slots(inventory);
+        maybe_flush(inventory);
+    }
+    agi_mutex_unlock(&inventory->lock);
+}
+
+b8 font_inventory_find(FontInventory *inventory, const char *hash, FontInventoryEntry *entry) {
+    if (strlen(hash) != AGI_FONT_HASH_LENGTH) return false;
+    agi_mutex_lock(&inventory->lock);
+    u32 index = find_hash(inventory, hash);
+    if (index != UINT32_MAX && entry) to_entry(&inventory->records[index], entry);
+    agi_mutex_unlock(&inventory->lock);
+    return index != UINT32_MAX;
+}
+
+b8 font_inventory_find_file(FontInventory *inventory, const char *file_name, FontInventoryEntry *entry) {
+    agi_mutex_lock(&inventory->lock);
+    u32 index = find_file(inventory, file_name);
+    if (index != UINT32_MAX && entry) to_entry(&inventory->records[index], entry);
+    agi_mutex_unlock(&inventory->lock);
+    return index != UINT32_MAX;
+}
+
+u32 font_inventory_count(FontInventory *inventory) {
+    agi_mutex_lock(&inventory->lock);
+    u32 count = inventory->count;
+    agi_mutex_unlock(&inventory->lock);
+    return count;
+}
+
+void font_inventory_visit(FontInventory *inventory, FontInventoryVisitor visit, void *userdata) {
+    agi_mutex_lock(&inventory->lock);
+    for (u32 i = 0; i < inventory->count; i++) {
+        FontInventoryEntry entry;
+        to_entry(&inventory->records[i], &entry);
+        visit(&entry, userdata);
+    }
+    agi_mutex_unlock(&inventory->lock);
+}
+
+agi_result_t font_inventory_flush(FontInventory *inventory) {
+    agi_mutex_lock(&inventory->lock);
+    agi_result_t result = inventory->dirty ? write_index(inventory) : AGI_SUCCESS;
+    agi_mutex_unlock(&inventory->lock);
+    return result;
+}
@@ -0,0 +1,488 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/font_jobs.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "agi/clock.h"
+#include "agi/download.h"
+#include "agi/fonts.h"
+#include "agi/log.h"
+#include "agi/memory.h"
+#include "agi/trace.h"
+
+typedef struct {
+    char font_hash[65];
+    char font_name[33];
+    char font_style[33];
+    char font_extension[33];
+    b8 install;
+} FontCommand;
+
+typedef struct FontBatchJob FontBatchJob;
+typedef struct FontInstallJob FontInstallJob;
+
+struct FontInstallJob {
+    WorkerJob job;
+    WorkerPool *pool;
+    TcpClient *client;
+    FontCommand command;
+    agi_result_t result;
+    FontInstallJob *next_waiter;
+    FontBatchJob *batch;  // set when this is a batch entry that waited on another job
+    u32 index;
+    u64 trace_id;     // the batch's for its entries
+    u64 received_ns;
+    u64 queued_ns;    // submitted to the pool, or attached to a flight
+};
+
+typedef enum {
+    BATCH_ENTRY_INVALID,   // didn't decode
+    BATCH_ENTRY_RUN,       // run by the batch job itself
+    BATCH_ENTRY_ATTACHED,  // waits on a job already working on the same font
+} batch_entry_state_t;
+
+struct FontBatchJob {
+    WorkerJob job;
+    WorkerPool *pool;
+    TcpClient *client;
+    u64 job_id;
+    u32 count;
+    FontCommand *commands;
+    u8 *states;
+    agi_result_t *results;
+    u32 outstanding;  // attached entries still waiting
+    b8 ran;
+    b8 cancelled;
+    u64 trace_id;
+    u64 received_ns;
+    u64 queued_ns;
+};
+
+// Single flight: while a job works on a font hash, later commands for that hash
+// wait on it instead of downloading and installing it again. A waiter asking for
+// exactly the same thing gets the job's result; any other command for the hash
+// is started once the job is done, when the font is in the cache. Commands for
+// one hash therefore never run at the same time and race on its temp files.
+// Loop thread only.
+#define FLIGHT_BUCKETS 256
+
+typedef struct FontFlight {
+    struct FontFlight *next;
+    const void *owner;  // the job that lands it
+    char hash[AGI_FONT_HASH_LENGTH + 1];
+    FontInstallJob *waiters;
+    FontInstallJob **waiters_tail;
+} FontFlight;
+
+static FontFlight *flights[FLIGHT_BUCKETS];
+
+static void batch_entry_done(FontBatchJob *batch_job, u32 index, agi_result_t result, b8 cancelled);
+static agi_result_t install_job_start(FontInstallJob *install_job);
+
+static void font_command_copy(FontCommand *command, const FontInstallRequest *request) {
+    wire_string_copy(request->font_hash, command->font_hash, sizeof(command->font_hash));
+    wire_string_copy(request->font_name, command->font_name, sizeof(command->font_name));
+    wire_string_copy(request->font_style, command->font_style, sizeof(command->font_style));
+    wire_string_copy(request->font_extension, command->font_extension, sizeof(command->font_extension));
+    command->install = request->install;
+}
+
+static b8 font_command_equals(const FontCommand *a, const FontCommand *b) {
+    return a->install == b->install && strcmp(a->font_name, b->font_name) == 0 && strcmp(a->font_style, b->font_style) == 0 &&
+           strcmp(a->font_extension, b->font_extension) == 0;
+}
+
+static agi_result_t font_command_run(const FontCommand *command) {
+    if (command->install) {
+        return install_font(command->font_hash, command->font_name, command->font_style, command->font_extension);
+    }
+    // Reconcile deltas remove fonts by hash, the server may not know their names
+    if (!command->font_name[0]) {
+        return uninstall_font_by_hash(command->font_hash);
+    }
+    return uninstall_font(command->font_name, command->font_style, command->font_extension);
+}
+
+static void send_install_response(TcpClient *client, const FontCommand *command, agi_result_t result) {
+    char message[256];
+    if (result == AGI_SUCCESS) {
+        snprintf(message, sizeof(message), "Font %s %s successfully", command->font_name,
+                 command->install ? "installed" : "uninstalled");
+    } else {
+        snprintf(message, sizeof(message), "Failed to %s font %s", command->install ? "install" : "uninstall",
+                 command->font_name);
+    }
+    protocol_send_font_install_response(client, result == AGI_SUCCESS, message);
+}
+
+// --- single flight ---
+
+// Keyed like the cache, so spellings of one hash that sanitize alike share a flight
+static FontFlight **flight_slot(const FontCommand *command, char key[AGI_FONT_HASH_LENGTH + 1]) {
+    font_sanitize_hash(command->font_hash, key);
+    u32 hash = 0x811C9DC5;
+    for (const char *c = key; *c; c++) {
+        hash = (hash ^ (u8)*c) * 0x01000193;
+    }
+    FontFlight **slot = &flights[hash % FLIGHT_BUCKETS];
+    while (*slot && strcmp((*slot)->hash, key) != 0) {
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+// Returns false if the command had to be left untracked (out of memory); it then simply runs
+static b8 flight_begin(FontFlight **slot, const char *key, const void *owner) {
+    FontFlight *flight = agi_calloc(1, sizeof(FontFlight));
+    if (!flight) return false;
+    flight->owner = owner;
+    memcpy(flight->hash, key, sizeof(flight->hash));
+    flight->waiters_tail = &flight->waiters;
+    *slot = flight;
+    return true;
+}
+
+static void flight_attach(FontFlight *flight, FontInstallJob *install_job) {
+    install_job->queued_ns = agi_clock_now_ns();
+    install_job->next_waiter = NULL;
+    *flight->waiters_tail = install_job;
+    flight->waiters_tail = &install_job->next_waiter;
+}
+
+static void install_job_finish(FontInstallJob *install_job, agi_result_t result, b8 cancelled) {
+    if (install_job->batch) {
+        batch_entry_done(install_job->batch, install_job->index, result, cancelled);
+    } else if (!cancelled) {
+        u64 started_ns = agi_clock_now_ns();
+        send_install_response(install_job->client, &install_job->command, result);
+        trace_record(install_job->trace_id, "respond", started_ns, agi_clock_now_ns());
+        trace_finish_request(install_job->trace_id, install_job->command.install ? "font_install" : "font_uninstall",
+                             install_job->received_ns);
+        agi_log_debug("Font install response sent");
+    }
+    agi_free(install_job);
+}
+
+// owner finished command with result. Unless replay is false (the owner never
+// ran), waiters wanting something else are started now, in arrival order.
+static void flight_land(const void *owner, const FontCommand *command, agi_result_t result, b8 replay, b8 cancelled) {
+    char key[AGI_FONT_HASH_LENGTH + 1];
+    FontFlight **slot = flight_slot(command, key);
+    FontFlight *flight = *slot;
+    if (!flight || flight->owner != owner) return;
+    *slot = flight->next;
+
+    FontInstallJob *waiter = flight->waiters;
+    agi_free(flight);
+    while (waiter) {
+        FontInstallJob *next = waiter->next_waiter;
+        trace_record(waiter->trace_id, "flight_wait", waiter->queued_ns, agi_clock_now_ns());
+        if (!replay || font_command_equals(command, &waiter->command)) {
+            install_job_finish(waiter, result, cancelled);
+        } else {
+            agi_result_t started = install_job_start(waiter);
+            if (started != AGI_SUCCESS) install_job_finish(waiter, started, false);
+        }
+        waiter = next;
+    }
+}
+
+// --- single font ---
+
+static void install_job_run(WorkerJob *job) {
+    FontInstallJob *install_job = job->userdata;
+    trace_record(install_job->trace_id, "queue_wait", install_job->queued_ns, agi_clock_now_ns());
+    trace_set_current(install_job->trace_id);
+    install_job->result = font_command_run(&install_job->command);
+    trace_set_current(0);
+}
+
+static void install_job_complete(WorkerJob *job) {
+    FontInstallJob *install_job = job->userdata;
+    agi_result_t result = job->cancelled ? AGI_ERROR_BUSY : install_job->result;
+    flight_land(install_job, &install_job->command, result, !job->cancelled, job->cancelled);
+    install_job_finish(install_job, result, job->cancelled);
+}
+
+// Runs the command, or queues it behind the job already working on its font
+static agi_result_t install_job_start(FontInstallJob *install_job) {
+    char key[AGI_FONT_HASH_LENGTH + 1];
+    FontFlight **slot = flight_slot(&install_job->command, key);
+    if (*slot) {
+        agi_log_debug("Font %s is already in flight, waiting for it", key);
+        flight_attach(*slot, install_job);
+        return AGI_SUCCESS;
+    }
+
+    b8 tracked = flight_begin(slot, key, install_job);
+    install_job->queued_ns = agi_clock_now_ns();
+    install_job->job = (WorkerJob){.run = install_job_run, .complete = install_job_complete, .userdata = install_job};
+    agi_result_t result = worker_pool_submit(install_job->pool, &install_job->job);
+    if (result != AGI_SUCCESS && tracked) {
+        // Nothing can have attached yet
+        agi_free(*slot);
+        *slot = NULL;
+    }
+    return result;
+}
+
+agi_result_t font_jobs_submit_install(WorkerPool *pool, TcpClient *client, const FontInstallRequest *request) {
+    FontInstallJob *install_job = agi_calloc(1, sizeof(FontInstallJob));
+    if (!install_job) {
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+    install_job->pool = pool;
+    install_job->client = client;
+    install_job->trace_id = trace_new_id();
+    install_job->received_ns = agi_clock_now_ns();
+    font_command_copy(&install_job->command, request);
+
+    agi_result_t result = install_job_start(install_job);
+    trace_record(install_job->trace_id, "receive", install_job->received_ns, agi_clock_now_ns());
+    if (result != AGI_SUCCESS) {
+        agi_log_warning("Rejecting font command for %s: %d", install_job->command.font_name, result);
+        send_install_response(client, &install_job->command, result);
+        agi_free(install_job);
+    }
+    return result;
+}
+
+// --- batch ---
+
+static void batch_job_free(FontBatchJob *batch_job) {
+    agi_free(batch_job->commands);
+    agi_free(batch_job->states);
+    agi_free(batch_job->results);
+    agi_free(batch_job);
+}
+
+// Starts the downloads for every install entry that isn't cached at once;
+// the engine caps per-host parallelism and reuses connections, so a family
+// of hundreds of files is bandwidth-bound rather than a handshake per file.
+// Installs then run in entry order once all downloads are in.
+static b8 batch_job_download(FontBatchJob *batch_job, FontSource **sources, agi_result_t *results) {
+    DownloadGroup *group = download_group_create(download_default_engine());
+    if (!group) return false;
+
+    for (u32 i = 0; i < batch_job->count; i++) {
+        const FontCommand *command = &batch_job->commands[i];
+        if (batch_job->states[i] != BATCH_ENTRY_RUN || !command->install) continue;
+
+        sources[i] = agi_malloc(sizeof(FontSource));
+        if (!sources[i]) {
+            results[i] = AGI_ERROR_OUT_OF_MEMORY;
+            continue;
+        }
+        char url[AGI_FONT_PATH_SIZE];
+        u64 started_ns = agi_clock_now_ns();
+        results[i] = font_resolve_source(command->font_hash, command->font_name, command->font_style, command->font_extension,
+                                         sources[i], url, sizeof(url));
+        trace_span("resolve_source", started_ns);
+        if (results[i] != AGI_SUCCESS || sources[i]->cached || sources[i]->installed) continue;
+
+        // On success the engine thread fills results[i] when the transfer finishes
+        DownloadOptions options = {.expected_sha256 = sources[i]->verify ? sources[i]->hash : NULL,
+                                   .resumable = sources[i]->resumable,
+                                   .segments = AGI_FONT_DOWNLOAD_SEGMENTS};
+        agi_result_t submitted = download_group_add(group, url, sources[i]->path, &options, &results[i]);
+        if (submitted != AGI_SUCCESS) results[i] = submitted;
+    }
+
+    u64 started_ns = agi_clock_now_ns();
+    download_group_destroy(group);
+    trace_span("download_all", started_ns);
+    return true;
+}
+
+static agi_result_t install_prefetched(const FontCommand *command, FontSource *source, agi_result_t download) {
+    if (download != AGI_SUCCESS) {
+        if (source) font_abandon_download(source);
+        return download;
+    }
+    if (source->installed) return AGI_SUCCESS;
+    if (!source->cached) {
+        u64 started_ns = agi_clock_now_ns();
+        agi_result_t result = font_store_download(source);
+        trace_span("cache_store", started_ns);
+        if (result != AGI_SUCCESS) return result;
+    }
+    return font_install_source(source, command->font_name, command->font_style, command->font_extension);
+}
+
+// Worker thread: only touches the results of its own (BATCH_ENTRY_RUN) entries,
+// attached ones are filled in on the loop thread
+static void batch_job_run(WorkerJob *job) {
+    FontBatchJob *batch_job = job->userdata;
+    trace_record(batch_job->trace_id, "queue_wait", batch_job->queued_ns, agi_clock_now_ns());
+    trace_set_current(batch_job->trace_id);
+    FontSource **sources = agi_calloc((size_t)batch_job->count + 1, sizeof(FontSource *));
+    agi_result_t *downloads = agi_calloc((size_t)batch_job->count + 1, sizeof(agi_result_t));
+    b8 prefetched = sources && downloads && download_default_engine();
+    if (prefetched) {
+        prefetched = batch_job_download(batch_job, sources, downloads);
+    }
+
+    for (u32 i = 0; i < batch_job->count; i++) {
+        const FontCommand *command = &batch_job->commands[i];
+        if (batch_job->states[i] != BATCH_ENTRY_RUN) continue;
+        if (prefetched && command->install) {
+            batch_job->results[i] = install_prefetched(command, sources[i], downloads[i]);
+        } else {
+            batch_job->results[i] = font_command_run(command);
+        }
+    }
+
+    if (sources) {
+        for (u32 i = 0; i < batch_job->count; i++) {
+            agi_free(sources[i]);
+        }
+    }
+    agi_free(sources);
+    agi_free(downloads);
+    trace_set_current(0);
+}
+
+// Answers once the batch ran and every attached entry has its result
+static void batch_job_try_finish(FontBatchJob *batch_job) {
+    if (!batch_job->ran || batch_job->outstanding > 0) return;
+    if (batch_job->cancelled) {
+        batch_job_free(batch_job);
+        return;
+    }
+
+    u8 *bitmap = agi_calloc(((size_t)batch_job->count + 7) / 8 + 1, 1);
+    FontBatchFailure *failures = agi_malloc(((size_t)batch_job->count + 1) * sizeof(FontBatchFailure));
+    if (!bitmap || !failures) {
+        agi_log_error("Out of memory answering font batch %llu", (unsigned long long)batch_job->job_id);
+    } else {
+        u32 failure_count = 0;
+        for (u32 i = 0; i < batch_job->count; i++) {
+            if (batch_job->results[i] == AGI_SUCCESS) {
+                bitmap[i / 8] |= (u8)(1u << (i % 8));
+            } else {
+                failures[failure_count].index = i;
+                failures[failure_count].error = batch_job->results[i];
+                failure_count++;
+            }
+        }
+        agi_log_debug("Font batch %llu done: %u of %u failed", (unsigned long long)batch_job->job_id, failure_count,
+                      batch_job->count);
+        u64 started_ns = agi_clock_now_ns();
+        if (protocol_send_font_batch_response(batch_job->client, batch_job->job_id, batch_job->count, bitmap, failures,
+                                              failure_count) != AGI_SUCCESS) {
+            agi_log_error("Failed to send font batch response");
+        }
+        trace_record(batch_job->trace_id, "respond", started_ns, agi_clock_now_ns());
+        trace_finish_request(batch_job->trace_id, "font_batch", batch_job->received_ns);
+    }
+    agi_free(bitmap);
+    agi_free(failures);
+    batch_job_free(batch_job);
+}
+
+static void batch_entry_done(FontBatchJob *batch_job, u32 index, agi_result_t result, b8 cancelled) {
+    batch_job->results[index] = result;
+    batch_job->cancelled |= cancelled;
+    batch_job->outstanding--;
+    batch_job_try_finish(batch_job);
+}
+
+// Lands the flights of the entries the batch ran itself. Its own attached
+// entries may finish in here, so the batch isn't marked ran until after.
+static void batch_job_land(FontBatchJob *batch_job, b8 replay, b8 cancelled) {
+    for (u32 i = 0; i < batch_job->count; i++) {
+        if (batch_job->states[i] != BATCH_ENTRY_RUN) continue;
+        flight_land(batch_job, &batch_job->commands[i], batch_job->results[i], replay, cancelled);
+    }
+    batch_job->ran = true;
+    batch_job->cancelled |= cancelled;
+    batch_job_try_finish(batch_job);
+}
+
+static void batch_job_complete(WorkerJob *job) {
+    FontBatchJob *batch_job = job->userdata;
+    if (job->cancelled) {
+        for (u32 i = 0; i < batch_job->count; i++) {
+            if (batch_job->states[i] == BATCH_ENTRY_RUN) batch_job->results[i] = AGI_ERROR_BUSY;
+        }
+    }
+    batch_job_land(batch_job, !job->cancelled, job->cancelled);
+}
+
+// Entries whose font is already being worked on, by another job or an earlier
+// entry of this batch, wait for that instead of running here
+static void batch_job_attach_duplicates(FontBatchJob *batch_job) {
+    for (u32 i = 0; i < batch_job->count; i++) {
+        if (batch_job->states[i] != BATCH_ENTRY_RUN) continue;
+
+        char key[AGI_FONT_HASH_LENGTH + 1];
+        FontFlight **slot = flight_slot(&batch_job->commands[i], key);
+        if (!*slot) {
+            flight_begin(slot, key, batch_job);
+            continue;
+        }
+        FontInstallJob *waiter = agi_calloc(1, sizeof(FontInstallJob));
+        if (!waiter) continue;  // just runs in the batch
+        waiter->pool = batch_job->pool;
+        waiter->client = batch_job->client;
+        waiter->command = batch_job->commands[i];
+        waiter->batch = batch_job;
+        waiter->index = i;
+        waiter->trace_id = batch_job->trace_id;
+        flight_attach(*slot, waiter);
+        batch_job->states[i] = BATCH_ENTRY_ATTACHED;
+        batch_job->outstanding++;
+    }
+}
+
+agi_result_t font_jobs_submit_batch(WorkerPool *pool, TcpClient *client, FontBatchRequest *batch) {
+    FontBatchJob *batch_job = agi_calloc(1, sizeof(FontBatchJob));
+    if (!batch_job) {
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+    batch_job->pool = pool;
+    batch_job->client = client;
+    batch_job->trace_id = trace_new_id();
+    batch_job->received_ns = agi_clock_now_ns();
+    batch_job->job_id = batch->job_id;
+    batch_job->count = batch->count;
+    batch_job->job.run = batch_job_run;
+    batch_job->job.complete = batch_job_complete;
+    batch_job->job.userdata = batch_job;
+    // +1 keeps the allocations non-empty for a zero-entry batch
+    batch_job->commands = agi_malloc(((size_t)batch->count + 1) * sizeof(FontCommand));
+    batch_job->states = agi_calloc((size_t)batch->count + 1, sizeof(u8));
+    batch_job->results = agi_malloc(((size_t)batch->count + 1) * sizeof(agi_result_t));
+    if (!batch_job->commands || !batch_job->states || !batch_job->results) {
+        batch_job_free(batch_job);
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+
+    // Decode everything now: the packet is only valid until the handler returns
+    for (u32 i = 0; i < batch->count; i++) {
+        batch_job->results[i] = AGI_ERROR_PROTOCOL;
+    }
+    for (u32 i = 0; i < batch->count; i++) {
+        FontInstallRequest entry;
+        if (!protocol_next_font_batch_entry(batch, &entry)) break;
+        font_command_copy(&batch_job->commands[i], &entry);
+        batch_job->states[i] = BATCH_ENTRY_RUN;
+    }
+    batch_job_attach_duplicates(batch_job);
+
+    batch_job->queued_ns = agi_clock_now_ns();
+    trace_record(batch_job->trace_id, "receive", batch_job->received_ns, batch_job->queued_ns);
+    agi_result_t result = worker_pool_submit(pool, &batch_job->job);
+    if (result != AGI_SUCCESS) {
+        // Reject what the batch would have run; its waiters get the same answer
+        agi_log_warning("Rejecting font batch %llu: %d", (unsigned long long)batch_job->job_id, result);
+        for (u32 i = 0; i < batch_job->count; i++) {
+            if (batch_job->states[i] == BATCH_ENTRY_RUN) batch_job->results[i] = result;
+        }
+        batch_job_land(batch_job, false, false);
+    }
+    return result;
+}
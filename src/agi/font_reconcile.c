@@ -0,0 +1,198 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/font_reconcile.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "agi/log.h"
+#include "agi/memory.h"
+#include "agi/sha256.h"
+
+#define BUCKETS_INITIAL_CAPACITY (64 * 1024)
+
+typedef char FontHashKey[AGI_FONT_HASH_LENGTH];
+
+struct FontReconciler {
+    FontInventory *inventory;
+    u64 session;  // the snapshot queries are answered from, 0 while there is none
+    u64 sessions;  // digests sent so far, so a session number is never reused
+    FontHashKey *hashes;  // sorted, unique
+    u32 count;
+    u32 visited;  // inventory entries seen by the last snapshot, collected or not
+    u32 capacity;
+};
+
+FontReconciler *font_reconciler_create(FontInventory *inventory) {
+    FontReconciler *reconciler = agi_calloc(1, sizeof(FontReconciler));
+    if (reconciler) reconciler->inventory = inventory;
+    return reconciler;
+}
+
+void font_reconciler_destroy(FontReconciler *reconciler) {
+    if (!reconciler) return;
+    agi_free(reconciler->hashes);
+    agi_free(reconciler);
+}
+
+static void collect_hash(const FontInventoryEntry *entry, void *userdata) {
+    FontReconciler *reconciler = userdata;
+    reconciler->visited++;
+    if (reconciler->count == reconciler->capacity) {
+        u32 capacity = reconciler->capacity ? reconciler->capacity * 2 : 256;
+        FontHashKey *hashes = agi_realloc(reconciler->hashes, (size_t)capacity * sizeof(FontHashKey));
+        if (!hashes) return;
+        reconciler->hashes = hashes;
+        reconciler->capacity = capacity;
+    }
+    memcpy(reconciler->hashes[reconciler->count++], entry->hash, sizeof(FontHashKey));
+}
+
+static int compare_hashes(const void *a, const void *b) {
+    return memcmp(a, b, sizeof(FontHashKey));
+}
+
+static b8 take_snapshot(FontReconciler *reconciler) {
+    // Queries against the old snapshot stop matching whether or not this one succeeds
+    reconciler->session = 0;
+    reconciler->count = 0;
+    reconciler->visited = 0;
+    u32 expected = font_inventory_count(reconciler->inventory);
+    if (expected > reconciler->capacity) {
+        FontHashKey *hashes = agi_realloc(reconciler->hashes, (size_t)expected * sizeof(FontHashKey));
+        if (!hashes) return false;
+        reconciler->hashes = hashes;
+        reconciler->capacity = expected;
+    }
+    font_inventory_visit(reconciler->inventory, collect_hash, reconciler);
+    if (reconciler->count < reconciler->visited) {
+        // An allocation failed mid-visit; a partial set would make the server reinstall fonts
+        reconciler->count = 0;
+        return false;
+    }
+
+    // The same font installed under two names is one hash to the server
+    qsort(reconciler->hashes, reconciler->count, sizeof(FontHashKey), compare_hashes);
+    u32 unique = 0;
+    for (u32 i = 0; i < reconciler->count; i++) {
+        if (unique == 0 || memcmp(reconciler->hashes[unique - 1], reconciler->hashes[i], sizeof(FontHashKey)) != 0) {
+            memmove(reconciler->hashes[unique++], reconciler->hashes[i], sizeof(FontHashKey));
+        }
+    }
+    reconciler->count = unique;
+    return true;
+}
+
+static void digest_range(const FontHashKey *hashes, u32 count, u8 digest[AGI_SHA256_DIGEST_SIZE]) {
+    Sha256 sha;
+    sha256_init(&sha);
+    sha256_update(&sha, hashes, (size_t)count * sizeof(FontHashKey));
+    sha256_final(&sha, digest);
+}
+
+agi_result_t font_reconciler_send_digest(FontReconciler *reconciler, TcpClient *client) {
+    if (!take_snapshot(reconciler)) {
+        agi_log_error("Failed to snapshot installed fonts for reconciliation");
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+
+    u8 digest[AGI_SHA256_DIGEST_SIZE];
+    digest_range(reconciler->hashes, reconciler->count, digest);
+    reconciler->session = ++reconciler->sessions;
+    agi_log_debug("Reconcile session %llu: %u installed fonts", (unsigned long long)reconciler->session, reconciler->count);
+    return protocol_send_reconcile_digest(client, reconciler->session, reconciler->count, digest);
+}
+
+// First hash in the snapshot that doesn't sort before prefix (above = false) or
+// that sorts after every hash starting with it (above = true)
+static u32 prefix_bound(const FontReconciler *reconciler, WireString prefix, b8 above) {
+    u32 low = 0;
+    u32 high = reconciler->count;
+    while (low < high) {
+        u32 middle = low + (high - low) / 2;
+        int order = memcmp(reconciler->hashes[middle], prefix.data, prefix.length);
+        if (order < 0 || (above && order == 0)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static void write_bucket(const FontReconciler *reconciler, WireString prefix, WireWriter *writer) {
+    u32 begin = prefix_bound(reconciler, prefix, false);
+    u32 end = prefix_bound(reconciler, prefix, true);
+    wire_write_string(writer, prefix.data, prefix.length);
+
+    if (end - begin <= AGI_RECONCILE_LEAF_SIZE || prefix.length >= AGI_FONT_HASH_LENGTH) {
+        wire_write_u8(writer, AGI_RECONCILE_LEAF);
+        wire_write_varint(writer, end - begin);
+        wire_write_bytes(writer, reconciler->hashes[begin], (size_t)(end - begin) * sizeof(FontHashKey));
+        return;
+    }
+
+    // Hashes sharing the next character are contiguous, so each child is one run
+    u32 children = 0;
+    for (u32 i = begin; i < end; i++) {
+        if (i == begin || reconciler->hashes[i][prefix.length] != reconciler->hashes[i - 1][prefix.length]) children++;
+    }
+    wire_write_u8(writer, AGI_RECONCILE_CHILDREN);
+    wire_write_varint(writer, children);
+    for (u32 run = begin; run < end;) {
+        char next = reconciler->hashes[run][prefix.length];
+        u32 run_end = run + 1;
+        while (run_end < end && reconciler->hashes[run_end][prefix.length] == next) run_end++;
+
+        u8 digest[AGI_SHA256_DIGEST_SIZE];
+        digest_range(reconciler->hashes + run, run_end - run, digest);
+        wire_write_u8(writer, (u8)next);
+        wire_write_varint(writer, run_end - run);
+        wire_write_bytes(writer, digest, sizeof(digest));
+        run = run_end;
+    }
+}
+
+agi_result_t font_reconciler_answer(FontReconciler *reconciler, TcpClient *client, ReconcileQuery *query) {
+    if (query->session == 0 || query->session != reconciler->session) {
+        // The snapshot the server is drilling into is gone; start over
+        return font_reconciler_send_digest(reconciler, client);
+    }
+
+    size_t capacity = BUCKETS_INITIAL_CAPACITY;
+    for (;;) {
+        u8 *buffer = agi_malloc(capacity);
+        if (!buffer) return AGI_ERROR_OUT_OF_MEMORY;
+
+        WireWriter writer = wire_writer(buffer, capacity);
+        wire_write_varint(&writer, query->session);
+        wire_write_varint(&writer, query->count);
+
+        ReconcileQuery prefixes = *query;
+        WireString prefix;
+        u32 answered = 0;
+        while (protocol_next_reconcile_prefix(&prefixes, &prefix)) {
+            if (prefix.length > AGI_FONT_HASH_LENGTH) {
+                prefixes.prefixes.failed = true;
+                break;
+            }
+            write_bucket(reconciler, prefix, &writer);
+            answered++;
+        }
+        if (prefixes.prefixes.failed || answered != query->count) {
+            agi_free(buffer);
+            agi_log_error("Malformed reconcile query");
+            return AGI_ERROR_PROTOCOL;
+        }
+
+        if (!writer.failed) {
+            agi_result_t result = tcp_client_send_packet(client, AGI_PACKET_RECONCILE_BUCKETS, buffer, writer.length);
+            agi_free(buffer);
+            return result;
+        }
+        agi_free(buffer);
+        if (capacity >= AGI_MAX_FRAME_SIZE) return AGI_ERROR_PROTOCOL;
+        capacity *= 2;
+    }
+}
@@ -0,0 +1,336 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/fonts.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agi/clock.h"
+#include "agi/download.h"
+#include "agi/log.h"
+#include "agi/sha256.h"
+#include "agi/trace.h"
+#include "agi/woff.h"
+
+#if defined(AGI_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define PATH_SEPARATOR '\\'
+#else
+#define PATH_SEPARATOR '/'
+#endif
+
+#define AGI_FONT_URL "http://192.168.1.36:6968/perma/"
+
+static FontCache *font_cache = NULL;
+static FontInventory *font_inventory = NULL;
+static char font_server_url[AGI_FONT_PATH_SIZE] = AGI_FONT_URL;
+
+// Without a state directory the inventory still works, it just starts empty every time
+static void open_inventory(const char *state_directory) {
+    char font_dir[AGI_FONT_PATH_SIZE];
+    if (font_install_directory(font_dir, sizeof(font_dir)) != AGI_SUCCESS) {
+        agi_log_warning("No font directory, installed fonts are not tracked");
+        return;
+    }
+    char index_path[AGI_FONT_PATH_SIZE];
+    int length = state_directory ? snprintf(index_path, sizeof(index_path), "%s%cinventory.bin", state_directory, PATH_SEPARATOR) : -1;
+    b8 persistent = length > 0 && (size_t)length < sizeof(index_path);
+    font_inventory = font_inventory_open(persistent ? index_path : NULL, font_dir);
+}
+
+agi_result_t fonts_init(const char *cache_directory, u64 cache_bytes) {
+    char directory[AGI_FONT_PATH_SIZE];
+    if (!cache_directory) {
+        if (font_cache_default_directory(directory, sizeof(directory)) != AGI_SUCCESS) {
+            agi_log_warning("No font cache directory available, caching disabled");
+            open_inventory(NULL);
+            return AGI_ERROR_IO;
+        }
+        cache_directory = directory;
+    }
+
+    font_cache = font_cache_open(cache_directory, cache_bytes);
+    open_inventory(font_cache ? cache_directory : NULL);
+    return font_cache ? AGI_SUCCESS : AGI_ERROR_IO;
+}
+
+void fonts_shutdown(void) {
+    font_backend_shutdown();
+    font_inventory_close(font_inventory);
+    font_inventory = NULL;
+    font_cache_close(font_cache);
+    font_cache = NULL;
+}
+
+FontInventory *fonts_inventory(void) {
+    return font_inventory;
+}
+
+agi_result_t fonts_set_server_url(const char *base_url) {
+    if (!base_url) base_url = AGI_FONT_URL;
+    if (strlen(base_url) >= sizeof(font_server_url)) return AGI_ERROR_INVALID_ARGUMENT;
+    snprintf(font_server_url, sizeof(font_server_url), "%s", base_url);
+    return AGI_SUCCESS;
+}
+
+b8 font_valid_name(const char *name) {
+    if (!name || !name[0] || name[0] == '.' || strstr(name, "..")) return false;
+    for (const char *c = name; *c; c++) {
+        if (*c == '/' || *c == '\\' || iscntrl((unsigned char)*c)) return false;
+    }
+    return true;
+}
+
+b8 font_valid_extension(const char *extension) {
+    if (!extension || extension[0] != '.' || !extension[1]) return false;
+    for (const char *c = extension + 1; *c; c++) {
+        if (!isalnum((unsigned char)*c)) return false;
+    }
+    return true;
+}
+
+void font_sanitize_hash(const char *hash, char sanitized[AGI_FONT_HASH_LENGTH + 1]) {
+    // Copy up to AGI_FONT_HASH_LENGTH valid characters
+    size_t i = 0;
+    for (const char *c = hash; *c && i < AGI_FONT_HASH_LENGTH; c++) {
+        if (isalnum((unsigned char)*c)) {
+            sanitized[i++] = *c;
+        }
+    }
+
+    // If we didn't get enough characters, pad with zeros
+    while (i < AGI_FONT_HASH_LENGTH) {
+        sanitized[i++] = '0';
+    }
+    sanitized[AGI_FONT_HASH_LENGTH] = '\0';
+}
+
+static void get_temp_dir(char *temp_dir, size_t size) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    GetTempPathA((DWORD)size, temp_dir);
+#else
+    const char *tmp = getenv("TMPDIR");
+    snprintf(temp_dir, size, "%s/", tmp && *tmp ? tmp : "/tmp");
+#endif
+}
+
+// The same font, under the same name, is already in the font directory
+static b8 already_installed(const char *hash, const char *font_name, const char *font_style) {
+    FontInventoryEntry entry;
+    return font_inventory && font_inventory_find(font_inventory, hash, &entry) && strcmp(entry.family, font_name) == 0 &&
+           strcmp(entry.style, font_style) == 0;
+}
+
+agi_result_t font_resolve_source(const char *font_hash, const char *font_name, const char *font_style, const char *font_extension,
+                                 FontSource *source, char *url, size_t url_size) {
+    if (!font_valid_name(font_name) || !font_valid_name(font_style) || !font_valid_extension(font_extension)) {
+        agi_log_error("Refusing font with an unsafe name: %s_%s%s", font_name, font_style, font_extension);
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+    font_sanitize_hash(font_hash, source->hash);
+    u8 digest[AGI_SHA256_DIGEST_SIZE];
+    source->verify = sha256_parse_hex(source->hash, digest);
+    source->resumable = false;
+    source->staged = false;
+    source->installed = already_installed(source->hash, font_name, font_style);
+    if (source->installed) {
+        source->cached = false;
+        source->path[0] = '\0';
+        return AGI_SUCCESS;
+    }
+    source->cached = font_cache && font_cache_lookup(font_cache, source->hash, source->path, sizeof(source->path));
+    if (source->cached) {
+        return AGI_SUCCESS;
+    }
+
+    int length = snprintf(url, url_size, "%s%s%s", font_server_url, source->hash, font_extension);
+    if (length < 0 || (size_t)length >= url_size) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (font_cache) {
+        return font_cache_temp_path(font_cache, source->hash, source->path, sizeof(source->path), &source->resumable);
+    }
+    // Downloaded next to the installed fonts, the install is a rename instead of a copy
+    source->staged = font_staging_path(source->hash, font_extension, source->path, sizeof(source->path)) == AGI_SUCCESS;
+    if (source->staged) {
+        return AGI_SUCCESS;
+    }
+    char temp_dir[AGI_FONT_PATH_SIZE];
+    get_temp_dir(temp_dir, sizeof(temp_dir));
+    snprintf(source->path, sizeof(source->path), "%s%s%s", temp_dir, source->hash, font_extension);
+    return AGI_SUCCESS;
+}
+
+agi_result_t font_store_download(FontSource *source) {
+    if (!font_cache) {
+        return AGI_SUCCESS;
+    }
+
+    char download_path[AGI_FONT_PATH_SIZE];
+    memcpy(download_path, source->path, sizeof(download_path));
+    agi_result_t result = font_cache_commit(font_cache, source->hash, download_path, source->path, sizeof(source->path));
+    source->cached = result == AGI_SUCCESS;
+    return result;
+}
+
+void font_abandon_download(FontSource *source) {
+    if (source->cached) return;
+    if (font_cache) {
+        font_cache_release(font_cache, source->hash, source->path);
+    } else {
+        remove(source->path);
+    }
+}
+
+b8 font_is_package_extension(const char *font_extension) {
+    return font_extension && (strcmp(font_extension, ".woff") == 0 || strcmp(font_extension, ".woff2") == 0);
+}
+
+static agi_result_t install_package(const FontSource *source, agi_font_format_t format, const char *font_name, const char *font_style,
+                                    const char **installed_extension) {
+    // The cache keeps the compact package; the OS gets a plain sfnt, unpacked straight into staging
+    char sfnt_path[AGI_FONT_PATH_SIZE];
+    agi_result_t result = font_staging_path(source->hash, ".sfnt", sfnt_path, sizeof(sfnt_path));
+    if (result != AGI_SUCCESS) return result;
+
+    b8 cff = false;
+    u64 started_ns = agi_clock_now_ns();
+    result = woff_unpack_file(source->path, sfnt_path, &cff);
+    trace_span("unpack", started_ns);
+    if (result != AGI_SUCCESS) {
+        agi_log_error("Failed to unpack %s font %s_%s", format == AGI_FONT_FORMAT_WOFF2 ? "WOFF2" : "WOFF", font_name, font_style);
+        remove(sfnt_path);
+        return result;
+    }
+    *installed_extension = cff ? ".otf" : ".ttf";
+    result = install_font_file(sfnt_path, font_name, font_style, *installed_extension, true);
+    if (result != AGI_SUCCESS) remove(sfnt_path);
+    return result;
+}
+
+agi_result_t font_install_source(const FontSource *source, const char *font_name, const char *font_style, const char *font_extension) {
+    // Sniffed rather than trusted from the extension: the cache holds whatever the server sent
+    agi_font_format_t format = woff_detect_format(source->path);
+    agi_result_t result;
+    if (format == AGI_FONT_FORMAT_SFNT) {
+        result = install_font_file(source->path, font_name, font_style, font_extension, source->staged);
+    } else {
+        result = install_package(source, format, font_name, font_style, &font_extension);
+    }
+
+    // An uncached download has served its purpose either way; don't let temp files pile up
+    if (!source->cached) remove(source->path);
+
+    if (result == AGI_SUCCESS && font_inventory) {
+        char file_name[AGI_FONT_FILE_NAME_SIZE];
+        snprintf(file_name, sizeof(file_name), "%s_%s%s", font_name, font_style, font_extension);
+        u64 started_ns = agi_clock_now_ns();
+        if (font_inventory_record(font_inventory, source->hash, font_name, font_style, file_name) != AGI_SUCCESS) {
+            agi_log_warning("Installed %s but couldn't add it to the inventory", file_name);
+        }
+        trace_span("inventory_record", started_ns);
+    }
+    return result;
+}
+
+agi_result_t install_font(const char *font_hash, const char *font_name, const char *font_style, const char *font_extension) {
+    FontSource source;
+    char url[AGI_FONT_PATH_SIZE];
+    u64 started_ns = agi_clock_now_ns();
+    agi_result_t result = font_resolve_source(font_hash, font_name, font_style, font_extension, &source, url, sizeof(url));
+    trace_span("resolve_source", started_ns);
+    if (result != AGI_SUCCESS) return result;
+
+    if (source.installed) {
+        agi_log_debug("%s_%s is already installed", font_name, font_style);
+        return AGI_SUCCESS;
+    }
+    if (source.cached) {
+        agi_log_debug("Installing %s_%s from font cache", font_name, font_style);
+    } else {
+        DownloadOptions options = {.expected_sha256 = source.verify ? source.hash : NULL,
+                                   .resumable = source.resumable,
+                                   .segments = AGI_FONT_DOWNLOAD_SEGMENTS};
+        started_ns = agi_clock_now_ns();
+        result = download_file(url, source.path, &options);
+        trace_span("download", started_ns);
+        if (result != AGI_SUCCESS) {
+            font_abandon_download(&source);
+            agi_log_error("Failed to download font");
+            return result;
+        }
+        started_ns = agi_clock_now_ns();
+        result = font_store_download(&source);
+        trace_span("cache_store", started_ns);
+        if (result != AGI_SUCCESS) return result;
+    }
+
+    return font_install_source(&source, font_name, font_style, font_extension);
+}
+
+static b8 installed_file_exists(const char *file_name) {
+    char font_dir[AGI_FONT_PATH_SIZE];
+    char path[AGI_FONT_PATH_SIZE];
+    if (font_install_directory(font_dir, sizeof(font_dir)) != AGI_SUCCESS) return false;
+    snprintf(path, sizeof(path), "%s%c%s", font_dir, PATH_SEPARATOR, file_name);
+    FILE *file = fopen(path, "rb");
+    if (file) fclose(file);
+    return file != NULL;
+}
+
+// The file an install under this name produced: the inventory knows, except for
+// fonts installed before it existed, where the name is all we have to go on
+static void installed_file_name(const char *font_name, const char *font_style, const char *font_extension, char *file_name,
+                                size_t size) {
+    if (!font_is_package_extension(font_extension)) {
+        snprintf(file_name, size, "%s_%s%s", font_name, font_style, font_extension);
+        return;
+    }
+    // Web fonts were installed unpacked, as whichever sfnt kind they held
+    static const char *unpacked[] = {".ttf", ".otf"};
+    for (size_t i = 0; i < sizeof(unpacked) / sizeof(unpacked[0]); i++) {
+        snprintf(file_name, size, "%s_%s%s", font_name, font_style, unpacked[i]);
+        if (font_inventory && font_inventory_find_file(font_inventory, file_name, NULL)) return;
+    }
+    snprintf(file_name, size, "%s_%s.ttf", font_name, font_style);
+    if (!installed_file_exists(file_name)) snprintf(file_name, size, "%s_%s.otf", font_name, font_style);
+}
+
+agi_result_t uninstall_font(const char *font_name, const char *font_style, const char *font_extension) {
+    if (!font_valid_name(font_name) || !font_valid_name(font_style) || !font_valid_extension(font_extension)) {
+        agi_log_error("Refusing font with an unsafe name: %s_%s%s", font_name, font_style, font_extension);
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+    char file_name[AGI_FONT_FILE_NAME_SIZE];
+    installed_file_name(font_name, font_style, font_extension, file_name, sizeof(file_name));
+    agi_result_t result = uninstall_font_file(file_name);
+    if (result == AGI_SUCCESS) {
+        if (font_inventory) font_inventory_forget(font_inventory, file_name);
+        agi_log_info("Font uninstalled successfully: %s", font_name);
+    }
+    return result;
+}
+
+agi_result_t uninstall_font_by_hash(const char *font_hash) {
+    // Without the inventory there's no telling which file holds the font
+    if (!font_inventory) return AGI_ERROR_INVALID_ARGUMENT;
+
+    char hash[AGI_FONT_HASH_LENGTH + 1];
+    font_sanitize_hash(font_hash, hash);
+    FontInventoryEntry entry;
+    if (!font_inventory_find(font_inventory, hash, &entry)) return AGI_SUCCESS;  // already gone
+
+    // One font can be installed under several names; they all go
+    do {
+        agi_result_t result = uninstall_font_file(entry.file_name);
+        if (result != AGI_SUCCESS) return result;
+        font_inventory_forget(font_inventory, entry.file_name);
+        agi_log_info("Font uninstalled successfully: %s", entry.file_name);
+    } while (font_inventory_find(font_inventory, hash, &entry));
+    return AGI_SUCCESS;
+}
@@ -0,0 +1,334 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#define _GNU_SOURCE  // copy_file_range
+#include "agi/fonts.h"
+
+#if defined(AGI_PLATFORM_LINUX)
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <spawn.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "agi/clock.h"
+#include "agi/log.h"
+#include "agi/metrics.h"
+#include "agi/thread.h"
+#include "agi/trace.h"
+
+extern char **environ;
+
+#define FONT_SYSTEM_DIRECTORY "/usr/local/share/fonts"
+#define COPY_CHUNK_SIZE (64 * 1024)
+// fc-cache runs once changes have been quiet this long...
+#define FC_CACHE_DEBOUNCE_MS 500
+// ...or at the latest this long after the first one, so a steady stream still refreshes
+#define FC_CACHE_MAX_DELAY_MS 5000
+
+// Numbers staging files, so two installs of the same file name never share one
+static atomic_uint staging_sequence;
+
+// fc-cache rescans the whole directory, so one run after a batch of installs
+// does the work of one per font. Changes mark the cache dirty, and a background
+// thread runs fc-cache once they stop coming.
+static struct {
+    agi_mutex_t lock;
+    agi_cond_t wake;
+    agi_thread_t thread;
+    b8 running;
+    b8 stopping;
+    b8 dirty;
+    u64 first_change_ms;
+    u64 last_change_ms;
+    char directory[AGI_FONT_PATH_SIZE];
+} refresher;
+
+static pthread_once_t refresher_once = PTHREAD_ONCE_INIT;
+
+static b8 make_directories(const char *path) {
+    char partial[AGI_FONT_PATH_SIZE];
+    size_t length = strlen(path);
+    if (length >= sizeof(partial)) return false;
+    memcpy(partial, path, length + 1);
+    for (char *c = partial + 1; *c; c++) {
+        if (*c != '/') continue;
+        *c = '\0';
+        if (mkdir(partial, 0755) != 0 && errno != EEXIST) return false;
+        *c = '/';
+    }
+    return mkdir(partial, 0755) == 0 || errno == EEXIST;
+}
+
+// Root installs for every user; anyone else into their own XDG data directory
+agi_result_t font_install_directory(char *directory, size_t size) {
+    int length;
+    if (geteuid() == 0) {
+        length = snprintf(directory, size, "%s", FONT_SYSTEM_DIRECTORY);
+    } else {
+        const char *data_home = getenv("XDG_DATA_HOME");
+        const char *home = getenv("HOME");
+        if (data_home && *data_home) {
+            length = snprintf(directory, size, "%s/fonts", data_home);
+        } else {
+            if (!home || !*home) {
+                struct passwd *pwd = getpwuid(geteuid());
+                home = pwd ? pwd->pw_dir : NULL;
+            }
+            if (!home || !*home) {
+                agi_log_error("Failed to find the home directory");
+                return AGI_ERROR_IO;
+            }
+            length = snprintf(directory, size, "%s/.local/share/fonts", home);
+        }
+    }
+    if (length < 0 || (size_t)length >= size) return AGI_ERROR_INVALID_ARGUMENT;
+
+    if (!make_directories(directory)) {
+        agi_log_error("Failed to create font directory %s: %s", directory, strerror(errno));
+        return AGI_ERROR_IO;
+    }
+    return AGI_SUCCESS;
+}
+
+static void run_fc_cache(const char *directory) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    char *argv[] = {"fc-cache", (char *)directory, NULL};
+    u64 started_ns = agi_clock_now_ns();
+    pid_t pid;
+    int error = posix_spawnp(&pid, "fc-cache", &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        agi_log_warning("Failed to run fc-cache: %s", strerror(error));
+        return;
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    metrics_record_since(AGI_HISTOGRAM_FONT_CACHE_REFRESH, started_ns);
+    trace_span("font_cache_refresh", started_ns);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        agi_log_debug("Font cache refreshed in %llu ms", (unsigned long long)((agi_clock_now_ns() - started_ns) / 1000000));
+    } else {
+        agi_log_warning("fc-cache failed for %s", directory);
+    }
+}
+
+static void refresher_main(void *arg) {
+    (void)arg;
+    trace_name_thread("font_cache_refresh");
+    agi_mutex_lock(&refresher.lock);
+    for (;;) {
+        while (!refresher.dirty && !refresher.stopping) {
+            agi_cond_wait(&refresher.wake, &refresher.lock);
+        }
+        if (!refresher.dirty) break;
+
+        // Shutting down flushes a pending refresh right away
+        u64 due = MIN(refresher.last_change_ms + FC_CACHE_DEBOUNCE_MS, refresher.first_change_ms + FC_CACHE_MAX_DELAY_MS);
+        u64 now = agi_clock_now_ms();
+        if (!refresher.stopping && now < due) {
+            agi_cond_timed_wait(&refresher.wake, &refresher.lock, due - now);
+            continue;
+        }
+
+        char directory[AGI_FONT_PATH_SIZE];
+        memcpy(directory, refresher.directory, sizeof(directory));
+        refresher.dirty = false;
+        agi_mutex_unlock(&refresher.lock);
+        run_fc_cache(directory);
+        agi_mutex_lock(&refresher.lock);
+    }
+    agi_mutex_unlock(&refresher.lock);
+}
+
+static void refresher_start(void) {
+    agi_mutex_init(&refresher.lock);
+    agi_cond_init(&refresher.wake);
+    refresher.running = agi_thread_create(&refresher.thread, refresher_main, NULL, 0) == AGI_SUCCESS;
+    if (!refresher.running) agi_log_warning("Failed to start font cache refresher, refreshing inline");
+}
+
+static void request_cache_refresh(const char *directory) {
+    pthread_once(&refresher_once, refresher_start);
+    if (!refresher.running) {
+        run_fc_cache(directory);
+        return;
+    }
+
+    agi_mutex_lock(&refresher.lock);
+    u64 now = agi_clock_now_ms();
+    if (!refresher.dirty) refresher.first_change_ms = now;
+    refresher.last_change_ms = now;
+    refresher.dirty = true;
+    snprintf(refresher.directory, sizeof(refresher.directory), "%s", directory);
+    agi_mutex_unlock(&refresher.lock);
+    agi_cond_signal(&refresher.wake);
+}
+
+void font_backend_shutdown(void) {
+    // Workers are stopped by now, so nothing races a first refresh request
+    if (!refresher.running) return;
+
+    agi_mutex_lock(&refresher.lock);
+    refresher.stopping = true;
+    agi_mutex_unlock(&refresher.lock);
+    agi_cond_signal(&refresher.wake);
+    agi_thread_join(refresher.thread);
+    refresher.running = false;
+}
+
+static b8 copy_contents(int in, int out) {
+    // copy_file_range keeps the data in the kernel, and can reflink on filesystems that support it
+    for (;;) {
+        ssize_t copied = copy_file_range(in, NULL, out, NULL, 1 << 30, 0);
+        if (copied == 0) return true;
+        if (copied > 0) continue;
+        if (errno == EINTR) continue;
+        if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) return false;
+        break;
+    }
+
+    char buffer[COPY_CHUNK_SIZE];
+    ssize_t read_bytes;
+    while ((read_bytes = read(in, buffer, sizeof(buffer))) != 0) {
+        if (read_bytes < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        for (ssize_t done = 0; done < read_bytes;) {
+            ssize_t written = write(out, buffer + done, (size_t)(read_bytes - done));
+            if (written < 0 && errno != EINTR) return false;
+            if (written > 0) done += written;
+        }
+    }
+    return true;
+}
+
+// A hard link when the source is on the same filesystem (cache objects are never
+// modified, so sharing their inode is safe), otherwise a full copy
+static agi_result_t stage_file(const char *source_path, const char *staging_path) {
+    unlink(staging_path);
+    if (link(source_path, staging_path) == 0) return AGI_SUCCESS;
+
+    int in = open(source_path, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        agi_log_error("Failed to open font file %s: %s", source_path, strerror(errno));
+        return AGI_ERROR_IO;
+    }
+    int out = open(staging_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        agi_log_error("Failed to create %s: %s", staging_path, strerror(errno));
+        close(in);
+        return AGI_ERROR_IO;
+    }
+
+    b8 copied = copy_contents(in, out) && fsync(out) == 0;
+    close(in);
+    if (close(out) != 0) copied = false;
+    if (!copied) {
+        agi_log_error("Failed to copy font file to %s: %s", staging_path, strerror(errno));
+        unlink(staging_path);
+        return AGI_ERROR_IO;
+    }
+    return AGI_SUCCESS;
+}
+
+// Staging files are hidden, and fontconfig skips dot files, so it never sees a
+// half-written font; the rename makes the finished one appear at once
+agi_result_t font_staging_path(const char *font_hash, const char *font_extension, char *path, size_t size) {
+    char font_dir[AGI_FONT_PATH_SIZE];
+    agi_result_t result = font_install_directory(font_dir, sizeof(font_dir));
+    if (result != AGI_SUCCESS) return result;
+
+    int length = snprintf(path, size, "%s/.agi-%s%s.part", font_dir, font_hash, font_extension);
+    return length > 0 && (size_t)length < size ? AGI_SUCCESS : AGI_ERROR_INVALID_ARGUMENT;
+}
+
+static agi_result_t place_font_file(const char *font_path, const char *font_name, const char *font_style,
+                                    const char *font_extension, b8 move) {
+    // Checked again here, whoever the caller: these become a path under the font directory
+    if (!font_valid_name(font_name) || !font_valid_name(font_style) || !font_valid_extension(font_extension)) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+    char font_dir[AGI_FONT_PATH_SIZE];
+    agi_result_t result = font_install_directory(font_dir, sizeof(font_dir));
+    if (result != AGI_SUCCESS) return result;
+
+    // Same file name uninstall_font() looks for, whatever the source file is called
+    char dest_path[AGI_FONT_PATH_SIZE];
+    char staging_path[AGI_FONT_PATH_SIZE];
+    int length = snprintf(dest_path, sizeof(dest_path), "%s/%s_%s%s", font_dir, font_name, font_style, font_extension);
+    int staging_length = snprintf(staging_path, sizeof(staging_path), "%s/.agi-stage-%ld-%u%s.part", font_dir,
+                                  (long)getpid(), atomic_fetch_add(&staging_sequence, 1), font_extension);
+    if (length < 0 || (size_t)length >= sizeof(dest_path) || staging_length < 0 ||
+        (size_t)staging_length >= sizeof(staging_path)) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (move) {
+        snprintf(staging_path, sizeof(staging_path), "%s", font_path);
+    } else {
+        u64 started_ns = agi_clock_now_ns();
+        result = stage_file(font_path, staging_path);
+        trace_span("stage_copy", started_ns);
+        if (result != AGI_SUCCESS) return result;
+    }
+    if (rename(staging_path, dest_path) != 0) {
+        agi_log_error("Failed to move font file to %s: %s", dest_path, strerror(errno));
+        if (!move) unlink(staging_path);
+        return AGI_ERROR_IO;
+    }
+
+    request_cache_refresh(font_dir);
+    return AGI_SUCCESS;
+}
+
+agi_result_t install_font_file(const char *font_path, const char *font_name, const char *font_style, const char *font_extension,
+                               b8 move) {
+    u64 started_ns = agi_clock_now_ns();
+    agi_result_t result = place_font_file(font_path, font_name, font_style, font_extension, move);
+    metrics_record_since(AGI_HISTOGRAM_FONT_BACKEND_INSTALL, started_ns);
+    trace_span("install_file", started_ns);
+    metrics_add(result == AGI_SUCCESS ? AGI_COUNTER_FONT_INSTALLS : AGI_COUNTER_FONT_INSTALL_FAILURES, 1);
+    return result;
+}
+
+static agi_result_t remove_font_file(const char *file_name) {
+    if (!font_valid_name(file_name)) return AGI_ERROR_INVALID_ARGUMENT;
+    char font_dir[AGI_FONT_PATH_SIZE];
+    char font_path[AGI_FONT_PATH_SIZE];
+    agi_result_t result = font_install_directory(font_dir, sizeof(font_dir));
+    if (result != AGI_SUCCESS) return result;
+
+    snprintf(font_path, sizeof(font_path), "%s/%s", font_dir, file_name);
+    if (unlink(font_path) != 0) {
+        agi_log_error("Failed to delete font file %s: %s", font_path, strerror(errno));
+        return AGI_ERROR_IO;
+    }
+
+    request_cache_refresh(font_dir);
+    return AGI_SUCCESS;
+}
+
+agi_result_t uninstall_font_file(const char *file_name) {
+    u64 started_ns = agi_clock_now_ns();
+    agi_result_t result = remove_font_file(file_name);
+    metrics_record_since(AGI_HISTOGRAM_FONT_BACKEND_UNINSTALL, started_ns);
+    trace_span("uninstall_file", started_ns);
+    metrics_add(result == AGI_SUCCESS ? AGI_COUNTER_FONT_UNINSTALLS : AGI_COUNTER_FONT_UNINSTALL_FAILURES, 1);
+    return result;
+}
+#endif
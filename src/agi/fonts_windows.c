@@ -3,8 +3,12 @@
  */
 #include "agi/fonts.h"
 
+#if defined(AGI_PLATFORM_WINDOWS)
+#include <agi/clock.h>
 #include <agi/download.h>
 #include <agi/log.h>
+#include <agi/metrics.h>
+#include <agi/trace.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,70 +22,10 @@
 #pragma comment(lib, "wininet.lib")
 #pragma comment(lib, "Shlwapi.lib")
 
-#define AGI_FONT_URL "http://192.168.1.36:6968/perma/"
-#define MAX_DOWNLOAD_ATTEMPTS 3
-#define DOWNLOAD_TIMEOUT 30L
 #define MAX_PATH 1024
-#define HASH_LENGTH 64
-// Removes anything after  a '\' and return a new string with the correct sized hash
-static char* sanitize_hash(const char* hash) {
-    size_t hash_len = strlen(hash);
-    char* sanitized_hash = malloc(HASH_LENGTH + 1);  // +1 for null terminator
-    if (!sanitized_hash) {
-        agi_log_error("Failed to allocate memory for sanitized hash");
-        return NULL;
-    }
-
-    // Initialize with zeros
-    memset(sanitized_hash, 0, HASH_LENGTH + 1);
-
-    // Find the start of the valid hash characters
-    const char* start = hash;
-    while (*start && !isalnum(*start)) {
-        start++;
-    }
-
-    // Copy up to HASH_LENGTH valid characters
-    size_t i = 0;
-    while (*start && i < HASH_LENGTH) {
-        if (isalnum(*start)) {
-            sanitized_hash[i++] = *start;
-        }
-        start++;
-    }
-
-    // If we didn't get enough characters, pad with zeros
-    while (i < HASH_LENGTH) {
-        sanitized_hash[i++] = '0';
-    }
 
-    sanitized_hash[HASH_LENGTH] = '\0';  // Ensure null termination
-
-    return sanitized_hash;
-}
-static char* create_url(const char* base_url, const char* font_hash, const char* font_extension) {
-    char* clean_hash = sanitize_hash(font_hash);
-    if (!clean_hash) {
-        return NULL;
-    }
-
-    size_t url_length = strlen(base_url) + strlen(clean_hash) + strlen(font_extension) + 1;  // +1 for null terminator
-    char* url = malloc(url_length);
-    if (!url) {
-        free(clean_hash);
-        agi_log_error("Failed to allocate memory for URL");
-        return NULL;
-    }
-
-    // Use snprintf to safely concatenate the strings
-    snprintf(url, url_length, "%s%s%s", base_url, clean_hash, font_extension);
-
-    free(clean_hash);
-    return url;
-}
-static void get_temp_dir(char* temp_dir) {
-    GetTempPathA(MAX_PATH, temp_dir);
-}
+// Numbers staging files, so two installs of the same file name never share one
+static volatile LONG staging_sequence;
 
 static BOOL is_admin() {
     BOOL is_admin = FALSE;
@@ -99,10 +43,7 @@ static BOOL is_admin() {
     return is_admin;
 }
 
-agi_result_t install_font_windows(const char* font_path) {
-    BOOL admin = is_admin();
-    char font_dir[MAX_PATH];
-
+static agi_result_t font_directory(BOOL admin, char* font_dir) {
     if (admin) {
         if (FAILED(SHGetFolderPathA(NULL, CSIDL_FONTS, NULL, 0, font_dir))) {
             agi_log_error("Failed to get system font directory");
@@ -116,27 +57,89 @@ agi_result_t install_font_windows(const char* font_path) {
         strcat(font_dir, "\\Microsoft\\Windows\\Fonts");
         CreateDirectoryA(font_dir, NULL);
     }
+    return AGI_SUCCESS;
+}
+
+agi_result_t font_install_directory(char* directory, size_t size) {
+    char font_dir[MAX_PATH];
+    agi_result_t result = font_directory(is_admin(), font_dir);
+    if (result != AGI_SUCCESS) return result;
+    int length = snprintf(directory, size, "%s", font_dir);
+    return length > 0 && (size_t)length < size ? AGI_SUCCESS : AGI_ERROR_INVALID_ARGUMENT;
+}
+
+// Files in the fonts directory that aren't registered are never loaded, so a
+// staging file there is invisible until it is moved into place and added
+agi_result_t font_staging_path(const char* font_hash, const char* font_extension, char* path, size_t size) {
+    char font_dir[MAX_PATH];
+    agi_result_t result = font_directory(is_admin(), font_dir);
+    if (result != AGI_SUCCESS) return result;
+
+    int length = snprintf(path, size, "%s\\.agi-%s%s.part", font_dir, font_hash, font_extension);
+    return length > 0 && (size_t)length < size ? AGI_SUCCESS : AGI_ERROR_INVALID_ARGUMENT;
+}
+
+// Every top-level window gets WM_FONTCHANGE and SendMessage waits on each, so one hung app stalls it
+static void broadcast_font_change(void) {
+    u64 started_ns = agi_clock_now_ns();
+    SendMessageA(HWND_BROADCAST, WM_FONTCHANGE, 0, 0);
+    metrics_record_since(AGI_HISTOGRAM_FONT_CACHE_REFRESH, started_ns);
+    trace_span("font_change_broadcast", started_ns);
+}
+
+static agi_result_t place_font_file(const char* font_path, const char* font_name, const char* font_style,
+                                    const char* font_extension, b8 move) {
+    // Checked again here, whoever the caller: these become a path under the font directory
+    if (!font_valid_name(font_name) || !font_valid_name(font_style) || !font_valid_extension(font_extension)) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+    BOOL admin = is_admin();
+    char font_dir[MAX_PATH];
+    agi_result_t result = font_directory(admin, font_dir);
+    if (result != AGI_SUCCESS) return result;
 
-    char* font_name = PathFindFileNameA(font_path);
+    // Same file name uninstall_font() looks for, whatever the source file is called
+    char file_name[MAX_PATH];
+    snprintf(file_name, sizeof(file_name), "%s_%s%s", font_name, font_style, font_extension);
     char dest_path[MAX_PATH];
-    snprintf(dest_path, sizeof(dest_path), "%s\\%s", font_dir, font_name);
+    snprintf(dest_path, sizeof(dest_path), "%s\\%s", font_dir, file_name);
 
-    if (!CopyFileA(font_path, dest_path, FALSE)) {
-        agi_log_error("Failed to copy font file, file may already exist");
+    // Copied rather than hard-linked from the cache: a loaded font locks the file,
+    // and with it every other name of it, which would pin cache entries
+    char staging_path[MAX_PATH];
+    if (move) {
+        snprintf(staging_path, sizeof(staging_path), "%s", font_path);
+    } else {
+        snprintf(staging_path, sizeof(staging_path), "%s\\.agi-stage-%lu-%ld%s.part", font_dir, GetCurrentProcessId(),
+                 InterlockedIncrement(&staging_sequence), font_extension);
+        u64 started_ns = agi_clock_now_ns();
+        b8 copied = CopyFileA(font_path, staging_path, FALSE);
+        trace_span("stage_copy", started_ns);
+        if (!copied) {
+            agi_log_error("Failed to copy font file to %s", staging_path);
+            return AGI_ERROR_IO;
+        }
+    }
+    if (!MoveFileExA(staging_path, dest_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        agi_log_error("Failed to move font file into place, it may be in use");
+        if (!move) DeleteFileA(staging_path);
         return AGI_ERROR_IO;
     }
 
-    if (AddFontResourceA(dest_path) == 0) {
+    u64 started_ns = agi_clock_now_ns();
+    int added = AddFontResourceA(dest_path);
+    trace_span("add_font_resource", started_ns);
+    if (added == 0) {
         agi_log_error("Failed to add font resource");
         return AGI_ERROR_IO;
     }
 
-    SendMessageA(HWND_BROADCAST, WM_FONTCHANGE, 0, 0);
+    broadcast_font_change();
 
     if (admin) {
         HKEY hKey;
         if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\Fonts", 0, KEY_SET_VALUE, &hKey) == ERROR_SUCCESS) {
-            RegSetValueExA(hKey, font_name, 0, REG_SZ, (BYTE*)dest_path, strlen(dest_path) + 1);
+            RegSetValueExA(hKey, file_name, 0, REG_SZ, (BYTE*)dest_path, strlen(dest_path) + 1);
             RegCloseKey(hKey);
         } else {
             agi_log_error("Failed to add font to registry");
@@ -146,27 +149,30 @@ agi_result_t install_font_windows(const char* font_path) {
     return AGI_SUCCESS;
 }
 
-agi_result_t uninstall_font(const char* font_name, const char* font_style, const char* font_extension) {
+agi_result_t install_font_file(const char* font_path, const char* font_name, const char* font_style, const char* font_extension,
+                               b8 move) {
+    u64 started_ns = agi_clock_now_ns();
+    agi_result_t result = place_font_file(font_path, font_name, font_style, font_extension, move);
+    metrics_record_since(AGI_HISTOGRAM_FONT_BACKEND_INSTALL, started_ns);
+    trace_span("install_file", started_ns);
+    metrics_add(result == AGI_SUCCESS ? AGI_COUNTER_FONT_INSTALLS : AGI_COUNTER_FONT_INSTALL_FAILURES, 1);
+    return result;
+}
+
+static agi_result_t remove_font_file(const char* file_name) {
+    if (!font_valid_name(file_name)) return AGI_ERROR_INVALID_ARGUMENT;
     BOOL admin = is_admin();
     char font_dir[MAX_PATH];
     char font_path[MAX_PATH];
+    agi_result_t result = font_directory(admin, font_dir);
+    if (result != AGI_SUCCESS) return result;
 
-    if (admin) {
-        if (FAILED(SHGetFolderPathA(NULL, CSIDL_FONTS, NULL, 0, font_dir))) {
-            agi_log_error("Failed to get system font directory");
-            return AGI_ERROR_IO;
-        }
-    } else {
-        if (FAILED(SHGetFolderPathA(NULL, CSIDL_LOCAL_APPDATA, NULL, 0, font_dir))) {
-            agi_log_error("Failed to get local app data directory");
-            return AGI_ERROR_IO;
-        }
-        strcat(font_dir, "\\Microsoft\\Windows\\Fonts");
-    }
+    snprintf(font_path, sizeof(font_path), "%s\\%s", font_dir, file_name);
 
-    snprintf(font_path, sizeof(font_path), "%s\\%s_%s%s", font_dir, font_name, font_style, font_extension);
-
-    if (RemoveFontResourceA(font_path) == 0) {
+    u64 started_ns = agi_clock_now_ns();
+    BOOL removed = RemoveFontResourceA(font_path);
+    trace_span("remove_font_resource", started_ns);
+    if (!removed) {
         agi_log_error("Failed to remove font resource");
         return AGI_ERROR_IO;
     }
@@ -176,41 +182,32 @@ agi_result_t uninstall_font(const char* font_name, const char* font_style, const
         return AGI_ERROR_IO;
     }
 
-    SendMessageA(HWND_BROADCAST, WM_FONTCHANGE, 0, 0);
+    broadcast_font_change();
 
     if (admin) {
         HKEY hKey;
         if (RegOpenKeyExA(HKEY_LOCAL_MACHINE, "SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\Fonts", 0, KEY_SET_VALUE, &hKey) == ERROR_SUCCESS) {
-            RegDeleteValueA(hKey, font_name);
+            // Same value name install_font_file() registered it under
+            RegDeleteValueA(hKey, file_name);
             RegCloseKey(hKey);
         } else {
             agi_log_error("Failed to remove font from registry");
         }
     }
 
-    agi_log_info("Font uninstalled successfully: %s", font_name);
     return AGI_SUCCESS;
 }
 
-agi_result_t install_font(const char* font_hash, const char* font_name, const char* font_style, const char* font_extension) {
-    char* url = create_url(AGI_FONT_URL, font_hash, font_extension);
-    if (!url) return AGI_ERROR_OUT_OF_MEMORY;
-
-    char temp_dir[MAX_PATH];
-    get_temp_dir(temp_dir);
-
-    char output_file_location[MAX_PATH];
-    snprintf(output_file_location, MAX_PATH, "%s%s_%s%s", temp_dir, font_name, font_style, font_extension);
-
-    agi_result_t download_result = download_file(url, output_file_location);
-
-    free(url);
-
-    if (download_result != AGI_SUCCESS) {
-        agi_log_error("Failed to download font");
-        return AGI_ERROR_NETWORK;
-    }
-
-    return install_font_windows(output_file_location);
+agi_result_t uninstall_font_file(const char* file_name) {
+    u64 started_ns = agi_clock_now_ns();
+    agi_result_t result = remove_font_file(file_name);
+    metrics_record_since(AGI_HISTOGRAM_FONT_BACKEND_UNINSTALL, started_ns);
+    trace_span("uninstall_file", started_ns);
+    metrics_add(result == AGI_SUCCESS ? AGI_COUNTER_FONT_UNINSTALLS : AGI_COUNTER_FONT_UNINSTALL_FAILURES, 1);
+    return result;
 }
 
+// Every install and uninstall already broadcast WM_FONTCHANGE; nothing is deferred
+void font_backend_shutdown(void) {
+}
+#endif
@@ -1,15 +1,13 @@
 #include "agi/log.h"
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <string.h>
 #include <time.h>
 
-#if defined(AGI_PLATFORM_WINDOWS)
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-#elif defined(AGI_PLATFORM_LINUX)
-#include <sys/time.h>
-#endif
+#include "agi/clock.h"
+#include "agi/thread.h"
 
 // ANSI color codes
 #define COLOR_RESET   "\x1b[0m"
@@ -20,11 +18,77 @@
 #define COLOR_YELLOW  "\x1b[33m"
 #define COLOR_RED     "\x1b[31m"
 
+#define LOG_RING_SLOTS 1024  // power of two
+#define LOG_MESSAGE_SIZE 472
+#define LOG_LINE_SIZE (LOG_MESSAGE_SIZE + 128)
+#define LOG_BATCH_SIZE (64 * 1024)
+// The writer wakes up this often on its own; warnings and errors wake it at once
+#define LOG_FLUSH_INTERVAL_MS 50
+// Drops are reported at most this often, however many there are
+#define LOG_DROP_REPORT_INTERVAL_MS 1000
+#define LOG_DEFAULT_MAX_FILE_BYTES (10 * 1024 * 1024)
+#define LOG_DEFAULT_MAX_FILES 5
+#define LOG_PATH_SIZE 1024
+
+// One queued message. The call site is kept as the __FILE__ pointer and line;
+// the message is formatted by the caller because arguments often point at
+// buffers that are gone by the time the writer gets to it.
+typedef struct {
+    atomic_size_t sequence;
+    u64 timestamp_ns;  // agi_clock_now_ns()
+    const char *file;
+    int line;
+    u8 level;
+    b8 truncated;
+    u16 length;
+    char message[LOG_MESSAGE_SIZE];
+} LogSlot;
+
+// Bounded MPSC ring (Vyukov): a slot whose sequence equals the enqueue position
+// is free for that position, position + 1 means it holds a message. Slots are
+// static so a caller racing shutdown never writes into freed memory.
+static LogSlot slots[LOG_RING_SLOTS];
+
+static struct {
+    atomic_size_t enqueue_position;
+    size_t dequeue_position;  // writer only
+    atomic_bool running;
+    atomic_uint_fast64_t dropped;
+    b8 initialized;
+
+    agi_mutex_t lock;
+    agi_cond_t wake;
+    agi_thread_t thread;
+    b8 stopping;
+
+    // Writer only
+    FILE *output;  // NULL = stderr
+    char path[LOG_PATH_SIZE];
+    u64 file_bytes;
+    u64 max_file_bytes;
+    u32 max_files;
+    u64 dropped_reported;
+    u64 last_drop_report_ms;
+    u64 wall_base_ns;  // wall clock at monotonic_base_ns
+    u64 monotonic_base_ns;
+    time_t cached_second;
+    char cached_timestamp[32];
+    char batch[LOG_BATCH_SIZE];
+    size_t batch_length;
+} logger;
+
 // Logging implementation
-static agi_log_level_t current_log_level = AGI_LOG_LEVEL_INFO;
+static atomic_int current_log_level = AGI_LOG_LEVEL_INFO;
+
+static const char *level_str[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+static const char *level_color[] = {COLOR_BLUE, COLOR_GREEN, COLOR_YELLOW, COLOR_RED};
 
 void agi_log_set_level(agi_log_level_t level) {
-    current_log_level = level;
+    atomic_store_explicit(&current_log_level, level, memory_order_relaxed);
+}
+
+u64 agi_log_dropped(void) {
+    return atomic_load_explicit(&logger.dropped, memory_order_relaxed);
 }
 
 static const char *get_filename(const char *path) {
@@ -35,30 +99,264 @@ static const char *get_filename(const char *path) {
     return filename ? filename + 1 : path;
 }
 
-void agi_log_message(agi_log_level_t level, const char *file, int line, const char *format, ...) {
-    if (level < current_log_level) return;
+static void format_timestamp(time_t seconds, char *timestamp, size_t size) {
+    struct tm tm_info;
+#if defined(AGI_PLATFORM_WINDOWS)
+    localtime_s(&tm_info, &seconds);
+#else
+    localtime_r(&seconds, &tm_info);
+#endif
+    strftime(timestamp, size, "%I:%M:%S %p", &tm_info);
+}
 
-    const char *level_str[] = {"DEBUG", "INFO", "WARN", "ERROR"};
-    const char *level_color[] = {COLOR_BLUE, COLOR_GREEN, COLOR_YELLOW, COLOR_RED};
+// Colored for the terminal, plain for files
+static int format_line(char *line, size_t size, b8 color, const char *timestamp, u8 level, const char *file, int source_line,
+                       const char *message, size_t message_length, b8 truncated) {
+    int length;
+    if (color) {
+        length = snprintf(line, size, "%s%s%s %s%s%-5s%s %s%s:%d:%s %.*s%s\n", COLOR_DIM, timestamp, COLOR_RESET, COLOR_BOLD,
+                          level_color[level], level_str[level], COLOR_RESET, COLOR_DIM, get_filename(file), source_line,
+                          COLOR_RESET, (int)message_length, message, truncated ? "..." : "");
+    } else {
+        length = snprintf(line, size, "%s %-5s %s:%d: %.*s%s\n", timestamp, level_str[level], get_filename(file), source_line,
+                          (int)message_length, message, truncated ? "..." : "");
+    }
+    if (length < 0) return 0;
+    return (size_t)length < size ? length : (int)size - 1;
+}
+
+// --- synchronous path, while no writer is running ---
+
+static void write_sync(agi_log_level_t level, const char *file, int line, const char *format, va_list args) {
+    char message[LOG_MESSAGE_SIZE];
+    int length = vsnprintf(message, sizeof(message), format, args);
+    b8 truncated = length >= (int)sizeof(message);
+    if (length < 0) length = 0;
+    if (truncated) length = sizeof(message) - 1;
 
     char timestamp[32];
-    time_t now;
-    struct tm *tm_info;
+    format_timestamp(time(NULL), timestamp, sizeof(timestamp));
+    char output[LOG_LINE_SIZE];
+    int output_length = format_line(output, sizeof(output), true, timestamp, (u8)level, file, line, message, (size_t)length, truncated);
+    fwrite(output, 1, (size_t)output_length, stderr);
+    fflush(stderr);
+}
 
-    time(&now);
-    tm_info = localtime(&now);
+// --- producers ---
 
-    strftime(timestamp, sizeof(timestamp), "%I:%M:%S %p", tm_info);
+// wake_writer is set every half ring, so a burst gets drained before it fills it
+static b8 enqueue(agi_log_level_t level, const char *file, int line, const char *format, va_list args, b8 *wake_writer) {
+    size_t position = atomic_load_explicit(&logger.enqueue_position, memory_order_relaxed);
+    LogSlot *slot;
+    for (;;) {
+        slot = &slots[position & (LOG_RING_SLOTS - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&logger.enqueue_position, &position, position + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            return false;  // full: the writer hasn't freed this slot yet
+        } else {
+            position = atomic_load_explicit(&logger.enqueue_position, memory_order_relaxed);
+        }
+    }
+
+    slot->timestamp_ns = agi_clock_now_ns();
+    slot->file = file;
+    slot->line = line;
+    slot->level = (u8)level;
+    int length = vsnprintf(slot->message, sizeof(slot->message), format, args);
+    slot->truncated = length >= (int)sizeof(slot->message);
+    slot->length = (u16)(length < 0 ? 0 : slot->truncated ? sizeof(slot->message) - 1 : (size_t)length);
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    *wake_writer = (position & (LOG_RING_SLOTS / 2 - 1)) == 0;
+    return true;
+}
 
-    fprintf(stderr, "%s%s%s ", COLOR_DIM, timestamp, COLOR_RESET);
-    fprintf(stderr, "%s%s%-5s%s ", COLOR_BOLD, level_color[level], level_str[level], COLOR_RESET);
-    fprintf(stderr, "%s%s:%d:%s ", COLOR_DIM, get_filename(file), line, COLOR_RESET);
+void agi_log_message(agi_log_level_t level, const char *file, int line, const char *format, ...) {
+    if ((int)level < atomic_load_explicit(&current_log_level, memory_order_relaxed)) return;
 
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    b8 wake_writer = false;
+    if (!atomic_load_explicit(&logger.running, memory_order_acquire)) {
+        write_sync(level, file, line, format, args);
+    } else if (!enqueue(level, file, line, format, args, &wake_writer)) {
+        atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+    } else if (level >= AGI_LOG_LEVEL_WARNING || wake_writer) {
+        agi_cond_signal(&logger.wake);
+    }
     va_end(args);
+}
 
-    fprintf(stderr, "\n");
-    fflush(stderr);
+// --- writer ---
+
+static FILE *open_log_file(void) {
+    FILE *file = fopen(logger.path, "ab");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    logger.file_bytes = size > 0 ? (u64)size : 0;
+    return file;
+}
+
+// path -> path.1 -> path.2 ... the oldest falls off the end
+static void rotate_log_file(void) {
+    fclose(logger.output);
+    logger.output = NULL;
+
+    char from[LOG_PATH_SIZE + 16];
+    char to[LOG_PATH_SIZE + 16];
+    snprintf(to, sizeof(to), "%s.%u", logger.path, logger.max_files);
+    remove(to);
+    for (u32 i = logger.max_files; i > 1; i--) {
+        snprintf(from, sizeof(from), "%s.%u", logger.path, i - 1);
+        snprintf(to, sizeof(to), "%s.%u", logger.path, i);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), "%s.1", logger.path);
+    rename(logger.path, to);
+
+    logger.output = open_log_file();
+}
+
+static void flush_batch(void) {
+    if (logger.batch_length == 0) return;
+    if (logger.path[0]) {
+        if (logger.output && logger.file_bytes + logger.batch_length > logger.max_file_bytes && logger.file_bytes > 0) {
+            rotate_log_file();
+        }
+        if (!logger.output) logger.output = open_log_file();
+    }
+
+    FILE *output = logger.output ? logger.output : stderr;
+    fwrite(logger.batch, 1, logger.batch_length, output);
+    fflush(output);
+    logger.file_bytes += logger.batch_length;
+    logger.batch_length = 0;
+}
+
+static void append_line(u8 level, u64 timestamp_ns, const char *file, int line, const char *message, size_t length, b8 truncated) {
+    u64 wall_ns = logger.wall_base_ns + (timestamp_ns - logger.monotonic_base_ns);
+    time_t second = (time_t)(wall_ns / 1000000000ULL);
+    if (second != logger.cached_second) {
+        // localtime is the expensive part, and most lines share their second with the previous one
+        format_timestamp(second, logger.cached_timestamp, sizeof(logger.cached_timestamp));
+        logger.cached_second = second;
+    }
+
+    if (sizeof(logger.batch) - logger.batch_length < LOG_LINE_SIZE) flush_batch();
+    logger.batch_length += (size_t)format_line(logger.batch + logger.batch_length, sizeof(logger.batch) - logger.batch_length,
+                                               !logger.path[0], logger.cached_timestamp, level, file, line, message, length,
+                                               truncated);
+}
+
+static void report_drops(b8 force) {
+    u64 dropped = atomic_load_explicit(&logger.dropped, memory_order_relaxed);
+    u64 now = agi_clock_now_ms();
+    if (dropped == logger.dropped_reported || (!force && now - logger.last_drop_report_ms < LOG_DROP_REPORT_INTERVAL_MS)) return;
+
+    char message[96];
+    int length = snprintf(message, sizeof(message), "Log ring full, dropped %llu messages",
+                          (unsigned long long)(dropped - logger.dropped_reported));
+    append_line(AGI_LOG_LEVEL_WARNING, agi_clock_now_ns(), __FILE__, __LINE__, message, (size_t)length, false);
+    logger.dropped_reported = dropped;
+    logger.last_drop_report_ms = now;
+}
+
+// Returns how many messages were written
+static u32 drain(b8 force_drop_report) {
+    u32 drained = 0;
+    for (;;) {
+        LogSlot *slot = &slots[logger.dequeue_position & (LOG_RING_SLOTS - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence != logger.dequeue_position + 1) break;  // empty, or still being written
+
+        append_line(slot->level, slot->timestamp_ns, slot->file, slot->line, slot->message, slot->length, slot->truncated);
+        atomic_store_explicit(&slot->sequence, logger.dequeue_position + LOG_RING_SLOTS, memory_order_release);
+        logger.dequeue_position++;
+        drained++;
+    }
+    report_drops(force_drop_report);
+    flush_batch();
+    return drained;
+}
+
+static void writer_main(void *arg) {
+    (void)arg;
+    agi_mutex_lock(&logger.lock);
+    for (;;) {
+        b8 stopping = logger.stopping;
+        agi_mutex_unlock(&logger.lock);
+        u32 drained = drain(stopping);
+        agi_mutex_lock(&logger.lock);
+
+        // Callers that saw the writer running may still be finishing their slot
+        b8 empty = atomic_load_explicit(&logger.enqueue_position, memory_order_acquire) == logger.dequeue_position;
+        if (logger.stopping && empty) break;
+        if (drained == 0) {
+            agi_cond_timed_wait(&logger.wake, &logger.lock, LOG_FLUSH_INTERVAL_MS);
+        }
+    }
+    agi_mutex_unlock(&logger.lock);
+}
+
+agi_result_t agi_log_start(const LogConfig *config) {
+    if (atomic_load_explicit(&logger.running, memory_order_relaxed)) return AGI_ERROR_INVALID_ARGUMENT;
+    if (!logger.initialized) {
+        for (size_t i = 0; i < LOG_RING_SLOTS; i++) {
+            atomic_init(&slots[i].sequence, i);
+        }
+        agi_mutex_init(&logger.lock);
+        agi_cond_init(&logger.wake);
+        logger.initialized = true;
+    }
+
+    logger.path[0] = '\0';
+    logger.max_file_bytes = config && config->max_file_bytes ? config->max_file_bytes : LOG_DEFAULT_MAX_FILE_BYTES;
+    logger.max_files = config && config->max_files ? config->max_files : LOG_DEFAULT_MAX_FILES;
+    if (config && config->file_path) {
+        int length = snprintf(logger.path, sizeof(logger.path), "%s", config->file_path);
+        if (length < 0 || (size_t)length >= sizeof(logger.path)) return AGI_ERROR_INVALID_ARGUMENT;
+        logger.output = open_log_file();
+        if (!logger.output) {
+            agi_log_error("Failed to open log file %s", config->file_path);
+            logger.path[0] = '\0';
+            return AGI_ERROR_IO;
+        }
+    }
+
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    logger.monotonic_base_ns = agi_clock_now_ns();
+    logger.wall_base_ns = (u64)now.tv_sec * 1000000000ULL + (u64)now.tv_nsec;
+    logger.cached_second = (time_t)-1;
+    logger.stopping = false;
+
+    agi_result_t result = agi_thread_create(&logger.thread, writer_main, NULL, 0);
+    if (result != AGI_SUCCESS) {
+        if (logger.output) fclose(logger.output);
+        logger.output = NULL;
+        return result;
+    }
+    atomic_store_explicit(&logger.running, true, memory_order_release);
+    return AGI_SUCCESS;
+}
+
+void agi_log_shutdown(void) {
+    if (!atomic_load_explicit(&logger.running, memory_order_relaxed)) return;
+
+    // New messages go straight to stderr; the writer finishes what's queued
+    atomic_store_explicit(&logger.running, false, memory_order_release);
+    agi_mutex_lock(&logger.lock);
+    logger.stopping = true;
+    agi_mutex_unlock(&logger.lock);
+    agi_cond_signal(&logger.wake);
+    agi_thread_join(logger.thread);
+
+    if (logger.output) fclose(logger.output);
+    logger.output = NULL;
 }
@@ -0,0 +1,88 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/memory.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every block carries its size in a header padded to keep the payload max-aligned
+typedef union {
+    size_t size;
+    max_align_t align;
+} AllocationHeader;
+
+static atomic_uint_fast64_t allocations;
+static atomic_uint_fast64_t reallocations;
+static atomic_uint_fast64_t frees;
+static atomic_uint_fast64_t bytes_in_use;
+static atomic_uint_fast64_t peak_bytes_in_use;
+
+static void track_growth(size_t added) {
+    u64 now = atomic_fetch_add_explicit(&bytes_in_use, added, memory_order_relaxed) + added;
+    u64 peak = atomic_load_explicit(&peak_bytes_in_use, memory_order_relaxed);
+    while (now > peak && !atomic_compare_exchange_weak_explicit(&peak_bytes_in_use, &peak, now, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void *agi_malloc(size_t size) {
+    AllocationHeader *header = malloc(sizeof(AllocationHeader) + size);
+    if (!header) {
+        return NULL;
+    }
+    header->size = size;
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    track_growth(size);
+    return header + 1;
+}
+
+void *agi_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *pointer = agi_malloc(count * size);
+    if (pointer) {
+        memset(pointer, 0, count * size);
+    }
+    return pointer;
+}
+
+void *agi_realloc(void *pointer, size_t size) {
+    if (!pointer) {
+        return agi_malloc(size);
+    }
+
+    AllocationHeader *header = (AllocationHeader *)pointer - 1;
+    size_t old_size = header->size;
+    AllocationHeader *grown = realloc(header, sizeof(AllocationHeader) + size);
+    if (!grown) {
+        return NULL;
+    }
+    grown->size = size;
+    atomic_fetch_add_explicit(&reallocations, 1, memory_order_relaxed);
+    if (size >= old_size) {
+        track_growth(size - old_size);
+    } else {
+        atomic_fetch_sub_explicit(&bytes_in_use, old_size - size, memory_order_relaxed);
+    }
+    return grown + 1;
+}
+
+void agi_free(void *pointer) {
+    if (!pointer) {
+        return;
+    }
+    AllocationHeader *header = (AllocationHeader *)pointer - 1;
+    atomic_fetch_add_explicit(&frees, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&bytes_in_use, header->size, memory_order_relaxed);
+    free(header);
+}
+
+void agi_memory_get_stats(AgiMemoryStats *stats) {
+    stats->allocations = atomic_load_explicit(&allocations, memory_order_relaxed);
+    stats->reallocations = atomic_load_explicit(&reallocations, memory_order_relaxed);
+    stats->frees = atomic_load_explicit(&frees, memory_order_relaxed);
+    stats->bytes_in_use = atomic_load_explicit(&bytes_in_use, memory_order_relaxed);
+    stats->peak_bytes_in_use = atomic_load_explicit(&peak_bytes_in_use, memory_order_relaxed);
+}
@@ -0,0 +1,239 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/metrics.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "agi/clock.h"
+#include "agi/memory.h"
+#include "agi/thread.h"
+
+#if defined(AGI_PLATFORM_WINDOWS)
+#include <intrin.h>
+#endif
+
+#define METRICS_PATH_SIZE 1024
+#define METRICS_TEXT_SIZE (16 * 1024)
+
+typedef struct {
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t max;
+    atomic_uint_fast64_t buckets[AGI_HISTOGRAM_BUCKETS];
+} ShardHistogram;
+
+// Written only by its own thread, so updates are a load and a store
+typedef struct MetricsShard {
+    struct MetricsShard *next;
+    atomic_uint_fast64_t counters[AGI_COUNTER_COUNT];
+    ShardHistogram histograms[AGI_HISTOGRAM_COUNT];
+} MetricsShard;
+
+static _Atomic(MetricsShard *) shards;
+static atomic_uint_fast64_t started_ns;
+static AGI_THREAD_LOCAL MetricsShard *thread_shard;
+
+static const char *counter_names[AGI_COUNTER_COUNT] = {
+    [AGI_COUNTER_TCP_PACKETS_RECEIVED] = "tcp_packets_received",
+    [AGI_COUNTER_TCP_PACKETS_SENT] = "tcp_packets_sent",
+    [AGI_COUNTER_TCP_BYTES_RECEIVED] = "tcp_bytes_received",
+    [AGI_COUNTER_TCP_BYTES_SENT] = "tcp_bytes_sent",
+    [AGI_COUNTER_TCP_UNKNOWN_PACKETS] = "tcp_unknown_packets",
+    [AGI_COUNTER_TCP_SEND_CALLS] = "tcp_send_calls",
+    [AGI_COUNTER_TCP_RECV_CALLS] = "tcp_recv_calls",
+    [AGI_COUNTER_DOWNLOADS_SUCCEEDED] = "downloads_succeeded",
+    [AGI_COUNTER_DOWNLOADS_FAILED] = "downloads_failed",
+    [AGI_COUNTER_DOWNLOAD_RETRIES] = "download_retries",
+    [AGI_COUNTER_DOWNLOAD_RESTARTS] = "download_restarts",
+    [AGI_COUNTER_DOWNLOAD_BYTES] = "download_bytes",
+    [AGI_COUNTER_DOWNLOAD_WIRE_BYTES] = "download_wire_bytes",
+    [AGI_COUNTER_FONT_INSTALLS] = "font_installs",
+    [AGI_COUNTER_FONT_INSTALL_FAILURES] = "font_install_failures",
+    [AGI_COUNTER_FONT_UNINSTALLS] = "font_uninstalls",
+    [AGI_COUNTER_FONT_UNINSTALL_FAILURES] = "font_uninstall_failures",
+};
+
+static const char *histogram_names[AGI_HISTOGRAM_COUNT] = {
+    [AGI_HISTOGRAM_TCP_HANDLER] = "tcp_handler_us",
+    [AGI_HISTOGRAM_DOWNLOAD] = "download_us",
+    [AGI_HISTOGRAM_FONT_BACKEND_INSTALL] = "font_backend_install_us",
+    [AGI_HISTOGRAM_FONT_BACKEND_UNINSTALL] = "font_backend_uninstall_us",
+    [AGI_HISTOGRAM_FONT_CACHE_REFRESH] = "font_cache_refresh_us",
+};
+
+const char *metrics_counter_name(agi_counter_t counter) {
+    return counter < AGI_COUNTER_COUNT ? counter_names[counter] : "unknown";
+}
+
+const char *metrics_histogram_name(agi_histogram_t histogram) {
+    return histogram < AGI_HISTOGRAM_COUNT ? histogram_names[histogram] : "unknown";
+}
+
+// First use on a thread links a new shard in; NULL only if that allocation failed
+static MetricsShard *current_shard(void) {
+    MetricsShard *shard = thread_shard;
+    if (shard) return shard;
+
+    shard = agi_calloc(1, sizeof(MetricsShard));
+    if (!shard) return NULL;
+    uint_fast64_t unset = 0;
+    atomic_compare_exchange_strong(&started_ns, &unset, agi_clock_now_ns());
+    MetricsShard *head = atomic_load_explicit(&shards, memory_order_relaxed);
+    do {
+        shard->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&shards, &head, shard, memory_order_release, memory_order_relaxed));
+    thread_shard = shard;
+    return shard;
+}
+
+static inline void bump(atomic_uint_fast64_t *value, u64 amount) {
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+void metrics_add(agi_counter_t counter, u64 value) {
+    MetricsShard *shard = current_shard();
+    if (shard) bump(&shard->counters[counter], value);
+}
+
+static u32 highest_bit(u64 value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (u32)index;
+#else
+    return 63 - (u32)__builtin_clzll(value);
+#endif
+}
+
+u32 metrics_bucket_index(u64 value) {
+    const u64 linear = 1u << AGI_HISTOGRAM_SUB_BUCKET_BITS;
+    if (value < linear) return (u32)value;
+    u32 bit = highest_bit(value);
+    if (bit >= AGI_HISTOGRAM_MAX_BITS) return AGI_HISTOGRAM_BUCKETS - 1;
+    u32 sub = (u32)(value >> (bit - AGI_HISTOGRAM_SUB_BUCKET_BITS)) & (u32)(linear - 1);
+    return ((bit - AGI_HISTOGRAM_SUB_BUCKET_BITS + 1) << AGI_HISTOGRAM_SUB_BUCKET_BITS) + sub;
+}
+
+u64 metrics_bucket_lower_bound(u32 bucket) {
+    const u32 linear = 1u << AGI_HISTOGRAM_SUB_BUCKET_BITS;
+    if (bucket < linear) return bucket;
+    u32 bit = (bucket >> AGI_HISTOGRAM_SUB_BUCKET_BITS) + AGI_HISTOGRAM_SUB_BUCKET_BITS - 1;
+    u64 sub = bucket & (linear - 1);
+    return (linear + sub) << (bit - AGI_HISTOGRAM_SUB_BUCKET_BITS);
+}
+
+void metrics_record(agi_histogram_t histogram, u64 value) {
+    MetricsShard *shard = current_shard();
+    if (!shard) return;
+    ShardHistogram *target = &shard->histograms[histogram];
+    bump(&target->count, 1);
+    bump(&target->sum, value);
+    bump(&target->buckets[metrics_bucket_index(value)], 1);
+    if (value > atomic_load_explicit(&target->max, memory_order_relaxed)) {
+        atomic_store_explicit(&target->max, value, memory_order_relaxed);
+    }
+}
+
+void metrics_record_since(agi_histogram_t histogram, u64 started) {
+    metrics_record(histogram, (agi_clock_now_ns() - started) / 1000);
+}
+
+void metrics_snapshot(MetricsSnapshot *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    u64 start = atomic_load_explicit(&started_ns, memory_order_relaxed);
+    snapshot->uptime_ms = start ? (agi_clock_now_ns() - start) / 1000000 : 0;
+
+    for (MetricsShard *shard = atomic_load_explicit(&shards, memory_order_acquire); shard; shard = shard->next) {
+        for (u32 i = 0; i < AGI_COUNTER_COUNT; i++) {
+            snapshot->counters[i] += atomic_load_explicit(&shard->counters[i], memory_order_relaxed);
+        }
+        for (u32 i = 0; i < AGI_HISTOGRAM_COUNT; i++) {
+            const ShardHistogram *source = &shard->histograms[i];
+            MetricsHistogram *target = &snapshot->histograms[i];
+            target->count += atomic_load_explicit(&source->count, memory_order_relaxed);
+            target->sum += atomic_load_explicit(&source->sum, memory_order_relaxed);
+            u64 max = atomic_load_explicit(&source->max, memory_order_relaxed);
+            if (max > target->max) target->max = max;
+            for (u32 bucket = 0; bucket < AGI_HISTOGRAM_BUCKETS; bucket++) {
+                target->buckets[bucket] += atomic_load_explicit(&source->buckets[bucket], memory_order_relaxed);
+            }
+        }
+    }
+}
+
+u64 metrics_histogram_quantile(const MetricsHistogram *histogram, f64 q) {
+    // Counted from the buckets: count may have moved on while they were read
+    u64 total = 0;
+    for (u32 bucket = 0; bucket < AGI_HISTOGRAM_BUCKETS; bucket++) total += histogram->buckets[bucket];
+    if (total == 0) return 0;
+
+    u64 rank = (u64)(q * (f64)total + 0.5);
+    if (rank == 0) rank = 1;
+    u64 seen = 0;
+    for (u32 bucket = 0; bucket < AGI_HISTOGRAM_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank) {
+            u64 upper = bucket + 1 < AGI_HISTOGRAM_BUCKETS ? metrics_bucket_lower_bound(bucket + 1) - 1 : histogram->max;
+            return MIN(upper, histogram->max);
+        }
+    }
+    return histogram->max;
+}
+
+size_t metrics_format_text(const MetricsSnapshot *snapshot, char *buffer, size_t size) {
+    size_t length = 0;
+#define APPEND(...)                                                              \
+    do {                                                                         \
+        int written = snprintf(buffer + length, size - length, __VA_ARGS__);    \
+        if (written > 0) length += MIN((size_t)written, size - length - 1);      \
+    } while (0)
+
+    if (size == 0) return 0;
+    buffer[0] = '\0';
+    APPEND("uptime_ms %llu\n", (unsigned long long)snapshot->uptime_ms);
+    for (u32 i = 0; i < AGI_COUNTER_COUNT; i++) {
+        APPEND("%s %llu\n", counter_names[i], (unsigned long long)snapshot->counters[i]);
+    }
+    for (u32 i = 0; i < AGI_HISTOGRAM_COUNT; i++) {
+        const MetricsHistogram *histogram = &snapshot->histograms[i];
+        APPEND("%s count=%llu sum=%llu p50=%llu p90=%llu p99=%llu max=%llu\n", histogram_names[i],
+               (unsigned long long)histogram->count, (unsigned long long)histogram->sum,
+               (unsigned long long)metrics_histogram_quantile(histogram, 0.50),
+               (unsigned long long)metrics_histogram_quantile(histogram, 0.90),
+               (unsigned long long)metrics_histogram_quantile(histogram, 0.99), (unsigned long long)histogram->max);
+    }
+#undef APPEND
+    return length;
+}
+
+agi_result_t metrics_write_text_file(const char *path) {
+    MetricsSnapshot *snapshot = agi_malloc(sizeof(MetricsSnapshot));
+    char *text = agi_malloc(METRICS_TEXT_SIZE);
+    if (!snapshot || !text) {
+        agi_free(snapshot);
+        agi_free(text);
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+    metrics_snapshot(snapshot);
+    size_t length = metrics_format_text(snapshot, text, METRICS_TEXT_SIZE);
+    agi_free(snapshot);
+
+    // Readers polling the file never see it half-written
+    char temp_path[METRICS_PATH_SIZE];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *file = fopen(temp_path, "wb");
+    b8 written = file && fwrite(text, 1, length, file) == length;
+    if (file && fclose(file) != 0) written = false;
+    agi_free(text);
+    if (!written) {
+        remove(temp_path);
+        return AGI_ERROR_IO;
+    }
+#if defined(AGI_PLATFORM_WINDOWS)
+    remove(path);
+#endif
+    return rename(temp_path, path) == 0 ? AGI_SUCCESS : AGI_ERROR_IO;
+}
@@ -0,0 +1,108 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/packet_dispatch.h"
+
+#include <string.h>
+
+#include "agi/memory.h"
+
+#define MIN_TABLE_CAPACITY 8
+// A direct-indexed table may be this many times larger than a hashed one
+#define DIRECT_INDEX_SLACK 4
+
+static u32 dispatch_slot(const PacketDispatchTable *table, u16 packet_type) {
+    return (((u32)packet_type * table->multiplier) >> table->shift) & (table->capacity - 1);
+}
+
+static u32 next_pow2(u32 value) {
+    u32 result = MIN_TABLE_CAPACITY;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+static u32 log2_u32(u32 value) {
+    u32 bits = 0;
+    while (value > 1) {
+        value >>= 1;
+        bits++;
+    }
+    return bits;
+}
+
+void packet_dispatch_init(PacketDispatchTable *table) {
+    memset(table, 0, sizeof(*table));
+}
+
+void packet_dispatch_free(PacketDispatchTable *table) {
+    agi_free(table->entries);
+    packet_dispatch_init(table);
+}
+
+agi_result_t packet_dispatch_insert(PacketDispatchTable *table, PacketHandlerInfo info) {
+    if (packet_dispatch_find(table, info.type)) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    u32 count = table->count + 1;
+    u32 max_type = info.type;
+    for (u32 i = 0; i < table->capacity; i++) {
+        if (table->entries[i].registered && table->entries[i].type > max_type) {
+            max_type = table->entries[i].type;
+        }
+    }
+
+    // Dense type ranges (the normal case) index directly and never collide;
+    // sparse ones fall back to multiplicative hashing at <= 50% load
+    PacketDispatchTable grown = {0};
+    u32 hashed_capacity = next_pow2(count * 2);
+    u32 direct_capacity = next_pow2(max_type + 2);  // keep a free slot to end probes
+    if (direct_capacity <= hashed_capacity * DIRECT_INDEX_SLACK) {
+        grown.capacity = direct_capacity;
+        grown.multiplier = 1;
+        grown.shift = 0;
+    } else {
+        grown.capacity = hashed_capacity;
+        grown.multiplier = 0x9E3779B1u;
+        grown.shift = 32 - log2_u32(hashed_capacity);
+    }
+
+    grown.entries = agi_calloc(grown.capacity, sizeof(PacketHandlerInfo));
+    if (!grown.entries) {
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+
+    info.registered = true;
+    for (u32 i = 0; i <= table->capacity; i++) {
+        const PacketHandlerInfo *item = i < table->capacity ? &table->entries[i] : &info;
+        if (!item->registered) continue;
+
+        u32 slot = dispatch_slot(&grown, item->type);
+        while (grown.entries[slot].registered) {
+            slot = (slot + 1) & (grown.capacity - 1);
+        }
+        grown.entries[slot] = *item;
+    }
+    grown.count = count;
+
+    packet_dispatch_free(table);
+    *table = grown;
+    return AGI_SUCCESS;
+}
+
+const PacketHandlerInfo *packet_dispatch_find(const PacketDispatchTable *table, u16 packet_type) {
+    if (table->count == 0) {
+        return NULL;
+    }
+
+    u32 slot = dispatch_slot(table, packet_type);
+    while (table->entries[slot].registered) {
+        if (table->entries[slot].type == packet_type) {
+            return &table->entries[slot];
+        }
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    return NULL;
+}
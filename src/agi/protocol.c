@@ -0,0 +1,255 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/protocol.h"
+
+#include <string.h>
+
+#include "agi/memory.h"
+
+// View over a fixed-size, possibly unterminated char array from a v1 struct
+static WireString fixed_string(const char *data, size_t capacity) {
+    const char *end = memchr(data, '\0', capacity);
+    return (WireString){.data = data, .length = (u32)(end ? (size_t)(end - data) : capacity)};
+}
+
+agi_result_t protocol_decode_auth_response(const TcpClient *client, const void *packet_data, size_t packet_size, AuthResponse *response) {
+    if (tcp_client_protocol_version(client) < AGI_PROTOCOL_V2) {
+        if (packet_size < sizeof(AuthResponsePacket)) {
+            return AGI_ERROR_PROTOCOL;
+        }
+        const AuthResponsePacket *packet = (const AuthResponsePacket *)packet_data;
+        response->success = packet->success;
+        response->message = fixed_string(packet->message, sizeof(packet->message));
+        return AGI_SUCCESS;
+    }
+
+    WireReader reader = wire_reader(packet_data, packet_size);
+    response->success = wire_read_u8(&reader);
+    response->message = wire_read_string(&reader);
+    return reader.failed ? AGI_ERROR_PROTOCOL : AGI_SUCCESS;
+}
+
+agi_result_t protocol_decode_font_install_request(const TcpClient *client, const void *packet_data, size_t packet_size, FontInstallRequest *request) {
+    if (tcp_client_protocol_version(client) < AGI_PROTOCOL_V2) {
+        if (packet_size < sizeof(FontInstallRequestPacket)) {
+            return AGI_ERROR_PROTOCOL;
+        }
+        const FontInstallRequestPacket *packet = (const FontInstallRequestPacket *)packet_data;
+        request->font_hash = fixed_string(packet->font_hash, sizeof(packet->font_hash));
+        request->font_name = fixed_string(packet->font_name, sizeof(packet->font_name));
+        request->font_style = fixed_string(packet->font_style, sizeof(packet->font_style));
+        request->font_extension = fixed_string(packet->font_extension, sizeof(packet->font_extension));
+        request->install = packet->install;
+        return AGI_SUCCESS;
+    }
+
+    WireReader reader = wire_reader(packet_data, packet_size);
+    request->font_hash = wire_read_string(&reader);
+    request->font_name = wire_read_string(&reader);
+    request->font_style = wire_read_string(&reader);
+    request->font_extension = wire_read_string(&reader);
+    request->install = wire_read_u8(&reader);
+    return reader.failed ? AGI_ERROR_PROTOCOL : AGI_SUCCESS;
+}
+
+agi_result_t protocol_decode_font_batch_request(const TcpClient *client, const void *packet_data, size_t packet_size, FontBatchRequest *request) {
+    if (tcp_client_protocol_version(client) < AGI_PROTOCOL_V2) {
+        // Variable-length payloads can't be framed on v1
+        return AGI_ERROR_PROTOCOL;
+    }
+
+    WireReader reader = wire_reader(packet_data, packet_size);
+    request->job_id = wire_read_varint(&reader);
+    u64 count = wire_read_varint(&reader);
+    if (reader.failed || count > AGI_MAX_BATCH_ENTRIES) {
+        return AGI_ERROR_PROTOCOL;
+    }
+    request->count = (u32)count;
+    request->entries = reader;
+    return AGI_SUCCESS;
+}
+
+b8 protocol_next_font_batch_entry(FontBatchRequest *request, FontInstallRequest *entry) {
+    WireReader *reader = &request->entries;
+    if (reader->failed || wire_reader_remaining(reader) == 0) {
+        return false;
+    }
+    entry->install = wire_read_u8(reader);
+    entry->font_hash = wire_read_string(reader);
+    entry->font_name = wire_read_string(reader);
+    entry->font_style = wire_read_string(reader);
+    entry->font_extension = wire_read_string(reader);
+    return !reader->failed;
+}
+
+agi_result_t protocol_decode_reconcile_query(const TcpClient *client, const void *packet_data, size_t packet_size, ReconcileQuery *query) {
+    if (tcp_client_protocol_version(client) < AGI_PROTOCOL_V2) {
+        return AGI_ERROR_PROTOCOL;
+    }
+
+    WireReader reader = wire_reader(packet_data, packet_size);
+    query->session = wire_read_varint(&reader);
+    u64 count = wire_read_varint(&reader);
+    if (reader.failed || count > AGI_MAX_RECONCILE_PREFIXES) {
+        return AGI_ERROR_PROTOCOL;
+    }
+    query->count = (u32)count;
+    query->prefixes = reader;
+    return AGI_SUCCESS;
+}
+
+agi_result_t protocol_decode_stats_request(const TcpClient *client, const void *packet_data, size_t packet_size, u64 *request_id) {
+    if (tcp_client_protocol_version(client) < AGI_PROTOCOL_V2) {
+        return AGI_ERROR_PROTOCOL;
+    }
+
+    WireReader reader = wire_reader(packet_data, packet_size);
+    *request_id = wire_read_varint(&reader);
+    return reader.failed ? AGI_ERROR_PROTOCOL : AGI_SUCCESS;
+}
+
+agi_result_t protocol_decode_trace_dump_request(const TcpClient *client, const void *packet_data, size_t packet_size, u64 *request_id,
+                                                u64 *trace_id) {
+    if (tcp_client_protocol_version(client) < AGI_PROTOCOL_V2) {
+        return AGI_ERROR_PROTOCOL;
+    }
+
+    WireReader reader = wire_reader(packet_data, packet_size);
+    *request_id = wire_read_varint(&reader);
+    *trace_id = wire_read_varint(&reader);
+    return reader.failed ? AGI_ERROR_PROTOCOL : AGI_SUCCESS;
+}
+
+b8 protocol_next_reconcile_prefix(ReconcileQuery *query, WireString *prefix) {
+    WireReader *reader = &query->prefixes;
+    if (reader->failed || wire_reader_remaining(reader) == 0) {
+        return false;
+    }
+    *prefix = wire_read_string(reader);
+    return !reader->failed;
+}
+
+agi_result_t protocol_send_font_install_response(TcpClient *client, b8 success, const char *message) {
+    if (tcp_client_protocol_version(client) < AGI_PROTOCOL_V2) {
+        FontInstallResponsePacket response = {0};
+        response.success = success;
+        strncpy(response.message, message, sizeof(response.message) - 1);
+        return tcp_client_send_packet(client, AGI_PACKET_FONT_INSTALL_RESPONSE, &response, sizeof(response));
+    }
+
+    u8 buffer[sizeof(FontInstallResponsePacket) + WIRE_MAX_VARINT_SIZE];
+    WireWriter writer = wire_writer(buffer, sizeof(buffer));
+    wire_write_u8(&writer, success);
+    wire_write_string(&writer, message, MIN(strlen(message), sizeof(((FontInstallResponsePacket *)0)->message) - 1));
+    if (writer.failed) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+    return tcp_client_send_packet(client, AGI_PACKET_FONT_INSTALL_RESPONSE, buffer, writer.length);
+}
+
+agi_result_t protocol_send_font_batch_response(TcpClient *client, u64 job_id, u32 count, const u8 *bitmap,
+                                               const FontBatchFailure *failures, u32 failure_count) {
+    if (tcp_client_protocol_version(client) < AGI_PROTOCOL_V2 || failure_count > count) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    size_t bitmap_size = ((size_t)count + 7) / 8;
+    size_t capacity = 3 * WIRE_MAX_VARINT_SIZE + bitmap_size + (size_t)failure_count * 2 * WIRE_MAX_VARINT_SIZE;
+    u8 *buffer = agi_malloc(capacity);
+    if (!buffer) {
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+
+    WireWriter writer = wire_writer(buffer, capacity);
+    wire_write_varint(&writer, job_id);
+    wire_write_varint(&writer, count);
+    wire_write_bytes(&writer, bitmap, bitmap_size);
+    wire_write_varint(&writer, failure_count);
+    for (u32 i = 0; i < failure_count; i++) {
+        wire_write_varint(&writer, failures[i].index);
+        wire_write_varint(&writer, (u64)failures[i].error);
+    }
+
+    agi_result_t result = tcp_client_send_packet(client, AGI_PACKET_FONT_BATCH_RESPONSE, buffer, writer.length);
+    agi_free(buffer);
+    return result;
+}
+
+agi_result_t protocol_send_reconcile_digest(TcpClient *client, u64 session, u32 count, const u8 digest[32]) {
+    if (tcp_client_protocol_version(client) < AGI_PROTOCOL_V2) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    u8 buffer[2 * WIRE_MAX_VARINT_SIZE + 32];
+    WireWriter writer = wire_writer(buffer, sizeof(buffer));
+    wire_write_varint(&writer, session);
+    wire_write_varint(&writer, count);
+    wire_write_bytes(&writer, digest, 32);
+    return tcp_client_send_packet(client, AGI_PACKET_RECONCILE_DIGEST, buffer, writer.length);
+}
+
+agi_result_t protocol_send_stats_response(TcpClient *client, u64 request_id, const MetricsSnapshot *snapshot) {
+    if (tcp_client_protocol_version(client) < AGI_PROTOCOL_V2) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    // Names are short; every bucket of every histogram being non-empty is the worst case
+    size_t capacity = 6 * WIRE_MAX_VARINT_SIZE + AGI_COUNTER_COUNT * (64 + WIRE_MAX_VARINT_SIZE) +
+                      AGI_HISTOGRAM_COUNT * (64 + 4 * WIRE_MAX_VARINT_SIZE + AGI_HISTOGRAM_BUCKETS * 2 * WIRE_MAX_VARINT_SIZE);
+    u8 *buffer = agi_malloc(capacity);
+    if (!buffer) {
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+
+    WireWriter writer = wire_writer(buffer, capacity);
+    wire_write_varint(&writer, request_id);
+    wire_write_varint(&writer, snapshot->uptime_ms);
+    wire_write_varint(&writer, AGI_COUNTER_COUNT);
+    for (u32 i = 0; i < AGI_COUNTER_COUNT; i++) {
+        wire_write_cstring(&writer, metrics_counter_name(i));
+        wire_write_varint(&writer, snapshot->counters[i]);
+    }
+    wire_write_varint(&writer, AGI_HISTOGRAM_SUB_BUCKET_BITS);
+    wire_write_varint(&writer, AGI_HISTOGRAM_COUNT);
+    for (u32 i = 0; i < AGI_HISTOGRAM_COUNT; i++) {
+        const MetricsHistogram *histogram = &snapshot->histograms[i];
+        wire_write_cstring(&writer, metrics_histogram_name(i));
+        wire_write_varint(&writer, histogram->count);
+        wire_write_varint(&writer, histogram->sum);
+        wire_write_varint(&writer, histogram->max);
+        u32 used = 0;
+        for (u32 bucket = 0; bucket < AGI_HISTOGRAM_BUCKETS; bucket++) {
+            if (histogram->buckets[bucket]) used++;
+        }
+        wire_write_varint(&writer, used);
+        for (u32 bucket = 0; bucket < AGI_HISTOGRAM_BUCKETS; bucket++) {
+            if (!histogram->buckets[bucket]) continue;
+            wire_write_varint(&writer, bucket);
+            wire_write_varint(&writer, histogram->buckets[bucket]);
+        }
+    }
+
+    agi_result_t result = writer.failed ? AGI_ERROR_INVALID_ARGUMENT
+                                        : tcp_client_send_packet(client, AGI_PACKET_STATS_RESPONSE, buffer, writer.length);
+    agi_free(buffer);
+    return result;
+}
+
+agi_result_t protocol_send_trace_dump_response(TcpClient *client, u64 request_id, agi_result_t result, u32 span_count,
+                                               const char *path) {
+    if (tcp_client_protocol_version(client) < AGI_PROTOCOL_V2) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    u8 buffer[4 * WIRE_MAX_VARINT_SIZE + 1024];
+    WireWriter writer = wire_writer(buffer, sizeof(buffer));
+    wire_write_varint(&writer, request_id);
+    wire_write_varint(&writer, (u64)result);
+    wire_write_varint(&writer, span_count);
+    wire_write_cstring(&writer, path ? path : "");
+    if (writer.failed) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+    return tcp_client_send_packet(client, AGI_PACKET_TRACE_DUMP_RESPONSE, buffer, writer.length);
+}
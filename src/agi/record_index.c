@@ -0,0 +1,110 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/record_index.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "agi/memory.h"
+
+#if defined(AGI_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#define SLOTS_MIN_CAPACITY 16
+#define RECORDS_MIN_CAPACITY 64
+
+u32 record_key(const char *key, size_t length) {
+    u32 value = 0x811C9DC5;  // FNV-1a
+    for (size_t i = 0; i < length && key[i]; i++) {
+        value ^= (u8)key[i];
+        value *= 0x01000193;
+    }
+    return value;
+}
+
+agi_result_t record_slots_reset(RecordSlots *table, u32 count) {
+    u64 capacity = SLOTS_MIN_CAPACITY;
+    while (capacity < (u64)count * 2 + 2) capacity *= 2;
+
+    if (capacity != table->capacity) {
+        u32 *slots = capacity <= UINT32_MAX && capacity <= SIZE_MAX / sizeof(u32)
+                         ? agi_malloc((size_t)capacity * sizeof(u32))
+                         : NULL;
+        if (!slots) {
+            record_slots_free(table);
+            return AGI_ERROR_OUT_OF_MEMORY;
+        }
+        agi_free(table->slots);
+        table->slots = slots;
+        table->capacity = (u32)capacity;
+    }
+    memset(table->slots, 0, (size_t)table->capacity * sizeof(u32));
+    return AGI_SUCCESS;
+}
+
+b8 record_slots_room(const RecordSlots *table, u32 count) {
+    return (u64)count * 2 + 2 <= table->capacity;
+}
+
+void record_slots_insert(RecordSlots *table, u32 key, u32 index) {
+    if (table->capacity == 0) return;
+    u32 mask = table->capacity - 1;
+    u32 slot = key & mask;
+    while (table->slots[slot]) slot = (slot + 1) & mask;
+    table->slots[slot] = index + 1;
+}
+
+u32 record_slots_find(const RecordSlots *table, u32 key, RecordMatch match, const void *records, const void *wanted) {
+    if (table->capacity == 0) return UINT32_MAX;
+    u32 mask = table->capacity - 1;
+    for (u32 slot = key & mask;; slot = (slot + 1) & mask) {
+        u32 index = table->slots[slot];
+        if (index == 0) return UINT32_MAX;
+        if (match(records, index - 1, wanted)) return index - 1;
+    }
+}
+
+void record_slots_free(RecordSlots *table) {
+    agi_free(table->slots);
+    table->slots = NULL;
+    table->capacity = 0;
+}
+
+agi_result_t record_array_reserve(void **records, u32 *capacity, u32 count, size_t record_size) {
+    if (count <= *capacity) return AGI_SUCCESS;
+    // Wide enough that doubling past UINT32_MAX / 2 can't wrap to 0
+    u64 grown = *capacity ? *capacity : RECORDS_MIN_CAPACITY;
+    while (grown < count) grown *= 2;
+    if (grown > UINT32_MAX || grown > SIZE_MAX / record_size) return AGI_ERROR_OUT_OF_MEMORY;
+    void *resized = agi_realloc(*records, (size_t)grown * record_size);
+    if (!resized) return AGI_ERROR_OUT_OF_MEMORY;
+    *records = resized;
+    *capacity = (u32)grown;
+    return AGI_SUCCESS;
+}
+
+b8 record_file_replace(const char *from, const char *to) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+agi_result_t record_file_write(const char *path, const char *temp_path, const void *header, size_t header_size,
+                               const void *records, size_t record_size, u32 count) {
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) return AGI_ERROR_IO;
+    b8 written = fwrite(header, header_size, 1, file) == 1 &&
+                 (count == 0 || fwrite(records, record_size, count, file) == count);
+    written = (fclose(file) == 0) && written;
+
+    if (!written || !record_file_replace(temp_path, path)) {
+        remove(temp_path);
+        return AGI_ERROR_IO;
+    }
+    return AGI_SUCCESS;
+}
@@ -0,0 +1,143 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/ring_buffer.h"
+
+#include <string.h>
+
+#include "agi/memory.h"
+
+agi_result_t ring_buffer_init(RingBuffer *buffer, size_t capacity) {
+    buffer->data = capacity ? agi_malloc(capacity) : NULL;
+    if (capacity && !buffer->data) {
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+    buffer->capacity = capacity;
+    buffer->origin = 0;
+    buffer->head = 0;
+    buffer->tail = 0;
+    return AGI_SUCCESS;
+}
+
+void ring_buffer_free(RingBuffer *buffer) {
+    agi_free(buffer->data);
+    buffer->data = NULL;
+    buffer->capacity = 0;
+    buffer->origin = 0;
+    buffer->head = 0;
+    buffer->tail = 0;
+}
+
+static void ring_buffer_compact(RingBuffer *buffer) {
+    if (buffer->head == buffer->origin) return;
+    size_t size = buffer->tail - buffer->head;
+    memmove(buffer->data + buffer->origin, buffer->data + buffer->head, size);
+    buffer->head = buffer->origin;
+    buffer->tail = buffer->origin + size;
+}
+
+agi_result_t ring_buffer_set_origin(RingBuffer *buffer, size_t origin) {
+    if (ring_buffer_size(buffer) != 0) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    size_t usable = buffer->capacity - buffer->origin;
+    if (origin > buffer->origin) {
+        u8 *grown = agi_realloc(buffer->data, origin + usable);
+        if (!grown) {
+            return AGI_ERROR_OUT_OF_MEMORY;
+        }
+        buffer->data = grown;
+    }
+    buffer->capacity = origin + usable;
+    buffer->origin = origin;
+    buffer->head = origin;
+    buffer->tail = origin;
+    return AGI_SUCCESS;
+}
+
+agi_result_t ring_buffer_reserve(RingBuffer *buffer, size_t capacity) {
+    if (buffer->origin + capacity <= buffer->capacity) {
+        return AGI_SUCCESS;
+    }
+
+    ring_buffer_compact(buffer);
+    u8 *grown = agi_realloc(buffer->data, buffer->origin + capacity);
+    if (!grown) {
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+    buffer->data = grown;
+    buffer->capacity = buffer->origin + capacity;
+    return AGI_SUCCESS;
+}
+
+void ring_buffer_shrink(RingBuffer *buffer, size_t capacity) {
+    if (ring_buffer_size(buffer) != 0 || buffer->origin + capacity >= buffer->capacity) {
+        return;
+    }
+
+    size_t size = buffer->origin + capacity;
+    if (size == 0) {
+        agi_free(buffer->data);
+        buffer->data = NULL;
+    } else {
+        // Shrinking in place can't fail for a real allocator; keep the old block if it does
+        u8 *shrunk = agi_realloc(buffer->data, size);
+        if (!shrunk) return;
+        buffer->data = shrunk;
+    }
+    buffer->capacity = size;
+    buffer->head = buffer->origin;
+    buffer->tail = buffer->origin;
+}
+
+size_t ring_buffer_capacity(const RingBuffer *buffer) {
+    return buffer->capacity - buffer->origin;
+}
+
+size_t ring_buffer_size(const RingBuffer *buffer) {
+    return buffer->tail - buffer->head;
+}
+
+const u8 *ring_buffer_read_ptr(const RingBuffer *buffer) {
+    return buffer->data + buffer->head;
+}
+
+void ring_buffer_consume(RingBuffer *buffer, size_t count) {
+    buffer->head += MIN(count, buffer->tail - buffer->head);
+    if (buffer->head == buffer->tail) {
+        // Empty: rewind for free so the next read starts at the origin
+        buffer->head = buffer->origin;
+        buffer->tail = buffer->origin;
+    }
+}
+
+u8 *ring_buffer_write_ptr(RingBuffer *buffer, size_t *available) {
+    if (buffer->head - buffer->origin > buffer->capacity - buffer->tail) {
+        ring_buffer_compact(buffer);
+    }
+    *available = buffer->capacity - buffer->tail;
+    return buffer->data + buffer->tail;
+}
+
+void ring_buffer_commit(RingBuffer *buffer, size_t count) {
+    buffer->tail += MIN(count, buffer->capacity - buffer->tail);
+}
+
+agi_result_t ring_buffer_append(RingBuffer *buffer, const void *data, size_t count) {
+    size_t available;
+    u8 *destination = ring_buffer_write_ptr(buffer, &available);
+    if (available < count) {
+        // Grow geometrically so a burst of appends doesn't realloc every time
+        size_t needed = ring_buffer_size(buffer) + count;
+        size_t capacity = (buffer->capacity - buffer->origin) * 2;
+        agi_result_t result = ring_buffer_reserve(buffer, capacity > needed ? capacity : needed);
+        if (result != AGI_SUCCESS) {
+            return result;
+        }
+        destination = ring_buffer_write_ptr(buffer, &available);
+    }
+    memcpy(destination, data, count);
+    buffer->tail += count;
+    return AGI_SUCCESS;
+}
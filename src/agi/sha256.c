@@ -0,0 +1,238 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/sha256.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SHA256_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SHA256_TARGET
+#else
+#include <cpuid.h>
+#define SHA256_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+#endif
+#endif
+
+typedef void (*Sha256BlocksFn)(u32 state[8], const u8 *data, size_t blocks);
+
+static const u32 K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_blocks_portable(u32 state[8], const u8 *data, size_t blocks) {
+    while (blocks--) {
+        u32 w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (u32)data[4 * i] << 24 | (u32)data[4 * i + 1] << 16 | (u32)data[4 * i + 2] << 8 | data[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            u32 s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            u32 s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        u32 a = state[0], b = state[1], c = state[2], d = state[3];
+        u32 e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            u32 t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            u32 t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        data += AGI_SHA256_BLOCK_SIZE;
+    }
+}
+
+#if defined(SHA256_X86)
+// The SHA extensions keep the state as ABEF/CDGH halves and do two rounds per
+// instruction; message words are expanded four at a time with msg1/msg2.
+SHA256_TARGET static void sha256_blocks_shani(u32 state[8], const u8 *data, size_t blocks) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);  // CDAB
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);  // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);  // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);       // CDGH
+
+    while (blocks--) {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i w[4];
+
+        for (int group = 0; group < 16; group++) {
+            __m128i words;
+            if (group < 4) {
+                words = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * group)), byte_swap);
+            } else {
+                words = _mm_sha256msg1_epu32(w[group & 3], w[(group + 1) & 3]);
+                words = _mm_add_epi32(words, _mm_alignr_epi8(w[(group + 3) & 3], w[(group + 2) & 3], 4));
+                words = _mm_sha256msg2_epu32(words, w[(group + 3) & 3]);
+            }
+            w[group & 3] = words;
+
+            __m128i message = _mm_add_epi32(words, _mm_loadu_si128((const __m128i *)&K[4 * group]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(message, 0x0E));
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        data += AGI_SHA256_BLOCK_SIZE;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);        // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);     // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);  // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);     // HGFE
+    _mm_storeu_si128((__m128i *)&state[0], state0);
+    _mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+static b8 cpu_has_sha_extensions(void) {
+    unsigned int leaf1[4] = {0};
+    unsigned int leaf7[4] = {0};
+#if defined(_MSC_VER)
+    __cpuid((int *)leaf1, 1);
+    __cpuidex((int *)leaf7, 7, 0);
+#else
+    if (!__get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3])) return false;
+    if (!__get_cpuid_count(7, 0, &leaf7[0], &leaf7[1], &leaf7[2], &leaf7[3])) return false;
+#endif
+    b8 ssse3 = (leaf1[2] >> 9) & 1;
+    b8 sse41 = (leaf1[2] >> 19) & 1;
+    b8 sha = (leaf7[1] >> 29) & 1;
+    return ssse3 && sse41 && sha;
+}
+#endif
+
+static _Atomic(Sha256BlocksFn) blocks_fn = NULL;
+
+static Sha256BlocksFn select_blocks_fn(void) {
+    Sha256BlocksFn fn = atomic_load_explicit(&blocks_fn, memory_order_relaxed);
+    if (fn) return fn;
+
+    fn = sha256_blocks_portable;
+#if defined(SHA256_X86)
+    if (cpu_has_sha_extensions()) fn = sha256_blocks_shani;
+#endif
+    atomic_store_explicit(&blocks_fn, fn, memory_order_relaxed);
+    return fn;
+}
+
+void sha256_init(Sha256 *sha) {
+    static const u32 initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(sha->state, initial, sizeof(initial));
+    sha->length = 0;
+    sha->buffered = 0;
+}
+
+void sha256_update(Sha256 *sha, const void *data, size_t size) {
+    const u8 *bytes = data;
+    Sha256BlocksFn blocks = select_blocks_fn();
+    sha->length += size;
+
+    if (sha->buffered > 0) {
+        size_t take = MIN(size, AGI_SHA256_BLOCK_SIZE - sha->buffered);
+        memcpy(sha->buffer + sha->buffered, bytes, take);
+        sha->buffered += take;
+        bytes += take;
+        size -= take;
+        if (sha->buffered < AGI_SHA256_BLOCK_SIZE) return;
+        blocks(sha->state, sha->buffer, 1);
+        sha->buffered = 0;
+    }
+
+    // Whole blocks are hashed straight from the caller's buffer
+    size_t whole = size / AGI_SHA256_BLOCK_SIZE;
+    if (whole > 0) {
+        blocks(sha->state, bytes, whole);
+        bytes += whole * AGI_SHA256_BLOCK_SIZE;
+        size -= whole * AGI_SHA256_BLOCK_SIZE;
+    }
+
+    memcpy(sha->buffer, bytes, size);
+    sha->buffered = size;
+}
+
+void sha256_final(Sha256 *sha, u8 digest[AGI_SHA256_DIGEST_SIZE]) {
+    Sha256BlocksFn blocks = select_blocks_fn();
+    u64 bit_length = sha->length * 8;
+
+    sha->buffer[sha->buffered++] = 0x80;
+    if (sha->buffered > AGI_SHA256_BLOCK_SIZE - 8) {
+        memset(sha->buffer + sha->buffered, 0, AGI_SHA256_BLOCK_SIZE - sha->buffered);
+        blocks(sha->state, sha->buffer, 1);
+        sha->buffered = 0;
+    }
+    memset(sha->buffer + sha->buffered, 0, AGI_SHA256_BLOCK_SIZE - 8 - sha->buffered);
+    for (int i = 0; i < 8; i++) {
+        sha->buffer[AGI_SHA256_BLOCK_SIZE - 1 - i] = (u8)(bit_length >> (8 * i));
+    }
+    blocks(sha->state, sha->buffer, 1);
+
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (u8)(sha->state[i] >> 24);
+        digest[4 * i + 1] = (u8)(sha->state[i] >> 16);
+        digest[4 * i + 2] = (u8)(sha->state[i] >> 8);
+        digest[4 * i + 3] = (u8)sha->state[i];
+    }
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+b8 sha256_parse_hex(const char *hex, u8 digest[AGI_SHA256_DIGEST_SIZE]) {
+    for (int i = 0; i < AGI_SHA256_DIGEST_SIZE; i++) {
+        int high = hex_value(hex[2 * i]);
+        if (high < 0) return false;
+        int low = hex_value(hex[2 * i + 1]);
+        if (low < 0) return false;
+        digest[i] = (u8)(high << 4 | low);
+    }
+    return hex[2 * AGI_SHA256_DIGEST_SIZE] == '\0';
+}
+
+void sha256_to_hex(const u8 digest[AGI_SHA256_DIGEST_SIZE], char hex[2 * AGI_SHA256_DIGEST_SIZE + 1]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < AGI_SHA256_DIGEST_SIZE; i++) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0xF];
+    }
+    hex[2 * AGI_SHA256_DIGEST_SIZE] = '\0';
+}
+
+const char *sha256_implementation(void) {
+#if defined(SHA256_X86)
+    if (select_blocks_fn() == sha256_blocks_shani) return "sha-ni";
+#endif
+    return "portable";
+}
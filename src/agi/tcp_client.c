@@ -2,7 +2,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include "agi/clock.h"
 #include "agi/log.h"
+#include "agi/memory.h"
+#include "agi/metrics.h"
+#include "agi/packet_dispatch.h"
+#include "agi/ring_buffer.h"
+#include "agi/wire.h"
 #ifdef AGI_PLATFORM_WINDOWS
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
@@ -13,6 +19,7 @@
 typedef int ssize_t;
 #else
     #include <sys/socket.h>
+    #include <sys/uio.h>
     #include <netinet/in.h>
     #include <arpa/inet.h>
     #include <unistd.h>
@@ -22,14 +29,32 @@ typedef int ssize_t;
 
 #define MAX_PACKET_HANDLERS 256
 #define MAX_PACKET_SIZE 1024 // Adjust this value as needed
+#define DEFAULT_SEND_HIGH_WATER_MARK (64 * 1024)
+// Buffers a burst grew past this are given back once they drain, so thousands
+// of mostly idle connections in one process stay a few KB each
+#define IDLE_BUFFER_LIMIT (64 * 1024)
 
 
 
 struct TcpClient {
     int socket;
     struct sockaddr_in server_addr;
-    PacketHandlerInfo handlers[MAX_PACKET_HANDLERS];
-    size_t handler_count;
+    PacketDispatchTable handlers;
+    agi_unknown_packet_policy_t unknown_policy;
+    u32 protocol_version;
+    RingBuffer recv_buffer;
+    size_t recv_reserved;  // what the registered packet sizes need
+    // Aligned landing spot for the rare payload that isn't aligned in recv_buffer
+    u8 *scratch;
+    size_t scratch_size;
+    RingBuffer send_buffer;
+    size_t send_high_water_mark;
+    u32 cork_depth;
+    b8 congested;
+    EventLoop *loop;
+    DisconnectHandler disconnect_handler;
+    DrainHandler drain_handler;
+    void *userdata;
 };
 
 static int initialize_winsock(void) {
@@ -58,7 +83,7 @@ TcpClient *tcp_client_create(const char *host, u16 port) {
         return NULL;
     }
 
-    TcpClient *client = (TcpClient *) malloc(sizeof(TcpClient));
+    TcpClient *client = (TcpClient *) agi_malloc(sizeof(TcpClient));
     if (!client) {
         cleanup_winsock();
         return NULL;
@@ -66,7 +91,19 @@ TcpClient *tcp_client_create(const char *host, u16 port) {
 
     client->socket = socket(AF_INET, SOCK_STREAM, 0);
     if (client->socket == -1) {
-        free(client);
+        agi_free(client);
+        cleanup_winsock();
+        return NULL;
+    }
+
+    // Start filling at an offset so the payload behind the first frame header is aligned
+    if (ring_buffer_init(&client->recv_buffer, MAX_PACKET_SIZE) != AGI_SUCCESS ||
+        ring_buffer_set_origin(&client->recv_buffer, AGI_PACKET_ALIGNMENT - sizeof(uint16_t)) != AGI_SUCCESS ||
+        // Most sends go straight to the kernel; the queue is allocated once one doesn't
+        ring_buffer_init(&client->send_buffer, 0) != AGI_SUCCESS) {
+        ring_buffer_free(&client->recv_buffer);
+        close(client->socket);
+        agi_free(client);
         cleanup_winsock();
         return NULL;
     }
@@ -75,31 +112,82 @@ TcpClient *tcp_client_create(const char *host, u16 port) {
     client->server_addr.sin_family = AF_INET;
     client->server_addr.sin_port = htons(port);
     inet_pton(AF_INET, host, &client->server_addr.sin_addr);
-    client->handler_count = 0;
+    packet_dispatch_init(&client->handlers);
+    client->recv_reserved = MAX_PACKET_SIZE;
+    client->unknown_policy = AGI_UNKNOWN_PACKET_SKIP;
+    client->protocol_version = AGI_PROTOCOL_V1;
+    client->scratch = NULL;
+    client->scratch_size = 0;
+    client->send_high_water_mark = DEFAULT_SEND_HIGH_WATER_MARK;
+    client->cork_depth = 0;
+    client->congested = false;
+    client->loop = NULL;
+    client->disconnect_handler = NULL;
+    client->drain_handler = NULL;
+    client->userdata = NULL;
     return client;
 }
 
 
 agi_result_t tcp_client_register_packet_handler(TcpClient *client, uint16_t packet_type, size_t packet_size,
                                                 PacketHandler handler) {
-    if (client->handler_count >= MAX_PACKET_HANDLERS) {
+    if (client->handlers.count >= MAX_PACKET_HANDLERS || packet_size > UINT32_MAX) {
         return AGI_ERROR_INVALID_ARGUMENT;
     }
 
-    client->handlers[client->handler_count] = (PacketHandlerInfo){
-        .type = packet_type,
-        .size = packet_size,
-        .handler = handler
-    };
-    client->handler_count++;
+    // The receive buffer must hold a whole frame; grow only when a packet needs it
+    agi_result_t result = ring_buffer_reserve(&client->recv_buffer, sizeof(uint16_t) + packet_size);
+    if (result != AGI_SUCCESS) {
+        return result;
+    }
+    if (sizeof(uint16_t) + packet_size > client->recv_reserved) {
+        client->recv_reserved = sizeof(uint16_t) + packet_size;
+    }
 
-    return AGI_SUCCESS;
+    if (packet_size > client->scratch_size) {
+        // Allocated at registration so delivery never touches the heap
+        u8 *scratch = agi_realloc(client->scratch, packet_size);
+        if (!scratch) {
+            return AGI_ERROR_OUT_OF_MEMORY;
+        }
+        client->scratch = scratch;
+        client->scratch_size = packet_size;
+    }
+
+    result = packet_dispatch_insert(&client->handlers, (PacketHandlerInfo){
+        .handler = handler,
+        .size = (u32) packet_size,
+        .type = packet_type
+    });
+    if (result == AGI_ERROR_INVALID_ARGUMENT) {
+        agi_log_error("Packet type %d already has a handler", packet_type);
+    }
+    return result;
+}
+
+void tcp_client_set_unknown_packet_policy(TcpClient *client, agi_unknown_packet_policy_t policy) {
+    client->unknown_policy = policy;
+}
+
+void tcp_client_set_protocol_version(TcpClient *client, u32 version) {
+    client->protocol_version = version;
+}
+
+u32 tcp_client_protocol_version(const TcpClient *client) {
+    return client->protocol_version;
 }
 
 void tcp_client_destroy(TcpClient *client) {
     if (client) {
-        close(client->socket);
-        free(client);
+        tcp_client_detach(client);
+        if (client->socket != -1) {
+            close(client->socket);
+        }
+        ring_buffer_free(&client->recv_buffer);
+        ring_buffer_free(&client->send_buffer);
+        packet_dispatch_free(&client->handlers);
+        agi_free(client->scratch);
+        agi_free(client);
     }
     cleanup_winsock();
 }
@@ -119,81 +207,384 @@ agi_result_t tcp_client_connect(TcpClient *client) {
 }
 
 agi_result_t tcp_client_disconnect(TcpClient *client) {
-    if (close(client->socket) == -1) {
+    tcp_client_detach(client);
+    // Closed once: in a process with many connections the number is soon someone else's
+    int socket = client->socket;
+    client->socket = -1;
+    if (socket == -1 || close(socket) == -1) {
         return AGI_ERROR_NETWORK;
     }
     return AGI_SUCCESS;
 }
 
-agi_result_t tcp_client_send_packet(TcpClient *client, uint16_t packet_type, const void *packet_data,
-                                    size_t data_size) {
-    uint8_t *buffer = malloc(sizeof(uint16_t) + data_size);
-    if (!buffer) {
-        return AGI_ERROR_OUT_OF_MEMORY;
+static b8 would_block(void) {
+#ifdef AGI_PLATFORM_WINDOWS
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+// Writes up to two slices with one syscall; returns bytes sent or -1
+static ssize_t send_gather(TcpClient *client, const void *first, size_t first_size, const void *second, size_t second_size) {
+    metrics_add(AGI_COUNTER_TCP_SEND_CALLS, 1);
+#ifdef AGI_PLATFORM_WINDOWS
+    WSABUF buffers[2] = {
+        {.len = (ULONG) first_size, .buf = (char *) first},
+        {.len = (ULONG) second_size, .buf = (char *) second}
+    };
+    DWORD sent = 0;
+    if (WSASend(client->socket, buffers, second_size ? 2 : 1, &sent, 0, NULL, NULL) != 0) {
+        return -1;
     }
+    return (ssize_t) sent;
+#else
+    struct iovec buffers[2] = {
+        {.iov_base = (void *) first, .iov_len = first_size},
+        {.iov_base = (void *) second, .iov_len = second_size}
+    };
+    struct msghdr message = {.msg_iov = buffers, .msg_iovlen = second_size ? 2 : 1};
+#ifdef MSG_NOSIGNAL
+    return sendmsg(client->socket, &message, MSG_NOSIGNAL);
+#else
+    return sendmsg(client->socket, &message, 0);
+#endif
+#endif
+}
 
-    memcpy(buffer, &packet_type, sizeof(uint16_t));
-    memcpy(buffer + sizeof(uint16_t), packet_data, data_size);
+static void update_send_state(TcpClient *client) {
+    size_t pending = ring_buffer_size(&client->send_buffer);
 
-    ssize_t sent = send(client->socket, (const char *) buffer, sizeof(uint16_t) + data_size, 0);
-    free(buffer);
+    if (client->loop) {
+        u32 events = AGI_EVENT_READ | (pending > 0 ? AGI_EVENT_WRITE : 0);
+        event_loop_modify_fd(client->loop, client->socket, events);
+    }
 
-    if (sent == -1) {
-        return AGI_ERROR_NETWORK;
+    if (pending >= client->send_high_water_mark) {
+        client->congested = true;
+    } else if (client->congested && pending < client->send_high_water_mark / 2) {
+        client->congested = false;
+        if (client->drain_handler) {
+            client->drain_handler(client);
+        }
+    }
+}
+
+agi_result_t tcp_client_flush(TcpClient *client) {
+    RingBuffer *buffer = &client->send_buffer;
+    while (ring_buffer_size(buffer) > 0) {
+        ssize_t sent = send_gather(client, ring_buffer_read_ptr(buffer), ring_buffer_size(buffer), NULL, 0);
+        if (sent < 0) {
+            if (!would_block()) {
+                return AGI_ERROR_NETWORK;
+            }
+            // Resumed by the writable event once the kernel has room again
+            break;
+        }
+        ring_buffer_consume(buffer, (size_t) sent);
+        metrics_add(AGI_COUNTER_TCP_BYTES_SENT, (u64) sent);
     }
+    if (ring_buffer_capacity(buffer) > IDLE_BUFFER_LIMIT) {
+        ring_buffer_shrink(buffer, 0);
+    }
+
+    update_send_state(client);
     return AGI_SUCCESS;
 }
 
-static PacketHandlerInfo *find_packet_handler(TcpClient *client, uint16_t packet_type) {
-    for (size_t i = 0; i < client->handler_count; i++) {
-        if (client->handlers[i].type == packet_type) {
-            return &client->handlers[i];
+agi_result_t tcp_client_send_packet(TcpClient *client, uint16_t packet_type, const void *packet_data,
+                                    size_t data_size) {
+    // Header stays on the stack; header and payload go out in one gather write
+    uint8_t header[2 * WIRE_MAX_VARINT_SIZE];
+    size_t header_size;
+    if (client->protocol_version >= AGI_PROTOCOL_V2) {
+        if (data_size > AGI_MAX_FRAME_SIZE - wire_varint_size(packet_type)) {
+            return AGI_ERROR_INVALID_ARGUMENT;
+        }
+        header_size = wire_encode_varint(header, wire_varint_size(packet_type) + data_size);
+        header_size += wire_encode_varint(header + header_size, packet_type);
+    } else {
+        memcpy(header, &packet_type, sizeof(uint16_t));
+        header_size = sizeof(uint16_t);
+    }
+    const uint8_t *payload = (const uint8_t *) packet_data;
+    metrics_add(AGI_COUNTER_TCP_PACKETS_SENT, 1);
+
+    size_t sent = 0;
+    if (client->cork_depth == 0 && ring_buffer_size(&client->send_buffer) == 0) {
+        ssize_t result = send_gather(client, header, header_size, payload, data_size);
+        if (result < 0 && !would_block()) {
+            return AGI_ERROR_NETWORK;
+        }
+        sent = result < 0 ? 0 : (size_t) result;
+        metrics_add(AGI_COUNTER_TCP_BYTES_SENT, sent);
+        if (sent == header_size + data_size) {
+            return AGI_SUCCESS;
         }
     }
-    return NULL;
+
+    // Queue whatever didn't make it out, preserving byte order
+    agi_result_t result = AGI_SUCCESS;
+    if (sent < header_size) {
+        result = ring_buffer_append(&client->send_buffer, header + sent, header_size - sent);
+        sent = 0;
+    } else {
+        sent -= header_size;
+    }
+    if (result == AGI_SUCCESS) {
+        result = ring_buffer_append(&client->send_buffer, payload + sent, data_size - sent);
+    }
+    if (result != AGI_SUCCESS) {
+        return result;
+    }
+
+    if (client->cork_depth > 0) {
+        update_send_state(client);
+        return AGI_SUCCESS;
+    }
+    return tcp_client_flush(client);
 }
 
-agi_result_t tcp_client_process_packets(TcpClient *client) {
-    uint8_t buffer[MAX_PACKET_SIZE];
-    ssize_t received = recv(client->socket, (char *) buffer, sizeof(buffer), 0);
+void tcp_client_cork(TcpClient *client) {
+    client->cork_depth++;
+}
 
-    if (received <= 0) {
-        return AGI_ERROR_NETWORK;
+agi_result_t tcp_client_uncork(TcpClient *client) {
+    if (client->cork_depth == 0 || --client->cork_depth > 0) {
+        return AGI_SUCCESS;
     }
+    return tcp_client_flush(client);
+}
 
-    size_t processed = 0;
-    while (processed < received) {
-        if (received - processed < sizeof(uint16_t)) {
-            // Not enough data for packet type
-            break;
-        }
+size_t tcp_client_pending_bytes(const TcpClient *client) {
+    return ring_buffer_size(&client->send_buffer);
+}
+
+void tcp_client_set_high_water_mark(TcpClient *client, size_t bytes) {
+    client->send_high_water_mark = bytes;
+}
+
+b8 tcp_client_is_congested(const TcpClient *client) {
+    return client->congested;
+}
 
+void tcp_client_set_drain_handler(TcpClient *client, DrainHandler handler) {
+    client->drain_handler = handler;
+}
+
+// Dispatches every complete frame in the receive buffer; a trailing partial
+// frame stays buffered until the rest of it arrives
+static agi_result_t dispatch_frames(TcpClient *client) {
+    RingBuffer *buffer = &client->recv_buffer;
+    for (;;) {
+        const uint8_t *frame = ring_buffer_read_ptr(buffer);
+        size_t available = ring_buffer_size(buffer);
         uint16_t packet_type;
-        memcpy(&packet_type, buffer + processed, sizeof(uint16_t));
-        processed += sizeof(uint16_t);
+        size_t header_size;
+        size_t payload_size;
+        const PacketHandlerInfo *handler;
+
+        if (client->protocol_version >= AGI_PROTOCOL_V2) {
+            // v2: varint frame length, varint type, payload
+            u64 frame_length;
+            u64 type;
+            size_t length_size;
+            size_t type_size;
+            int status = wire_peek_varint(frame, available, &frame_length, &length_size);
+            if (status == 0) {
+                break;
+            }
+            if (status < 0 || frame_length == 0 || frame_length > AGI_MAX_FRAME_SIZE) {
+                agi_log_error("Malformed frame header");
+                return AGI_ERROR_PROTOCOL;
+            }
+            if (available - length_size < frame_length) {
+                // Grow only for frames that can't fit; the rest of it is still in flight
+                return ring_buffer_reserve(buffer, length_size + (size_t) frame_length);
+            }
+            status = wire_peek_varint(frame + length_size, (size_t) frame_length, &type, &type_size);
+            if (status != 1 || type > UINT16_MAX) {
+                agi_log_error("Malformed packet type in frame");
+                return AGI_ERROR_PROTOCOL;
+            }
+
+            packet_type = (uint16_t) type;
+            header_size = length_size + type_size;
+            payload_size = (size_t) frame_length - type_size;
+            handler = packet_dispatch_find(&client->handlers, packet_type);
+            if (!handler) {
+                if (client->unknown_policy == AGI_UNKNOWN_PACKET_DISCONNECT) {
+                    agi_log_error("Unknown packet type: %d", packet_type);
+                    return AGI_ERROR_PROTOCOL;
+                }
+                agi_log_warning("Unknown packet type: %d, skipping %zu bytes", packet_type, payload_size);
+                metrics_add(AGI_COUNTER_TCP_UNKNOWN_PACKETS, 1);
+                ring_buffer_consume(buffer, header_size + payload_size);
+                continue;
+            }
+        } else {
+            if (available < sizeof(uint16_t)) {
+                break;
+            }
+            memcpy(&packet_type, frame, sizeof(uint16_t));
+            header_size = sizeof(uint16_t);
+
+            handler = packet_dispatch_find(&client->handlers, packet_type);
+            if (!handler) {
+                // v1 frames carry no length, so there is no telling where this one ends:
+                // dropping what's buffered would parse the rest of it as new packets
+                agi_log_error("Unknown packet type: %d", packet_type);
+                metrics_add(AGI_COUNTER_TCP_UNKNOWN_PACKETS, 1);
+                return AGI_ERROR_PROTOCOL;
+            }
+
+            payload_size = handler->size;
+            if (available - header_size < payload_size) {
+                // Not enough data for full packet
+                break;
+            }
+        }
 
-        PacketHandlerInfo *handler = find_packet_handler(client, packet_type);
-        if (!handler) {
-            printf("Unknown packet type: %d\n", packet_type);
-            return AGI_ERROR_INVALID_ARGUMENT;
+        metrics_add(AGI_COUNTER_TCP_PACKETS_RECEIVED, 1);
+        if (!handler->handler) {
+            // Known type but nobody interested: skip it by length
+            ring_buffer_consume(buffer, header_size + payload_size);
+            continue;
         }
 
-        if (received - processed < handler->size) {
-            // Not enough data for full packet
-            break;
+        // Hand out a view straight into the receive buffer. v1 structs are kept
+        // aligned, bouncing the rare misaligned one through the scratch buffer;
+        // v2 payloads are byte-encoded and need no alignment.
+        PacketHandler callback = handler->handler;
+        const uint8_t *packet_data = frame + header_size;
+        if (client->protocol_version < AGI_PROTOCOL_V2 &&
+            ((uintptr_t) packet_data & (AGI_PACKET_ALIGNMENT - 1)) != 0) {
+            memcpy(client->scratch, packet_data, payload_size);
+            packet_data = client->scratch;
         }
 
-        void *packet_data = malloc(handler->size);
-        if (!packet_data) {
-            return AGI_ERROR_OUT_OF_MEMORY;
+        u64 started_ns = agi_clock_now_ns();
+        callback(client, packet_data, payload_size);
+        metrics_record_since(AGI_HISTOGRAM_TCP_HANDLER, started_ns);
+        ring_buffer_consume(buffer, header_size + payload_size);
+    }
+
+    return AGI_SUCCESS;
+}
+
+static agi_result_t receive_packets(TcpClient *client) {
+    for (;;) {
+        size_t space;
+        uint8_t *write_ptr = ring_buffer_write_ptr(&client->recv_buffer, &space);
+        ssize_t received = recv(client->socket, (char *) write_ptr, space, 0);
+        metrics_add(AGI_COUNTER_TCP_RECV_CALLS, 1);
+
+        if (received == 0) {
+            return AGI_ERROR_NETWORK;
+        }
+        if (received < 0) {
+            // Nothing buffered yet on a non-blocking socket is not an error
+            return would_block() ? AGI_SUCCESS : AGI_ERROR_NETWORK;
+        }
+        ring_buffer_commit(&client->recv_buffer, (size_t) received);
+        metrics_add(AGI_COUNTER_TCP_BYTES_RECEIVED, (u64) received);
+
+        agi_result_t result = dispatch_frames(client);
+        if (result != AGI_SUCCESS) {
+            return result;
+        }
+
+        // A short read means the socket is drained; only a blocking socket that
+        // filled the whole buffer needs another pass (and would block otherwise)
+        if (!client->loop || (size_t) received < space) {
+            return AGI_SUCCESS;
+        }
+    }
+}
+
+agi_result_t tcp_client_process_packets(TcpClient *client) {
+    // Responses produced by the handlers are coalesced into one write
+    tcp_client_cork(client);
+    agi_result_t result = receive_packets(client);
+    if (ring_buffer_capacity(&client->recv_buffer) > IDLE_BUFFER_LIMIT) {
+        ring_buffer_shrink(&client->recv_buffer, client->recv_reserved);
+    }
+    agi_result_t flushed = tcp_client_uncork(client);
+    return result != AGI_SUCCESS ? result : flushed;
+}
+
+static agi_result_t set_nonblocking(int socket) {
+#ifdef AGI_PLATFORM_WINDOWS
+    u_long mode = 1;
+    if (ioctlsocket(socket, FIONBIO, &mode) != 0) {
+        return AGI_ERROR_NETWORK;
+    }
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    if (flags == -1 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return AGI_ERROR_NETWORK;
+    }
+#endif
+    return AGI_SUCCESS;
+}
+
+static void on_socket_event(EventLoop *loop, int fd, u32 events, void *userdata) {
+    TcpClient *client = (TcpClient *) userdata;
+    agi_result_t result = AGI_SUCCESS;
+
+    if (events & AGI_EVENT_WRITE) {
+        result = tcp_client_flush(client);
+    }
+    if (result == AGI_SUCCESS && (events & AGI_EVENT_READ)) {
+        result = tcp_client_process_packets(client);
+    } else if (events & AGI_EVENT_ERROR) {
+        result = AGI_ERROR_NETWORK;
+    }
+
+    if (result != AGI_SUCCESS) {
+        tcp_client_detach(client);
+        if (client->disconnect_handler) {
+            client->disconnect_handler(client, result);
         }
+    }
+}
+
+agi_result_t tcp_client_attach(TcpClient *client, EventLoop *loop) {
+    if (client->loop) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
 
-        memcpy(packet_data, buffer + processed, handler->size);
-        processed += handler->size;
+    agi_result_t result = set_nonblocking(client->socket);
+    if (result != AGI_SUCCESS) {
+        agi_log_error("Failed to make socket non-blocking");
+        return result;
+    }
 
-        handler->handler(client, packet_data);
-        free(packet_data);
+    u32 events = AGI_EVENT_READ | (ring_buffer_size(&client->send_buffer) > 0 ? AGI_EVENT_WRITE : 0);
+    result = event_loop_add_fd(loop, client->socket, events, on_socket_event, client);
+    if (result != AGI_SUCCESS) {
+        return result;
     }
 
+    client->loop = loop;
     return AGI_SUCCESS;
 }
+
+void tcp_client_detach(TcpClient *client) {
+    if (client->loop) {
+        event_loop_remove_fd(client->loop, client->socket);
+        client->loop = NULL;
+    }
+}
+
+void tcp_client_set_disconnect_handler(TcpClient *client, DisconnectHandler handler) {
+    client->disconnect_handler = handler;
+}
+
+void tcp_client_set_userdata(TcpClient *client, void *userdata) {
+    client->userdata = userdata;
+}
+
+void *tcp_client_get_userdata(TcpClient *client) {
+    return client->userdata;
+}
@@ -0,0 +1,156 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/thread.h"
+
+#include "agi/memory.h"
+
+#if defined(AGI_PLATFORM_WINDOWS)
+#include <process.h>
+#else
+#include <time.h>
+#endif
+
+void agi_mutex_init(agi_mutex_t *mutex) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void agi_mutex_destroy(agi_mutex_t *mutex) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+void agi_mutex_lock(agi_mutex_t *mutex) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+void agi_mutex_unlock(agi_mutex_t *mutex) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+void agi_cond_init(agi_cond_t *cond) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+void agi_cond_destroy(agi_cond_t *cond) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    (void)cond;  // nothing to release
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+void agi_cond_wait(agi_cond_t *cond, agi_mutex_t *mutex) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+b8 agi_cond_timed_wait(agi_cond_t *cond, agi_mutex_t *mutex, u64 timeout_ms) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    DWORD timeout = timeout_ms >= INFINITE ? INFINITE - 1 : (DWORD)timeout_ms;
+    return SleepConditionVariableCS(cond, mutex, timeout) != 0;
+#else
+    // Condition variables are created with the default (realtime) clock
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t)(timeout_ms / 1000);
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return pthread_cond_timedwait(cond, mutex, &deadline) == 0;
+#endif
+}
+
+void agi_cond_signal(agi_cond_t *cond) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    WakeConditionVariable(cond);
+#else
+    pthread_cond_signal(cond);
+#endif
+}
+
+void agi_cond_broadcast(agi_cond_t *cond) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+typedef struct {
+    agi_thread_fn fn;
+    void *arg;
+} ThreadStart;
+
+#if defined(AGI_PLATFORM_WINDOWS)
+static unsigned __stdcall thread_entry(void *param) {
+#else
+static void *thread_entry(void *param) {
+#endif
+    ThreadStart start = *(ThreadStart *)param;
+    agi_free(param);
+    start.fn(start.arg);
+    return 0;
+}
+
+agi_result_t agi_thread_create(agi_thread_t *thread, agi_thread_fn fn, void *arg, size_t stack_size) {
+    ThreadStart *start = agi_malloc(sizeof(ThreadStart));
+    if (!start) return AGI_ERROR_OUT_OF_MEMORY;
+    start->fn = fn;
+    start->arg = arg;
+
+#if defined(AGI_PLATFORM_WINDOWS)
+    uintptr_t handle = _beginthreadex(NULL, (unsigned)stack_size, thread_entry, start, 0, NULL);
+    if (handle == 0) {
+        agi_free(start);
+        return AGI_ERROR_IO;
+    }
+    *thread = (HANDLE)handle;
+#else
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    if (stack_size > 0) {
+        pthread_attr_setstacksize(&attributes, stack_size);
+    }
+    int error = pthread_create(thread, &attributes, thread_entry, start);
+    pthread_attr_destroy(&attributes);
+    if (error != 0) {
+        agi_free(start);
+        return AGI_ERROR_IO;
+    }
+#endif
+    return AGI_SUCCESS;
+}
+
+void agi_thread_join(agi_thread_t thread) {
+#if defined(AGI_PLATFORM_WINDOWS)
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
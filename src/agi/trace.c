@@ -0,0 +1,294 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/trace.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "agi/clock.h"
+#include "agi/log.h"
+#include "agi/memory.h"
+#include "agi/thread.h"
+
+#if defined(AGI_PLATFORM_WINDOWS)
+#define PATH_SEPARATOR '\\'
+#else
+#define PATH_SEPARATOR '/'
+#endif
+
+#define TRACE_PATH_SIZE 1024
+#define SLOW_DUMP_INTERVAL_MS 1000
+
+// Seqlock per slot: sequence is 0 while the slot is written, then its claim + 1.
+// A reader that sees the same non-zero sequence before and after copying the
+// fields has a consistent span.
+typedef struct {
+    atomic_uint_fast64_t sequence;
+    atomic_uint_fast64_t trace_id;
+    atomic_uint_fast64_t started_ns;
+    atomic_uint_fast64_t duration_ns;
+    _Atomic(const char *) name;
+    atomic_uint thread;
+} TraceSlot;
+
+typedef struct {
+    u64 trace_id;
+    u64 started_ns;
+    u64 duration_ns;
+    const char *name;
+    u32 thread;
+} TraceSpan;
+
+static TraceSlot slots[AGI_TRACE_CAPACITY];
+static atomic_uint_fast64_t next_claim;
+static atomic_uint_fast64_t next_id;
+static atomic_uint next_thread;
+static _Atomic(const char *) thread_names[AGI_TRACE_MAX_THREADS];
+static AGI_THREAD_LOCAL u32 thread_index;
+static AGI_THREAD_LOCAL u64 current_trace;
+
+static char dump_directory[TRACE_PATH_SIZE];
+static atomic_bool dumps_enabled;
+static atomic_uint_fast64_t slow_ns = (u64)AGI_TRACE_DEFAULT_SLOW_MS * 1000000;
+static atomic_uint_fast64_t last_slow_dump_ms;
+
+// Writing a dump scans the whole ring and touches the disk, too slow for the
+// loop thread that finishes requests; this thread writes them instead
+static struct {
+    agi_mutex_t lock;
+    agi_cond_t wake;
+    agi_thread_t thread;
+    b8 initialized;
+    b8 running;
+    b8 stopping;
+    u64 trace_id;  // 0 = nothing pending
+    const char *name;
+    u64 duration_ns;
+} dumper;
+
+static void start_dumper(void);
+
+void trace_configure(const TraceConfig *config) {
+    // Set up before any request is traced, so readers never see the directory change
+    b8 enabled = config && config->directory && strlen(config->directory) < sizeof(dump_directory);
+    if (enabled) snprintf(dump_directory, sizeof(dump_directory), "%s", config->directory);
+    u32 slow_ms = config && config->slow_ms ? config->slow_ms : AGI_TRACE_DEFAULT_SLOW_MS;
+    atomic_store(&slow_ns, (u64)slow_ms * 1000000);
+    atomic_store(&dumps_enabled, enabled);
+    if (enabled) start_dumper();
+}
+
+u64 trace_new_id(void) {
+    return atomic_fetch_add_explicit(&next_id, 1, memory_order_relaxed) + 1;
+}
+
+void trace_set_current(u64 trace_id) {
+    current_trace = trace_id;
+}
+
+u64 trace_current(void) {
+    return current_trace;
+}
+
+// 1-based, so 0 means not assigned yet; threads past the name table share the last index
+static u32 current_thread(void) {
+    if (!thread_index) {
+        u32 index = atomic_fetch_add_explicit(&next_thread, 1, memory_order_relaxed) + 1;
+        thread_index = MIN(index, (u32)AGI_TRACE_MAX_THREADS);
+    }
+    return thread_index;
+}
+
+void trace_name_thread(const char *name) {
+    atomic_store_explicit(&thread_names[current_thread() - 1], name, memory_order_relaxed);
+}
+
+void trace_record(u64 trace_id, const char *name, u64 started_ns, u64 ended_ns) {
+    u64 claim = atomic_fetch_add_explicit(&next_claim, 1, memory_order_relaxed);
+    TraceSlot *slot = &slots[claim % AGI_TRACE_CAPACITY];
+    atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&slot->trace_id, trace_id, memory_order_relaxed);
+    atomic_store_explicit(&slot->started_ns, started_ns, memory_order_relaxed);
+    atomic_store_explicit(&slot->duration_ns, ended_ns > started_ns ? ended_ns - started_ns : 0, memory_order_relaxed);
+    atomic_store_explicit(&slot->name, name, memory_order_relaxed);
+    atomic_store_explicit(&slot->thread, current_thread(), memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, claim + 1, memory_order_release);
+}
+
+void trace_span(const char *name, u64 started_ns) {
+    trace_record(current_trace, name, started_ns, agi_clock_now_ns());
+}
+
+static b8 read_slot(TraceSlot *slot, TraceSpan *span) {
+    u64 before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (before == 0) return false;
+    span->trace_id = atomic_load_explicit(&slot->trace_id, memory_order_relaxed);
+    span->started_ns = atomic_load_explicit(&slot->started_ns, memory_order_relaxed);
+    span->duration_ns = atomic_load_explicit(&slot->duration_ns, memory_order_relaxed);
+    span->name = atomic_load_explicit(&slot->name, memory_order_relaxed);
+    span->thread = atomic_load_explicit(&slot->thread, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->sequence, memory_order_relaxed) == before;
+}
+
+static int compare_spans(const void *a, const void *b) {
+    const TraceSpan *left = a;
+    const TraceSpan *right = b;
+    if (left->started_ns != right->started_ns) return left->started_ns < right->started_ns ? -1 : 1;
+    // Parents start with their first child but last longer; put them first
+    if (left->duration_ns != right->duration_ns) return left->duration_ns > right->duration_ns ? -1 : 1;
+    return 0;
+}
+
+agi_result_t trace_write_chrome_json(const char *path, u64 trace_id, u32 *span_count) {
+    TraceSpan *spans = agi_malloc(AGI_TRACE_CAPACITY * sizeof(TraceSpan));
+    if (!spans) return AGI_ERROR_OUT_OF_MEMORY;
+    u32 count = 0;
+    for (u32 i = 0; i < AGI_TRACE_CAPACITY; i++) {
+        if (read_slot(&slots[i], &spans[count]) && (trace_id == 0 || spans[count].trace_id == trace_id)) count++;
+    }
+    qsort(spans, count, sizeof(TraceSpan), compare_spans);
+
+    // Readers polling for dumps never see one half-written
+    char temp_path[TRACE_PATH_SIZE];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) {
+        agi_free(spans);
+        return AGI_ERROR_IO;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    b8 first = true;
+    for (u32 i = 0; i < AGI_TRACE_MAX_THREADS; i++) {
+        const char *name = atomic_load_explicit(&thread_names[i], memory_order_relaxed);
+        if (!name) continue;
+        fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", i + 1, name);
+        first = false;
+    }
+    // Microseconds with the nanoseconds kept as decimals; names are literals, so need no escaping
+    for (u32 i = 0; i < count; i++) {
+        const TraceSpan *span = &spans[i];
+        fprintf(file,
+                "%s{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%llu.%03u,\"dur\":%llu.%03u,"
+                "\"args\":{\"trace\":%llu}}",
+                first ? "" : ",\n", span->name, span->trace_id ? "request" : "background", span->thread,
+                (unsigned long long)(span->started_ns / 1000), (u32)(span->started_ns % 1000),
+                (unsigned long long)(span->duration_ns / 1000), (u32)(span->duration_ns % 1000),
+                (unsigned long long)span->trace_id);
+        first = false;
+    }
+    fprintf(file, "\n]}\n");
+    agi_free(spans);
+
+    b8 written = !ferror(file);
+    if (fclose(file) != 0) written = false;
+    if (!written) {
+        remove(temp_path);
+        return AGI_ERROR_IO;
+    }
+#if defined(AGI_PLATFORM_WINDOWS)
+    remove(path);
+#endif
+    if (rename(temp_path, path) != 0) return AGI_ERROR_IO;
+    if (span_count) *span_count = count;
+    return AGI_SUCCESS;
+}
+
+static b8 dump_path(u64 trace_id, char *path, size_t path_size) {
+    int length;
+    if (trace_id) {
+        length = snprintf(path, path_size, "%s%ctrace-%llu.json", dump_directory, PATH_SEPARATOR, (unsigned long long)trace_id);
+    } else {
+        length = snprintf(path, path_size, "%s%ctrace-all-%llu.json", dump_directory, PATH_SEPARATOR, (unsigned long long)time(NULL));
+    }
+    return length > 0 && (size_t)length < path_size;
+}
+
+agi_result_t trace_dump(u64 trace_id, char *path, size_t path_size, u32 *span_count) {
+    if (!atomic_load(&dumps_enabled)) return AGI_ERROR_INVALID_ARGUMENT;
+    if (!dump_path(trace_id, path, path_size)) return AGI_ERROR_INVALID_ARGUMENT;
+    return trace_write_chrome_json(path, trace_id, span_count);
+}
+
+static void dump_slow_request(u64 trace_id, const char *name, u64 duration_ns) {
+    char path[TRACE_PATH_SIZE];
+    if (trace_dump(trace_id, path, sizeof(path), NULL) == AGI_SUCCESS) {
+        agi_log_warning("Slow %s took %llu ms, trace written to %s", name, (unsigned long long)(duration_ns / 1000000), path);
+    } else {
+        agi_log_warning("Failed to write trace of slow %s to %s", name, path);
+    }
+}
+
+static void dumper_main(void *arg) {
+    (void)arg;
+    agi_mutex_lock(&dumper.lock);
+    for (;;) {
+        while (!dumper.trace_id && !dumper.stopping) {
+            agi_cond_wait(&dumper.wake, &dumper.lock);
+        }
+        // Shutting down still writes a pending dump
+        if (!dumper.trace_id) break;
+
+        u64 trace_id = dumper.trace_id;
+        const char *name = dumper.name;
+        u64 duration_ns = dumper.duration_ns;
+        dumper.trace_id = 0;
+        agi_mutex_unlock(&dumper.lock);
+        dump_slow_request(trace_id, name, duration_ns);
+        agi_mutex_lock(&dumper.lock);
+    }
+    agi_mutex_unlock(&dumper.lock);
+}
+
+static void start_dumper(void) {
+    if (dumper.running) return;
+    if (!dumper.initialized) {
+        agi_mutex_init(&dumper.lock);
+        agi_cond_init(&dumper.wake);
+        dumper.initialized = true;
+    }
+    dumper.stopping = false;
+    dumper.running = agi_thread_create(&dumper.thread, dumper_main, NULL, 0) == AGI_SUCCESS;
+    if (!dumper.running) agi_log_warning("Failed to start trace dump thread, dumping inline");
+}
+
+void trace_shutdown(void) {
+    if (!dumper.running) return;
+
+    agi_mutex_lock(&dumper.lock);
+    dumper.stopping = true;
+    agi_mutex_unlock(&dumper.lock);
+    agi_cond_signal(&dumper.wake);
+    agi_thread_join(dumper.thread);
+    dumper.running = false;
+}
+
+void trace_finish_request(u64 trace_id, const char *name, u64 started_ns) {
+    u64 now = agi_clock_now_ns();
+    trace_record(trace_id, name, started_ns, now);
+    if (now - started_ns < atomic_load_explicit(&slow_ns, memory_order_relaxed) || !atomic_load(&dumps_enabled)) return;
+
+    // During a mass rollout every request can be slow; one dump a second tells the story
+    u64 now_ms = now / 1000000;
+    u64 last = atomic_load_explicit(&last_slow_dump_ms, memory_order_relaxed);
+    if (last && now_ms - last < SLOW_DUMP_INTERVAL_MS) return;
+    if (!atomic_compare_exchange_strong(&last_slow_dump_ms, &last, now_ms)) return;
+
+    if (!dumper.running) {
+        dump_slow_request(trace_id, name, now - started_ns);
+        return;
+    }
+    agi_mutex_lock(&dumper.lock);
+    dumper.trace_id = trace_id;
+    dumper.name = name;
+    dumper.duration_ns = now - started_ns;
+    agi_mutex_unlock(&dumper.lock);
+    agi_cond_signal(&dumper.wake);
+}
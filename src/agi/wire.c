@@ -0,0 +1,139 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/wire.h"
+
+#include <string.h>
+
+int wire_peek_varint(const u8 *data, size_t size, u64 *value, size_t *consumed) {
+    u64 result = 0;
+    for (size_t i = 0; i < WIRE_MAX_VARINT_SIZE; i++) {
+        if (i >= size) {
+            return 0;
+        }
+        u8 byte = data[i];
+        if (i == WIRE_MAX_VARINT_SIZE - 1 && byte > 1) {
+            return -1;  // would overflow 64 bits
+        }
+        result |= (u64)(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            *consumed = i + 1;
+            return 1;
+        }
+    }
+    return -1;
+}
+
+size_t wire_varint_size(u64 value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+size_t wire_encode_varint(u8 *destination, u64 value) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        destination[size++] = (u8)(value | 0x80);
+        value >>= 7;
+    }
+    destination[size++] = (u8)value;
+    return size;
+}
+
+WireReader wire_reader(const void *data, size_t size) {
+    return (WireReader){.data = (const u8 *)data, .size = size, .position = 0, .failed = false};
+}
+
+size_t wire_reader_remaining(const WireReader *reader) {
+    return reader->failed ? 0 : reader->size - reader->position;
+}
+
+u64 wire_read_varint(WireReader *reader) {
+    u64 value = 0;
+    size_t consumed = 0;
+    if (reader->failed ||
+        wire_peek_varint(reader->data + reader->position, reader->size - reader->position, &value, &consumed) != 1) {
+        reader->failed = true;
+        return 0;
+    }
+    reader->position += consumed;
+    return value;
+}
+
+const u8 *wire_read_bytes(WireReader *reader, size_t count) {
+    if (reader->failed || reader->size - reader->position < count) {
+        reader->failed = true;
+        return NULL;
+    }
+    const u8 *bytes = reader->data + reader->position;
+    reader->position += count;
+    return bytes;
+}
+
+u8 wire_read_u8(WireReader *reader) {
+    const u8 *byte = wire_read_bytes(reader, 1);
+    return byte ? *byte : 0;
+}
+
+WireString wire_read_string(WireReader *reader) {
+    WireString string = {.data = "", .length = 0};
+    u64 length = wire_read_varint(reader);
+    if (length > UINT32_MAX) {
+        reader->failed = true;
+        return string;
+    }
+    const u8 *bytes = wire_read_bytes(reader, (size_t)length);
+    if (bytes) {
+        string.data = (const char *)bytes;
+        string.length = (u32)length;
+    }
+    return string;
+}
+
+WireWriter wire_writer(void *buffer, size_t capacity) {
+    return (WireWriter){.data = (u8 *)buffer, .capacity = capacity, .length = 0, .failed = false};
+}
+
+void wire_write_bytes(WireWriter *writer, const void *data, size_t count) {
+    if (writer->failed || writer->capacity - writer->length < count) {
+        writer->failed = true;
+        return;
+    }
+    memcpy(writer->data + writer->length, data, count);
+    writer->length += count;
+}
+
+void wire_write_varint(WireWriter *writer, u64 value) {
+    u8 encoded[WIRE_MAX_VARINT_SIZE];
+    wire_write_bytes(writer, encoded, wire_encode_varint(encoded, value));
+}
+
+void wire_write_u8(WireWriter *writer, u8 value) {
+    wire_write_bytes(writer, &value, 1);
+}
+
+void wire_write_string(WireWriter *writer, const char *data, size_t length) {
+    wire_write_varint(writer, length);
+    wire_write_bytes(writer, data, length);
+}
+
+void wire_write_cstring(WireWriter *writer, const char *string) {
+    wire_write_string(writer, string, strlen(string));
+}
+
+void wire_string_copy(WireString string, char *destination, size_t destination_size) {
+    if (destination_size == 0) {
+        return;
+    }
+    size_t length = MIN((size_t)string.length, destination_size - 1);
+    memcpy(destination, string.data, length);
+    destination[length] = '\0';
+}
+
+b8 wire_string_equals(WireString string, const char *other) {
+    return strlen(other) == string.length && memcmp(string.data, other, string.length) == 0;
+}
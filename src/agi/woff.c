@@ -0,0 +1,894 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/woff.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+#if defined(AGI_HAVE_BROTLI)
+#include <brotli/decode.h>
+#endif
+
+#include "agi/log.h"
+#include "agi/memory.h"
+
+// Bounds what a package may claim to unpack to; real fonts are far smaller
+#define WOFF_MAX_SFNT_SIZE (256u * 1024 * 1024)
+#define WOFF_HEADER_SIZE 44
+#define WOFF2_HEADER_SIZE 48
+#define SFNT_HEADER_SIZE 12
+#define SFNT_RECORD_SIZE 16
+
+#define TAG(a, b, c, d) (((u32)(a) << 24) | ((u32)(b) << 16) | ((u32)(c) << 8) | (u32)(d))
+#define TAG_WOFF TAG('w', 'O', 'F', 'F')
+#define TAG_WOFF2 TAG('w', 'O', 'F', '2')
+#define TAG_OTTO TAG('O', 'T', 'T', 'O')
+#define TAG_TTCF TAG('t', 't', 'c', 'f')
+#define TAG_GLYF TAG('g', 'l', 'y', 'f')
+#define TAG_LOCA TAG('l', 'o', 'c', 'a')
+#define TAG_HMTX TAG('h', 'm', 't', 'x')
+#define TAG_HEAD TAG('h', 'e', 'a', 'd')
+#define TAG_HHEA TAG('h', 'h', 'e', 'a')
+#define TAG_MAXP TAG('m', 'a', 'x', 'p')
+
+// glyf flags
+#define GLYF_ON_CURVE 0x01
+#define GLYF_X_SHORT 0x02
+#define GLYF_Y_SHORT 0x04
+#define GLYF_REPEAT 0x08
+#define GLYF_X_SAME 0x10
+#define GLYF_Y_SAME 0x20
+#define GLYF_OVERLAP_SIMPLE 0x40
+
+// Composite glyph component flags
+#define COMPOSITE_ARG_WORDS 0x0001
+#define COMPOSITE_SCALE 0x0008
+#define COMPOSITE_MORE 0x0020
+#define COMPOSITE_XY_SCALE 0x0040
+#define COMPOSITE_TWO_BY_TWO 0x0080
+#define COMPOSITE_INSTRUCTIONS 0x0100
+
+typedef struct {
+    u32 tag;
+    u32 orig_length;
+    u32 transform_length;  // WOFF: compressed length
+    u32 offset;            // WOFF: offset in the file
+    b8 transformed;
+    const u8 *data;  // final table bytes
+    u32 length;
+    u8 *owned;  // data, when rebuilt here
+} FontTable;
+
+// --- big-endian reading and writing ---
+
+typedef struct {
+    const u8 *data;
+    size_t size;
+    size_t position;
+    b8 failed;  // sticky, like WireReader
+} FontReader;
+
+static FontReader font_reader(const u8 *data, size_t size) {
+    FontReader reader = {.data = data, .size = size};
+    return reader;
+}
+
+static const u8 *read_bytes(FontReader *reader, size_t count) {
+    if (reader->failed || reader->size - reader->position < count) {
+        reader->failed = true;
+        return NULL;
+    }
+    const u8 *bytes = reader->data + reader->position;
+    reader->position += count;
+    return bytes;
+}
+
+static u8 read_u8(FontReader *reader) {
+    const u8 *bytes = read_bytes(reader, 1);
+    return bytes ? bytes[0] : 0;
+}
+
+static u16 read_u16(FontReader *reader) {
+    const u8 *bytes = read_bytes(reader, 2);
+    return bytes ? (u16)((bytes[0] << 8) | bytes[1]) : 0;
+}
+
+static u32 read_u32(FontReader *reader) {
+    const u8 *bytes = read_bytes(reader, 4);
+    return bytes ? ((u32)bytes[0] << 24) | ((u32)bytes[1] << 16) | ((u32)bytes[2] << 8) | bytes[3] : 0;
+}
+
+// WOFF2 UIntBase128: big-endian base 128, at most 5 bytes, no leading zeros
+static u32 read_base128(FontReader *reader) {
+    u32 value = 0;
+    for (int i = 0; i < 5; i++) {
+        u8 byte = read_u8(reader);
+        if (reader->failed || (i == 0 && byte == 0x80) || (value & 0xFE000000u)) break;
+        value = (value << 7) | (byte & 0x7F);
+        if (!(byte & 0x80)) return value;
+    }
+    reader->failed = true;
+    return 0;
+}
+
+// WOFF2 255UInt16
+static u16 read_255u16(FontReader *reader) {
+    u8 code = read_u8(reader);
+    switch (code) {
+        case 253: return read_u16(reader);
+        case 254: return (u16)(read_u8(reader) + 253 * 2);
+        case 255: return (u16)(read_u8(reader) + 253);
+        default: return code;
+    }
+}
+
+static u16 get_u16(const u8 *data) {
+    return (u16)((data[0] << 8) | data[1]);
+}
+
+static u32 get_u32(const u8 *data) {
+    return ((u32)data[0] << 24) | ((u32)data[1] << 16) | ((u32)data[2] << 8) | data[3];
+}
+
+static void put_u16(u8 *data, u16 value) {
+    data[0] = (u8)(value >> 8);
+    data[1] = (u8)value;
+}
+
+static void put_u32(u8 *data, u32 value) {
+    data[0] = (u8)(value >> 24);
+    data[1] = (u8)(value >> 16);
+    data[2] = (u8)(value >> 8);
+    data[3] = (u8)value;
+}
+
+typedef struct {
+    u8 *data;
+    size_t length;
+    size_t capacity;
+    b8 failed;
+} FontWriter;
+
+static u8 *writer_reserve(FontWriter *writer, size_t count) {
+    if (writer->failed) return NULL;
+    if (writer->capacity - writer->length < count) {
+        size_t capacity = writer->capacity ? writer->capacity : 4096;
+        while (capacity - writer->length < count) capacity *= 2;
+        u8 *data = capacity <= WOFF_MAX_SFNT_SIZE ? agi_realloc(writer->data, capacity) : NULL;
+        if (!data) {
+            writer->failed = true;
+            return NULL;
+        }
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+    u8 *destination = writer->data + writer->length;
+    writer->length += count;
+    return destination;
+}
+
+static void write_u8(FontWriter *writer, u8 value) {
+    u8 *destination = writer_reserve(writer, 1);
+    if (destination) destination[0] = value;
+}
+
+static void write_u16(FontWriter *writer, u16 value) {
+    u8 *destination = writer_reserve(writer, 2);
+    if (destination) put_u16(destination, value);
+}
+
+static void write_bytes(FontWriter *writer, const void *data, size_t count) {
+    u8 *destination = writer_reserve(writer, count);
+    if (destination && count) memcpy(destination, data, count);
+}
+
+static void write_padding(FontWriter *writer) {
+    while (!writer->failed && writer->length % 4) write_u8(writer, 0);
+}
+
+// --- sfnt output ---
+
+static u32 table_checksum(const u8 *data, size_t length) {
+    u32 sum = 0;
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) sum += get_u32(data + i);
+    if (i < length) {
+        u8 tail[4] = {0};
+        memcpy(tail, data + i, length - i);
+        sum += get_u32(tail);
+    }
+    return sum;
+}
+
+static int compare_tables(const void *a, const void *b) {
+    u32 left = ((const FontTable *)a)->tag;
+    u32 right = ((const FontTable *)b)->tag;
+    return left < right ? -1 : left > right;
+}
+
+static agi_result_t write_sfnt(u32 flavor, FontTable *tables, u16 count, const char *output_path) {
+    qsort(tables, count, sizeof(FontTable), compare_tables);
+
+    u16 power = 1;
+    u16 selector = 0;
+    while ((u32)power * 2 <= count) {
+        power *= 2;
+        selector++;
+    }
+
+    FontWriter writer = {0};
+    u8 *header = writer_reserve(&writer, SFNT_HEADER_SIZE + (size_t)count * SFNT_RECORD_SIZE);
+    if (!header) return AGI_ERROR_OUT_OF_MEMORY;
+    put_u32(header, flavor);
+    put_u16(header + 4, count);
+    put_u16(header + 6, (u16)(power * 16));
+    put_u16(header + 8, selector);
+    put_u16(header + 10, (u16)(count * 16 - power * 16));
+
+    size_t head_offset = 0;
+    for (u16 i = 0; i < count; i++) {
+        FontTable *table = &tables[i];
+        size_t offset = writer.length;
+        write_bytes(&writer, table->data, table->length);
+        if (writer.failed) break;
+        if (table->tag == TAG_HEAD && table->length >= 12) {
+            head_offset = offset;
+            put_u32(writer.data + offset + 8, 0);  // checkSumAdjustment, set below
+        }
+        u8 *record = writer.data + SFNT_HEADER_SIZE + (size_t)i * SFNT_RECORD_SIZE;
+        put_u32(record, table->tag);
+        put_u32(record + 4, table_checksum(writer.data + offset, table->length));
+        put_u32(record + 8, (u32)offset);
+        put_u32(record + 12, table->length);
+        write_padding(&writer);
+    }
+    if (writer.failed) {
+        agi_free(writer.data);
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+    if (head_offset) {
+        put_u32(writer.data + head_offset + 8, 0xB1B0AFBAu - table_checksum(writer.data, writer.length));
+    }
+
+    agi_result_t result = AGI_ERROR_IO;
+    FILE *file = fopen(output_path, "wb");
+    if (file) {
+        b8 written = fwrite(writer.data, 1, writer.length, file) == writer.length;
+        if (fclose(file) == 0 && written) result = AGI_SUCCESS;
+    }
+    if (result != AGI_SUCCESS) {
+        agi_log_error("Failed to write %s", output_path);
+        remove(output_path);
+    }
+    agi_free(writer.data);
+    return result;
+}
+
+static FontTable *find_table(FontTable *tables, u16 count, u32 tag) {
+    for (u16 i = 0; i < count; i++) {
+        if (tables[i].tag == tag) return &tables[i];
+    }
+    return NULL;
+}
+
+// --- WOFF ---
+
+static agi_result_t unpack_woff(const u8 *file, size_t size, const char *output_path, b8 *cff) {
+    FontReader reader = font_reader(file, size);
+    read_u32(&reader);  // signature
+    u32 flavor = read_u32(&reader);
+    u32 length = read_u32(&reader);
+    u16 count = read_u16(&reader);
+    read_bytes(&reader, WOFF_HEADER_SIZE - 14);
+    if (reader.failed || length != size || count == 0 || flavor == TAG_TTCF) return AGI_ERROR_INVALID_ARGUMENT;
+
+    FontTable *tables = agi_calloc(count, sizeof(FontTable));
+    if (!tables) return AGI_ERROR_OUT_OF_MEMORY;
+
+    agi_result_t result = AGI_SUCCESS;
+    u64 total = 0;
+    for (u16 i = 0; i < count && result == AGI_SUCCESS; i++) {
+        FontTable *table = &tables[i];
+        table->tag = read_u32(&reader);
+        table->offset = read_u32(&reader);
+        table->transform_length = read_u32(&reader);
+        table->orig_length = read_u32(&reader);
+        read_u32(&reader);  // checksum, recomputed on output
+        total += table->orig_length;
+        if (reader.failed || table->offset > size || size - table->offset < table->transform_length ||
+            table->transform_length > table->orig_length || total > WOFF_MAX_SFNT_SIZE) {
+            result = AGI_ERROR_INVALID_ARGUMENT;
+            break;
+        }
+
+        if (table->transform_length == table->orig_length) {
+            table->data = file + table->offset;
+            table->length = table->orig_length;
+            continue;
+        }
+        table->owned = agi_malloc(table->orig_length ? table->orig_length : 1);
+        if (!table->owned) {
+            result = AGI_ERROR_OUT_OF_MEMORY;
+            break;
+        }
+        uLongf inflated = table->orig_length;
+        if (uncompress(table->owned, &inflated, file + table->offset, table->transform_length) != Z_OK ||
+            inflated != table->orig_length) {
+            result = AGI_ERROR_INVALID_ARGUMENT;
+            break;
+        }
+        table->data = table->owned;
+        table->length = table->orig_length;
+    }
+
+    if (result == AGI_SUCCESS) {
+        *cff = flavor == TAG_OTTO;
+        result = write_sfnt(flavor, tables, count, output_path);
+    }
+    for (u16 i = 0; i < count; i++) agi_free(tables[i].owned);
+    agi_free(tables);
+    return result;
+}
+
+// --- WOFF2 ---
+
+#if defined(AGI_HAVE_BROTLI)
+
+static const u32 known_tags[63] = {
+    TAG('c', 'm', 'a', 'p'), TAG('h', 'e', 'a', 'd'), TAG('h', 'h', 'e', 'a'), TAG('h', 'm', 't', 'x'),
+    TAG('m', 'a', 'x', 'p'), TAG('n', 'a', 'm', 'e'), TAG('O', 'S', '/', '2'), TAG('p', 'o', 's', 't'),
+    TAG('c', 'v', 't', ' '), TAG('f', 'p', 'g', 'm'), TAG('g', 'l', 'y', 'f'), TAG('l', 'o', 'c', 'a'),
+    TAG('p', 'r', 'e', 'p'), TAG('C', 'F', 'F', ' '), TAG('V', 'O', 'R', 'G'), TAG('E', 'B', 'D', 'T'),
+    TAG('E', 'B', 'L', 'C'), TAG('g', 'a', 's', 'p'), TAG('h', 'd', 'm', 'x'), TAG('k', 'e', 'r', 'n'),
+    TAG('L', 'T', 'S', 'H'), TAG('P', 'C', 'L', 'T'), TAG('V', 'D', 'M', 'X'), TAG('v', 'h', 'e', 'a'),
+    TAG('v', 'm', 't', 'x'), TAG('B', 'A', 'S', 'E'), TAG('G', 'D', 'E', 'F'), TAG('G', 'P', 'O', 'S'),
+    TAG('G', 'S', 'U', 'B'), TAG('E', 'B', 'S', 'C'), TAG('J', 'S', 'T', 'F'), TAG('M', 'A', 'T', 'H'),
+    TAG('C', 'B', 'D', 'T'), TAG('C', 'B', 'L', 'C'), TAG('C', 'O', 'L', 'R'), TAG('C', 'P', 'A', 'L'),
+    TAG('S', 'V', 'G', ' '), TAG('s', 'b', 'i', 'x'), TAG('a', 'c', 'n', 't'), TAG('a', 'v', 'a', 'r'),
+    TAG('b', 'd', 'a', 't'), TAG('b', 'l', 'o', 'c'), TAG('b', 's', 'l', 'n'), TAG('c', 'v', 'a', 'r'),
+    TAG('f', 'd', 's', 'c'), TAG('f', 'e', 'a', 't'), TAG('f', 'm', 't', 'x'), TAG('f', 'v', 'a', 'r'),
+    TAG('g', 'v', 'a', 'r'), TAG('h', 's', 't', 'y'), TAG('j', 'u', 's', 't'), TAG('l', 'c', 'a', 'r'),
+    TAG('m', 'o', 'r', 't'), TAG('m', 'o', 'r', 'x'), TAG('o', 'p', 'b', 'd'), TAG('p', 'r', 'o', 'p'),
+    TAG('t', 'r', 'a', 'k'), TAG('Z', 'a', 'p', 'f'), TAG('S', 'i', 'l', 'f'), TAG('G', 'l', 'a', 't'),
+    TAG('G', 'l', 'o', 'c'), TAG('F', 'e', 'a', 't'), TAG('S', 'i', 'l', 'l'),
+};
+
+typedef struct {
+    s32 x;
+    s32 y;
+    b8 on_curve;
+} GlyphPoint;
+
+static s32 with_sign(u32 flag, s32 value) {
+    return (flag & 1) ? value : -value;
+}
+
+// Point coordinates of a simple glyph: one flag byte per point says how many
+// bytes of the glyph stream hold its x/y deltas and how they are packed
+static b8 decode_triplets(const u8 *flags, FontReader *glyphs, GlyphPoint *points, u32 count) {
+    s32 x = 0;
+    s32 y = 0;
+    for (u32 i = 0; i < count; i++) {
+        u32 flag = flags[i];
+        b8 on_curve = !(flag >> 7);
+        flag &= 0x7F;
+
+        size_t byte_count = flag < 84 ? 1 : flag < 120 ? 2 : flag < 124 ? 3 : 4;
+        const u8 *in = read_bytes(glyphs, byte_count);
+        if (!in) return false;
+
+        s32 dx;
+        s32 dy;
+        if (flag < 10) {
+            dx = 0;
+            dy = with_sign(flag, (s32)(((flag & 14) << 7) + in[0]));
+        } else if (flag < 20) {
+            dx = with_sign(flag, (s32)((((flag - 10) & 14) << 7) + in[0]));
+            dy = 0;
+        } else if (flag < 84) {
+            u32 b0 = flag - 20;
+            u32 b1 = in[0];
+            dx = with_sign(flag, (s32)(1 + (b0 & 0x30) + (b1 >> 4)));
+            dy = with_sign(flag >> 1, (s32)(1 + ((b0 & 0x0C) << 2) + (b1 & 0x0F)));
+        } else if (flag < 120) {
+            u32 b0 = flag - 84;
+            dx = with_sign(flag, (s32)(1 + ((b0 / 12) << 8) + in[0]));
+            dy = with_sign(flag >> 1, (s32)(1 + (((b0 % 12) >> 2) << 8) + in[1]));
+        } else if (flag < 124) {
+            u32 b2 = in[1];
+            dx = with_sign(flag, (s32)((in[0] << 4) + (b2 >> 4)));
+            dy = with_sign(flag >> 1, (s32)(((b2 & 0x0F) << 8) + in[2]));
+        } else {
+            dx = with_sign(flag, (s32)((in[0] << 8) + in[1]));
+            dy = with_sign(flag >> 1, (s32)((in[2] << 8) + in[3]));
+        }
+        x += dx;
+        y += dy;
+        points[i].x = x;
+        points[i].y = y;
+        points[i].on_curve = on_curve;
+    }
+    return true;
+}
+
+// Standard glyf encoding of the points: flags (run-length packed), then x and y deltas
+static void write_points(FontWriter *out, const GlyphPoint *points, u32 count, b8 overlap) {
+    s32 last_x = 0;
+    s32 last_y = 0;
+    int last_flag = -1;
+    u32 repeat = 0;
+    size_t repeat_position = 0;
+    for (u32 i = 0; i < count; i++) {
+        s32 dx = points[i].x - last_x;
+        s32 dy = points[i].y - last_y;
+        u8 flag = points[i].on_curve ? GLYF_ON_CURVE : 0;
+        if (i == 0 && overlap) flag |= GLYF_OVERLAP_SIMPLE;
+        if (dx == 0) {
+            flag |= GLYF_X_SAME;
+        } else if (dx > -256 && dx < 256) {
+            flag |= GLYF_X_SHORT | (dx > 0 ? GLYF_X_SAME : 0);
+        }
+        if (dy == 0) {
+            flag |= GLYF_Y_SAME;
+        } else if (dy > -256 && dy < 256) {
+            flag |= GLYF_Y_SHORT | (dy > 0 ? GLYF_Y_SAME : 0);
+        }
+
+        if (flag == last_flag && repeat < 255) {
+            if (repeat == 0) {
+                out->data[repeat_position] |= GLYF_REPEAT;
+                write_u8(out, 0);
+            }
+            repeat++;
+            if (!out->failed) out->data[out->length - 1] = (u8)repeat;
+        } else {
+            repeat = 0;
+            repeat_position = out->length;
+            write_u8(out, flag);
+        }
+        if (out->failed) return;
+        last_flag = flag;
+        last_x = points[i].x;
+        last_y = points[i].y;
+    }
+
+    last_x = 0;
+    for (u32 i = 0; i < count; i++) {
+        s32 dx = points[i].x - last_x;
+        if (dx != 0) {
+            if (dx > -256 && dx < 256) {
+                write_u8(out, (u8)(dx < 0 ? -dx : dx));
+            } else {
+                write_u16(out, (u16)(s16)dx);
+            }
+        }
+        last_x = points[i].x;
+    }
+    last_y = 0;
+    for (u32 i = 0; i < count; i++) {
+        s32 dy = points[i].y - last_y;
+        if (dy != 0) {
+            if (dy > -256 && dy < 256) {
+                write_u8(out, (u8)(dy < 0 ? -dy : dy));
+            } else {
+                write_u16(out, (u16)(s16)dy);
+            }
+        }
+        last_y = points[i].y;
+    }
+}
+
+static b8 bitmap_bit(const u8 *bitmap, u32 index) {
+    return (bitmap[index >> 3] & (0x80 >> (index & 7))) != 0;
+}
+
+typedef struct {
+    FontReader contours;
+    FontReader points;
+    FontReader flags;
+    FontReader glyphs;
+    FontReader composites;
+    FontReader boxes;
+    FontReader instructions;
+    const u8 *box_bitmap;
+    const u8 *overlap_bitmap;  // NULL when absent
+} GlyfStreams;
+
+static b8 write_instructions(FontWriter *out, GlyfStreams *streams) {
+    u16 length = read_255u16(&streams->glyphs);
+    const u8 *instructions = read_bytes(&streams->instructions, length);
+    if (streams->glyphs.failed || !instructions) return false;
+    write_u16(out, length);
+    write_bytes(out, instructions, length);
+    return true;
+}
+
+static b8 write_composite(FontWriter *out, GlyfStreams *streams) {
+    size_t start = streams->composites.position;
+    b8 have_instructions = false;
+    u16 flags;
+    do {
+        flags = read_u16(&streams->composites);
+        size_t size = 2 + ((flags & COMPOSITE_ARG_WORDS) ? 4 : 2);
+        if (flags & COMPOSITE_SCALE) {
+            size += 2;
+        } else if (flags & COMPOSITE_XY_SCALE) {
+            size += 4;
+        } else if (flags & COMPOSITE_TWO_BY_TWO) {
+            size += 8;
+        }
+        if (flags & COMPOSITE_INSTRUCTIONS) have_instructions = true;
+        read_bytes(&streams->composites, size);  // glyph index, arguments and scale
+    } while (!streams->composites.failed && (flags & COMPOSITE_MORE));
+    if (streams->composites.failed) return false;
+
+    write_bytes(out, streams->composites.data + start, streams->composites.position - start);
+    return !have_instructions || write_instructions(out, streams);
+}
+
+static b8 write_simple(FontWriter *out, GlyfStreams *streams, s16 contour_count, b8 has_box, b8 overlap) {
+    u16 *end_points = agi_malloc((size_t)contour_count * sizeof(u16));
+    if (!end_points) return false;
+    u32 total = 0;
+    for (s16 i = 0; i < contour_count; i++) {
+        total += read_255u16(&streams->points);
+        end_points[i] = (u16)(total - 1);
+    }
+    const u8 *flags = read_bytes(&streams->flags, total);
+    GlyphPoint *points = total <= 0xFFFF ? agi_malloc((size_t)total * sizeof(GlyphPoint) + 1) : NULL;
+    b8 ok = !streams->points.failed && flags && points && decode_triplets(flags, &streams->glyphs, points, total);
+
+    if (ok) {
+        s16 box[4];
+        if (has_box) {
+            for (int i = 0; i < 4; i++) box[i] = (s16)read_u16(&streams->boxes);
+            ok = !streams->boxes.failed;
+        } else {
+            s32 min_x = total ? points[0].x : 0, min_y = total ? points[0].y : 0;
+            s32 max_x = min_x, max_y = min_y;
+            for (u32 i = 1; i < total; i++) {
+                min_x = points[i].x < min_x ? points[i].x : min_x;
+                min_y = points[i].y < min_y ? points[i].y : min_y;
+                max_x = points[i].x > max_x ? points[i].x : max_x;
+                max_y = points[i].y > max_y ? points[i].y : max_y;
+            }
+            box[0] = (s16)min_x;
+            box[1] = (s16)min_y;
+            box[2] = (s16)max_x;
+            box[3] = (s16)max_y;
+        }
+
+        write_u16(out, (u16)contour_count);
+        for (int i = 0; i < 4; i++) write_u16(out, (u16)box[i]);
+        for (s16 i = 0; i < contour_count; i++) write_u16(out, end_points[i]);
+        ok = ok && write_instructions(out, streams);
+        if (ok) write_points(out, points, total, overlap);
+    }
+    agi_free(points);
+    agi_free(end_points);
+    return ok;
+}
+
+// Rebuilds glyf and loca from the transformed glyf table (WOFF2 section 5.1)
+static agi_result_t rebuild_glyf(FontTable *glyf, FontTable *loca, u16 *loca_format) {
+    FontReader header = font_reader(glyf->data, glyf->length);
+    read_u16(&header);  // reserved
+    u16 options = read_u16(&header);
+    u16 glyph_count = read_u16(&header);
+    u16 index_format = read_u16(&header);
+    u32 sizes[7];
+    for (int i = 0; i < 7; i++) sizes[i] = read_u32(&header);
+    if (header.failed || index_format > 1) return AGI_ERROR_INVALID_ARGUMENT;
+
+    GlyfStreams streams = {0};
+    FontReader *readers[7] = {&streams.contours, &streams.points, &streams.flags, &streams.glyphs,
+                              &streams.composites, &streams.boxes, &streams.instructions};
+    for (int i = 0; i < 7; i++) {
+        const u8 *data = read_bytes(&header, sizes[i]);
+        if (!data) return AGI_ERROR_INVALID_ARGUMENT;
+        *readers[i] = font_reader(data, sizes[i]);
+    }
+    size_t bitmap_size = 4 * (((size_t)glyph_count + 31) / 32);
+    streams.box_bitmap = read_bytes(&streams.boxes, bitmap_size);
+    if (options & 1) streams.overlap_bitmap = read_bytes(&header, bitmap_size);
+    if (!streams.box_bitmap || header.failed) return AGI_ERROR_INVALID_ARGUMENT;
+
+    u32 loca_size = ((u32)glyph_count + 1) * (index_format ? 4 : 2);
+    if (loca->orig_length != loca_size) return AGI_ERROR_INVALID_ARGUMENT;
+    FontWriter out = {0};
+    FontWriter loca_out = {0};
+    writer_reserve(&loca_out, loca_size);
+    loca_out.length = 0;
+
+    b8 ok = !loca_out.failed;
+    for (u32 i = 0; i < glyph_count && ok; i++) {
+        size_t start = out.length;
+        b8 has_box = bitmap_bit(streams.box_bitmap, i);
+        b8 overlap = streams.overlap_bitmap && bitmap_bit(streams.overlap_bitmap, i);
+        s16 contour_count = (s16)read_u16(&streams.contours);
+        if (streams.contours.failed) {
+            ok = false;
+        } else if (contour_count == 0) {
+            ok = !has_box;  // an empty glyph has no box
+        } else if (contour_count == -1) {
+            // Composites always carry an explicit box
+            write_u16(&out, (u16)contour_count);
+            for (int b = 0; b < 4; b++) write_u16(&out, read_u16(&streams.boxes));
+            ok = has_box && !streams.boxes.failed && write_composite(&out, &streams);
+        } else if (contour_count > 0) {
+            ok = write_simple(&out, &streams, contour_count, has_box, overlap);
+        } else {
+            ok = false;
+        }
+        write_padding(&out);
+        ok = ok && !out.failed;
+
+        if (index_format) {
+            u8 *entry = writer_reserve(&loca_out, 4);
+            if (entry) put_u32(entry, (u32)start);
+        } else {
+            u8 *entry = writer_reserve(&loca_out, 2);
+            if (entry) put_u16(entry, (u16)(start / 2));
+        }
+    }
+    if (index_format) {
+        u8 *entry = writer_reserve(&loca_out, 4);
+        if (entry) put_u32(entry, (u32)out.length);
+    } else {
+        u8 *entry = writer_reserve(&loca_out, 2);
+        if (entry) put_u16(entry, (u16)(out.length / 2));
+        ok = ok && out.length / 2 <= 0xFFFF;
+    }
+    if (!ok || out.failed || loca_out.failed) {
+        agi_free(out.data);
+        agi_free(loca_out.data);
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    glyf->owned = out.data;
+    glyf->data = out.data;
+    glyf->length = (u32)out.length;
+    loca->owned = loca_out.data;
+    loca->data = loca_out.data;
+    loca->length = loca_size;
+    *loca_format = index_format;
+    return AGI_SUCCESS;
+}
+
+// The left side bearings a transformed hmtx leaves out are each glyph's xMin
+static agi_result_t glyph_x_mins(const FontTable *glyf, const FontTable *loca, b8 long_offsets, u16 glyph_count,
+                                 s16 *x_mins) {
+    u32 entry_size = long_offsets ? 4 : 2;
+    if (!glyf || !loca || loca->length < ((u32)glyph_count + 1) * entry_size) return AGI_ERROR_INVALID_ARGUMENT;
+    for (u32 i = 0; i < glyph_count; i++) {
+        u32 start = long_offsets ? get_u32(loca->data + i * 4) : get_u16(loca->data + i * 2) * 2u;
+        u32 end = long_offsets ? get_u32(loca->data + i * 4 + 4) : get_u16(loca->data + i * 2 + 2) * 2u;
+        x_mins[i] = 0;
+        if (end > start) {
+            if (end > glyf->length || end - start < 10) return AGI_ERROR_INVALID_ARGUMENT;
+            x_mins[i] = (s16)get_u16(glyf->data + start + 2);
+        }
+    }
+    return AGI_SUCCESS;
+}
+
+// Rebuilds hmtx from its transformed form (WOFF2 section 5.4)
+static agi_result_t rebuild_hmtx(FontTable *hmtx, FontTable *tables, u16 count) {
+    FontTable *head = find_table(tables, count, TAG_HEAD);
+    FontTable *hhea = find_table(tables, count, TAG_HHEA);
+    FontTable *maxp = find_table(tables, count, TAG_MAXP);
+    if (!head || !hhea || !maxp || head->length < 54 || hhea->length < 36 || maxp->length < 6) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+    u16 glyph_count = get_u16(maxp->data + 4);
+    u16 metric_count = get_u16(hhea->data + 34);
+    if (metric_count == 0 || metric_count > glyph_count) return AGI_ERROR_INVALID_ARGUMENT;
+
+    FontReader reader = font_reader(hmtx->data, hmtx->length);
+    u8 flags = read_u8(&reader);
+    b8 no_proportional_lsb = flags & 1;
+    b8 no_monospace_lsb = flags & 2;
+    if ((flags & 0xFC) || !(flags & 3)) return AGI_ERROR_INVALID_ARGUMENT;
+
+    s16 *x_mins = agi_malloc((size_t)glyph_count * sizeof(s16) + 1);
+    if (!x_mins) return AGI_ERROR_OUT_OF_MEMORY;
+    agi_result_t result = glyph_x_mins(find_table(tables, count, TAG_GLYF), find_table(tables, count, TAG_LOCA),
+                                       get_u16(head->data + 50) != 0, glyph_count, x_mins);
+    u32 length = (u32)metric_count * 4 + ((u32)glyph_count - metric_count) * 2;
+    u8 *out = result == AGI_SUCCESS ? agi_malloc(length) : NULL;
+    if (result == AGI_SUCCESS && !out) result = AGI_ERROR_OUT_OF_MEMORY;
+
+    if (out) {
+        const u8 *advances = read_bytes(&reader, (size_t)metric_count * 2);
+        const u8 *proportional = no_proportional_lsb ? NULL : read_bytes(&reader, (size_t)metric_count * 2);
+        const u8 *monospace = no_monospace_lsb ? NULL : read_bytes(&reader, ((size_t)glyph_count - metric_count) * 2);
+        if (reader.failed) {
+            result = AGI_ERROR_INVALID_ARGUMENT;
+        } else {
+            for (u32 i = 0; i < metric_count; i++) {
+                memcpy(out + i * 4, advances + i * 2, 2);
+                put_u16(out + i * 4 + 2, proportional ? get_u16(proportional + i * 2) : (u16)x_mins[i]);
+            }
+            for (u32 i = metric_count; i < glyph_count; i++) {
+                u8 *entry = out + (size_t)metric_count * 4 + (i - metric_count) * 2;
+                put_u16(entry, monospace ? get_u16(monospace + (i - metric_count) * 2) : (u16)x_mins[i]);
+            }
+            hmtx->owned = out;
+            hmtx->data = out;
+            hmtx->length = length;
+            out = NULL;
+        }
+    }
+    agi_free(out);
+    agi_free(x_mins);
+    return result;
+}
+
+static agi_result_t unpack_woff2(const u8 *file, size_t size, const char *output_path, b8 *cff) {
+    FontReader reader = font_reader(file, size);
+    read_u32(&reader);  // signature
+    u32 flavor = read_u32(&reader);
+    u32 length = read_u32(&reader);
+    u16 count = read_u16(&reader);
+    read_u16(&reader);  // reserved
+    read_u32(&reader);  // totalSfntSize
+    u32 compressed_size = read_u32(&reader);
+    read_bytes(&reader, WOFF2_HEADER_SIZE - 24);
+    if (reader.failed || length != size || count == 0) return AGI_ERROR_INVALID_ARGUMENT;
+    if (flavor == TAG_TTCF) {
+        agi_log_error("WOFF2 font collections are not supported");
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    FontTable *tables = agi_calloc(count, sizeof(FontTable));
+    if (!tables) return AGI_ERROR_OUT_OF_MEMORY;
+
+    agi_result_t result = AGI_SUCCESS;
+    u64 stream_size = 0;
+    for (u16 i = 0; i < count; i++) {
+        FontTable *table = &tables[i];
+        u8 flags = read_u8(&reader);
+        table->tag = (flags & 0x3F) == 0x3F ? read_u32(&reader) : known_tags[flags & 0x3F];
+        u32 version = flags >> 6;
+        table->orig_length = read_base128(&reader);
+        // glyf and loca use version 0 for their transform and 3 for none; the rest the reverse
+        b8 glyf_or_loca = table->tag == TAG_GLYF || table->tag == TAG_LOCA;
+        table->transformed = glyf_or_loca ? version != 3 : version != 0;
+        if ((glyf_or_loca && version != 0 && version != 3) ||
+            (!glyf_or_loca && version != 0 && !(table->tag == TAG_HMTX && version == 1))) {
+            result = AGI_ERROR_INVALID_ARGUMENT;
+            break;
+        }
+        table->transform_length = table->transformed ? read_base128(&reader) : table->orig_length;
+        stream_size += table->transform_length;
+        if (reader.failed || stream_size > WOFF_MAX_SFNT_SIZE) {
+            result = AGI_ERROR_INVALID_ARGUMENT;
+            break;
+        }
+    }
+
+    FontTable *glyf = find_table(tables, count, TAG_GLYF);
+    FontTable *loca = find_table(tables, count, TAG_LOCA);
+    if (result == AGI_SUCCESS && (!glyf != !loca || (glyf && glyf->transformed != loca->transformed) ||
+                                  (loca && loca->transformed && loca->transform_length != 0))) {
+        result = AGI_ERROR_INVALID_ARGUMENT;
+    }
+
+    // Every table comes out of one Brotli stream, in directory order
+    const u8 *compressed = read_bytes(&reader, compressed_size);
+    u8 *stream = NULL;
+    if (result == AGI_SUCCESS && !compressed) result = AGI_ERROR_INVALID_ARGUMENT;
+    if (result == AGI_SUCCESS) {
+        stream = agi_malloc(stream_size ? (size_t)stream_size : 1);
+        size_t decoded = (size_t)stream_size;
+        if (!stream) {
+            result = AGI_ERROR_OUT_OF_MEMORY;
+        } else if (BrotliDecoderDecompress(compressed_size, compressed, &decoded, stream) != BROTLI_DECODER_RESULT_SUCCESS ||
+                   decoded != stream_size) {
+            result = AGI_ERROR_INVALID_ARGUMENT;
+        }
+    }
+    u16 loca_format = 0;
+    if (result == AGI_SUCCESS) {
+        size_t offset = 0;
+        for (u16 i = 0; i < count; i++) {
+            tables[i].data = stream + offset;
+            tables[i].length = tables[i].transform_length;
+            offset += tables[i].transform_length;
+        }
+        if (glyf && glyf->transformed) result = rebuild_glyf(glyf, loca, &loca_format);
+    }
+    FontTable *head = find_table(tables, count, TAG_HEAD);
+    if (result == AGI_SUCCESS && glyf && glyf->transformed) {
+        // The rebuilt loca may not use the offset size head declares
+        u8 *copy = head && head->length >= 54 ? agi_malloc(head->length) : NULL;
+        if (!copy) {
+            result = head && head->length >= 54 ? AGI_ERROR_OUT_OF_MEMORY : AGI_ERROR_INVALID_ARGUMENT;
+        } else {
+            memcpy(copy, head->data, head->length);
+            put_u16(copy + 50, loca_format);
+            head->owned = copy;
+            head->data = copy;
+        }
+    }
+    FontTable *hmtx = find_table(tables, count, TAG_HMTX);
+    if (result == AGI_SUCCESS && hmtx && hmtx->transformed) result = rebuild_hmtx(hmtx, tables, count);
+
+    if (result == AGI_SUCCESS) {
+        *cff = flavor == TAG_OTTO;
+        result = write_sfnt(flavor, tables, count, output_path);
+    }
+
+    for (u16 i = 0; i < count; i++) agi_free(tables[i].owned);
+    agi_free(tables);
+    agi_free(stream);
+    return result;
+}
+
+#else
+
+static agi_result_t unpack_woff2(const u8 *file, size_t size, const char *output_path, b8 *cff) {
+    agi_log_error("Built without Brotli, can't unpack WOFF2 fonts");
+    return AGI_ERROR_INVALID_ARGUMENT;
+}
+
+#endif
+
+// --- files ---
+
+static u8 *read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    u8 *data = NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long length = ftell(file);
+        if (length > 0 && (unsigned long)length <= WOFF_MAX_SFNT_SIZE && fseek(file, 0, SEEK_SET) == 0) {
+            data = agi_malloc((size_t)length);
+            if (data && fread(data, 1, (size_t)length, file) != (size_t)length) {
+                agi_free(data);
+                data = NULL;
+            }
+            *size = (size_t)length;
+        }
+    }
+    fclose(file);
+    return data;
+}
+
+agi_font_format_t woff_detect_format(const char *path) {
+    u8 signature[4];
+    FILE *file = fopen(path, "rb");
+    if (!file) return AGI_FONT_FORMAT_SFNT;
+    size_t read = fread(signature, 1, sizeof(signature), file);
+    fclose(file);
+    if (read != sizeof(signature)) return AGI_FONT_FORMAT_SFNT;
+    switch (get_u32(signature)) {
+        case TAG_WOFF: return AGI_FONT_FORMAT_WOFF;
+        case TAG_WOFF2: return AGI_FONT_FORMAT_WOFF2;
+        default: return AGI_FONT_FORMAT_SFNT;
+    }
+}
+
+agi_result_t woff_unpack_file(const char *input_path, const char *output_path, b8 *cff) {
+    size_t size = 0;
+    u8 *file = read_file(input_path, &size);
+    if (!file) {
+        agi_log_error("Failed to read %s", input_path);
+        return AGI_ERROR_IO;
+    }
+
+    agi_result_t result = AGI_ERROR_INVALID_ARGUMENT;
+    if (size >= WOFF2_HEADER_SIZE && get_u32(file) == TAG_WOFF2) {
+        result = unpack_woff2(file, size, output_path, cff);
+    } else if (size >= WOFF_HEADER_SIZE && get_u32(file) == TAG_WOFF) {
+        result = unpack_woff(file, size, output_path, cff);
+    }
+    if (result == AGI_ERROR_INVALID_ARGUMENT) {
+        agi_log_error("Malformed font package %s", input_path);
+    }
+    agi_free(file);
+    return result;
+}
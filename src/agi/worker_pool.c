@@ -0,0 +1,186 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "agi/worker_pool.h"
+
+#include "agi/log.h"
+#include "agi/memory.h"
+#include "agi/thread.h"
+#include "agi/trace.h"
+
+struct WorkerPool {
+    EventLoop *loop;
+    agi_mutex_t lock;
+    agi_cond_t job_ready;
+
+    // Guarded by lock
+    WorkerJob *queue_head;
+    WorkerJob *queue_tail;
+    u32 queued;
+    u32 queue_capacity;
+    WorkerJob *done_head;
+    WorkerJob *done_tail;
+    b8 notify_posted;
+    b8 stopping;
+
+    // Loop thread only
+    u32 pending;
+    EventLoopTask notify;
+
+    agi_thread_t *threads;
+    u32 thread_count;
+};
+
+static void job_list_append(WorkerJob **head, WorkerJob **tail, WorkerJob *job) {
+    job->next = NULL;
+    if (*tail) {
+        (*tail)->next = job;
+    } else {
+        *head = job;
+    }
+    *tail = job;
+}
+
+static void run_completions(WorkerPool *pool, WorkerJob *job) {
+    while (job) {
+        // Read next first: complete() owns and may free the job
+        WorkerJob *next = job->next;
+        pool->pending--;
+        job->complete(job);
+        job = next;
+    }
+}
+
+// Finished jobs are handed back in batches: one loop wakeup covers every job
+// that completed since the last one was posted
+static void on_jobs_done(EventLoop *loop, void *userdata) {
+    WorkerPool *pool = userdata;
+
+    agi_mutex_lock(&pool->lock);
+    WorkerJob *done = pool->done_head;
+    pool->done_head = NULL;
+    pool->done_tail = NULL;
+    pool->notify_posted = false;
+    agi_mutex_unlock(&pool->lock);
+
+    run_completions(pool, done);
+}
+
+static void worker_main(void *arg) {
+    WorkerPool *pool = arg;
+    trace_name_thread("worker");
+
+    agi_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->queue_head && !pool->stopping) {
+            agi_cond_wait(&pool->job_ready, &pool->lock);
+        }
+        if (pool->stopping) break;
+
+        WorkerJob *job = pool->queue_head;
+        pool->queue_head = job->next;
+        if (!pool->queue_head) pool->queue_tail = NULL;
+        pool->queued--;
+        agi_mutex_unlock(&pool->lock);
+
+        job->run(job);
+
+        agi_mutex_lock(&pool->lock);
+        job_list_append(&pool->done_head, &pool->done_tail, job);
+        if (!pool->notify_posted) {
+            pool->notify_posted = true;
+            event_loop_post(pool->loop, &pool->notify);
+        }
+    }
+    agi_mutex_unlock(&pool->lock);
+}
+
+WorkerPool *worker_pool_create(EventLoop *loop, u32 worker_count, u32 queue_capacity) {
+    if (!loop) return NULL;
+    if (worker_count == 0) worker_count = AGI_DEFAULT_WORKER_COUNT;
+    if (queue_capacity == 0) queue_capacity = AGI_DEFAULT_JOB_QUEUE_CAPACITY;
+
+    WorkerPool *pool = agi_calloc(1, sizeof(WorkerPool));
+    if (!pool) return NULL;
+
+    pool->threads = agi_calloc(worker_count, sizeof(agi_thread_t));
+    if (!pool->threads) {
+        agi_free(pool);
+        return NULL;
+    }
+
+    pool->loop = loop;
+    pool->queue_capacity = queue_capacity;
+    pool->notify.callback = on_jobs_done;
+    pool->notify.userdata = pool;
+    agi_mutex_init(&pool->lock);
+    agi_cond_init(&pool->job_ready);
+
+    for (u32 i = 0; i < worker_count; i++) {
+        if (agi_thread_create(&pool->threads[i], worker_main, pool, AGI_WORKER_STACK_SIZE) != AGI_SUCCESS) {
+            agi_log_error("Failed to start worker thread %u", i);
+            worker_pool_destroy(pool);
+            return NULL;
+        }
+        pool->thread_count++;
+    }
+
+    return pool;
+}
+
+void worker_pool_destroy(WorkerPool *pool) {
+    if (!pool) return;
+
+    agi_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    WorkerJob *cancelled = pool->queue_head;
+    pool->queue_head = NULL;
+    pool->queue_tail = NULL;
+    pool->queued = 0;
+    agi_cond_broadcast(&pool->job_ready);
+    agi_mutex_unlock(&pool->lock);
+
+    for (u32 i = 0; i < pool->thread_count; i++) {
+        agi_thread_join(pool->threads[i]);
+    }
+
+    // Workers are gone; finish whatever they handed back that the loop hasn't seen
+    if (pool->notify_posted) {
+        event_loop_cancel_task(pool->loop, &pool->notify);
+    }
+    run_completions(pool, pool->done_head);
+
+    for (WorkerJob *job = cancelled; job; job = job->next) {
+        job->cancelled = true;
+    }
+    run_completions(pool, cancelled);
+
+    agi_cond_destroy(&pool->job_ready);
+    agi_mutex_destroy(&pool->lock);
+    agi_free(pool->threads);
+    agi_free(pool);
+}
+
+agi_result_t worker_pool_submit(WorkerPool *pool, WorkerJob *job) {
+    if (!pool || !job || !job->run || !job->complete) {
+        return AGI_ERROR_INVALID_ARGUMENT;
+    }
+    job->cancelled = false;
+
+    agi_mutex_lock(&pool->lock);
+    if (pool->stopping || pool->queued >= pool->queue_capacity) {
+        agi_mutex_unlock(&pool->lock);
+        return AGI_ERROR_BUSY;
+    }
+    job_list_append(&pool->queue_head, &pool->queue_tail, job);
+    pool->queued++;
+    agi_cond_signal(&pool->job_ready);
+    agi_mutex_unlock(&pool->lock);
+
+    pool->pending++;
+    return AGI_SUCCESS;
+}
+
+u32 worker_pool_pending(const WorkerPool *pool) {
+    return pool->pending;
+}
@@ -1,67 +1,61 @@
 #include <agi/defines.h>
 #include <stdio.h>
 #include <string.h>
-#if defined(AGI_PLATFORM_APPLE)
-#include <unistd.h>
-#define Sleep(x) usleep(x * 1000)
-#elif defined(AGI_PLATFORM_WINDOWS)
-#include <winsock2.h>
-#endif
 #include <agi/log.h>
 
 #include "agi/app.h"
-#include "agi/fonts.h"
+#include "agi/font_jobs.h"
+#include "agi/protocol.h"
 #include "agi/tcp_client.h"
 
-void handle_auth_response(TcpClient *client, void *packet_data) {
-    AuthResponsePacket *response = (AuthResponsePacket *)packet_data;
-    agi_log_debug("Auth response: %s", response->success ? "Success" : "Failure");
-    agi_log_debug("Message: %s", response->message);
+void handle_auth_response(TcpClient *client, const void *packet_data, size_t packet_size) {
+    AuthResponse response;
+    if (protocol_decode_auth_response(client, packet_data, packet_size, &response) != AGI_SUCCESS) {
+        agi_log_error("Malformed auth response");
+        return;
+    }
+    agi_log_debug("Auth response: %s", response.success ? "Success" : "Failure");
+    agi_log_debug("Message: %.*s", (int)response.message.length, response.message.data);
 }
 
-void handle_font_install_request(TcpClient *client, void *packet_data) {
-    FontInstallRequestPacket *request = (FontInstallRequestPacket *)packet_data;
-    agi_log_debug("Font install request received for font: %s", request->font_name);
-    if (request->install) {
-        FontInstallResponsePacket response = {0};
-
-        agi_result_t result = install_font(request->font_hash, request->font_name, request->font_style, request->font_extension);
-
-        if (result == AGI_SUCCESS) {
-            response.success = 1;
-            snprintf(response.message, sizeof(response.message), "Font %s installed successfully", request->font_name);
-        } else {
-            response.success = 0;
-            snprintf(response.message, sizeof(response.message), "Failed to install font %s", request->font_name);
-        }
-
-        tcp_client_send_packet(client, 3, &response, sizeof(response));
-    } else {
-        FontInstallResponsePacket response = {0};
-        agi_result_t result = uninstall_font(request->font_name, request->font_style, request->font_extension);
+void handle_font_install_request(TcpClient *client, const void *packet_data, size_t packet_size) {
+    FontInstallRequest request;
+    if (protocol_decode_font_install_request(client, packet_data, packet_size, &request) != AGI_SUCCESS) {
+        agi_log_error("Malformed font install request");
+        return;
+    }
 
-        if (result == AGI_SUCCESS) {
-            response.success = 1;
-            snprintf(response.message, sizeof(response.message), "Font %s uninstalled successfully", request->font_name);
-        } else {
-            response.success = 0;
-            snprintf(response.message, sizeof(response.message), "Failed to uninstall font %s", request->font_name);
-        }
+    // Downloads run on a worker; the response goes out when the job completes
+    App *app = tcp_client_get_userdata(client);
+    agi_log_debug("Font install request received for font: %.*s", (int)request.font_name.length, request.font_name.data);
+    font_jobs_submit_install(app->workers, client, &request);
+}
 
-        tcp_client_send_packet(client, 3, &response, sizeof(response));
+void handle_font_batch_request(TcpClient *client, const void *packet_data, size_t packet_size) {
+    FontBatchRequest batch;
+    if (protocol_decode_font_batch_request(client, packet_data, packet_size, &batch) != AGI_SUCCESS) {
+        agi_log_error("Malformed font batch request");
+        return;
     }
-    agi_log_debug("Font install response sent");
+
+    App *app = tcp_client_get_userdata(client);
+    agi_log_debug("Font batch %llu received with %u entries", (unsigned long long)batch.job_id, batch.count);
+    font_jobs_submit_batch(app->workers, client, &batch);
 }
 
 int main() {
     agi_log_set_level(AGI_LOG_LEVEL_DEBUG);
+    // Formatting and writing happen on a background thread from here on
+    agi_log_start(NULL);
     App *app = app_new(.hostname = "192.168.1.36",
                        .port = 6969,
                        .auth_handler = handle_auth_response,
-                       .font_install_handler = handle_font_install_request);
+                       .font_install_handler = handle_font_install_request,
+                       .font_batch_handler = handle_font_batch_request);
 
     if (app == NULL) {
         agi_log_debug("Failed to create app");
+        agi_log_shutdown();
         return 1;
     }
 
@@ -69,27 +63,26 @@ int main() {
     if (result != AGI_SUCCESS) {
         agi_log_debug("Failed to connect to server");
         app_destroy(app);
+        agi_log_shutdown();
         return 1;
     }
 
     // Register the font installation packet handler
-    result = tcp_client_register_packet_handler(app->client, 4, sizeof(FontInstallRequestPacket), handle_font_install_request);
+    result = tcp_client_register_packet_handler(app->client, AGI_PACKET_FONT_INSTALL_REQUEST_LEGACY, sizeof(FontInstallRequestPacket), handle_font_install_request);
     if (result != AGI_SUCCESS) {
         agi_log_debug("Failed to register font install packet handler");
         app_destroy(app);
+        agi_log_shutdown();
         return 1;
     }
 
-    // Main loop to process incoming packets
-    while (1) {
-        result = tcp_client_process_packets(app->client);
-        if (result != AGI_SUCCESS) {
-            agi_log_debug("Error processing packets: %d", result);
-            break;
-        }
-        Sleep(100);
+    // Packets are dispatched from the event loop as soon as they arrive
+    result = app_run(app);
+    if (result != AGI_SUCCESS) {
+        agi_log_debug("Event loop exited with error: %d", result);
     }
 
     app_destroy(app);
+    agi_log_shutdown();
     return 0;
 }
\ No newline at end of file
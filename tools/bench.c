@@ -0,0 +1,487 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "agi/clock.h"
+#include "agi/download.h"
+#include "agi/font_jobs.h"
+#include "agi/fonts.h"
+#include "agi/log.h"
+#include "agi/memory.h"
+#include "agi/metrics.h"
+#include "agi/protocol.h"
+#include "agi/sha256.h"
+#include "agi/tcp_client.h"
+#include "agi/worker_pool.h"
+#include "fixture.h"
+#include "mock_server.h"
+
+// Drives the real TcpClient against the loopback mocks and prints one JSON
+// document, so runs can be diffed between commits:
+//
+//   bench [--quick] [--output results.json]
+//
+// dispatch:            frames parsed and dispatched per second, recv() calls and
+//                      allocations per frame, for small and large frames
+// send_path:           send() calls per packet, uncorked and corked in bursts
+// install_round_trip:  install command to response through the worker pool, the
+//                      download engine and the font backend, cold and cached
+//
+// Fonts are installed under a temporary XDG_DATA_HOME that is removed afterwards.
+
+#define BENCH_SCHEMA "agi-bench/1"
+
+// Frame types the portal mock uses besides the real protocol's
+#define BENCH_PACKET_DATA 200
+#define BENCH_PACKET_DONE 201
+
+#define BENCH_BLOB_BYTES (256 * 1024)
+#define BENCH_CORK_BURST 64
+#define BENCH_SEND_PAYLOAD 64
+#define BENCH_FONT_SIZE (48 * 1024)
+
+typedef struct {
+    u64 dispatch_small_frames;
+    u64 dispatch_large_frames;
+    u64 send_packets;
+    u32 install_fonts;
+} BenchSizes;
+
+static const BenchSizes full_sizes = {2000000, 20000, 200000, 64};
+static const BenchSizes quick_sizes = {100000, 1000, 10000, 16};
+
+// --- JSON report ---
+
+typedef struct {
+    FILE *file;
+    b8 first_benchmark;
+} Report;
+
+static void report_begin(Report *report, const char *name) {
+    fprintf(report->file, "%s    {\"name\": \"%s\"", report->first_benchmark ? "" : ",\n", name);
+    report->first_benchmark = false;
+}
+
+static void report_number(Report *report, const char *key, f64 value) {
+    fprintf(report->file, ", \"%s\": %.10g", key, value);
+}
+
+static void report_end(Report *report) {
+    fprintf(report->file, "}");
+}
+
+// --- measurement helpers ---
+
+typedef struct {
+    u64 started_ns;
+    u64 counters[AGI_COUNTER_COUNT];
+    AgiMemoryStats memory;
+} Sample;
+
+typedef struct {
+    f64 seconds;
+    u64 counters[AGI_COUNTER_COUNT];
+    u64 allocations;
+} Delta;
+
+static MetricsSnapshot snapshot;
+
+static void sample_begin(Sample *sample) {
+    metrics_snapshot(&snapshot);
+    memcpy(sample->counters, snapshot.counters, sizeof(sample->counters));
+    agi_memory_get_stats(&sample->memory);
+    sample->started_ns = agi_clock_now_ns();
+}
+
+static Delta sample_end(const Sample *sample) {
+    Delta delta;
+    delta.seconds = (f64)(agi_clock_now_ns() - sample->started_ns) / 1e9;
+    metrics_snapshot(&snapshot);
+    for (u32 i = 0; i < AGI_COUNTER_COUNT; i++) delta.counters[i] = snapshot.counters[i] - sample->counters[i];
+    AgiMemoryStats memory;
+    agi_memory_get_stats(&memory);
+    delta.allocations = memory.allocations + memory.reallocations - sample->memory.allocations - sample->memory.reallocations;
+    return delta;
+}
+
+static f64 per(u64 value, u64 count) {
+    return count ? (f64)value / (f64)count : 0;
+}
+
+// --- agent side ---
+
+typedef struct {
+    EventLoop *loop;
+    TcpClient *client;
+    WorkerPool *workers;
+    u64 frames;  // data frames dispatched
+} Agent;
+
+static void handle_data(TcpClient *client, const void *packet_data, size_t packet_size) {
+    Agent *agent = tcp_client_get_userdata(client);
+    agent->frames++;
+}
+
+static void handle_done(TcpClient *client, const void *packet_data, size_t packet_size) {
+    Agent *agent = tcp_client_get_userdata(client);
+    event_loop_stop(agent->loop);
+}
+
+static void handle_install(TcpClient *client, const void *packet_data, size_t packet_size) {
+    Agent *agent = tcp_client_get_userdata(client);
+    FontInstallRequest request;
+    if (protocol_decode_font_install_request(client, packet_data, packet_size, &request) != AGI_SUCCESS) {
+        agi_log_error("Malformed font install request");
+        return;
+    }
+    font_jobs_submit_install(agent->workers, client, &request);
+}
+
+static void handle_disconnect(TcpClient *client, agi_result_t reason) {
+    Agent *agent = tcp_client_get_userdata(client);
+    agi_log_error("Portal mock closed the connection");
+    event_loop_stop(agent->loop);
+}
+
+// Connected, attached and on v2 framing, as after the portal selected it
+static agi_result_t agent_connect(Agent *agent, u16 port) {
+    memset(agent, 0, sizeof(*agent));
+    agent->loop = event_loop_create();
+    agent->client = tcp_client_create("127.0.0.1", port);
+    if (!agent->loop || !agent->client || tcp_client_connect(agent->client) != AGI_SUCCESS) {
+        return AGI_ERROR_NETWORK;
+    }
+    tcp_client_set_userdata(agent->client, agent);
+    tcp_client_set_protocol_version(agent->client, AGI_PROTOCOL_V2);
+    tcp_client_set_disconnect_handler(agent->client, handle_disconnect);
+    tcp_client_register_packet_handler(agent->client, BENCH_PACKET_DATA, 0, handle_data);
+    tcp_client_register_packet_handler(agent->client, BENCH_PACKET_DONE, 0, handle_done);
+    return tcp_client_attach(agent->client, agent->loop);
+}
+
+static void agent_close(Agent *agent) {
+    // Cancelled jobs still answer through the client
+    if (agent->workers) worker_pool_destroy(agent->workers);
+    if (agent->client) tcp_client_destroy(agent->client);
+    if (agent->loop) event_loop_destroy(agent->loop);
+}
+
+// --- dispatch ---
+
+typedef struct {
+    u32 payload_size;
+    u64 frames;  // rounded down to whole blobs; the agent's count is what's reported
+} DispatchSession;
+
+static void dispatch_session(MockPeer *peer, void *userdata) {
+    const DispatchSession *session = userdata;
+    size_t frame_size = 2 * WIRE_MAX_VARINT_SIZE + session->payload_size;
+    size_t per_blob = frame_size < BENCH_BLOB_BYTES ? BENCH_BLOB_BYTES / frame_size : 1;
+    u8 *payload = calloc(1, session->payload_size);
+    u8 *blob = malloc(per_blob * frame_size);
+    if (payload && blob) {
+        WireWriter writer = wire_writer(blob, per_blob * frame_size);
+        for (size_t i = 0; i < per_blob; i++) mock_encode_frame(&writer, BENCH_PACKET_DATA, payload, session->payload_size);
+        for (u64 sent = 0; sent + per_blob <= session->frames; sent += per_blob) {
+            if (mock_peer_send_raw(peer, blob, writer.length) != AGI_SUCCESS) break;
+        }
+    }
+    free(payload);
+    free(blob);
+    mock_peer_send_frame(peer, BENCH_PACKET_DONE, NULL, 0);
+
+    // Held open until the agent hangs up, so it never sees EOF mid-run
+    u16 type;
+    const u8 *data;
+    size_t size;
+    while (mock_peer_recv_frame(peer, &type, &data, &size) == AGI_SUCCESS) {
+    }
+}
+
+static void bench_dispatch(Report *report, const char *name, u32 payload_size, u64 frames) {
+    DispatchSession session = {.payload_size = payload_size, .frames = frames};
+    MockPortal *portal = mock_portal_start(dispatch_session, &session);
+    Agent agent;
+    if (!portal || agent_connect(&agent, mock_portal_port(portal)) != AGI_SUCCESS) {
+        agi_log_error("Failed to set up %s", name);
+        agent_close(&agent);
+        mock_portal_stop(portal);
+        return;
+    }
+
+    Sample sample;
+    sample_begin(&sample);
+    event_loop_run(agent.loop);
+    Delta delta = sample_end(&sample);
+    agent_close(&agent);
+    mock_portal_stop(portal);
+
+    report_begin(report, name);
+    report_number(report, "payload_bytes", payload_size);
+    report_number(report, "frames", (f64)agent.frames);
+    report_number(report, "seconds", delta.seconds);
+    report_number(report, "frames_per_sec", (f64)agent.frames / delta.seconds);
+    report_number(report, "mb_per_sec", (f64)delta.counters[AGI_COUNTER_TCP_BYTES_RECEIVED] / delta.seconds / 1e6);
+    report_number(report, "recv_calls_per_frame", per(delta.counters[AGI_COUNTER_TCP_RECV_CALLS], agent.frames));
+    report_number(report, "allocations_per_frame", per(delta.allocations, agent.frames));
+    report_end(report);
+}
+
+// --- send path ---
+
+typedef struct {
+    u64 packets;  // per phase
+    u32 phases;
+} SendSession;
+
+static void send_session(MockPeer *peer, void *userdata) {
+    const SendSession *session = userdata;
+    u16 type;
+    const u8 *data;
+    size_t size;
+    for (u32 phase = 0; phase < session->phases; phase++) {
+        for (u64 received = 0; received < session->packets;) {
+            if (mock_peer_recv_frame(peer, &type, &data, &size) != AGI_SUCCESS) return;
+            if (type == BENCH_PACKET_DATA) received++;
+        }
+        if (mock_peer_send_frame(peer, BENCH_PACKET_DONE, NULL, 0) != AGI_SUCCESS) return;
+    }
+    while (mock_peer_recv_frame(peer, &type, &data, &size) == AGI_SUCCESS) {
+    }
+}
+
+static void report_send_phase(Report *report, const char *name, u64 packets, const Delta *delta) {
+    report_begin(report, name);
+    report_number(report, "packets", (f64)packets);
+    report_number(report, "seconds", delta->seconds);
+    report_number(report, "packets_per_sec", (f64)packets / delta->seconds);
+    report_number(report, "send_calls_per_packet", per(delta->counters[AGI_COUNTER_TCP_SEND_CALLS], packets));
+    report_number(report, "allocations_per_packet", per(delta->allocations, packets));
+    report_end(report);
+}
+
+static void bench_send_path(Report *report, u64 packets) {
+    SendSession session = {.packets = packets, .phases = 2};
+    MockPortal *portal = mock_portal_start(send_session, &session);
+    Agent agent;
+    if (!portal || agent_connect(&agent, mock_portal_port(portal)) != AGI_SUCCESS) {
+        agi_log_error("Failed to set up send_path");
+        agent_close(&agent);
+        mock_portal_stop(portal);
+        return;
+    }
+    u8 payload[BENCH_SEND_PAYLOAD] = {0};
+
+    // Every packet written as it's sent
+    Sample sample;
+    sample_begin(&sample);
+    for (u64 i = 0; i < packets; i++) tcp_client_send_packet(agent.client, BENCH_PACKET_DATA, payload, sizeof(payload));
+    event_loop_run(agent.loop);
+    Delta uncorked = sample_end(&sample);
+
+    // Bursts leaving in one write, as responses do from inside a handler
+    sample_begin(&sample);
+    tcp_client_cork(agent.client);
+    for (u64 i = 0; i < packets; i++) {
+        tcp_client_send_packet(agent.client, BENCH_PACKET_DATA, payload, sizeof(payload));
+        if ((i + 1) % BENCH_CORK_BURST == 0) {
+            tcp_client_uncork(agent.client);
+            tcp_client_cork(agent.client);
+        }
+    }
+    tcp_client_uncork(agent.client);
+    event_loop_run(agent.loop);
+    Delta corked = sample_end(&sample);
+
+    agent_close(&agent);
+    mock_portal_stop(portal);
+    report_send_phase(report, "send_path_uncorked", packets, &uncorked);
+    report_send_phase(report, "send_path_corked", packets, &corked);
+}
+
+// --- install round trip ---
+
+typedef struct {
+    FixtureFont *fonts;  // count cold fonts, then count for the pipelined pass
+    u32 count;
+    // Filled by the session, read once the portal has stopped
+    u64 *cold_us;
+    u64 *uninstall_us;
+    u64 *cached_us;
+    f64 pipelined_seconds;
+    u32 failures;
+} InstallSession;
+
+// Waits for the next install response; false once the connection is gone
+static b8 recv_response(MockPeer *peer, InstallSession *session) {
+    u16 type;
+    const u8 *data;
+    size_t size;
+    do {
+        if (mock_peer_recv_frame(peer, &type, &data, &size) != AGI_SUCCESS) return false;
+    } while (type != AGI_PACKET_FONT_INSTALL_RESPONSE);
+    WireReader reader = wire_reader(data, size);
+    if (!wire_read_u8(&reader) || reader.failed) session->failures++;
+    return true;
+}
+
+static b8 sequential_pass(MockPeer *peer, InstallSession *session, b8 install, u64 *latencies) {
+    for (u32 i = 0; i < session->count; i++) {
+        u64 started = agi_clock_now_ns();
+        if (fixture_send_install(peer, &session->fonts[i], install) != AGI_SUCCESS || !recv_response(peer, session)) return false;
+        latencies[i] = (agi_clock_now_ns() - started) / 1000;
+    }
+    return true;
+}
+
+static void install_session(MockPeer *peer, void *userdata) {
+    InstallSession *session = userdata;
+    b8 ok = sequential_pass(peer, session, true, session->cold_us) && sequential_pass(peer, session, false, session->uninstall_us) &&
+            sequential_pass(peer, session, true, session->cached_us);
+    if (ok) {
+        // Commands sent back to back, as a rollout does
+        u64 started = agi_clock_now_ns();
+        for (u32 i = 0; i < session->count && ok; i++) ok = fixture_send_install(peer, &session->fonts[session->count + i], true) == AGI_SUCCESS;
+        for (u32 i = 0; i < session->count && ok; i++) ok = recv_response(peer, session);
+        session->pipelined_seconds = (f64)(agi_clock_now_ns() - started) / 1e9;
+    }
+    mock_peer_send_frame(peer, BENCH_PACKET_DONE, NULL, 0);
+
+    u16 type;
+    const u8 *data;
+    size_t size;
+    while (mock_peer_recv_frame(peer, &type, &data, &size) == AGI_SUCCESS) {
+    }
+}
+
+static void report_latencies(Report *report, const char *name, u64 *latencies, u32 count) {
+    u64 total = 0;
+    for (u32 i = 0; i < count; i++) total += latencies[i];
+    report_begin(report, name);
+    report_number(report, "installs", count);
+    report_number(report, "p50_us", (f64)fixture_percentile(latencies, count, 0.50));
+    report_number(report, "p99_us", (f64)fixture_percentile(latencies, count, 0.99));
+    report_number(report, "mean_us", per(total, count));
+    report_number(report, "per_sec", total ? (f64)count * 1e6 / (f64)total : 0);
+    report_end(report);
+}
+
+static void bench_install(Report *report, u32 count) {
+    FixtureDirectory directory;
+    if (!fixture_directory_create(&directory, "bench")) return;
+
+    InstallSession session = {.count = count};
+    session.fonts = calloc(2 * (size_t)count, sizeof(FixtureFont));
+    session.cold_us = calloc(count, sizeof(u64));
+    session.uninstall_us = calloc(count, sizeof(u64));
+    session.cached_us = calloc(count, sizeof(u64));
+    MockFontServer *server = mock_font_server_start();
+    MockPortal *portal = NULL;
+    Agent agent = {0};
+    b8 ready = session.fonts && session.cold_us && session.uninstall_us && session.cached_us && server &&
+               fixture_add_fonts(server, session.fonts, 2 * count, BENCH_FONT_SIZE, "AgiBench") == AGI_SUCCESS;
+
+    char url[FIXTURE_PATH_SIZE];
+    if (ready) {
+        snprintf(url, sizeof(url), "http://127.0.0.1:%u/perma/", mock_font_server_port(server));
+        ready = fonts_set_server_url(url) == AGI_SUCCESS && fonts_init(directory.cache, 0) == AGI_SUCCESS && download_init(NULL) == AGI_SUCCESS;
+    }
+    if (ready) {
+        portal = mock_portal_start(install_session, &session);
+        ready = portal && agent_connect(&agent, mock_portal_port(portal)) == AGI_SUCCESS;
+    }
+    if (ready) {
+        agent.workers = worker_pool_create(agent.loop, 4, 2 * count);
+        ready = agent.workers != NULL;
+        tcp_client_register_packet_handler(agent.client, AGI_PACKET_FONT_INSTALL_REQUEST, sizeof(FontInstallRequestPacket), handle_install);
+    }
+
+    if (ready) {
+        Sample sample;
+        sample_begin(&sample);
+        event_loop_run(agent.loop);
+        Delta delta = sample_end(&sample);
+        agent_close(&agent);
+        mock_portal_stop(portal);
+        portal = NULL;
+
+        report_latencies(report, "install_cold", session.cold_us, count);
+        report_latencies(report, "uninstall", session.uninstall_us, count);
+        report_latencies(report, "install_cached", session.cached_us, count);
+        report_begin(report, "install_pipelined");
+        report_number(report, "installs", count);
+        report_number(report, "seconds", session.pipelined_seconds);
+        report_number(report, "per_sec", session.pipelined_seconds > 0 ? count / session.pipelined_seconds : 0);
+        report_end(report);
+        report_begin(report, "install_round_trip");
+        report_number(report, "commands", 4.0 * count);
+        report_number(report, "failures", session.failures);
+        report_number(report, "http_requests", (f64)mock_font_server_requests(server));
+        report_number(report, "download_wire_bytes", (f64)delta.counters[AGI_COUNTER_DOWNLOAD_WIRE_BYTES]);
+        report_number(report, "allocations_per_command", per(delta.allocations, 4 * (u64)count));
+        report_end(report);
+    } else {
+        agi_log_error("Failed to set up install_round_trip");
+        agent_close(&agent);
+    }
+
+    mock_portal_stop(portal);
+    download_shutdown();
+    fonts_shutdown();
+    fonts_set_server_url(NULL);
+    mock_font_server_stop(server);
+    free(session.fonts);
+    free(session.cold_us);
+    free(session.uninstall_us);
+    free(session.cached_us);
+    fixture_directory_remove(&directory);
+}
+
+int main(int argc, char **argv) {
+    const BenchSizes *sizes = &full_sizes;
+    const char *output = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            sizes = &quick_sizes;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--output file]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    agi_log_set_level(AGI_LOG_LEVEL_ERROR);
+    FILE *file = output ? fopen(output, "w") : stdout;
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", output);
+        return 1;
+    }
+
+    Report report = {.file = file, .first_benchmark = true};
+    fprintf(file, "{\n  \"schema\": \"%s\",\n  \"timestamp\": %llu,\n  \"quick\": %s,\n  \"sha256\": \"%s\",\n  \"benchmarks\": [\n",
+            BENCH_SCHEMA, (unsigned long long)time(NULL), sizes == &quick_sizes ? "true" : "false", sha256_implementation());
+    bench_dispatch(&report, "dispatch_small", 32, sizes->dispatch_small_frames);
+    bench_dispatch(&report, "dispatch_large", 16 * 1024, sizes->dispatch_large_frames);
+    bench_send_path(&report, sizes->send_packets);
+    bench_install(&report, sizes->install_fonts);
+
+    u64 rss_kb;
+    u64 peak_kb;
+    fixture_read_rss(&rss_kb, &peak_kb);
+    AgiMemoryStats memory;
+    agi_memory_get_stats(&memory);
+    fprintf(file, "\n  ],\n  \"process\": {\"rss_kb\": %llu, \"peak_rss_kb\": %llu, \"allocations\": %llu, \"peak_heap_bytes\": %llu}\n}\n",
+            (unsigned long long)rss_kb, (unsigned long long)peak_kb, (unsigned long long)memory.allocations,
+            (unsigned long long)memory.peak_bytes_in_use);
+    if (file != stdout) fclose(file);
+    return 0;
+}
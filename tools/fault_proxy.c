@@ -0,0 +1,485 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "fault_proxy.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "agi/clock.h"
+#include "agi/log.h"
+#include "agi/thread.h"
+
+// Plain malloc, like the mocks, so agi_memory_get_stats() sees only the agent
+#define PROXY_THREAD_STACK_SIZE (256 * 1024)
+#define PROXY_READ_SIZE (16 * 1024)
+// Reading stops while this much waits to go out, as it would with full socket buffers
+#define PROXY_QUEUE_LIMIT (256 * 1024)
+
+// Received bytes waiting for their delivery time
+typedef struct Chunk {
+    struct Chunk *next;
+    u64 due_ns;
+    size_t size;
+    u8 data[];
+} Chunk;
+
+typedef struct Link Link;
+
+// One direction of a link: a reader queues what arrives, a writer sends it when due
+typedef struct {
+    Link *link;
+    int from;
+    int to;
+    b8 downstream;
+    agi_thread_t reader;
+    agi_thread_t writer;
+
+    agi_mutex_t lock;
+    agi_cond_t changed;
+    Chunk *head;
+    Chunk *tail;
+    size_t queued;
+    b8 eof;   // nothing more will be queued
+    b8 done;  // the link was dropped; both sides give up
+
+    // Reader only
+    u64 random;
+    u64 wire_free_ns;  // when the capped link finishes sending what's queued
+    u64 last_due_ns;
+    // Writer only
+    u64 sent;
+    u64 next_stall;
+} Pipe;
+
+struct Link {
+    FaultProxy *proxy;
+    FaultConfig config;  // as when accepted
+    u32 index;
+    int agent_fd;
+    int target_fd;
+    agi_thread_t thread;
+    atomic_bool reset;
+    b8 finished;  // sockets closed; under the proxy lock
+    Pipe up;
+    Pipe down;
+};
+
+struct FaultProxy {
+    int fd;
+    u16 port;
+    u16 target_port;
+    agi_thread_t thread;
+
+    agi_mutex_t lock;
+    FaultConfig config;
+    Link **links;  // freed only at stop, like the mocks' connections
+    u32 count;
+    u32 capacity;
+    u32 resets;
+};
+
+static u64 next_random(u64 *state) {
+    u64 x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static b8 send_all(int fd, const void *data, size_t size) {
+    const u8 *bytes = data;
+    while (size > 0) {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+// Wakes everything blocked on the link. A reset sets SO_LINGER to zero so the
+// close that follows sends RST, and only stops the reading, so no FIN goes first.
+static void link_drop(Link *link, b8 reset) {
+    if (reset) {
+        struct linger abort_close = {.l_onoff = 1, .l_linger = 0};
+        setsockopt(link->agent_fd, SOL_SOCKET, SO_LINGER, &abort_close, sizeof(abort_close));
+        setsockopt(link->target_fd, SOL_SOCKET, SO_LINGER, &abort_close, sizeof(abort_close));
+    }
+    Pipe *pipes[] = {&link->up, &link->down};
+    for (u32 i = 0; i < 2; i++) {
+        agi_mutex_lock(&pipes[i]->lock);
+        pipes[i]->done = true;
+        agi_cond_broadcast(&pipes[i]->changed);
+        agi_mutex_unlock(&pipes[i]->lock);
+    }
+    int how = reset ? SHUT_RD : SHUT_RDWR;
+    shutdown(link->agent_fd, how);
+    shutdown(link->target_fd, how);
+}
+
+static void link_reset(Link *link) {
+    if (atomic_exchange(&link->reset, true)) return;
+    FaultProxy *proxy = link->proxy;
+    agi_mutex_lock(&proxy->lock);
+    proxy->resets++;
+    agi_mutex_unlock(&proxy->lock);
+    link_drop(link, true);
+}
+
+// Jitter never reorders: a chunk is due no earlier than the one before it
+static u64 due_time(Pipe *pipe, size_t size) {
+    const FaultConfig *config = &pipe->link->config;
+    u64 now = agi_clock_now_ns();
+    u64 sent_ns = now;
+    if (config->bytes_per_second) {
+        u64 start = pipe->wire_free_ns > now ? pipe->wire_free_ns : now;
+        sent_ns = start + (u64)size * 1000000000ull / config->bytes_per_second;
+        pipe->wire_free_ns = sent_ns;
+    }
+    u64 delay_ms = config->latency_ms;
+    if (config->jitter_ms) delay_ms += next_random(&pipe->random) % (config->jitter_ms + 1);
+    u64 due = sent_ns + delay_ms * 1000000;
+    if (due < pipe->last_due_ns) due = pipe->last_due_ns;
+    pipe->last_due_ns = due;
+    return due;
+}
+
+// False once the link is dropped
+static b8 pipe_push(Pipe *pipe, Chunk *chunk) {
+    agi_mutex_lock(&pipe->lock);
+    while (pipe->queued >= PROXY_QUEUE_LIMIT && !pipe->done) agi_cond_wait(&pipe->changed, &pipe->lock);
+    b8 queued = !pipe->done;
+    if (queued) {
+        chunk->next = NULL;
+        if (pipe->tail) {
+            pipe->tail->next = chunk;
+        } else {
+            pipe->head = chunk;
+        }
+        pipe->tail = chunk;
+        pipe->queued += chunk->size;
+        agi_cond_broadcast(&pipe->changed);
+    }
+    agi_mutex_unlock(&pipe->lock);
+    return queued;
+}
+
+static void pipe_reader(void *arg) {
+    Pipe *pipe = arg;
+    const FaultConfig *config = &pipe->link->config;
+    u8 buffer[PROXY_READ_SIZE];
+    b8 open = true;
+    while (open) {
+        ssize_t received = recv(pipe->from, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) break;
+
+        size_t piece = config->split_bytes ? config->split_bytes : (size_t)received;
+        for (size_t offset = 0; offset < (size_t)received && open; offset += piece) {
+            size_t size = MIN(piece, (size_t)received - offset);
+            Chunk *chunk = malloc(sizeof(Chunk) + size);
+            if (!chunk) {
+                link_drop(pipe->link, false);
+                open = false;
+                break;
+            }
+            chunk->size = size;
+            memcpy(chunk->data, buffer + offset, size);
+            chunk->due_ns = due_time(pipe, size);
+            if (!pipe_push(pipe, chunk)) {
+                free(chunk);
+                open = false;
+            }
+        }
+    }
+
+    agi_mutex_lock(&pipe->lock);
+    pipe->eof = true;
+    agi_cond_broadcast(&pipe->changed);
+    agi_mutex_unlock(&pipe->lock);
+}
+
+// Sleeps on the pipe, so dropping the link cuts the stall short; false if it did
+static b8 pipe_stall(Pipe *pipe, u64 ms) {
+    u64 deadline = agi_clock_now_ms() + ms;
+    agi_mutex_lock(&pipe->lock);
+    for (u64 now = agi_clock_now_ms(); !pipe->done && now < deadline; now = agi_clock_now_ms()) {
+        agi_cond_timed_wait(&pipe->changed, &pipe->lock, deadline - now);
+    }
+    b8 done = pipe->done;
+    agi_mutex_unlock(&pipe->lock);
+    return !done;
+}
+
+// Stalls and resets are counted in downstream bytes only; returns false to stop writing
+static b8 pipe_deliver(Pipe *pipe, const Chunk *chunk) {
+    const FaultConfig *config = &pipe->link->config;
+    size_t size = chunk->size;
+    b8 reset = false;
+    if (pipe->downstream && config->reset_after_bytes && pipe->sent + size >= config->reset_after_bytes) {
+        size = (size_t)(config->reset_after_bytes - pipe->sent);
+        reset = true;
+    }
+    if (size && !send_all(pipe->to, chunk->data, size)) {
+        link_drop(pipe->link, false);
+        return false;
+    }
+    pipe->sent += size;
+    if (reset) {
+        link_reset(pipe->link);
+        return false;
+    }
+    if (pipe->downstream && config->stall_every_bytes && config->stall_ms) {
+        if (!pipe->next_stall) pipe->next_stall = config->stall_every_bytes;
+        while (pipe->sent >= pipe->next_stall) {
+            pipe->next_stall += config->stall_every_bytes;
+            if (!pipe_stall(pipe, config->stall_ms)) return false;
+        }
+    }
+    return true;
+}
+
+static void pipe_writer(void *arg) {
+    Pipe *pipe = arg;
+    b8 drained = false;
+    agi_mutex_lock(&pipe->lock);
+    while (!pipe->done) {
+        Chunk *chunk = pipe->head;
+        if (!chunk) {
+            if (pipe->eof) {
+                drained = true;
+                break;
+            }
+            agi_cond_wait(&pipe->changed, &pipe->lock);
+            continue;
+        }
+        u64 now = agi_clock_now_ns();
+        if (chunk->due_ns > now) {
+            agi_cond_timed_wait(&pipe->changed, &pipe->lock, (chunk->due_ns - now + 999999) / 1000000);
+            continue;
+        }
+
+        pipe->head = chunk->next;
+        if (!pipe->head) pipe->tail = NULL;
+        pipe->queued -= chunk->size;
+        agi_cond_broadcast(&pipe->changed);
+        agi_mutex_unlock(&pipe->lock);
+        b8 more = pipe_deliver(pipe, chunk);
+        free(chunk);
+        agi_mutex_lock(&pipe->lock);
+        if (!more) break;
+    }
+    agi_mutex_unlock(&pipe->lock);
+    // Passes the half-close on, so the far side sees EOF where this side did
+    if (drained) shutdown(pipe->to, SHUT_WR);
+}
+
+static void pipe_init(Pipe *pipe, Link *link, int from, int to, b8 downstream) {
+    memset(pipe, 0, sizeof(*pipe));
+    pipe->link = link;
+    pipe->from = from;
+    pipe->to = to;
+    pipe->downstream = downstream;
+    pipe->random = 0x9E3779B97F4A7C15ull ^ ((u64)link->index << 1 | downstream);
+    agi_mutex_init(&pipe->lock);
+    agi_cond_init(&pipe->changed);
+}
+
+static void pipe_destroy(Pipe *pipe) {
+    while (pipe->head) {
+        Chunk *chunk = pipe->head;
+        pipe->head = chunk->next;
+        free(chunk);
+    }
+    agi_cond_destroy(&pipe->changed);
+    agi_mutex_destroy(&pipe->lock);
+}
+
+static int connect_target(u16 port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(port)};
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static void link_main(void *arg) {
+    Link *link = arg;
+    FaultProxy *proxy = link->proxy;
+    Pipe *pipes[] = {&link->up, &link->down};
+    u32 started = 0;
+    for (u32 i = 0; i < 2 && link->target_fd >= 0; i++) {
+        if (agi_thread_create(&pipes[i]->reader, pipe_reader, pipes[i], PROXY_THREAD_STACK_SIZE) != AGI_SUCCESS) break;
+        if (agi_thread_create(&pipes[i]->writer, pipe_writer, pipes[i], PROXY_THREAD_STACK_SIZE) != AGI_SUCCESS) {
+            link_drop(link, false);
+            agi_thread_join(pipes[i]->reader);
+            break;
+        }
+        started++;
+    }
+    if (started < 2) link_drop(link, false);
+    for (u32 i = 0; i < started; i++) {
+        agi_thread_join(pipes[i]->reader);
+        agi_thread_join(pipes[i]->writer);
+    }
+
+    // Under the lock, so stop never shuts down a descriptor that was reused
+    agi_mutex_lock(&proxy->lock);
+    close(link->agent_fd);
+    if (link->target_fd >= 0) close(link->target_fd);
+    link->finished = true;
+    agi_mutex_unlock(&proxy->lock);
+    pipe_destroy(&link->up);
+    pipe_destroy(&link->down);
+}
+
+static void accept_main(void *arg) {
+    FaultProxy *proxy = arg;
+    for (;;) {
+        int fd = accept(proxy->fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;  // shut down by stop
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        Link *link = calloc(1, sizeof(Link));
+        agi_mutex_lock(&proxy->lock);
+        if (link && proxy->count == proxy->capacity) {
+            u32 capacity = proxy->capacity ? proxy->capacity * 2 : 16;
+            Link **links = realloc(proxy->links, capacity * sizeof(Link *));
+            if (links) {
+                proxy->links = links;
+                proxy->capacity = capacity;
+            }
+        }
+        if (!link || proxy->count == proxy->capacity) {
+            agi_mutex_unlock(&proxy->lock);
+            free(link);
+            close(fd);
+            continue;
+        }
+        link->proxy = proxy;
+        link->config = proxy->config;
+        link->index = proxy->count;
+        agi_mutex_unlock(&proxy->lock);
+
+        link->agent_fd = fd;
+        link->target_fd = connect_target(proxy->target_port);
+        atomic_init(&link->reset, false);
+        pipe_init(&link->up, link, link->agent_fd, link->target_fd, false);
+        pipe_init(&link->down, link, link->target_fd, link->agent_fd, true);
+
+        agi_mutex_lock(&proxy->lock);
+        if (agi_thread_create(&link->thread, link_main, link, PROXY_THREAD_STACK_SIZE) != AGI_SUCCESS) {
+            agi_mutex_unlock(&proxy->lock);
+            pipe_destroy(&link->up);
+            pipe_destroy(&link->down);
+            if (link->target_fd >= 0) close(link->target_fd);
+            close(fd);
+            free(link);
+            continue;
+        }
+        proxy->links[proxy->count++] = link;
+        agi_mutex_unlock(&proxy->lock);
+    }
+}
+
+FaultProxy *fault_proxy_start(u16 target_port, const FaultConfig *config) {
+    FaultProxy *proxy = calloc(1, sizeof(FaultProxy));
+    if (!proxy) return NULL;
+    proxy->target_port = target_port;
+    if (config) proxy->config = *config;
+    proxy->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (proxy->fd < 0) {
+        free(proxy);
+        return NULL;
+    }
+
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = 0};
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (bind(proxy->fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(proxy->fd, SOMAXCONN) != 0 ||
+        getsockname(proxy->fd, (struct sockaddr *)&address, &length) != 0) {
+        agi_log_error("Failed to start fault proxy");
+        close(proxy->fd);
+        free(proxy);
+        return NULL;
+    }
+    proxy->port = ntohs(address.sin_port);
+
+    agi_mutex_init(&proxy->lock);
+    if (agi_thread_create(&proxy->thread, accept_main, proxy, PROXY_THREAD_STACK_SIZE) != AGI_SUCCESS) {
+        agi_mutex_destroy(&proxy->lock);
+        close(proxy->fd);
+        free(proxy);
+        return NULL;
+    }
+    return proxy;
+}
+
+u16 fault_proxy_port(const FaultProxy *proxy) {
+    return proxy->port;
+}
+
+void fault_proxy_set_config(FaultProxy *proxy, const FaultConfig *config) {
+    agi_mutex_lock(&proxy->lock);
+    proxy->config = config ? *config : (FaultConfig){0};
+    agi_mutex_unlock(&proxy->lock);
+}
+
+u32 fault_proxy_connections(const FaultProxy *proxy) {
+    FaultProxy *mutable_proxy = (FaultProxy *)proxy;
+    agi_mutex_lock(&mutable_proxy->lock);
+    u32 count = proxy->count;
+    agi_mutex_unlock(&mutable_proxy->lock);
+    return count;
+}
+
+u32 fault_proxy_resets(const FaultProxy *proxy) {
+    FaultProxy *mutable_proxy = (FaultProxy *)proxy;
+    agi_mutex_lock(&mutable_proxy->lock);
+    u32 resets = proxy->resets;
+    agi_mutex_unlock(&mutable_proxy->lock);
+    return resets;
+}
+
+void fault_proxy_stop(FaultProxy *proxy) {
+    if (!proxy) return;
+    // Wakes the blocked accept()
+    shutdown(proxy->fd, SHUT_RDWR);
+    agi_thread_join(proxy->thread);
+    close(proxy->fd);
+
+    agi_mutex_lock(&proxy->lock);
+    for (u32 i = 0; i < proxy->count; i++) {
+        if (!proxy->links[i]->finished) link_drop(proxy->links[i], false);
+    }
+    agi_mutex_unlock(&proxy->lock);
+    for (u32 i = 0; i < proxy->count; i++) {
+        agi_thread_join(proxy->links[i]->thread);
+        free(proxy->links[i]);
+    }
+    free(proxy->links);
+    agi_mutex_destroy(&proxy->lock);
+    free(proxy);
+}
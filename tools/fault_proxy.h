@@ -0,0 +1,33 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "agi/defines.h"
+
+// A TCP proxy on 127.0.0.1 that degrades the link between the agent and a
+// loopback server: it delays, throttles, splits, stalls and resets what it
+// forwards. Each accepted connection is paired with a fresh one to the target.
+// "Downstream" is target to agent, the direction fonts and commands flow.
+// POSIX only, like the mocks it fronts.
+
+typedef struct {
+    u32 latency_ms;          // one way, both directions
+    u32 jitter_ms;           // up to this much more, at random; bytes are never reordered
+    u32 bytes_per_second;    // per direction and connection, 0 = unlimited
+    u32 split_bytes;         // forwarded in sends of at most this many bytes, 0 = as received
+    u32 stall_every_bytes;   // downstream pauses for stall_ms each time this many more bytes went through
+    u32 stall_ms;
+    u32 reset_after_bytes;   // connections are reset (RST) once this many bytes went downstream, 0 = never
+} FaultConfig;
+
+typedef struct FaultProxy FaultProxy;
+
+// Forwards to 127.0.0.1:target_port; config may be NULL for a clean link
+FaultProxy *fault_proxy_start(u16 target_port, const FaultConfig *config);
+u16 fault_proxy_port(const FaultProxy *proxy);
+// Applies to connections accepted from now on
+void fault_proxy_set_config(FaultProxy *proxy, const FaultConfig *config);
+u32 fault_proxy_connections(const FaultProxy *proxy);
+u32 fault_proxy_resets(const FaultProxy *proxy);
+// Drops every connection, then waits for their threads
+void fault_proxy_stop(FaultProxy *proxy);
@@ -0,0 +1,389 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "agi/app.h"
+#include "agi/clock.h"
+#include "agi/download.h"
+#include "agi/font_jobs.h"
+#include "agi/log.h"
+#include "agi/metrics.h"
+#include "agi/protocol.h"
+#include "agi/tcp_client.h"
+#include "agi/thread.h"
+#include "fault_proxy.h"
+#include "fixture.h"
+#include "mock_server.h"
+
+// Tail latency under a degraded network. The agent runs as main.c runs it (one
+// App, restarted whenever app_run() returns on a lost connection, the way its
+// service manager would) against the loopback mocks, with a fault proxy in
+// front of each, one scenario after another:
+//
+//   faults [--quick] [--installs N] [--output results.json]
+//
+// clean          no faults, the baseline
+// latency        40 ms plus up to 20 ms of jitter each way, both links
+// bandwidth      font downloads capped at 256 KB/s
+// segment_split  portal bytes delivered one at a time, font bytes seven at a
+//                time, so every frame reaches tcp_client_process_packets() in pieces
+// http_stall     font downloads pause for a second every 128 KB
+// http_reset     font connections reset every 160 KB; downloads retry and resume
+// portal_reset   the portal link reset every KB, often mid-frame; the agent
+//                restarts, reconnects and authenticates again
+//
+// engine_abort then destroys a download engine while its transfers are stalled
+// mid-body, unsplit ones included: each must be reported aborted, once.
+//
+// The portal sends installs one at a time. An install's latency runs from when
+// it was first sent, or from when the connection was lost if that came first,
+// to its answer, on whichever connection that arrives. Installs that needed a
+// download retry or a reconnect are the recovery samples. Fonts are installed
+// under a temporary XDG_DATA_HOME per scenario that is removed afterwards.
+
+#define FAULTS_SCHEMA "agi-faults/1"
+
+// Frame type the portal mock uses besides the real protocol's
+#define FAULTS_PACKET_DONE 201
+
+#define FAULTS_FONT_SIZE (48 * 1024)
+#define DEFAULT_INSTALLS 32
+#define QUICK_INSTALLS 12
+#define SCENARIO_TIMEOUT_MS 120000
+#define MAX_RESTARTS 256
+// Before trying again when the portal can't be reached at all
+#define RESTART_DELAY_MS 100
+// Long enough that an aborted transfer is still stalled when the engine goes
+#define ABORT_STALL_MS 30000
+
+typedef struct {
+    const char *name;
+    FaultConfig portal;
+    FaultConfig http;
+} Scenario;
+
+static const Scenario scenarios[] = {
+    {"clean"},
+    {"latency", .portal = {.latency_ms = 40, .jitter_ms = 20}, .http = {.latency_ms = 40, .jitter_ms = 20}},
+    {"bandwidth", .http = {.bytes_per_second = 256 * 1024}},
+    {"segment_split", .portal = {.split_bytes = 1}, .http = {.split_bytes = 7}},
+    {"http_stall", .http = {.stall_every_bytes = 128 * 1024, .stall_ms = 1000}},
+    {"http_reset", .http = {.reset_after_bytes = 160 * 1024}},
+    {"portal_reset", .portal = {.reset_after_bytes = 1024}},
+};
+
+// Shared by the portal sessions of one scenario; they take turns on the lock
+typedef struct {
+    const FixtureFont *fonts;
+    u32 count;
+    agi_mutex_t lock;
+    u32 next;           // first install not answered yet
+    u64 *started_ns;    // when each install was first sent, 0 = not yet
+    u64 *latency_us;
+    b8 *disturbed;      // needed a download retry or a reconnect
+    u64 lost_ns;        // when the last session ended early, 0 = none since
+    u32 sessions;
+    u32 failures;
+    b8 finished;        // agent side, loop thread only
+    b8 timed_out;
+} Run;
+
+static MetricsSnapshot snapshot;
+
+// Under the run's lock: the snapshot is shared
+static u64 download_retries(void) {
+    metrics_snapshot(&snapshot);
+    return snapshot.counters[AGI_COUNTER_DOWNLOAD_RETRIES] + snapshot.counters[AGI_COUNTER_DOWNLOAD_RESTARTS];
+}
+
+// --- portal ---
+
+// Picks up at the first unanswered install; false if the connection went first
+static b8 serve_installs(MockPeer *peer, Run *run) {
+    while (run->next < run->count) {
+        u32 index = run->next;
+        if (!run->started_ns[index]) run->started_ns[index] = run->lost_ns ? run->lost_ns : agi_clock_now_ns();
+        if (run->lost_ns) run->disturbed[index] = true;
+        run->lost_ns = 0;
+
+        u64 retries = download_retries();
+        if (fixture_send_install(peer, &run->fonts[index], true) != AGI_SUCCESS) return false;
+        u16 type;
+        const u8 *data;
+        size_t size;
+        do {
+            if (mock_peer_recv_frame(peer, &type, &data, &size) != AGI_SUCCESS) return false;
+        } while (type != AGI_PACKET_FONT_INSTALL_RESPONSE);
+
+        run->latency_us[index] = (agi_clock_now_ns() - run->started_ns[index]) / 1000;
+        if (download_retries() != retries) run->disturbed[index] = true;
+        WireReader reader = wire_reader(data, size);
+        if (!wire_read_u8(&reader) || reader.failed) run->failures++;
+        run->next++;
+    }
+    return mock_peer_send_frame(peer, FAULTS_PACKET_DONE, NULL, 0) == AGI_SUCCESS;
+}
+
+static void portal_session(MockPeer *peer, void *userdata) {
+    Run *run = userdata;
+    agi_mutex_lock(&run->lock);
+    run->sessions++;
+    b8 served = mock_peer_handshake(peer, NULL) == AGI_SUCCESS && serve_installs(peer, run);
+    if (!served && !run->lost_ns) run->lost_ns = agi_clock_now_ns();
+    agi_mutex_unlock(&run->lock);
+
+    // Held open until the agent hangs up
+    u16 type;
+    const u8 *data;
+    size_t size;
+    while (served && mock_peer_recv_frame(peer, &type, &data, &size) == AGI_SUCCESS) {
+    }
+}
+
+// --- agent side ---
+
+static void handle_auth_response(TcpClient *client, const void *packet_data, size_t packet_size) {
+    AuthResponse response;
+    if (protocol_decode_auth_response(client, packet_data, packet_size, &response) != AGI_SUCCESS || !response.success) {
+        agi_log_error("Authentication failed");
+    }
+}
+
+static void handle_install(TcpClient *client, const void *packet_data, size_t packet_size) {
+    App *app = tcp_client_get_userdata(client);
+    FontInstallRequest request;
+    if (protocol_decode_font_install_request(client, packet_data, packet_size, &request) != AGI_SUCCESS) {
+        agi_log_error("Malformed font install request");
+        return;
+    }
+    font_jobs_submit_install(app->workers, client, &request);
+}
+
+static void handle_done(TcpClient *client, const void *packet_data, size_t packet_size) {
+    App *app = tcp_client_get_userdata(client);
+    Run *run = app->descriptor->userdata;
+    run->finished = true;
+    app_stop(app);
+}
+
+static void scenario_deadline(EventLoop *loop, u32 timer_id, void *userdata) {
+    App *app = userdata;
+    Run *run = app->descriptor->userdata;
+    run->timed_out = true;
+    app_stop(app);
+}
+
+// Returns the number of times the agent was started
+static u32 run_agent(Run *run, u16 portal_port, const char *font_url, const char *cache) {
+    AppDescriptor descriptor = {
+        .hostname = "127.0.0.1",
+        .port = portal_port,
+        .auth_handler = handle_auth_response,
+        .font_install_handler = handle_install,
+        .worker_count = 4,
+        .font_cache_directory = cache,
+        .font_server_url = font_url,
+        .userdata = run,
+    };
+    u64 deadline = agi_clock_now_ms() + SCENARIO_TIMEOUT_MS;
+    u32 starts = 0;
+    while (!run->finished && !run->timed_out && starts < MAX_RESTARTS) {
+        u64 now = agi_clock_now_ms();
+        if (now >= deadline) {
+            run->timed_out = true;
+            break;
+        }
+        App *app = app_create(&descriptor);
+        if (!app) break;
+        starts++;
+        tcp_client_register_packet_handler(app->client, FAULTS_PACKET_DONE, 0, handle_done);
+        event_loop_add_timer(app->loop, deadline - now, 0, scenario_deadline, app);
+        if (app_connect(app) == AGI_SUCCESS) {
+            app_run(app);
+        } else {
+            usleep(RESTART_DELAY_MS * 1000);
+        }
+        app_destroy(app);
+    }
+    return starts;
+}
+
+// --- scenarios ---
+
+static void report_scenario(FILE *file, b8 first, const Scenario *scenario, Run *run, u32 starts, const FaultProxy *portal_proxy,
+                            const FaultProxy *http_proxy, u64 retries, f64 seconds) {
+    u32 answered = run->next;
+    u64 *recovery = calloc(answered + 1, sizeof(u64));
+    u32 recovered = 0;
+    u64 max_us = 0;
+    for (u32 i = 0; i < answered; i++) {
+        if (run->disturbed[i] && recovery) recovery[recovered++] = run->latency_us[i];
+        if (run->latency_us[i] > max_us) max_us = run->latency_us[i];
+    }
+
+    fprintf(file, "%s    {\"name\": \"%s\", \"installs\": %u, \"answered\": %u, \"failures\": %u, \"timed_out\": %s,\n",
+            first ? "" : ",\n", scenario->name, run->count, answered, run->failures, run->timed_out ? "true" : "false");
+    fprintf(file, "     \"latency_ms\": {\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+            fixture_percentile(run->latency_us, answered, 0.50) / 1e3, fixture_percentile(run->latency_us, answered, 0.99) / 1e3, max_us / 1e3);
+    fprintf(file, "     \"recovery_ms\": {\"samples\": %u, \"p50\": %.3f, \"max\": %.3f},\n", recovered,
+            fixture_percentile(recovery, recovered, 0.50) / 1e3, fixture_percentile(recovery, recovered, 1.0) / 1e3);
+    fprintf(file,
+            "     \"agent_starts\": %u, \"portal_sessions\": %u, \"download_retries\": %llu, \"portal_resets\": %u, "
+            "\"http_connections\": %u, \"http_resets\": %u, \"seconds\": %.3f}",
+            starts, run->sessions, (unsigned long long)retries, fault_proxy_resets(portal_proxy),
+            fault_proxy_connections(http_proxy), fault_proxy_resets(http_proxy), seconds);
+    free(recovery);
+}
+
+// False if the scenario could not be set up, so nothing was reported
+static b8 run_scenario(FILE *file, b8 first, const Scenario *scenario, MockFontServer *server, const FixtureFont *fonts, u32 count) {
+    FixtureDirectory directory;
+    if (!fixture_directory_create(&directory, "faults")) return false;
+
+    Run run = {.fonts = fonts, .count = count};
+    agi_mutex_init(&run.lock);
+    run.started_ns = calloc(count, sizeof(u64));
+    run.latency_us = calloc(count, sizeof(u64));
+    run.disturbed = calloc(count, sizeof(b8));
+    MockPortal *portal = mock_portal_start(portal_session, &run);
+    FaultProxy *portal_proxy = portal ? fault_proxy_start(mock_portal_port(portal), &scenario->portal) : NULL;
+    FaultProxy *http_proxy = fault_proxy_start(mock_font_server_port(server), &scenario->http);
+
+    b8 ready = run.started_ns && run.latency_us && run.disturbed && portal_proxy && http_proxy;
+    if (ready) {
+        char url[FIXTURE_PATH_SIZE];
+        snprintf(url, sizeof(url), "http://127.0.0.1:%u/perma/", fault_proxy_port(http_proxy));
+        agi_mutex_lock(&run.lock);
+        u64 retries = download_retries();
+        agi_mutex_unlock(&run.lock);
+        u64 started = agi_clock_now_ns();
+
+        u32 starts = run_agent(&run, fault_proxy_port(portal_proxy), url, directory.cache);
+
+        f64 seconds = (f64)(agi_clock_now_ns() - started) / 1e9;
+        agi_mutex_lock(&run.lock);
+        retries = download_retries() - retries;
+        report_scenario(file, first, scenario, &run, starts, portal_proxy, http_proxy, retries, seconds);
+        agi_mutex_unlock(&run.lock);
+    } else {
+        agi_log_error("Failed to set up scenario %s", scenario->name);
+    }
+
+    // The agent is gone, so the last session returns as soon as the proxy passes that on
+    fault_proxy_stop(portal_proxy);
+    fault_proxy_stop(http_proxy);
+    mock_portal_stop(portal);
+    agi_mutex_destroy(&run.lock);
+    free(run.started_ns);
+    free(run.latency_us);
+    free(run.disturbed);
+    fixture_directory_remove(&directory);
+    return ready;
+}
+
+// --- engine abort ---
+
+typedef struct {
+    u32 reports;
+    u32 aborted;
+} AbortRun;
+
+static void count_abort(const DownloadReport *report, void *userdata) {
+    AbortRun *run = userdata;
+    run->reports++;
+    if (report->result == AGI_ERROR_NETWORK) run->aborted++;
+}
+
+// Unsplit transfers (no options, one segment) and a split one, all in flight
+static void run_engine_abort(FILE *file, MockFontServer *server, const FixtureFont *fonts, u32 count) {
+    static const DownloadOptions one_segment = {.segments = 1};
+    static const DownloadOptions split = {.segments = 4};
+    const DownloadOptions *options[] = {NULL, &one_segment, &split};
+    u32 transfers = MIN(count, (u32)(sizeof(options) / sizeof(options[0])));
+
+    FixtureDirectory directory;
+    if (!fixture_directory_create(&directory, "faults")) return;
+    FaultConfig stall = {.stall_every_bytes = 1024, .stall_ms = ABORT_STALL_MS};
+    FaultProxy *proxy = fault_proxy_start(mock_font_server_port(server), &stall);
+    // A threshold under the font size, so the split transfer really splits
+    DownloadEngineConfig config = {.segment_threshold = FAULTS_FONT_SIZE / 2};
+    DownloadEngine *engine = proxy ? download_engine_create(&config) : NULL;
+    AbortRun run = {0};
+    u32 submitted = 0;
+    for (u32 i = 0; i < transfers && engine; i++) {
+        char url[FIXTURE_PATH_SIZE];
+        char path[FIXTURE_PATH_SIZE];
+        snprintf(url, sizeof(url), "http://127.0.0.1:%u/perma/%s.ttf", fault_proxy_port(proxy), fonts[i].hash);
+        snprintf(path, sizeof(path), "%s/%u.ttf", directory.root, i);
+        if (download_engine_submit(engine, url, path, options[i], count_abort, &run) == AGI_SUCCESS) submitted++;
+    }
+
+    // Every transfer has its connection and is stalled behind its first KB
+    u64 deadline = agi_clock_now_ms() + 5000;
+    while (engine && fault_proxy_connections(proxy) < submitted && agi_clock_now_ms() < deadline) usleep(10 * 1000);
+    usleep(200 * 1000);
+    u64 started = agi_clock_now_ns();
+    download_engine_destroy(engine);
+    f64 seconds = (f64)(agi_clock_now_ns() - started) / 1e9;
+
+    fprintf(file, "  \"engine_abort\": {\"transfers\": %u, \"reports\": %u, \"aborted\": %u, \"seconds\": %.3f}\n",
+            submitted, run.reports, run.aborted, seconds);
+    fault_proxy_stop(proxy);
+    fixture_directory_remove(&directory);
+}
+
+int main(int argc, char **argv) {
+    u32 installs = DEFAULT_INSTALLS;
+    const char *output = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            installs = QUICK_INSTALLS;
+        } else if (strcmp(argv[i], "--installs") == 0 && i + 1 < argc && fixture_parse_u32(argv[i + 1], &installs) && installs > 0) {
+            i++;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--installs N] [--output file]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    // Every scenario but clean logs its faults as errors; the report says what happened
+    agi_log_set_level(AGI_LOG_LEVEL_ERROR);
+    FILE *file = output ? fopen(output, "w") : stdout;
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", output);
+        return 1;
+    }
+
+    FixtureFont *fonts = calloc(installs, sizeof(FixtureFont));
+    MockFontServer *server = mock_font_server_start();
+    if (!fonts || !server || fixture_add_fonts(server, fonts, installs, FAULTS_FONT_SIZE, "AgiFaults") != AGI_SUCCESS) {
+        fprintf(stderr, "Failed to set up the font server\n");
+        return 1;
+    }
+
+    fprintf(file, "{\n  \"schema\": \"%s\",\n  \"timestamp\": %llu,\n  \"scenarios\": [\n", FAULTS_SCHEMA,
+            (unsigned long long)time(NULL));
+    b8 first = true;
+    for (u32 i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        if (run_scenario(file, first, &scenarios[i], server, fonts, installs)) first = false;
+        fflush(file);
+    }
+    fprintf(file, "\n  ],\n");
+    run_engine_abort(file, server, fonts, installs);
+    fprintf(file, "}\n");
+    if (file != stdout) fclose(file);
+
+    mock_font_server_stop(server);
+    free(fonts);
+    return 0;
+}
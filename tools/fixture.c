@@ -0,0 +1,118 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#define _GNU_SOURCE
+#include "fixture.h"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "agi/log.h"
+
+// --- fonts ---
+
+agi_result_t fixture_add_fonts(MockFontServer *server, FixtureFont *fonts, u32 count, size_t size, const char *prefix) {
+    u8 *data = size >= 4 ? malloc(size) : NULL;
+    if (!data) return AGI_ERROR_OUT_OF_MEMORY;
+    u64 state = 0x9E3779B97F4A7C15ull;
+    agi_result_t result = AGI_SUCCESS;
+    for (u32 i = 0; i < count && result == AGI_SUCCESS; i++) {
+        for (size_t j = 0; j < size; j++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            data[j] = (u8)state;
+        }
+        memcpy(data, "\x00\x01\x00\x00", 4);
+
+        Sha256 sha;
+        u8 digest[AGI_SHA256_DIGEST_SIZE];
+        sha256_init(&sha);
+        sha256_update(&sha, data, size);
+        sha256_final(&sha, digest);
+        sha256_to_hex(digest, fonts[i].hash);
+        snprintf(fonts[i].name, sizeof(fonts[i].name), "%s%04u", prefix, i);
+
+        char path[FIXTURE_PATH_SIZE];
+        snprintf(path, sizeof(path), "/perma/%s.ttf", fonts[i].hash);
+        result = mock_font_server_add(server, path, data, size);
+    }
+    free(data);
+    return result;
+}
+
+agi_result_t fixture_send_install(MockPeer *peer, const FixtureFont *font, b8 install) {
+    u8 buffer[256];
+    WireWriter writer = wire_writer(buffer, sizeof(buffer));
+    wire_write_cstring(&writer, font->hash);
+    wire_write_cstring(&writer, font->name);
+    wire_write_cstring(&writer, "Regular");
+    wire_write_cstring(&writer, ".ttf");
+    wire_write_u8(&writer, install);
+    return mock_peer_send_frame(peer, AGI_PACKET_FONT_INSTALL_REQUEST, buffer, writer.length);
+}
+
+// --- directories ---
+
+b8 fixture_directory_create(FixtureDirectory *directory, const char *name) {
+    int length = snprintf(directory->root, sizeof(directory->root), "/tmp/agi-%s-XXXXXX", name);
+    if (length < 0 || (size_t)length >= sizeof(directory->root) || !mkdtemp(directory->root)) {
+        agi_log_error("Failed to create a temporary directory");
+        return false;
+    }
+    snprintf(directory->cache, sizeof(directory->cache), "%s/cache", directory->root);
+    snprintf(directory->data_home, sizeof(directory->data_home), "%s/data", directory->root);
+    mkdir(directory->cache, 0700);
+    mkdir(directory->data_home, 0700);
+    setenv("XDG_DATA_HOME", directory->data_home, 1);
+    return true;
+}
+
+static int remove_entry(const char *path, const struct stat *info, int flag, struct FTW *ftw) {
+    remove(path);
+    return 0;
+}
+
+void fixture_directory_remove(const FixtureDirectory *directory) {
+    nftw(directory->root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// --- reports ---
+
+static int compare_u64(const void *a, const void *b) {
+    u64 left = *(const u64 *)a;
+    u64 right = *(const u64 *)b;
+    return left < right ? -1 : left > right;
+}
+
+u64 fixture_percentile(u64 *values, u32 count, f64 q) {
+    if (count == 0) return 0;
+    qsort(values, count, sizeof(u64), compare_u64);
+    u32 rank = (u32)(q * count + 0.5);
+    return values[rank ? MIN(rank, count) - 1 : 0];
+}
+
+void fixture_read_rss(u64 *rss_kb, u64 *peak_kb) {
+    *rss_kb = 0;
+    *peak_kb = 0;
+    FILE *file = fopen("/proc/self/status", "r");
+    if (!file) return;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long long value;
+        if (sscanf(line, "VmRSS: %llu", &value) == 1) *rss_kb = value;
+        if (sscanf(line, "VmHWM: %llu", &value) == 1) *peak_kb = value;
+    }
+    fclose(file);
+}
+
+b8 fixture_parse_u32(const char *text, u32 *value) {
+    char *end;
+    unsigned long parsed = strtoul(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || parsed > UINT32_MAX) return false;
+    *value = (u32)parsed;
+    return true;
+}
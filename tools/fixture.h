@@ -0,0 +1,43 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "agi/defines.h"
+#include "agi/sha256.h"
+#include "mock_server.h"
+
+// What the tools share on top of the mocks: fonts for the mock font server, the
+// portal's install command, a throwaway directory for the agent's files, and
+// report helpers. POSIX only, like the mocks.
+
+#define FIXTURE_PATH_SIZE 1024
+
+typedef struct {
+    char hash[2 * AGI_SHA256_DIGEST_SIZE + 1];
+    char name[32];
+} FixtureFont;
+
+// Adds count fonts of size random bytes behind a TrueType header, named
+// <prefix><index>, under the path the agent derives from their hash
+agi_result_t fixture_add_fonts(MockFontServer *server, FixtureFont *fonts, u32 count, size_t size, const char *prefix);
+// The portal's install (or, with install false, uninstall) command for font
+agi_result_t fixture_send_install(MockPeer *peer, const FixtureFont *font, b8 install);
+
+// /tmp/agi-<name>-XXXXXX with a font cache and a data home for installs;
+// XDG_DATA_HOME points at the latter until the next create
+typedef struct {
+    char root[FIXTURE_PATH_SIZE / 2];  // leaves room for the file names under it
+    char cache[FIXTURE_PATH_SIZE];
+    char data_home[FIXTURE_PATH_SIZE];
+} FixtureDirectory;
+
+b8 fixture_directory_create(FixtureDirectory *directory, const char *name);
+// Removes the whole tree
+void fixture_directory_remove(const FixtureDirectory *directory);
+
+// Nearest rank; sorts values
+u64 fixture_percentile(u64 *values, u32 count, f64 q);
+// Current and peak resident set, 0 where /proc is unavailable
+void fixture_read_rss(u64 *rss_kb, u64 *peak_kb);
+// Decimal, whole string
+b8 fixture_parse_u32(const char *text, u32 *value);
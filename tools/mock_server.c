@@ -0,0 +1,512 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include "mock_server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "agi/log.h"
+#include "agi/tcp_client.h"
+#include "agi/thread.h"
+
+// The mocks allocate with plain malloc, so agi_memory_get_stats() sees only the agent
+#define MOCK_THREAD_STACK_SIZE (256 * 1024)
+#define MOCK_PEER_BUFFER_SIZE (16 * 1024)
+#define MOCK_HTTP_HEADER_SIZE (16 * 1024)
+#define MOCK_SMALL_FRAME_SIZE 4096
+
+// --- listener shared by both servers ---
+
+typedef void (*ConnectionFn)(int fd, void *userdata);
+
+typedef struct {
+    int fd;
+    agi_thread_t thread;
+} Connection;
+
+typedef struct {
+    int fd;
+    u16 port;
+    agi_thread_t thread;
+    ConnectionFn serve;
+    void *userdata;
+    agi_mutex_t lock;
+    Connection *connections;  // closed only at stop, so a descriptor is never reused under a live thread
+    u32 count;
+    u32 capacity;
+} Listener;
+
+typedef struct {
+    Listener *listener;
+    int fd;
+} ConnectionStart;
+
+static void connection_main(void *arg) {
+    ConnectionStart start = *(ConnectionStart *)arg;
+    free(arg);
+    start.listener->serve(start.fd, start.listener->userdata);
+    // The agent sees EOF now; the descriptor itself stays open until stop
+    shutdown(start.fd, SHUT_RDWR);
+}
+
+static void accept_main(void *arg) {
+    Listener *listener = arg;
+    for (;;) {
+        int fd = accept(listener->fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;  // shut down by stop
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        agi_mutex_lock(&listener->lock);
+        if (listener->count == listener->capacity) {
+            u32 capacity = listener->capacity ? listener->capacity * 2 : 16;
+            Connection *connections = realloc(listener->connections, capacity * sizeof(Connection));
+            if (!connections) {
+                agi_mutex_unlock(&listener->lock);
+                close(fd);
+                continue;
+            }
+            listener->connections = connections;
+            listener->capacity = capacity;
+        }
+        ConnectionStart *start = malloc(sizeof(ConnectionStart));
+        Connection *connection = &listener->connections[listener->count];
+        connection->fd = fd;
+        if (!start) {
+            agi_mutex_unlock(&listener->lock);
+            close(fd);
+            continue;
+        }
+        *start = (ConnectionStart){.listener = listener, .fd = fd};
+        if (agi_thread_create(&connection->thread, connection_main, start, MOCK_THREAD_STACK_SIZE) != AGI_SUCCESS) {
+            agi_mutex_unlock(&listener->lock);
+            free(start);
+            close(fd);
+            continue;
+        }
+        listener->count++;
+        agi_mutex_unlock(&listener->lock);
+    }
+}
+
+static agi_result_t listener_start(Listener *listener, ConnectionFn serve, void *userdata) {
+    memset(listener, 0, sizeof(*listener));
+    listener->serve = serve;
+    listener->userdata = userdata;
+    listener->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener->fd < 0) return AGI_ERROR_NETWORK;
+
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = 0};
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (bind(listener->fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener->fd, SOMAXCONN) != 0 ||
+        getsockname(listener->fd, (struct sockaddr *)&address, &length) != 0) {
+        close(listener->fd);
+        return AGI_ERROR_NETWORK;
+    }
+    listener->port = ntohs(address.sin_port);
+
+    agi_mutex_init(&listener->lock);
+    if (agi_thread_create(&listener->thread, accept_main, listener, MOCK_THREAD_STACK_SIZE) != AGI_SUCCESS) {
+        agi_mutex_destroy(&listener->lock);
+        close(listener->fd);
+        return AGI_ERROR_NETWORK;
+    }
+    return AGI_SUCCESS;
+}
+
+static void listener_stop(Listener *listener) {
+    // Wakes the blocked accept()
+    shutdown(listener->fd, SHUT_RDWR);
+    agi_thread_join(listener->thread);
+    close(listener->fd);
+
+    for (u32 i = 0; i < listener->count; i++) {
+        shutdown(listener->connections[i].fd, SHUT_RDWR);
+    }
+    for (u32 i = 0; i < listener->count; i++) {
+        agi_thread_join(listener->connections[i].thread);
+        close(listener->connections[i].fd);
+    }
+    free(listener->connections);
+    agi_mutex_destroy(&listener->lock);
+}
+
+static b8 send_all(int fd, const void *data, size_t size) {
+    const u8 *bytes = data;
+    while (size > 0) {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+// --- portal ---
+
+struct MockPeer {
+    int fd;
+    u8 *buffer;
+    size_t capacity;
+    size_t start;  // first unconsumed byte
+    size_t end;    // one past the last received byte
+};
+
+struct MockPortal {
+    Listener listener;
+    MockSessionFn session;
+    void *userdata;
+};
+
+static void serve_session(int fd, void *userdata) {
+    MockPortal *portal = userdata;
+    MockPeer peer = {.fd = fd, .capacity = MOCK_PEER_BUFFER_SIZE};
+    peer.buffer = malloc(peer.capacity);
+    if (!peer.buffer) return;
+    portal->session(&peer, portal->userdata);
+    free(peer.buffer);
+}
+
+MockPortal *mock_portal_start(MockSessionFn session, void *userdata) {
+    MockPortal *portal = calloc(1, sizeof(MockPortal));
+    if (!portal) return NULL;
+    portal->session = session;
+    portal->userdata = userdata;
+    if (listener_start(&portal->listener, serve_session, portal) != AGI_SUCCESS) {
+        agi_log_error("Failed to start mock portal");
+        free(portal);
+        return NULL;
+    }
+    return portal;
+}
+
+u16 mock_portal_port(const MockPortal *portal) {
+    return portal->listener.port;
+}
+
+void mock_portal_stop(MockPortal *portal) {
+    if (!portal) return;
+    listener_stop(&portal->listener);
+    free(portal);
+}
+
+void mock_encode_frame(WireWriter *writer, u16 type, const void *payload, size_t size) {
+    wire_write_varint(writer, wire_varint_size(type) + size);
+    wire_write_varint(writer, type);
+    if (size) wire_write_bytes(writer, payload, size);
+}
+
+agi_result_t mock_peer_send_frame(MockPeer *peer, u16 type, const void *payload, size_t size) {
+    // Small frames go out in one send, so one frame is one segment with TCP_NODELAY;
+    // benchmarks count allocations, so nothing here touches the heap
+    u8 frame[MOCK_SMALL_FRAME_SIZE];
+    WireWriter writer = wire_writer(frame, sizeof(frame));
+    wire_write_varint(&writer, wire_varint_size(type) + size);
+    wire_write_varint(&writer, type);
+    if (writer.length + size <= sizeof(frame)) {
+        if (size) wire_write_bytes(&writer, payload, size);
+        return send_all(peer->fd, frame, writer.length) ? AGI_SUCCESS : AGI_ERROR_NETWORK;
+    }
+    b8 sent = send_all(peer->fd, frame, writer.length) && send_all(peer->fd, payload, size);
+    return sent ? AGI_SUCCESS : AGI_ERROR_NETWORK;
+}
+
+agi_result_t mock_peer_send_raw(MockPeer *peer, const void *data, size_t size) {
+    return send_all(peer->fd, data, size) ? AGI_SUCCESS : AGI_ERROR_NETWORK;
+}
+
+// Makes room for needed bytes from start, moving what's buffered to the front
+static b8 peer_reserve(MockPeer *peer, size_t needed) {
+    if (peer->start > 0) {
+        memmove(peer->buffer, peer->buffer + peer->start, peer->end - peer->start);
+        peer->end -= peer->start;
+        peer->start = 0;
+    }
+    if (needed <= peer->capacity) return true;
+    u8 *buffer = realloc(peer->buffer, needed);
+    if (!buffer) return false;
+    peer->buffer = buffer;
+    peer->capacity = needed;
+    return true;
+}
+
+static b8 peer_fill(MockPeer *peer) {
+    if (peer->end == peer->capacity) {
+        // Compacting is enough unless the buffer is full of unconsumed bytes
+        size_t buffered = peer->end - peer->start;
+        if (!peer_reserve(peer, buffered < peer->capacity ? peer->capacity : 2 * peer->capacity)) return false;
+    }
+    for (;;) {
+        ssize_t received = recv(peer->fd, peer->buffer + peer->end, peer->capacity - peer->end, 0);
+        if (received > 0) {
+            peer->end += (size_t)received;
+            return true;
+        }
+        if (received < 0 && errno == EINTR) continue;
+        return false;
+    }
+}
+
+agi_result_t mock_peer_recv_frame(MockPeer *peer, u16 *type, const u8 **payload, size_t *size) {
+    for (;;) {
+        const u8 *data = peer->buffer + peer->start;
+        size_t available = peer->end - peer->start;
+        u64 frame_length;
+        size_t length_size;
+        int status = wire_peek_varint(data, available, &frame_length, &length_size);
+        if (status < 0 || (status > 0 && (frame_length == 0 || frame_length > AGI_MAX_FRAME_SIZE))) {
+            return AGI_ERROR_PROTOCOL;
+        }
+        if (status > 0 && available - length_size >= frame_length) {
+            u64 frame_type;
+            size_t type_size;
+            if (wire_peek_varint(data + length_size, (size_t)frame_length, &frame_type, &type_size) <= 0) {
+                return AGI_ERROR_PROTOCOL;
+            }
+            *type = (u16)frame_type;
+            *payload = data + length_size + type_size;
+            *size = (size_t)frame_length - type_size;
+            peer->start += length_size + (size_t)frame_length;
+            return AGI_SUCCESS;
+        }
+        if (status > 0 && length_size + frame_length > peer->capacity - peer->start &&
+            !peer_reserve(peer, length_size + (size_t)frame_length)) {
+            return AGI_ERROR_OUT_OF_MEMORY;
+        }
+        if (!peer_fill(peer)) return AGI_ERROR_NETWORK;
+    }
+}
+
+agi_result_t mock_peer_recv_exact(MockPeer *peer, size_t size, const u8 **data) {
+    if (size > peer->capacity - peer->start && !peer_reserve(peer, size)) return AGI_ERROR_OUT_OF_MEMORY;
+    while (peer->end - peer->start < size) {
+        if (!peer_fill(peer)) return AGI_ERROR_NETWORK;
+    }
+    *data = peer->buffer + peer->start;
+    peer->start += size;
+    return AGI_SUCCESS;
+}
+
+agi_result_t mock_peer_handshake(MockPeer *peer, AuthRequestPacket *request) {
+    const u8 *data;
+    agi_result_t result = mock_peer_recv_exact(peer, sizeof(u16) + sizeof(AuthRequestPacket), &data);
+    if (result != AGI_SUCCESS) return result;
+    u16 type;
+    AuthRequestPacket auth;
+    memcpy(&type, data, sizeof(type));
+    memcpy(&auth, data + sizeof(type), sizeof(auth));
+    if (type != AGI_PACKET_AUTH_REQUEST) return AGI_ERROR_PROTOCOL;
+    if (request) *request = auth;
+
+    // v1 framing until the select: raw type, then the packed struct
+    u8 reply[2 * sizeof(u16) + sizeof(AuthResponsePacket) + sizeof(ProtocolSelectPacket)];
+    AuthResponsePacket response = {.success = true};
+    snprintf(response.message, sizeof(response.message), "Welcome %.32s", auth.username);
+    ProtocolSelectPacket select = {.version = AGI_PROTOCOL_V2};
+    u16 response_type = AGI_PACKET_AUTH_RESPONSE;
+    u16 select_type = AGI_PACKET_PROTOCOL_SELECT;
+    u8 *cursor = reply;
+    memcpy(cursor, &response_type, sizeof(u16));
+    memcpy(cursor += sizeof(u16), &response, sizeof(response));
+    memcpy(cursor += sizeof(response), &select_type, sizeof(u16));
+    memcpy(cursor += sizeof(u16), &select, sizeof(select));
+    b8 v2 = auth.version >= AGI_PROTOCOL_V2;
+    result = mock_peer_send_raw(peer, reply, v2 ? sizeof(reply) : sizeof(u16) + sizeof(response));
+    if (result != AGI_SUCCESS) return result;
+    return v2 ? AGI_SUCCESS : AGI_ERROR_PROTOCOL;
+}
+
+// --- font server ---
+
+typedef struct {
+    char *path;
+    u8 *data;
+    size_t size;
+} MockFile;
+
+struct MockFontServer {
+    Listener listener;
+    agi_mutex_t lock;
+    MockFile *files;
+    u32 count;
+    u32 capacity;
+    u64 requests;
+};
+
+// Only "bytes=first-" and "bytes=first-last"
+static b8 parse_range(const char *value, size_t size, size_t *first, size_t *last) {
+    unsigned long long begin;
+    unsigned long long end;
+    int consumed = 0;
+    if (sscanf(value, "bytes=%llu-%n", &begin, &consumed) != 1 || consumed == 0) return false;
+    if (sscanf(value + consumed, "%llu", &end) != 1) end = size ? size - 1 : 0;
+    if (begin >= size || end < begin) return false;
+    *first = (size_t)begin;
+    *last = (size_t)(end < size ? end : size - 1);
+    return true;
+}
+
+static b8 respond(int fd, MockFontServer *server, const char *path, const char *range, b8 close_after) {
+    agi_mutex_lock(&server->lock);
+    server->requests++;
+    const MockFile *file = NULL;
+    for (u32 i = 0; i < server->count && !file; i++) {
+        if (strcmp(server->files[i].path, path) == 0) file = &server->files[i];
+    }
+    agi_mutex_unlock(&server->lock);
+
+    char header[512];
+    const char *connection = close_after ? "close" : "keep-alive";
+    if (!file) {
+        int length = snprintf(header, sizeof(header), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+                              connection);
+        return send_all(fd, header, (size_t)length);
+    }
+
+    // Files are never removed, so the data stays valid without the lock
+    size_t first = 0;
+    size_t last = file->size ? file->size - 1 : 0;
+    int length;
+    if (range && parse_range(range, file->size, &first, &last)) {
+        length = snprintf(header, sizeof(header),
+                          "HTTP/1.1 206 Partial Content\r\nContent-Length: %zu\r\nContent-Range: bytes %zu-%zu/%zu\r\n"
+                          "Accept-Ranges: bytes\r\nConnection: %s\r\n\r\n",
+                          last - first + 1, first, last, file->size, connection);
+    } else {
+        length = snprintf(header, sizeof(header),
+                          "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\nAccept-Ranges: bytes\r\nConnection: %s\r\n\r\n",
+                          file->size, connection);
+    }
+    return send_all(fd, header, (size_t)length) && (file->size == 0 || send_all(fd, file->data + first, last - first + 1));
+}
+
+// Finds a header's value in a request; the line is NUL-terminated in place
+static char *find_header(char *headers, const char *name) {
+    size_t name_length = strlen(name);
+    for (char *line = strstr(headers, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, name, name_length) == 0 && line[name_length] == ':') {
+            char *value = line + name_length + 1;
+            while (*value == ' ') value++;
+            char *end = strstr(value, "\r\n");
+            if (end) *end = '\0';
+            return value;
+        }
+    }
+    return NULL;
+}
+
+static void serve_http(int fd, void *userdata) {
+    MockFontServer *server = userdata;
+    char buffer[MOCK_HTTP_HEADER_SIZE + 1];
+    size_t buffered = 0;
+    for (;;) {
+        buffer[buffered] = '\0';
+        char *end = strstr(buffer, "\r\n\r\n");
+        if (!end) {
+            if (buffered == MOCK_HTTP_HEADER_SIZE) return;
+            ssize_t received = recv(fd, buffer + buffered, MOCK_HTTP_HEADER_SIZE - buffered, 0);
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) return;
+            buffered += (size_t)received;
+            continue;
+        }
+
+        size_t request_size = (size_t)(end - buffer) + 4;
+        end[2] = '\0';  // keeps the last header's CRLF for find_header()
+        char method[8];
+        char path[1024];
+        if (sscanf(buffer, "%7s %1023s", method, path) != 2 || strcmp(method, "GET") != 0) return;
+        // Both are looked up before either value is cut off at its line end
+        char *connection = find_header(buffer, "Connection");
+        b8 close_after = connection && strncasecmp(connection, "close", 5) == 0;
+        char *range = find_header(buffer, "Range");
+        if (!respond(fd, server, path, range, close_after) || close_after) return;
+
+        memmove(buffer, buffer + request_size, buffered - request_size);
+        buffered -= request_size;
+    }
+}
+
+MockFontServer *mock_font_server_start(void) {
+    MockFontServer *server = calloc(1, sizeof(MockFontServer));
+    if (!server) return NULL;
+    agi_mutex_init(&server->lock);
+    if (listener_start(&server->listener, serve_http, server) != AGI_SUCCESS) {
+        agi_log_error("Failed to start mock font server");
+        agi_mutex_destroy(&server->lock);
+        free(server);
+        return NULL;
+    }
+    return server;
+}
+
+u16 mock_font_server_port(const MockFontServer *server) {
+    return server->listener.port;
+}
+
+agi_result_t mock_font_server_add(MockFontServer *server, const char *path, const void *data, size_t size) {
+    size_t path_size = strlen(path) + 1;
+    char *path_copy = malloc(path_size);
+    u8 *data_copy = malloc(size + 1);
+    if (!path_copy || !data_copy) {
+        free(path_copy);
+        free(data_copy);
+        return AGI_ERROR_OUT_OF_MEMORY;
+    }
+    memcpy(path_copy, path, path_size);
+    if (size) memcpy(data_copy, data, size);
+
+    agi_mutex_lock(&server->lock);
+    if (server->count == server->capacity) {
+        u32 capacity = server->capacity ? server->capacity * 2 : 64;
+        MockFile *files = realloc(server->files, capacity * sizeof(MockFile));
+        if (!files) {
+            agi_mutex_unlock(&server->lock);
+            free(path_copy);
+            free(data_copy);
+            return AGI_ERROR_OUT_OF_MEMORY;
+        }
+        server->files = files;
+        server->capacity = capacity;
+    }
+    server->files[server->count++] = (MockFile){.path = path_copy, .data = data_copy, .size = size};
+    agi_mutex_unlock(&server->lock);
+    return AGI_SUCCESS;
+}
+
+u64 mock_font_server_requests(const MockFontServer *server) {
+    MockFontServer *mutable_server = (MockFontServer *)server;
+    agi_mutex_lock(&mutable_server->lock);
+    u64 requests = server->requests;
+    agi_mutex_unlock(&mutable_server->lock);
+    return requests;
+}
+
+void mock_font_server_stop(MockFontServer *server) {
+    if (!server) return;
+    listener_stop(&server->listener);
+    for (u32 i = 0; i < server->count; i++) {
+        free(server->files[i].path);
+        free(server->files[i].data);
+    }
+    free(server->files);
+    agi_mutex_destroy(&server->lock);
+    free(server);
+}
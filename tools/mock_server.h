@@ -0,0 +1,51 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#pragma once
+#include "agi/defines.h"
+#include "agi/protocol.h"
+#include "agi/wire.h"
+
+// Loopback stand-ins for the portal and the font server, so benchmarks and
+// simulations run on one machine with no network. Both listen on 127.0.0.1 on
+// a port the kernel picks, and serve every connection from a thread of its own
+// with blocking sockets. POSIX only.
+
+// --- portal ---
+
+typedef struct MockPortal MockPortal;
+// One accepted agent connection. Frames use v2 framing (see tcp_client.h).
+typedef struct MockPeer MockPeer;
+
+// Runs for every accepted connection; the peer is closed when it returns
+typedef void (*MockSessionFn)(MockPeer *peer, void *userdata);
+
+MockPortal *mock_portal_start(MockSessionFn session, void *userdata);
+u16 mock_portal_port(const MockPortal *portal);
+// Closes the listener and every connection, then waits for the sessions to return
+void mock_portal_stop(MockPortal *portal);
+
+agi_result_t mock_peer_send_frame(MockPeer *peer, u16 type, const void *payload, size_t size);
+// Bytes as they are, e.g. many frames encoded up front
+agi_result_t mock_peer_send_raw(MockPeer *peer, const void *data, size_t size);
+// Blocks for the next frame; payload stays valid until the next receive
+agi_result_t mock_peer_recv_frame(MockPeer *peer, u16 *type, const u8 **payload, size_t *size);
+// Blocks for exactly size bytes, e.g. a v1 packet; valid until the next receive
+agi_result_t mock_peer_recv_exact(MockPeer *peer, size_t size, const u8 **data);
+// Takes the agent's v1 auth request, accepts it and selects v2; request may be NULL.
+// Fails for an agent that only speaks v1, after telling it it's welcome.
+agi_result_t mock_peer_handshake(MockPeer *peer, AuthRequestPacket *request);
+// Appends one v2 frame to writer, for building send_raw() blobs
+void mock_encode_frame(WireWriter *writer, u16 type, const void *payload, size_t size);
+
+// --- font server ---
+
+// HTTP/1.1 with keep-alive and single byte ranges, serving files registered up front
+typedef struct MockFontServer MockFontServer;
+
+MockFontServer *mock_font_server_start(void);
+u16 mock_font_server_port(const MockFontServer *server);
+// data is copied; path is the request path, e.g. "/perma/<hash>.ttf"
+agi_result_t mock_font_server_add(MockFontServer *server, const char *path, const void *data, size_t size);
+u64 mock_font_server_requests(const MockFontServer *server);
+void mock_font_server_stop(MockFontServer *server);
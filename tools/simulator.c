@@ -0,0 +1,515 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "agi/app.h"
+#include "agi/clock.h"
+#include "agi/log.h"
+#include "agi/memory.h"
+#include "agi/protocol.h"
+#include "agi/tcp_client.h"
+#include "fixture.h"
+#include "mock_server.h"
+
+// Fleet load generator: many virtual agents in one process, each a real App
+// (app_create / app_connect / TcpClient) on one shared event loop, with a
+// synthetic username and HWID. Downloads and installs are stubbed: commands are
+// answered after a configurable delay, failing a configurable share of them.
+//
+//   simulator [--agents N] [--host H --port P] [--connect-rate R] [--install-ms MS]
+//             [--uninstall-ms MS] [--fail-percent P] [--commands N] [--duration S]
+//             [--output file]
+//
+// Without --port the agents connect to an in-process mock portal that
+// authenticates them, selects v2 and sends each --commands installs and
+// uninstalls in turn; it starts a thread per connection, which shows in the
+// auth latency of large fleets. The report is one JSON document, like bench's.
+
+#define SIMULATOR_SCHEMA "agi-simulator/1"
+
+#define CONNECT_TICK_MS 10
+// Agents connected per tick when no rate is given
+#define CONNECT_BURST 100
+#define DEFAULT_AGENTS 1000
+#define DEFAULT_COMMANDS 10
+#define DEFAULT_DURATION_S 60
+
+typedef struct {
+    u32 agents;
+    char host[32];
+    u16 port;           // 0 = in-process mock portal
+    u32 connect_rate;   // agents per second, 0 = as fast as they connect
+    u32 install_ms;     // simulated install time
+    u32 uninstall_ms;
+    u32 fail_percent;   // share of commands answered with a failure
+    u32 commands;       // per agent, mock portal only
+    u32 duration_s;
+    const char *output;
+} SimulatorOptions;
+
+typedef struct Simulation Simulation;
+typedef struct PendingReply PendingReply;
+
+typedef struct {
+    AppDescriptor descriptor;
+    App *app;
+    Simulation *simulation;
+    char username[32];
+    char hwid[16];
+    u64 auth_sent_ns;
+    b8 connected;
+    PendingReply *pending;
+} VirtualAgent;
+
+// A stubbed command waiting out its simulated duration
+struct PendingReply {
+    PendingReply *next;
+    VirtualAgent *agent;
+    u32 timer;
+    b8 batch;
+    u64 job_id;
+    u32 count;
+};
+
+struct Simulation {
+    SimulatorOptions options;
+    EventLoop *loop;
+    VirtualAgent *agents;
+    u32 next_agent;
+    b8 mock;
+    u64 started_ns;
+    u64 random;
+
+    u32 connected;
+    u32 connect_failures;
+    u32 authenticated;
+    u32 auth_failures;
+    u32 disconnects;
+    u64 *connect_us;
+    u64 *auth_us;
+    u64 connects_done_ns;
+    u64 heap_before;
+    u64 heap_connected;
+
+    u64 commands;
+    u64 replies;
+    u64 failed_replies;
+    u64 first_command_ns;
+    u64 last_reply_ns;
+    u64 expected_replies;  // 0 = until the duration runs out
+};
+
+static u64 next_random(Simulation *simulation) {
+    u64 x = simulation->random;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    simulation->random = x;
+    return x;
+}
+
+static b8 roll_failure(Simulation *simulation) {
+    return next_random(simulation) % 100 < simulation->options.fail_percent;
+}
+
+static u64 heap_in_use(void) {
+    AgiMemoryStats stats;
+    agi_memory_get_stats(&stats);
+    return stats.bytes_in_use;
+}
+
+// --- virtual agents ---
+
+static VirtualAgent *agent_of(TcpClient *client) {
+    App *app = tcp_client_get_userdata(client);
+    return app->descriptor->userdata;
+}
+
+static void check_finished(Simulation *simulation) {
+    b8 replied = simulation->expected_replies && simulation->replies >= simulation->expected_replies;
+    b8 gone = simulation->next_agent == simulation->options.agents &&
+              simulation->disconnects + simulation->connect_failures >= simulation->options.agents;
+    if (replied || gone) event_loop_stop(simulation->loop);
+}
+
+static void send_reply(PendingReply *reply) {
+    VirtualAgent *agent = reply->agent;
+    Simulation *simulation = agent->simulation;
+    TcpClient *client = agent->app->client;
+
+    if (!reply->batch) {
+        b8 success = !roll_failure(simulation);
+        protocol_send_font_install_response(client, success, success ? "Simulated install done" : "Simulated install failed");
+        if (!success) simulation->failed_replies++;
+    } else {
+        u8 bitmap[(AGI_MAX_BATCH_ENTRIES + 7) / 8] = {0};
+        FontBatchFailure *failures = malloc((size_t)reply->count * sizeof(FontBatchFailure) + 1);
+        u32 failure_count = 0;
+        for (u32 i = 0; i < reply->count; i++) {
+            if (failures && roll_failure(simulation)) {
+                failures[failure_count++] = (FontBatchFailure){.index = i, .error = AGI_ERROR_IO};
+            } else {
+                bitmap[i / 8] |= (u8)(1u << (i % 8));
+            }
+        }
+        protocol_send_font_batch_response(client, reply->job_id, reply->count, bitmap, failures, failure_count);
+        if (failure_count) simulation->failed_replies++;
+        free(failures);
+    }
+    simulation->replies++;
+    simulation->last_reply_ns = agi_clock_now_ns();
+    check_finished(simulation);
+}
+
+static void unlink_reply(PendingReply *reply) {
+    for (PendingReply **link = &reply->agent->pending; *link; link = &(*link)->next) {
+        if (*link == reply) {
+            *link = reply->next;
+            return;
+        }
+    }
+}
+
+static void on_reply_due(EventLoop *loop, u32 timer_id, void *userdata) {
+    PendingReply *reply = userdata;
+    unlink_reply(reply);
+    if (reply->agent->connected) send_reply(reply);
+    free(reply);
+}
+
+// Answers now, or after delay_ms as if a worker had been busy that long
+static void schedule_reply(VirtualAgent *agent, PendingReply reply, u64 delay_ms) {
+    Simulation *simulation = agent->simulation;
+    if (!simulation->first_command_ns) simulation->first_command_ns = agi_clock_now_ns();
+    simulation->commands++;
+    reply.agent = agent;
+    if (delay_ms == 0) {
+        send_reply(&reply);
+        return;
+    }
+
+    PendingReply *pending = malloc(sizeof(PendingReply));
+    if (!pending) return;
+    *pending = reply;
+    pending->timer = event_loop_add_timer(simulation->loop, delay_ms, 0, on_reply_due, pending);
+    if (!pending->timer) {
+        free(pending);
+        return;
+    }
+    pending->next = agent->pending;
+    agent->pending = pending;
+}
+
+static void handle_auth_response(TcpClient *client, const void *packet_data, size_t packet_size) {
+    VirtualAgent *agent = agent_of(client);
+    Simulation *simulation = agent->simulation;
+    AuthResponse response;
+    if (protocol_decode_auth_response(client, packet_data, packet_size, &response) != AGI_SUCCESS || !response.success) {
+        simulation->auth_failures++;
+        return;
+    }
+    if (simulation->authenticated < simulation->options.agents) {
+        simulation->auth_us[simulation->authenticated++] = (agi_clock_now_ns() - agent->auth_sent_ns) / 1000;
+    }
+}
+
+static void handle_install_request(TcpClient *client, const void *packet_data, size_t packet_size) {
+    VirtualAgent *agent = agent_of(client);
+    FontInstallRequest request;
+    if (protocol_decode_font_install_request(client, packet_data, packet_size, &request) != AGI_SUCCESS) {
+        agi_log_error("Malformed font install request");
+        return;
+    }
+    const SimulatorOptions *options = &agent->simulation->options;
+    schedule_reply(agent, (PendingReply){.batch = false}, request.install ? options->install_ms : options->uninstall_ms);
+}
+
+static void handle_batch_request(TcpClient *client, const void *packet_data, size_t packet_size) {
+    VirtualAgent *agent = agent_of(client);
+    FontBatchRequest batch;
+    if (protocol_decode_font_batch_request(client, packet_data, packet_size, &batch) != AGI_SUCCESS) {
+        agi_log_error("Malformed font batch request");
+        return;
+    }
+    // Entries run one after another, as on a single worker
+    const SimulatorOptions *options = &agent->simulation->options;
+    u64 delay_ms = 0;
+    u32 count = batch.count;
+    FontInstallRequest entry;
+    while (protocol_next_font_batch_entry(&batch, &entry)) {
+        delay_ms += entry.install ? options->install_ms : options->uninstall_ms;
+    }
+    schedule_reply(agent, (PendingReply){.batch = true, .job_id = batch.job_id, .count = count}, delay_ms);
+}
+
+static void handle_disconnect(TcpClient *client, agi_result_t reason) {
+    VirtualAgent *agent = agent_of(client);
+    agent->connected = false;
+    agent->simulation->disconnects++;
+    check_finished(agent->simulation);
+}
+
+static void connect_agent(Simulation *simulation, u32 index) {
+    VirtualAgent *agent = &simulation->agents[index];
+    agent->simulation = simulation;
+    snprintf(agent->username, sizeof(agent->username), "sim-agent-%05u", index);
+    // Same shape as a real HWID hash: 8 hex digits
+    u32 hash = 0x811C9DC5u;
+    for (const char *c = agent->username; *c; c++) hash = (hash ^ (u8)*c) * 0x01000193u;
+    snprintf(agent->hwid, sizeof(agent->hwid), "%08x", hash);
+
+    AppDescriptor *descriptor = &agent->descriptor;
+    memcpy(descriptor->hostname, simulation->options.host, sizeof(descriptor->hostname));
+    descriptor->port = simulation->options.port;
+    descriptor->auth_handler = handle_auth_response;
+    descriptor->font_install_handler = handle_install_request;
+    descriptor->font_batch_handler = handle_batch_request;
+    descriptor->loop = simulation->loop;
+    descriptor->simulated = true;
+    descriptor->username = agent->username;
+    descriptor->hwid = agent->hwid;
+    descriptor->disconnect_handler = handle_disconnect;
+    descriptor->userdata = agent;
+
+    u64 started = agi_clock_now_ns();
+    agent->app = app_create(descriptor);
+    if (!agent->app || app_connect(agent->app) != AGI_SUCCESS || app_attach(agent->app) != AGI_SUCCESS) {
+        simulation->connect_failures++;
+        return;
+    }
+    agent->auth_sent_ns = agi_clock_now_ns();
+    agent->connected = true;
+    simulation->connect_us[simulation->connected++] = (agent->auth_sent_ns - started) / 1000;
+}
+
+static void connect_tick(EventLoop *loop, u32 timer_id, void *userdata) {
+    Simulation *simulation = userdata;
+    u32 agents = simulation->options.agents;
+    u64 target = simulation->next_agent + CONNECT_BURST;
+    if (simulation->options.connect_rate) {
+        u64 elapsed_ns = agi_clock_now_ns() - simulation->started_ns;
+        target = (u64)simulation->options.connect_rate * elapsed_ns / 1000000000ull + 1;
+    }
+    while (simulation->next_agent < agents && simulation->next_agent < target) {
+        connect_agent(simulation, simulation->next_agent++);
+    }
+
+    if (simulation->next_agent == agents) {
+        simulation->connects_done_ns = agi_clock_now_ns();
+        simulation->heap_connected = heap_in_use();
+        event_loop_cancel_timer(loop, timer_id);
+        check_finished(simulation);
+    }
+}
+
+static void duration_elapsed(EventLoop *loop, u32 timer_id, void *userdata) {
+    event_loop_stop(loop);
+}
+
+// --- mock portal ---
+
+static void portal_session(MockPeer *peer, void *userdata) {
+    // Options only: they don't change once the portal has started
+    const SimulatorOptions *options = userdata;
+    AuthRequestPacket request;
+    if (mock_peer_handshake(peer, &request) != AGI_SUCCESS) return;
+    u16 type;
+
+    // Installs and uninstalls in turn, each waiting for its answer
+    for (u32 i = 0; i < options->commands; i++) {
+        char hash[65];
+        char name[32];
+        snprintf(hash, sizeof(hash), "%.8s%056x", request.hwid, i / 2);
+        snprintf(name, sizeof(name), "SimFont%u", i / 2);
+        u8 buffer[256];
+        WireWriter writer = wire_writer(buffer, sizeof(buffer));
+        wire_write_cstring(&writer, hash);
+        wire_write_cstring(&writer, name);
+        wire_write_cstring(&writer, "Regular");
+        wire_write_cstring(&writer, ".ttf");
+        wire_write_u8(&writer, i % 2 == 0);
+        if (mock_peer_send_frame(peer, AGI_PACKET_FONT_INSTALL_REQUEST, buffer, writer.length) != AGI_SUCCESS) return;
+
+        const u8 *payload;
+        size_t size;
+        do {
+            if (mock_peer_recv_frame(peer, &type, &payload, &size) != AGI_SUCCESS) return;
+        } while (type != AGI_PACKET_FONT_INSTALL_RESPONSE);
+    }
+
+    // Held open until the agent hangs up
+    const u8 *payload;
+    size_t size;
+    while (mock_peer_recv_frame(peer, &type, &payload, &size) == AGI_SUCCESS) {
+    }
+}
+
+// --- report ---
+
+static void write_report(FILE *file, Simulation *simulation) {
+    const SimulatorOptions *options = &simulation->options;
+    f64 connect_seconds = simulation->connects_done_ns ? (f64)(simulation->connects_done_ns - simulation->started_ns) / 1e9 : 0;
+    f64 command_seconds = simulation->last_reply_ns > simulation->first_command_ns
+                              ? (f64)(simulation->last_reply_ns - simulation->first_command_ns) / 1e9
+                              : 0;
+    u64 heap_per_agent = simulation->connected && simulation->heap_connected > simulation->heap_before
+                             ? (simulation->heap_connected - simulation->heap_before) / simulation->connected
+                             : 0;
+    u64 rss_kb;
+    u64 peak_kb;
+    fixture_read_rss(&rss_kb, &peak_kb);
+
+    fprintf(file, "{\n  \"schema\": \"%s\",\n  \"timestamp\": %llu,\n", SIMULATOR_SCHEMA, (unsigned long long)time(NULL));
+    if (simulation->mock) {
+        fprintf(file, "  \"target\": \"mock\",\n");
+    } else {
+        fprintf(file, "  \"target\": \"%s:%u\",\n", options->host, options->port);
+    }
+    fprintf(file,
+            "  \"agents\": %u,\n  \"behavior\": {\"install_ms\": %u, \"uninstall_ms\": %u, \"fail_percent\": %u},\n",
+            options->agents, options->install_ms, options->uninstall_ms, options->fail_percent);
+    fprintf(file,
+            "  \"connect\": {\"connected\": %u, \"failed\": %u, \"seconds\": %.6f, \"per_sec\": %.1f, \"p50_us\": %llu, "
+            "\"p99_us\": %llu},\n",
+            simulation->connected, simulation->connect_failures, connect_seconds,
+            connect_seconds > 0 ? simulation->connected / connect_seconds : 0,
+            (unsigned long long)fixture_percentile(simulation->connect_us, simulation->connected, 0.50),
+            (unsigned long long)fixture_percentile(simulation->connect_us, simulation->connected, 0.99));
+    fprintf(file, "  \"auth\": {\"authenticated\": %u, \"failed\": %u, \"p50_us\": %llu, \"p99_us\": %llu},\n",
+            simulation->authenticated, simulation->auth_failures,
+            (unsigned long long)fixture_percentile(simulation->auth_us, simulation->authenticated, 0.50),
+            (unsigned long long)fixture_percentile(simulation->auth_us, simulation->authenticated, 0.99));
+    fprintf(file,
+            "  \"commands\": {\"received\": %llu, \"replied\": %llu, \"failed\": %llu, \"seconds\": %.6f, \"per_sec\": %.1f},\n",
+            (unsigned long long)simulation->commands, (unsigned long long)simulation->replies,
+            (unsigned long long)simulation->failed_replies, command_seconds,
+            command_seconds > 0 ? simulation->replies / command_seconds : 0);
+    fprintf(file, "  \"disconnects\": %u,\n", simulation->disconnects);
+    fprintf(file, "  \"memory\": {\"heap_bytes_per_agent\": %llu, \"rss_kb\": %llu, \"peak_rss_kb\": %llu}\n}\n",
+            (unsigned long long)heap_per_agent, (unsigned long long)rss_kb, (unsigned long long)peak_kb);
+}
+
+// --- main ---
+
+static b8 parse_options(int argc, char **argv, SimulatorOptions *options) {
+    *options = (SimulatorOptions){
+        .agents = DEFAULT_AGENTS, .host = "127.0.0.1", .commands = DEFAULT_COMMANDS, .duration_s = DEFAULT_DURATION_S};
+    for (int i = 1; i < argc; i++) {
+        const char *name = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        u32 number = 0;
+        if (!value) return false;
+        i++;
+        if (strcmp(name, "--host") == 0 && strlen(value) < sizeof(options->host)) {
+            snprintf(options->host, sizeof(options->host), "%s", value);
+        } else if (strcmp(name, "--output") == 0) {
+            options->output = value;
+        } else if (!fixture_parse_u32(value, &number)) {
+            return false;
+        } else if (strcmp(name, "--agents") == 0 && number > 0) {
+            options->agents = number;
+        } else if (strcmp(name, "--port") == 0 && number > 0 && number <= UINT16_MAX) {
+            options->port = (u16)number;
+        } else if (strcmp(name, "--connect-rate") == 0) {
+            options->connect_rate = number;
+        } else if (strcmp(name, "--install-ms") == 0) {
+            options->install_ms = number;
+        } else if (strcmp(name, "--uninstall-ms") == 0) {
+            options->uninstall_ms = number;
+        } else if (strcmp(name, "--fail-percent") == 0 && number <= 100) {
+            options->fail_percent = number;
+        } else if (strcmp(name, "--commands") == 0) {
+            options->commands = number;
+        } else if (strcmp(name, "--duration") == 0 && number > 0) {
+            options->duration_s = number;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every agent holds a socket, and the mock portal one more per agent
+static void raise_file_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char **argv) {
+    Simulation simulation = {.random = 0x9E3779B97F4A7C15ull};
+    if (!parse_options(argc, argv, &simulation.options)) {
+        fprintf(stderr,
+                "usage: %s [--agents N] [--host H --port P] [--connect-rate R] [--install-ms MS] [--uninstall-ms MS]\n"
+                "          [--fail-percent P] [--commands N] [--duration S] [--output file]\n",
+                argv[0]);
+        return 2;
+    }
+    SimulatorOptions *options = &simulation.options;
+
+    signal(SIGPIPE, SIG_IGN);
+    raise_file_limit();
+    agi_log_set_level(AGI_LOG_LEVEL_ERROR);
+    FILE *file = options->output ? fopen(options->output, "w") : stdout;
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", options->output);
+        return 1;
+    }
+
+    MockPortal *portal = NULL;
+    if (!options->port) {
+        portal = mock_portal_start(portal_session, options);
+        if (!portal) return 1;
+        snprintf(options->host, sizeof(options->host), "127.0.0.1");
+        options->port = mock_portal_port(portal);
+        simulation.mock = true;
+        simulation.expected_replies = (u64)options->agents * options->commands;
+    } else {
+        // A real portal decides what to send
+        options->commands = 0;
+    }
+
+    simulation.loop = event_loop_create();
+    simulation.agents = calloc(options->agents, sizeof(VirtualAgent));
+    simulation.connect_us = calloc(options->agents, sizeof(u64));
+    simulation.auth_us = calloc(options->agents, sizeof(u64));
+    if (!simulation.loop || !simulation.agents || !simulation.connect_us || !simulation.auth_us) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    simulation.heap_before = heap_in_use();
+    simulation.started_ns = agi_clock_now_ns();
+    event_loop_add_timer(simulation.loop, 0, CONNECT_TICK_MS, connect_tick, &simulation);
+    event_loop_add_timer(simulation.loop, (u64)options->duration_s * 1000, 0, duration_elapsed, &simulation);
+    event_loop_run(simulation.loop);
+
+    write_report(file, &simulation);
+    if (file != stdout) fclose(file);
+
+    for (u32 i = 0; i < simulation.next_agent; i++) {
+        VirtualAgent *agent = &simulation.agents[i];
+        while (agent->pending) {
+            PendingReply *reply = agent->pending;
+            agent->pending = reply->next;
+            event_loop_cancel_timer(simulation.loop, reply->timer);
+            free(reply);
+        }
+        if (agent->app) app_destroy(agent->app);
+    }
+    mock_portal_stop(portal);
+    event_loop_destroy(simulation.loop);
+    free(simulation.agents);
+    free(simulation.connect_us);
+    free(simulation.auth_us);
+    return 0;
+}
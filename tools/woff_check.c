@@ -0,0 +1,727 @@
+/**
+ * Created by James Raynor on 10/17/26.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "agi/log.h"
+#include "agi/woff.h"
+
+// Checks woff_unpack_file() against fonts with a known answer: a small TrueType
+// font is built in memory, packed as WOFF and as WOFF2 (glyf/loca and hmtx
+// transformed), unpacked through the library, and the result must match the
+// original sfnt byte for byte. Exits non-zero on any mismatch:
+//
+//   woff_check
+//
+// The glyphs cover every triplet encoding in both signs, explicit and computed
+// bounding boxes, the overlap bit, instructions and composites. The packages are
+// written here independently of woff.c; WOFF2 uses uncompressed Brotli
+// meta-blocks, so no encoder is needed. The damaged packages at the end must be
+// rejected, and log an error each when they are.
+
+#define TAG(a, b, c, d) (((u32)(a) << 24) | ((u32)(b) << 16) | ((u32)(c) << 8) | (u32)(d))
+#define CHECK_PATH_SIZE 1024
+#define CHECK_TABLES 8
+#define CHECK_GLYPHS 5
+#define CHECK_METRICS 3  // glyphs after these only store a left side bearing
+#define CHECK_MAX_POINTS 16
+
+// --- growing big-endian buffer ---
+
+typedef struct {
+    u8 *data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+static void put_bytes(Buffer *buffer, const void *data, size_t count) {
+    if (buffer->capacity - buffer->length < count) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 256;
+        while (capacity - buffer->length < count) capacity *= 2;
+        u8 *grown = realloc(buffer->data, capacity);
+        if (!grown) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    if (count) memcpy(buffer->data + buffer->length, data, count);
+    buffer->length += count;
+}
+
+static void put_u8(Buffer *buffer, u8 value) {
+    put_bytes(buffer, &value, 1);
+}
+
+static void put_u16(Buffer *buffer, u16 value) {
+    u8 bytes[2] = {(u8)(value >> 8), (u8)value};
+    put_bytes(buffer, bytes, 2);
+}
+
+static void put_u32(Buffer *buffer, u32 value) {
+    u8 bytes[4] = {(u8)(value >> 24), (u8)(value >> 16), (u8)(value >> 8), (u8)value};
+    put_bytes(buffer, bytes, 4);
+}
+
+static void set_u32(Buffer *buffer, size_t offset, u32 value) {
+    buffer->data[offset] = (u8)(value >> 24);
+    buffer->data[offset + 1] = (u8)(value >> 16);
+    buffer->data[offset + 2] = (u8)(value >> 8);
+    buffer->data[offset + 3] = (u8)value;
+}
+
+static void pad4(Buffer *buffer) {
+    while (buffer->length % 4) put_u8(buffer, 0);
+}
+
+static u32 get_u32(const u8 *data) {
+    return ((u32)data[0] << 24) | ((u32)data[1] << 16) | ((u32)data[2] << 8) | data[3];
+}
+
+static u32 checksum(const u8 *data, size_t length) {
+    u32 sum = 0;
+    for (size_t i = 0; i < length; i += 4) {
+        u8 word[4] = {0};
+        memcpy(word, data + i, length - i < 4 ? length - i : 4);
+        sum += get_u32(word);
+    }
+    return sum;
+}
+
+// --- the font ---
+
+typedef struct {
+    s32 x;
+    s32 y;
+    b8 on_curve;
+} Point;
+
+typedef struct {
+    s16 contours;  // -1 for a composite
+    u16 end_points[2];
+    Point points[CHECK_MAX_POINTS];
+    u16 point_count;
+    b8 explicit_box;  // else the box is computed from the points, as WOFF2 does
+    s16 box[4];
+    b8 overlap;
+    const u8 *components;  // composites only
+    u16 component_size;
+    const u8 *instructions;
+    u16 instruction_length;
+} Glyph;
+
+static const u8 simple_instructions[] = {0xB0, 0x01};
+static const u8 composite_instructions[] = {0xB0, 0x00};
+// Glyph 1 at (1000, -20) in word arguments, then glyph 2 at (5, 6) scaled by 1.0,
+// with instructions for the composite
+static const u8 components[] = {
+    0x00, 0x23, 0x00, 0x01, 0x03, 0xE8, 0xFF, 0xEC,
+    0x01, 0x0A, 0x00, 0x02, 0x05, 0x06, 0x40, 0x00,
+};
+
+// Relative moves picked to hit each triplet class: x only, y only, both under 65,
+// under 769, under 4096, and the four byte form
+static Glyph glyphs[CHECK_GLYPHS] = {
+    {.contours = 0},
+    {
+        .contours = 2,
+        .end_points = {3, 6},
+        .points = {{0, 700, 1}, {-300, 700, 1}, {-280, 667, 0}, {220, 1267, 0},
+                   {-2780, 1367, 1}, {2220, -3133, 1}, {2220, -3133, 0}},
+        .point_count = 7,
+        .instructions = simple_instructions,
+        .instruction_length = sizeof(simple_instructions),
+    },
+    {
+        .contours = 1,
+        .end_points = {4},
+        .points = {{10, 0, 1}, {20, 0, 1}, {30, 0, 1}, {40, 0, 1}, {40, 50, 1}},
+        .point_count = 5,
+        .explicit_box = true,
+        .box = {-10, -10, 60, 60},
+        .overlap = true,
+    },
+    {
+        .contours = -1,
+        .explicit_box = true,
+        .box = {-1780, -3153, 3220, 1347},
+        .components = components,
+        .component_size = sizeof(components),
+        .instructions = composite_instructions,
+        .instruction_length = sizeof(composite_instructions),
+    },
+    {.contours = 0},
+};
+
+static const u16 advances[CHECK_METRICS] = {500, 1200, 600};
+static const s16 monospace_lsbs[CHECK_GLYPHS - CHECK_METRICS] = {-1780, 0};
+
+static void glyph_box(Glyph *glyph) {
+    if (glyph->explicit_box || glyph->point_count == 0) return;
+    s32 box[4] = {glyph->points[0].x, glyph->points[0].y, glyph->points[0].x, glyph->points[0].y};
+    for (u16 i = 1; i < glyph->point_count; i++) {
+        const Point *point = &glyph->points[i];
+        if (point->x < box[0]) box[0] = point->x;
+        if (point->y < box[1]) box[1] = point->y;
+        if (point->x > box[2]) box[2] = point->x;
+        if (point->y > box[3]) box[3] = point->y;
+    }
+    for (int i = 0; i < 4; i++) glyph->box[i] = (s16)box[i];
+}
+
+// Plain glyf encoding, packed the way every font compiler packs it
+static void encode_glyph(Buffer *glyf, const Glyph *glyph) {
+    if (glyph->contours == 0) return;
+    put_u16(glyf, (u16)glyph->contours);
+    for (int i = 0; i < 4; i++) put_u16(glyf, (u16)glyph->box[i]);
+    if (glyph->contours < 0) {
+        put_bytes(glyf, glyph->components, glyph->component_size);
+        put_u16(glyf, glyph->instruction_length);
+        put_bytes(glyf, glyph->instructions, glyph->instruction_length);
+        pad4(glyf);
+        return;
+    }
+    for (s16 i = 0; i < glyph->contours; i++) put_u16(glyf, glyph->end_points[i]);
+    put_u16(glyf, glyph->instruction_length);
+    put_bytes(glyf, glyph->instructions, glyph->instruction_length);
+
+    u8 flags[CHECK_MAX_POINTS];
+    s32 last_x = 0;
+    s32 last_y = 0;
+    for (u16 i = 0; i < glyph->point_count; i++) {
+        s32 dx = glyph->points[i].x - last_x;
+        s32 dy = glyph->points[i].y - last_y;
+        u8 flag = glyph->points[i].on_curve ? 0x01 : 0;
+        if (i == 0 && glyph->overlap) flag |= 0x40;
+        if (dx == 0) {
+            flag |= 0x10;
+        } else if (abs(dx) < 256) {
+            flag |= 0x02 | (dx > 0 ? 0x10 : 0);
+        }
+        if (dy == 0) {
+            flag |= 0x20;
+        } else if (abs(dy) < 256) {
+            flag |= 0x04 | (dy > 0 ? 0x20 : 0);
+        }
+        flags[i] = flag;
+        last_x = glyph->points[i].x;
+        last_y = glyph->points[i].y;
+    }
+    for (u16 i = 0; i < glyph->point_count;) {
+        u16 run = 1;
+        while (i + run < glyph->point_count && flags[i + run] == flags[i] && run <= 255) run++;
+        if (run > 1) {
+            put_u8(glyf, flags[i] | 0x08);
+            put_u8(glyf, (u8)(run - 1));
+        } else {
+            put_u8(glyf, flags[i]);
+        }
+        i += run;
+    }
+    for (int axis = 0; axis < 2; axis++) {
+        s32 last = 0;
+        for (u16 i = 0; i < glyph->point_count; i++) {
+            s32 value = axis ? glyph->points[i].y : glyph->points[i].x;
+            s32 delta = value - last;
+            if (delta != 0 && abs(delta) < 256) {
+                put_u8(glyf, (u8)abs(delta));
+            } else if (delta != 0) {
+                put_u16(glyf, (u16)(s16)delta);
+            }
+            last = value;
+        }
+    }
+    pad4(glyf);
+}
+
+typedef struct {
+    u32 tag;
+    Buffer data;
+} Table;
+
+typedef struct {
+    Table tables[CHECK_TABLES];  // sorted by tag
+    u16 count;
+    Buffer sfnt;
+} Font;
+
+static Buffer *add_table(Font *font, u32 tag) {
+    Table *table = &font->tables[font->count++];
+    table->tag = tag;
+    return &table->data;
+}
+
+static Table *font_table(Font *font, u32 tag) {
+    for (u16 i = 0; i < font->count; i++) {
+        if (font->tables[i].tag == tag) return &font->tables[i];
+    }
+    return NULL;
+}
+
+static void build_font(Font *font) {
+    for (int i = 0; i < CHECK_GLYPHS; i++) glyph_box(&glyphs[i]);
+
+    // Added in tag order, which is also the order write_sfnt() uses
+    Buffer *dsig = add_table(font, TAG('D', 'S', 'I', 'G'));
+    put_u32(dsig, 1);
+    put_u32(dsig, 0);
+
+    Buffer *glyf = add_table(font, TAG('g', 'l', 'y', 'f'));
+    u16 offsets[CHECK_GLYPHS + 1];
+    for (int i = 0; i < CHECK_GLYPHS; i++) {
+        offsets[i] = (u16)(glyf->length / 2);
+        encode_glyph(glyf, &glyphs[i]);
+    }
+    offsets[CHECK_GLYPHS] = (u16)(glyf->length / 2);
+
+    Buffer *head = add_table(font, TAG('h', 'e', 'a', 'd'));
+    put_u32(head, 0x00010000);
+    put_u32(head, 0x00010000);  // fontRevision
+    put_u32(head, 0);           // checkSumAdjustment
+    put_u32(head, 0x5F0F3CF5);
+    put_u16(head, 0x000B);  // flags
+    put_u16(head, 1000);    // unitsPerEm
+    for (int i = 0; i < 4; i++) put_u32(head, 0);  // created, modified
+    put_u16(head, (u16)-2780);
+    put_u16(head, (u16)-3153);
+    put_u16(head, 3220);
+    put_u16(head, 1367);
+    put_u16(head, 0);  // macStyle
+    put_u16(head, 8);  // lowestRecPPEM
+    put_u16(head, 2);  // fontDirectionHint
+    put_u16(head, 0);  // indexToLocFormat: short
+    put_u16(head, 0);  // glyphDataFormat
+
+    Buffer *hhea = add_table(font, TAG('h', 'h', 'e', 'a'));
+    put_u32(hhea, 0x00010000);
+    put_u16(hhea, 800);  // ascender
+    put_u16(hhea, (u16)-200);
+    put_u16(hhea, 0);
+    put_u16(hhea, 1200);  // advanceWidthMax
+    for (int i = 0; i < 3; i++) put_u16(hhea, 0);
+    put_u16(hhea, 1);  // caretSlopeRise
+    for (int i = 0; i < 7; i++) put_u16(hhea, 0);
+    put_u16(hhea, CHECK_METRICS);
+
+    Buffer *hmtx = add_table(font, TAG('h', 'm', 't', 'x'));
+    for (int i = 0; i < CHECK_METRICS; i++) {
+        put_u16(hmtx, advances[i]);
+        put_u16(hmtx, (u16)(glyphs[i].contours ? glyphs[i].box[0] : 0));
+    }
+    for (int i = CHECK_METRICS; i < CHECK_GLYPHS; i++) put_u16(hmtx, (u16)monospace_lsbs[i - CHECK_METRICS]);
+
+    Buffer *loca = add_table(font, TAG('l', 'o', 'c', 'a'));
+    for (int i = 0; i <= CHECK_GLYPHS; i++) put_u16(loca, offsets[i]);
+
+    Buffer *maxp = add_table(font, TAG('m', 'a', 'x', 'p'));
+    put_u32(maxp, 0x00005000);
+    put_u16(maxp, CHECK_GLYPHS);
+
+    Buffer *post = add_table(font, TAG('p', 'o', 's', 't'));
+    put_u32(post, 0x00030000);
+    for (int i = 0; i < 7; i++) put_u32(post, 0);
+
+    u16 power = 1;
+    u16 selector = 0;
+    while (power * 2 <= font->count) {
+        power *= 2;
+        selector++;
+    }
+    Buffer *sfnt = &font->sfnt;
+    put_u32(sfnt, 0x00010000);
+    put_u16(sfnt, font->count);
+    put_u16(sfnt, (u16)(power * 16));
+    put_u16(sfnt, selector);
+    put_u16(sfnt, (u16)(font->count * 16 - power * 16));
+    for (u16 i = 0; i < font->count; i++) {
+        for (int j = 0; j < 4; j++) put_u32(sfnt, 0);
+    }
+    size_t head_offset = 0;
+    for (u16 i = 0; i < font->count; i++) {
+        Table *table = &font->tables[i];
+        size_t record = 12 + (size_t)i * 16;
+        if (table->tag == TAG('h', 'e', 'a', 'd')) head_offset = sfnt->length;
+        set_u32(sfnt, record, table->tag);
+        set_u32(sfnt, record + 4, checksum(table->data.data, table->data.length));
+        set_u32(sfnt, record + 8, (u32)sfnt->length);
+        set_u32(sfnt, record + 12, (u32)table->data.length);
+        put_bytes(sfnt, table->data.data, table->data.length);
+        pad4(sfnt);
+    }
+    u32 adjustment = 0xB1B0AFBAu - checksum(sfnt->data, sfnt->length);
+    set_u32(sfnt, head_offset + 8, adjustment);
+    set_u32(&font_table(font, TAG('h', 'e', 'a', 'd'))->data, 8, adjustment);
+}
+
+// --- WOFF ---
+
+static void pack_woff(Font *font, Buffer *out) {
+    put_u32(out, TAG('w', 'O', 'F', 'F'));
+    put_u32(out, 0x00010000);
+    put_u32(out, 0);  // length, set below
+    put_u16(out, font->count);
+    put_u16(out, 0);
+    put_u32(out, (u32)font->sfnt.length);
+    put_u16(out, 1);
+    put_u16(out, 0);
+    for (int i = 0; i < 5; i++) put_u32(out, 0);  // no metadata or private data
+
+    size_t directory = out->length;
+    for (u16 i = 0; i < font->count; i++) {
+        for (int j = 0; j < 5; j++) put_u32(out, 0);
+    }
+    for (u16 i = 0; i < font->count; i++) {
+        const Buffer *table = &font->tables[i].data;
+        uLongf compressed_size = compressBound(table->length);
+        u8 *compressed = malloc(compressed_size);
+        if (!compressed || compress2(compressed, &compressed_size, table->data, table->length, 9) != Z_OK) {
+            fprintf(stderr, "zlib failed\n");
+            exit(1);
+        }
+        // Tables that don't shrink are stored as they are, which unpack_woff() must also take
+        b8 stored = compressed_size >= table->length;
+        size_t entry = directory + (size_t)i * 20;
+        set_u32(out, entry, font->tables[i].tag);
+        set_u32(out, entry + 4, (u32)out->length);
+        set_u32(out, entry + 8, stored ? (u32)table->length : (u32)compressed_size);
+        set_u32(out, entry + 12, (u32)table->length);
+        set_u32(out, entry + 16, checksum(table->data, table->length));
+        put_bytes(out, stored ? table->data : compressed, stored ? table->length : compressed_size);
+        pad4(out);
+        free(compressed);
+    }
+    set_u32(out, 8, (u32)out->length);
+}
+
+// --- WOFF2 ---
+
+static void put_base128(Buffer *buffer, u32 value) {
+    u8 bytes[5];
+    int count = 0;
+    do {
+        bytes[count++] = value & 0x7F;
+        value >>= 7;
+    } while (value);
+    for (int i = count - 1; i >= 0; i--) put_u8(buffer, (u8)(bytes[i] | (i ? 0x80 : 0)));
+}
+
+static void put_255u16(Buffer *buffer, u16 value) {
+    if (value < 253) {
+        put_u8(buffer, (u8)value);
+    } else if (value < 506) {
+        put_u8(buffer, 255);
+        put_u8(buffer, (u8)(value - 253));
+    } else if (value < 762) {
+        put_u8(buffer, 254);
+        put_u8(buffer, (u8)(value - 506));
+    } else {
+        put_u8(buffer, 253);
+        put_u16(buffer, value);
+    }
+}
+
+// WOFF2 section 5.2, written straight from the table of encodings
+static void put_triplet(Buffer *flags, Buffer *stream, s32 dx, s32 dy, b8 on_curve) {
+    u32 x = (u32)abs(dx);
+    u32 y = (u32)abs(dy);
+    u32 flag = on_curve ? 0 : 128;
+    u32 x_sign = dx < 0 ? 0 : 1;
+    u32 y_sign = dy < 0 ? 0 : 2;
+    if (dx == 0 && y < 1280) {
+        put_u8(flags, (u8)(flag + ((y & 0xF00) >> 7) + (y_sign >> 1)));
+        put_u8(stream, (u8)y);
+    } else if (dy == 0 && x < 1280) {
+        put_u8(flags, (u8)(flag + 10 + ((x & 0xF00) >> 7) + x_sign));
+        put_u8(stream, (u8)x);
+    } else if (x < 65 && y < 65) {
+        put_u8(flags, (u8)(flag + 20 + ((x - 1) & 0x30) + (((y - 1) & 0x30) >> 2) + x_sign + y_sign));
+        put_u8(stream, (u8)((((x - 1) & 0x0F) << 4) | ((y - 1) & 0x0F)));
+    } else if (x < 769 && y < 769) {
+        put_u8(flags, (u8)(flag + 84 + 12 * (((x - 1) & 0x300) >> 8) + (((y - 1) & 0x300) >> 6) + x_sign + y_sign));
+        put_u8(stream, (u8)(x - 1));
+        put_u8(stream, (u8)(y - 1));
+    } else if (x < 4096 && y < 4096) {
+        put_u8(flags, (u8)(flag + 120 + x_sign + y_sign));
+        put_u8(stream, (u8)(x >> 4));
+        put_u8(stream, (u8)(((x & 0x0F) << 4) | (y >> 8)));
+        put_u8(stream, (u8)y);
+    } else {
+        put_u8(flags, (u8)(flag + 124 + x_sign + y_sign));
+        put_u16(stream, (u16)x);
+        put_u16(stream, (u16)y);
+    }
+}
+
+// WOFF2 section 5.1; glyph_count may overstate the glyphs to damage the table
+static void transform_glyf(Buffer *out, u16 glyph_count) {
+    Buffer streams[7] = {0};  // contours, points, flags, glyphs, composites, boxes, instructions
+    u8 box_bitmap[4 * ((CHECK_GLYPHS + 31) / 32)] = {0};
+    u8 overlap_bitmap[sizeof(box_bitmap)] = {0};
+    Buffer boxes = {0};
+    for (int i = 0; i < CHECK_GLYPHS; i++) {
+        const Glyph *glyph = &glyphs[i];
+        put_u16(&streams[0], (u16)glyph->contours);
+        if (glyph->explicit_box) {
+            box_bitmap[i >> 3] |= 0x80 >> (i & 7);
+            for (int b = 0; b < 4; b++) put_u16(&boxes, (u16)glyph->box[b]);
+        }
+        if (glyph->overlap) overlap_bitmap[i >> 3] |= 0x80 >> (i & 7);
+        if (glyph->contours < 0) {
+            put_bytes(&streams[4], glyph->components, glyph->component_size);
+            put_255u16(&streams[3], glyph->instruction_length);
+            put_bytes(&streams[6], glyph->instructions, glyph->instruction_length);
+        } else if (glyph->contours > 0) {
+            u16 start = 0;
+            for (s16 c = 0; c < glyph->contours; c++) {
+                put_255u16(&streams[1], (u16)(glyph->end_points[c] + 1 - start));
+                start = (u16)(glyph->end_points[c] + 1);
+            }
+            s32 last_x = 0;
+            s32 last_y = 0;
+            for (u16 p = 0; p < glyph->point_count; p++) {
+                const Point *point = &glyph->points[p];
+                put_triplet(&streams[2], &streams[3], point->x - last_x, point->y - last_y, point->on_curve);
+                last_x = point->x;
+                last_y = point->y;
+            }
+            put_255u16(&streams[3], glyph->instruction_length);
+            put_bytes(&streams[6], glyph->instructions, glyph->instruction_length);
+        }
+    }
+    put_bytes(&streams[5], box_bitmap, sizeof(box_bitmap));
+    put_bytes(&streams[5], boxes.data, boxes.length);
+
+    put_u16(out, 0);
+    put_u16(out, 1);  // optionFlags: overlap bitmap follows
+    put_u16(out, glyph_count);
+    put_u16(out, 0);  // short loca
+    for (int i = 0; i < 7; i++) put_u32(out, (u32)streams[i].length);
+    for (int i = 0; i < 7; i++) {
+        put_bytes(out, streams[i].data, streams[i].length);
+        free(streams[i].data);
+    }
+    put_bytes(out, overlap_bitmap, sizeof(overlap_bitmap));
+    free(boxes.data);
+}
+
+// Section 5.4 with flag 1: the proportional left side bearings are the glyph xMins
+static void transform_hmtx(Buffer *out) {
+    put_u8(out, 1);
+    for (int i = 0; i < CHECK_METRICS; i++) put_u16(out, advances[i]);
+    for (int i = CHECK_METRICS; i < CHECK_GLYPHS; i++) put_u16(out, (u16)monospace_lsbs[i - CHECK_METRICS]);
+}
+
+typedef struct {
+    u32 bits;
+    int bit_count;
+} BitWriter;
+
+static void put_bits(Buffer *out, BitWriter *writer, u32 value, int count) {
+    writer->bits |= value << writer->bit_count;
+    writer->bit_count += count;
+    while (writer->bit_count >= 8) {
+        put_u8(out, (u8)writer->bits);
+        writer->bits >>= 8;
+        writer->bit_count -= 8;
+    }
+}
+
+static void flush_bits(Buffer *out, BitWriter *writer) {
+    if (writer->bit_count) put_bits(out, writer, 0, 8 - writer->bit_count);
+}
+
+// A valid Brotli stream (RFC 7932) that only holds uncompressed meta-blocks
+static void brotli_store(Buffer *out, const u8 *data, size_t length) {
+    BitWriter writer = {0};
+    put_bits(out, &writer, 0, 1);  // WBITS: 16
+    for (size_t offset = 0; offset < length; offset += 65536) {
+        size_t block = length - offset < 65536 ? length - offset : 65536;
+        put_bits(out, &writer, 0, 1);  // ISLAST
+        put_bits(out, &writer, 0, 2);  // MNIBBLES: 4
+        put_bits(out, &writer, (u32)(block - 1), 16);
+        put_bits(out, &writer, 1, 1);  // ISUNCOMPRESSED
+        flush_bits(out, &writer);
+        put_bytes(out, data + offset, block);
+    }
+    put_bits(out, &writer, 1, 1);  // ISLAST
+    put_bits(out, &writer, 1, 1);  // ISLASTEMPTY
+    flush_bits(out, &writer);
+}
+
+static int known_tag(u32 tag) {
+    switch (tag) {
+        case TAG('h', 'e', 'a', 'd'): return 1;
+        case TAG('h', 'h', 'e', 'a'): return 2;
+        case TAG('h', 'm', 't', 'x'): return 3;
+        case TAG('m', 'a', 'x', 'p'): return 4;
+        case TAG('p', 'o', 's', 't'): return 7;
+        case TAG('g', 'l', 'y', 'f'): return 10;
+        case TAG('l', 'o', 'c', 'a'): return 11;
+        default: return 0x3F;
+    }
+}
+
+static void pack_woff2(Font *font, Buffer *out, u16 glyph_count) {
+    // glyf must come right before loca; the rest can be in any order
+    static const u32 order[CHECK_TABLES] = {
+        TAG('h', 'e', 'a', 'd'), TAG('h', 'h', 'e', 'a'), TAG('m', 'a', 'x', 'p'), TAG('h', 'm', 't', 'x'),
+        TAG('g', 'l', 'y', 'f'), TAG('l', 'o', 'c', 'a'), TAG('p', 'o', 's', 't'), TAG('D', 'S', 'I', 'G'),
+    };
+    Buffer directory = {0};
+    Buffer stream = {0};
+    for (int i = 0; i < CHECK_TABLES; i++) {
+        const Table *table = font_table(font, order[i]);
+        int index = known_tag(table->tag);
+        b8 glyf_or_loca = table->tag == TAG('g', 'l', 'y', 'f') || table->tag == TAG('l', 'o', 'c', 'a');
+        b8 transformed = glyf_or_loca || table->tag == TAG('h', 'm', 't', 'x');
+        // glyf and loca transform with version 0, hmtx with 1
+        put_u8(&directory, (u8)(index | (transformed && !glyf_or_loca ? 0x40 : 0)));
+        if (index == 0x3F) put_u32(&directory, table->tag);
+        put_base128(&directory, (u32)table->data.length);
+
+        size_t start = stream.length;
+        if (table->tag == TAG('g', 'l', 'y', 'f')) {
+            transform_glyf(&stream, glyph_count);
+        } else if (table->tag == TAG('h', 'm', 't', 'x')) {
+            transform_hmtx(&stream);
+        } else if (table->tag != TAG('l', 'o', 'c', 'a')) {
+            put_bytes(&stream, table->data.data, table->data.length);
+        }
+        if (transformed) put_base128(&directory, (u32)(stream.length - start));
+    }
+    Buffer compressed = {0};
+    brotli_store(&compressed, stream.data, stream.length);
+
+    put_u32(out, TAG('w', 'O', 'F', '2'));
+    put_u32(out, 0x00010000);
+    put_u32(out, 0);  // length, set below
+    put_u16(out, font->count);
+    put_u16(out, 0);
+    put_u32(out, (u32)font->sfnt.length);
+    put_u32(out, (u32)compressed.length);
+    put_u16(out, 1);
+    put_u16(out, 0);
+    for (int i = 0; i < 5; i++) put_u32(out, 0);
+    put_bytes(out, directory.data, directory.length);
+    put_bytes(out, compressed.data, compressed.length);
+    set_u32(out, 8, (u32)out->length);
+    free(directory.data);
+    free(stream.data);
+    free(compressed.data);
+}
+
+// --- checks ---
+
+static b8 write_file(const char *path, const u8 *data, size_t length) {
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+    b8 written = fwrite(data, 1, length, file) == length;
+    return fclose(file) == 0 && written;
+}
+
+static u8 *read_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    Buffer buffer = {0};
+    u8 chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) put_bytes(&buffer, chunk, read);
+    fclose(file);
+    *length = buffer.length;
+    return buffer.data;
+}
+
+// Names the first table of the output that differs from the original
+static void report_difference(const Font *font, const u8 *output, size_t length) {
+    for (u16 i = 0; i < font->count; i++) {
+        const u8 *record = font->sfnt.data + 12 + (size_t)i * 16;
+        u32 offset = get_u32(record + 8);
+        u32 size = get_u32(record + 12);
+        if (offset + size > length || memcmp(output + 12 + (size_t)i * 16, record, 16) != 0 ||
+            memcmp(output + offset, font->sfnt.data + offset, size) != 0) {
+            u32 tag = get_u32(record);
+            printf("    first difference in '%c%c%c%c'\n", tag >> 24, (tag >> 16) & 0xFF, (tag >> 8) & 0xFF, tag & 0xFF);
+            return;
+        }
+    }
+    printf("    output is %zu bytes, expected %zu\n", length, font->sfnt.length);
+}
+
+static b8 check_package(const char *name, const Font *font, const Buffer *package, const char *directory,
+                        b8 expect_success) {
+    char input[CHECK_PATH_SIZE];
+    char output[CHECK_PATH_SIZE];
+    snprintf(input, sizeof(input), "%s/%s.pkg", directory, name);
+    snprintf(output, sizeof(output), "%s/%s.ttf", directory, name);
+    if (!write_file(input, package->data, package->length)) {
+        printf("%s: FAIL, can't write %s\n", name, input);
+        return false;
+    }
+
+    b8 cff = true;
+    agi_result_t result = woff_unpack_file(input, output, &cff);
+    b8 passed;
+    if (!expect_success) {
+        passed = result == AGI_ERROR_INVALID_ARGUMENT;
+        printf("%s: %s (result %d)\n", name, passed ? "ok, rejected" : "FAIL, not rejected", result);
+    } else if (result != AGI_SUCCESS) {
+        passed = false;
+        printf("%s: FAIL, unpack returned %d\n", name, result);
+    } else {
+        size_t length = 0;
+        u8 *unpacked = read_file(output, &length);
+        passed = unpacked && !cff && length == font->sfnt.length && memcmp(unpacked, font->sfnt.data, length) == 0;
+        printf("%s: %s, %zu bytes, checksum %08x\n", name, passed ? "ok" : "FAIL", length,
+               unpacked ? checksum(unpacked, length) : 0);
+        if (!passed && unpacked) report_difference(font, unpacked, length);
+        free(unpacked);
+    }
+    remove(input);
+    remove(output);
+    return passed;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+    agi_log_set_level(AGI_LOG_LEVEL_ERROR);
+    char directory[] = "/tmp/agi-woff-check-XXXXXX";
+    if (!mkdtemp(directory)) {
+        fprintf(stderr, "Failed to create a temporary directory\n");
+        return 1;
+    }
+
+    Font font = {0};
+    build_font(&font);
+    Buffer woff = {0};
+    Buffer woff2 = {0};
+    Buffer overstated = {0};
+    pack_woff(&font, &woff);
+    pack_woff2(&font, &woff2, CHECK_GLYPHS);
+    pack_woff2(&font, &overstated, CHECK_GLYPHS + 1);
+    Buffer truncated = {0};
+    put_bytes(&truncated, woff2.data, woff2.length - 1);
+    set_u32(&truncated, 8, (u32)truncated.length);
+
+    b8 passed = check_package("woff", &font, &woff, directory, true);
+    passed = check_package("woff2", &font, &woff2, directory, true) && passed;
+    passed = check_package("woff2_truncated", &font, &truncated, directory, false) && passed;
+    passed = check_package("woff2_glyph_count", &font, &overstated, directory, false) && passed;
+
+    rmdir(directory);
+    for (u16 i = 0; i < font.count; i++) free(font.tables[i].data.data);
+    free(font.sfnt.data);
+    free(woff.data);
+    free(woff2.data);
+    free(overstated.data);
+    free(truncated.data);
+    return passed ? 0 : 1;
+}